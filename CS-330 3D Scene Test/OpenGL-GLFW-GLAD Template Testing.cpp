@@ -12,6 +12,21 @@ using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 #include "main.h"
 #include "events.h"
+#include "culling.h"
+#include "bvh.h"
+#include "clustered.h"
+#include "permutations.h"
+#include "prepass.h"
+#include "lightmaps.h"
+#include "resolution.h"
+#include "ssao.h"
+#include "environment.h"
+#include "reflections.h"
+#include "visibility.h"
+#include "textures.h"
+#include "cooker.h"
+
+#include <glm/gtc/matrix_transform.hpp>
 
 namespace OpenGLGLFWGLADTemplateTesting
 {
@@ -71,6 +86,448 @@ namespace OpenGLGLFWGLADTemplateTesting
 
 			glfwTerminate();
 		}
+
+		TEST_METHOD(CullingFrustumVisibility)
+		{
+			glm::mat4 projection = glm::perspective(glm::radians(45.f), 4.f / 3.f, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(glm::vec3(0.f, 0.f, 3.f), glm::vec3(0.f, 0.f, 2.f), glm::vec3(0.f, 1.f, 0.f));
+			culling::Frustum frustum = culling::extract_frustum(projection * view);
+
+			culling::BoundsSoA bounds;
+			bounds.resize(6);
+			bounds.set(0, glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.5f), 0.87f);		// In front of the camera
+			bounds.set(1, glm::vec3(0.f, 0.f, 10.f), glm::vec3(0.5f), 0.87f);		// Behind the camera
+			bounds.set(2, glm::vec3(-50.f, 0.f, 0.f), glm::vec3(0.5f), 0.87f);		// Far to the left
+			bounds.set(3, glm::vec3(0.f, 0.f, -200.f), glm::vec3(0.5f), 0.87f);	// Beyond the far plane
+			bounds.set(4, glm::vec3(-2.f, 0.f, 0.f), glm::vec3(0.5f), 0.87f);	// Straddling the left plane
+			bounds.set(5, glm::vec3(0.2f, 0.1f, -5.f), glm::vec3(0.5f), 0.87f);	// In front of the camera
+
+			std::vector<unsigned int> visible, visible_scalar;
+			culling::CullStats stats, stats_scalar;
+			culling::cull(frustum, bounds, visible, stats);
+			culling::cull_scalar(frustum, bounds, visible_scalar, stats_scalar);
+
+			Assert::AreEqual(3u, stats.visible, L"Unexpected number of visible objects");
+			Assert::AreEqual(3u, stats.culled, L"Unexpected number of culled objects");
+			Assert::AreEqual(0u, visible[0], L"Object in front of the camera was culled");
+			Assert::AreEqual(4u, visible[1], L"Object straddling a plane was culled");
+			Assert::AreEqual(5u, visible[2], L"Object in front of the camera was culled");
+			Assert::IsTrue(visible == visible_scalar, L"SIMD and scalar culling disagree");
+		}
+
+		TEST_METHOD(BVHQueries)
+		{
+			std::vector<bvh::AABB> boxes(4);
+			for (int i = 0; i < 4; ++i) {
+				boxes[i].min = glm::vec3(i * 3.f, 0.f, 0.f);		// Unit boxes in a row along X, 2 apart
+				boxes[i].max = glm::vec3(i * 3.f + 1.f, 1.f, 1.f);
+			}
+
+			bvh::Tree tree;
+			tree.build(boxes, 2);
+			Assert::AreEqual((size_t)4, tree.size(), L"Unexpected object count after build");
+
+			int hit = -1;
+			float distance = tree.pick(glm::vec3(-5.f, 0.5f, 0.5f), glm::vec3(1.f, 0.f, 0.f), 100.f, hit);
+			Assert::AreEqual(0, hit, L"Ray pick did not return the nearest box");
+			Assert::AreEqual(5.f, distance, 1e-4f, L"Unexpected ray pick distance");
+
+			tree.remove(0);
+			tree.pick(glm::vec3(-5.f, 0.5f, 0.5f), glm::vec3(1.f, 0.f, 0.f), 100.f, hit);
+			Assert::AreEqual(1, hit, L"Removed box was still picked");
+
+			std::vector<unsigned int> nearby;
+			tree.query_sphere(glm::vec3(7.5f, 0.5f, 0.5f), 1.f, nearby);
+			Assert::AreEqual((size_t)1, nearby.size(), L"Unexpected proximity query result count");
+			Assert::AreEqual(2u, nearby[0], L"Unexpected proximity query result");
+
+			tree.move(0, boxes[1]);										// Moving or refitting a removed object is a no-op
+			tree.set_bounds(0, boxes[1]);
+			Assert::AreEqual((size_t)3, tree.size(), L"Moving a removed box changed the object count");
+			Assert::AreEqual(bvh::NULL_NODE, tree.leaf_of(0), L"Moving a removed box re-inserted it");
+
+			tree.remove(0);												// Removing an object not in the tree, or never inserted, is a no-op
+			tree.remove(100);
+			Assert::AreEqual((size_t)3, tree.size(), L"Removing an unknown box changed the object count");
+
+			boxes[0].min = glm::vec3(6.f, 3.f, 0.f);
+			boxes[0].max = glm::vec3(7.f, 4.f, 1.f);
+			tree.insert(0, boxes[0]);
+			nearby.clear();
+			tree.query_sphere(glm::vec3(7.5f, 3.5f, 0.5f), 1.f, nearby);
+			Assert::AreEqual((size_t)1, nearby.size(), L"Unexpected proximity query result count after insert");
+			Assert::AreEqual(0u, nearby[0], L"Re-inserted box not found by proximity query");
+
+			int leaf = tree.leaf_of(0);
+			tree.insert(0, boxes[1]);									// Inserting an object already in the tree is a no-op
+			Assert::AreEqual((size_t)4, tree.size(), L"Inserting a box twice changed the object count");
+			Assert::AreEqual(leaf, tree.leaf_of(0), L"Inserting a box twice replaced its leaf");
+		}
+
+		TEST_METHOD(ClusteredLightAssignment)
+		{
+			clustered::ClusterGrid grid;								// 16x9 tiles, 24 slices
+			glm::mat4 projection = glm::perspective(glm::radians(45.f), 16.f / 9.f, 0.1f, 100.f);
+			glm::mat4 view = glm::mat4(1.f);
+
+			std::vector<RadiantLight> lights(2);
+			lights[0].position = glm::vec3(0.f, 0.f, -5.f);			// In front of the camera, on the view axis
+			lights[0].radius = 0.5f;
+			lights[1].position = glm::vec3(0.f, 0.f, 5.f);				// Behind the camera
+			lights[1].radius = 0.5f;
+
+			grid.assign(lights, view, projection);
+			Assert::AreEqual(1u, grid.stats().lights, L"Light behind the camera was assigned");
+
+			int center = grid.cluster_index(8, 4, 13);					// Depth 5 falls in slice 13
+			Assert::AreEqual(1u, grid.counts()[center], L"Light missing from the cluster containing it");
+			Assert::AreEqual(0u, grid.indices()[grid.offsets()[center]], L"Wrong light in cluster");
+			Assert::AreEqual(0u, grid.counts()[grid.cluster_index(8, 4, 12)], L"Light assigned to a slice in front of it");
+			Assert::AreEqual(0u, grid.counts()[grid.cluster_index(0, 0, 13)], L"Light assigned to a distant tile");
+
+			std::vector<unsigned int> indices = grid.indices();
+			grid.assign_scalar(lights, view, projection);
+			Assert::IsTrue(indices == grid.indices(), L"SIMD and scalar assignment disagree");
+		}
+
+		TEST_METHOD(ShaderPermutationDefines)
+		{
+			Assert::AreEqual(std::string(""), permutations::defines(0), L"Base variant has defines");
+			Assert::AreEqual(std::string("#define SPECULAR_MAP\n"), permutations::defines(permutations::SPECULAR_MAP));
+			Assert::AreEqual(std::string("#define CLUSTERED_LIGHTS\n#define FOG\n"),
+				permutations::defines(permutations::FOG | permutations::CLUSTERED_LIGHTS), L"Defines not in bit order");
+		}
+
+		TEST_METHOD(DepthPrepassHeuristic)
+		{
+			prepass::PrepassSettings settings;						// On at 1.3x overdraw, off below 1.15x
+
+			Assert::IsTrue(prepass::should_prepass(false, 3.f, 0.5f, 0.f, settings), L"High overdraw did not enable the pre-pass");
+			Assert::IsFalse(prepass::should_prepass(false, 1.2f, 0.5f, 0.f, settings), L"Low overdraw enabled the pre-pass");
+			Assert::IsTrue(prepass::should_prepass(true, 1.2f, 0.5f, 0.f, settings), L"No hysteresis between the overdraw thresholds");
+			Assert::IsFalse(prepass::should_prepass(true, 1.1f, 0.5f, 0.f, settings), L"Low overdraw kept the pre-pass on");
+			Assert::IsFalse(prepass::should_prepass(false, 3.f, 0.01f, 0.f, settings), L"A few hidden pixels enabled the pre-pass");
+			Assert::IsFalse(prepass::should_prepass(false, 3.f, 0.5f, 1.2f, settings), L"Pre-pass enabled although it was slower");
+			Assert::IsTrue(prepass::should_prepass(true, 3.f, 0.5f, 1.f, settings), L"No hysteresis between the cost thresholds");
+			Assert::IsFalse(prepass::should_prepass(true, 3.f, 0.5f, 1.1f, settings), L"Slower pre-pass kept on");
+		}
+
+		TEST_METHOD(LightmapUVsDoNotOverlap)
+		{
+			std::vector<glm::vec2> uvs;
+			const size_t triangles = 101;							// Odd, so the last cell is half empty
+			int size = lightmaps::generate_uvs(triangles, 64, uvs);
+			Assert::IsTrue(size >= 64, L"Atlas smaller than requested");
+			Assert::AreEqual(triangles * 3, uvs.size(), L"Not three UVs per triangle");
+
+			/**
+			 * Both triangles of a cell stay inside it, and the centroids of the two halves
+			 * land on different sides of the cell's diagonal.
+			 */
+			int cells = (int)std::ceil(std::sqrt((float)((triangles + 1) / 2)));
+			float cell = (float)(size / cells);
+			for (size_t t = 0; t < triangles; ++t) {
+				glm::vec2 origin = glm::vec2((float)(t / 2 % cells), (float)(t / 2 / cells)) * cell;
+				glm::vec2 centroid(0.f);
+				for (int corner = 0; corner < 3; ++corner) {
+					glm::vec2 texel = uvs[t * 3 + corner] * (float)size - origin;
+					Assert::IsTrue(texel.x >= 1.f && texel.y >= 1.f && texel.x <= cell - 1.f && texel.y <= cell - 1.f,
+						L"Triangle reaches into its cell's gutter");
+					centroid += texel / 3.f;
+				}
+				bool lower = centroid.x + centroid.y < cell;
+				Assert::AreEqual(t % 2 == 0, lower, L"Triangles of a cell overlap");
+			}
+		}
+
+		TEST_METHOD(DynamicResolutionController)
+		{
+			resolution::ResolutionSettings settings;				// 16.7 ms budget, hold between 80% and 100% of it
+
+			Assert::AreEqual(0.8f, resolution::next_scale(0.8f, 0.f, settings), L"Scale changed before any measurement");
+			Assert::AreEqual(0.8f, resolution::next_scale(0.8f, 15.f, settings), L"Scale changed inside the hold band");
+			Assert::IsTrue(resolution::next_scale(0.8f, 20.f, settings) < 0.8f, L"Over budget did not scale down");
+			Assert::IsTrue(resolution::next_scale(0.8f, 10.f, settings) > 0.8f, L"Well under budget did not scale up");
+			Assert::AreEqual(0.7f, resolution::next_scale(0.8f, 100.f, settings), 1e-5f, L"Step not limited");
+			Assert::AreEqual(settings.min_scale, resolution::next_scale(0.55f, 100.f, settings), L"Scale below minimum");
+			Assert::AreEqual(settings.max_scale, resolution::next_scale(0.95f, 1.f, settings), L"Scale above maximum");
+
+			/**
+			 * Frame time falls with the pixel count: one step from an over-budget scale
+			 * lands inside the hold band.
+			 */
+			float full_ms = 30.f;
+			float scale = resolution::next_scale(0.8f, full_ms * 0.64f, settings);
+			float predicted_ms = full_ms * scale * scale;
+			Assert::IsTrue(predicted_ms <= settings.target_ms && predicted_ms >= settings.target_ms * settings.headroom, L"Did not aim inside the hold band");
+		}
+	
+		TEST_METHOD(SsaoKernelStaysInHemisphere)
+		{
+			std::vector<glm::vec3> points = ssao::kernel(ssao::MAX_SAMPLES);
+			Assert::AreEqual((size_t)ssao::MAX_SAMPLES, points.size(), L"Wrong sample count");
+
+			glm::vec3 mean(0.f);
+			for (size_t i = 0; i < points.size(); ++i) {
+				Assert::IsTrue(points[i].z > 0.f, L"Sample below the surface");
+				Assert::IsTrue(glm::length(points[i]) <= 1.f + 1e-5f, L"Sample outside the unit hemisphere");
+				if (i > 0)
+					Assert::IsTrue(glm::length(points[i]) >= glm::length(points[i - 1]), L"Samples not packed towards the centre");
+				mean += glm::normalize(points[i]);
+			}
+
+			/**
+			 * Directions are spread around the normal rather than bunched to one side.
+			 */
+			mean /= (float)points.size();
+			Assert::IsTrue(glm::length(glm::vec2(mean.x, mean.y)) < 0.1f, L"Sample directions lean to one side");
+		}
+
+		TEST_METHOD(SphericalHarmonicsAmbient)
+		{
+			/**
+			 * A constant environment lights every orientation equally: its irradiance is
+			 * the constant itself in every direction.
+			 */
+			glm::vec3 grey(0.3f, 0.4f, 0.5f);
+			environment::SH9 constant = environment::irradiance(environment::project(environment::procedural_environment(16, grey, grey, grey)));
+			glm::vec3 directions[] = { glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(1.f, -1.f, 1.f) };
+			for (glm::vec3 direction : directions) {
+				glm::vec3 value = environment::evaluate(constant, direction);
+				Assert::AreEqual(grey.x, value.x, 1e-3f, L"Constant environment not reproduced");
+				Assert::AreEqual(grey.z, value.z, 1e-3f, L"Constant environment not reproduced");
+			}
+
+			/**
+			 * A bright sky over a dark ground lights surfaces facing up more than those
+			 * facing down, with the sides in between.
+			 */
+			environment::SH9 room = environment::irradiance(environment::project(environment::procedural_environment(16, glm::vec3(1.f), glm::vec3(0.5f), glm::vec3(0.f))));
+			float up = environment::evaluate(room, glm::vec3(0.f, 1.f, 0.f)).x;
+			float side = environment::evaluate(room, glm::vec3(1.f, 0.f, 0.f)).x;
+			float down = environment::evaluate(room, glm::vec3(0.f, -1.f, 0.f)).x;
+			Assert::IsTrue(up > side && side > down, L"Irradiance not ordered sky to ground");
+			Assert::AreEqual(0.5f, side, 0.05f, L"Sideways irradiance not the horizon's");
+		}
+
+		TEST_METHOD(ReflectionFacesMatchCubemapLayout)
+		{
+			/**
+			 * Rendering a probe face with its view and a 90 degree projection must put
+			 * each direction on the texel a cube map lookup (and the prefilter pass, which
+			 * follows environment::cubemap_direction) expects it on.
+			 */
+			const int size = 8;
+			glm::mat4 projection = glm::perspective(glm::radians(90.f), 1.f, 0.02f, 20.f);
+			glm::vec3 eye(0.5f, 1.f, -2.f);
+			for (int face = 0; face < 6; ++face) {
+				for (int y = 0; y < size; y += 3) {
+					for (int x = 0; x < size; x += 3) {
+						glm::vec3 direction = environment::cubemap_direction(face, x, y, size);
+						glm::vec4 clip = projection * reflections::face_view(face, eye) * glm::vec4(eye + direction, 1.f);
+						Assert::AreEqual((x + 0.5f) / size, (clip.x / clip.w + 1.f) * 0.5f, 1e-4f, L"Direction rendered to the wrong column");
+						Assert::AreEqual((y + 0.5f) / size, (clip.y / clip.w + 1.f) * 0.5f, 1e-4f, L"Direction rendered to the wrong row");
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(VisibilityIdsAndMaterialDepths)
+		{
+			/**
+			 * No draw and triangle may encode to the ID that marks empty pixels, and every
+			 * material depth must land on its own step of a 24-bit depth buffer.
+			 */
+			unsigned int last_id = ((visibility::MAX_DRAWS - 1) << visibility::TRIANGLE_BITS) | ((1u << visibility::TRIANGLE_BITS) - 1);
+			Assert::AreNotEqual(0xFFFFFFFFu, last_id, L"Largest ID is the empty ID");
+			Assert::IsTrue((unsigned long long)visibility::MAX_DRAWS << visibility::TRIANGLE_BITS <= 0xFFFFFFFFull, L"Draw index overflows the ID");
+
+			long long previous = -1;
+			for (unsigned int material = 0; material < visibility::MAX_MATERIALS; ++material) {
+				float depth = (float)(material + 1) / (visibility::MAX_MATERIALS + 1);
+				long long stored = (long long)((double)depth * ((1 << 24) - 1) + 0.5);
+				Assert::IsTrue(stored > previous, L"Two material depths share a depth buffer value");
+				previous = stored;
+			}
+			Assert::IsTrue(previous < (1 << 24) - 1, L"A material depth equals the cleared depth");
+		}
+
+		TEST_METHOD(TextureRowsFlipForUpload)
+		{
+			/**
+			 * Decoded rows run top-down and OpenGL's bottom-up, so the first row decoded
+			 * must be the last uploaded, with every row's texels kept in order.
+			 */
+			const int width = 3, height = 4, channels = 3;
+			unsigned char source[width * height * channels];
+			for (int i = 0; i < width * height * channels; ++i)
+				source[i] = (unsigned char)i;
+
+			unsigned char flipped[width * height * channels];
+			textures::copy_flipped(source, flipped, width, height, channels);
+			for (int row = 0; row < height; ++row) {
+				for (int i = 0; i < width * channels; ++i)
+					Assert::AreEqual((int)source[row * width * channels + i], (int)flipped[(height - 1 - row) * width * channels + i], L"Texel copied to the wrong place");
+			}
+		}
+
+		TEST_METHOD(TextureFormatFollowsChannelsAndUsage)
+		{
+			/**
+			 * Masks are one byte per texel whatever the image holds, color keeps alpha
+			 * only where the image has it, and sRGB never drops to a format 3.3 lacks.
+			 */
+			for (int channels = 1; channels <= 4; ++channels) {
+				textures::Format mask = textures::choose_format(channels, textures::Usage::MASK, false);
+				Assert::AreEqual(1, mask.components, L"Mask not decoded to one channel");
+				Assert::AreEqual((unsigned int)GL_R8, mask.internal_format, L"Mask not stored as R8");
+
+				textures::Format srgb = textures::choose_format(channels, textures::Usage::ALBEDO, true);
+				Assert::AreEqual((unsigned int)GL_SRGB8_ALPHA8, srgb.internal_format, L"sRGB albedo not stored as SRGB8_ALPHA8");
+			}
+			Assert::AreEqual((unsigned int)GL_R8, textures::choose_format(1, textures::Usage::ALBEDO, false).internal_format, L"Grey albedo not stored as R8");
+			Assert::AreEqual((unsigned int)GL_RG8, textures::choose_format(2, textures::Usage::ALBEDO, false).internal_format, L"Grey and alpha albedo not stored as RG8");
+			Assert::AreEqual((unsigned int)GL_RGBA8, textures::choose_format(3, textures::Usage::ALBEDO, false).internal_format, L"RGB albedo not stored as RGBA8");
+			Assert::AreEqual(4, textures::choose_format(3, textures::Usage::ALBEDO, false).components, L"RGB albedo not decoded to RGBA");
+		}
+
+		TEST_METHOD(MipDownsampleAveragesAndClampsOddSizes)
+		{
+			/**
+			 * Each texel of the next level averages a 2x2 quad, rounded to nearest, and an
+			 * odd last column or row is averaged with itself rather than read past.
+			 */
+			const int width = 3, height = 2, components = 2;
+			std::vector<unsigned char> image = {
+				0, 10,   4, 20,   9, 255,
+				2, 30,   6, 40,   9, 255,
+			};
+			std::vector<unsigned char> half = textures::downsample(image, width, height, components);
+			Assert::AreEqual((size_t)1 * 1 * components, half.size(), L"Wrong level size");
+			Assert::AreEqual(3, (int)half[0], L"Quad not averaged");
+			Assert::AreEqual(25, (int)half[1], L"Second component not averaged");
+
+			std::vector<unsigned char> column = { 8, 0, 4 };
+			std::vector<unsigned char> last = textures::downsample(column, 1, 3, 1);
+			Assert::AreEqual((size_t)1, last.size(), L"1x3 should halve to 1x1");
+			Assert::AreEqual(4, (int)last[0], L"One-texel-wide level not averaged");
+		}
+
+		TEST_METHOD(MipTailStartsAtTailSize)
+		{
+			/**
+			 * A 6668x3046 chain has 13 levels; 6668 >> 6 = 104 is the first no larger than
+			 * 128. Short chains and tails larger than the image keep every level.
+			 */
+			Assert::AreEqual((size_t)6, textures::mip_tail(6668, 3046, 13, 128), L"Tail starts at the wrong level");
+			Assert::AreEqual((size_t)7, textures::mip_tail(128, 4096, 13, 32), L"Taller side ignored");
+			Assert::AreEqual((size_t)2, textures::mip_tail(4096, 4096, 3, 128), L"Tail past the last level");
+			Assert::AreEqual((size_t)0, textures::mip_tail(64, 64, 7, 128), L"Small image not all tail");
+		}
+
+		TEST_METHOD(MinFilterFollowsResidentLevels)
+		{
+			/**
+			 * Trilinear only once a smaller level than the base is resident, as levels are
+			 * streamed in and given up again.
+			 */
+			Assert::AreEqual((unsigned int)GL_LINEAR, textures::min_filter(0, 1), L"Single level not bilinear");
+			Assert::AreEqual((unsigned int)GL_LINEAR, textures::min_filter(12, 13), L"Last level alone not bilinear");
+			Assert::AreEqual((unsigned int)GL_LINEAR_MIPMAP_LINEAR, textures::min_filter(11, 13), L"Two levels not trilinear");
+			Assert::AreEqual((unsigned int)GL_LINEAR_MIPMAP_LINEAR, textures::min_filter(0, 13), L"Full chain not trilinear");
+		}
+
+		TEST_METHOD(RestreamedLevelsWaitForTheWorker)
+		{
+			/**
+			 * A 4-level chain completed by its worker and fully uploaded, whose 2 largest
+			 * levels were then dropped and are read again.
+			 */
+			textures::TextureLoader::job loaded;
+			loaded.levels.resize(4);
+			loaded.ready = 4;
+			loaded.done = true;
+			loaded.resident = 0;
+			loaded.rows_uploaded = 96;
+			loaded.priority = 2.f;
+			Assert::IsTrue(textures::TextureLoader::finished(loaded, loaded.done), L"Completed job not finished");
+
+			textures::TextureLoader::job again = textures::TextureLoader::restream_job(loaded, 2);
+			Assert::IsFalse(again.done, L"Restreamed job starts out done");
+			Assert::AreEqual((size_t)4, again.levels.size(), L"Level table not kept");
+			Assert::AreEqual((size_t)2, again.resident, L"Dropped levels counted as resident");
+			Assert::AreEqual((size_t)2, again.ready, L"Kept levels not counted as ready");
+			Assert::AreEqual((size_t)2, again.unread, L"Dropped levels not left to read");
+			Assert::AreEqual(0, again.rows_uploaded, L"Upload progress carried over");
+			Assert::AreEqual(0.f, again.priority, L"Priority carried over");
+			Assert::IsFalse(textures::TextureLoader::finished(again, again.done), L"Restreamed job finished before any upload");
+
+			again.resident = 0;											// Every level uploaded, but the worker still holds the job
+			Assert::IsFalse(textures::TextureLoader::finished(again, again.done), L"Restreamed job finished before the worker was done");
+			again.done = true;
+			Assert::IsTrue(textures::TextureLoader::finished(again, again.done), L"Restreamed job not finished once the worker was done");
+		}
+
+		TEST_METHOD(TexturePathsNormalizeForSharing)
+		{
+			/**
+			 * Spellings of one file share a key, so they share a texture; different files
+			 * never do.
+			 */
+			Assert::AreEqual(std::string("data/wood.jpg"), textures::normalize_path("data/wood.jpg"), L"Plain path changed");
+			Assert::AreEqual(std::string("data/wood.jpg"), textures::normalize_path("./data/wood.jpg"), L"Leading ./ kept");
+			Assert::AreEqual(std::string("data/wood.jpg"), textures::normalize_path("data\\wood.jpg"), L"Backslash kept");
+			Assert::AreEqual(std::string("data/wood.jpg"), textures::normalize_path("data//./wood.jpg"), L"Repeated separators kept");
+			Assert::AreEqual(std::string("../data/wood.jpg"), textures::normalize_path("../data/wood.jpg"), L"Parent directory dropped");
+			Assert::AreNotEqual(textures::normalize_path("data/wood.jpg"), textures::normalize_path("data/soda.jpg"), L"Different files share a key");
+		}
+
+		TEST_METHOD(BlockCompressionRoundTrip)
+		{
+			/**
+			 * Blocks whose texels are exactly on their formats' endpoints decode to the
+			 * same texels, and every block format fills 4x4 texels in 8 or 16 bytes.
+			 */
+			unsigned char colors[16 * 4], channel[16], pairs[16 * 2];
+			for (int i = 0; i < 16; ++i) {
+				bool first = (i * 7) % 3 == 0;
+				colors[i * 4 + 0] = first ? 255 : 0;		// Pure red and blue are exact in 5:6:5
+				colors[i * 4 + 1] = 0;
+				colors[i * 4 + 2] = first ? 0 : 255;
+				colors[i * 4 + 3] = first ? 255 : 0;
+				channel[i] = first ? 200 : 17;
+				pairs[i * 2 + 0] = first ? 3 : 250;
+				pairs[i * 2 + 1] = first ? 90 : 91;
+			}
+
+			unsigned char block[16], rgba[16 * 4];
+			cooker::encode_block(cooker::BlockFormat::BC1, colors, block);
+			cooker::decode_block(cooker::BlockFormat::BC1, block, rgba);
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < 3; ++c)
+					Assert::AreEqual((int)colors[i * 4 + c], (int)rgba[i * 4 + c], L"BC1 texel changed");
+			}
+
+			cooker::encode_block(cooker::BlockFormat::BC3, colors, block);
+			cooker::decode_block(cooker::BlockFormat::BC3, block, rgba);
+			for (int i = 0; i < 16 * 4; ++i)
+				Assert::AreEqual((int)colors[i], (int)rgba[i], L"BC3 texel changed");
+
+			cooker::encode_block(cooker::BlockFormat::BC4, channel, block);
+			cooker::decode_block(cooker::BlockFormat::BC4, block, rgba);
+			for (int i = 0; i < 16; ++i)
+				Assert::AreEqual((int)channel[i], (int)rgba[i * 4], L"BC4 texel changed");
+
+			cooker::encode_block(cooker::BlockFormat::BC5, pairs, block);
+			cooker::decode_block(cooker::BlockFormat::BC5, block, rgba);
+			for (int i = 0; i < 16; ++i) {
+				Assert::AreEqual((int)pairs[i * 2], (int)rgba[i * 4], L"BC5 red changed");
+				Assert::AreEqual((int)pairs[i * 2 + 1], (int)rgba[i * 4 + 1], L"BC5 green changed");
+			}
+
+			Assert::AreEqual(std::string("data/wood.ktx2"), cooker::cooked_path("data/wood.jpg"), L"Cooked file not next to its source");
+			Assert::IsTrue(cooker::choose_block_format(3, textures::Usage::MASK) == cooker::BlockFormat::BC4, L"Mask not cooked to BC4");
+			Assert::IsTrue(cooker::choose_block_format(3, textures::Usage::ALBEDO) == cooker::BlockFormat::BC1, L"Color not cooked to BC1");
+		}
 	};
 }
-
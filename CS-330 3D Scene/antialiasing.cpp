@@ -0,0 +1,40 @@
+/**
+ * "antialiasing.cpp" - Implementations for post-process anti-aliasing. Function
+ *		prototypes defined in "antialiasing.h".
+ */
+#include <glad/glad.h>
+
+#include "antialiasing.h"
+
+namespace antialiasing {
+	void Fxaa::init() {
+		shader = new Shader("shaders/fullscreen.vs.glsl", "shaders/fxaa.fs.glsl");
+		shader->use();
+		shader->setInt("scene", 0);
+		glGenVertexArrays(1, &empty_VAO);
+	}
+
+	void Fxaa::apply(unsigned int texture, glm::vec2 uv_scale, glm::vec2 texel_size) const {
+		shader->use();
+		shader->setVec2("uvScale", uv_scale);
+		shader->setVec2("texelSize", texel_size);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture);
+
+		/**
+		 * The pass replaces every pixel and must not be depth tested or clipped by
+		 * wireframe mode.
+		 */
+		GLint polygon_mode[2];
+		glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glDisable(GL_DEPTH_TEST);
+
+		glBindVertexArray(empty_VAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+
+		glEnable(GL_DEPTH_TEST);
+		glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+	}
+}
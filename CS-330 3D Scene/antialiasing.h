@@ -0,0 +1,40 @@
+/**
+ * "antialiasing.h" - Post-process anti-aliasing. FXAA (after Lottes, "FXAA", NVIDIA
+ *		2009) finds luma edges in the finished frame, walks along each edge to its
+ *		ends and blends across it in proportion to where the pixel sits on the edge,
+ *		plus a sub-pixel blend for features thinner than a pixel. It costs one
+ *		full-screen pass over an offscreen colour target instead of MSAA's multiplied
+ *		colour and depth storage. Function implementations defined in
+ *		"antialiasing.cpp".
+ */
+#pragma once
+#ifndef __ANTIALIASING_H__
+#define __ANTIALIASING_H__
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+namespace antialiasing {
+	enum class Mode {
+		OFF,
+		FXAA,
+	};
+
+	class Fxaa {
+	public:
+		void init();							// Create the shader; requires a GL context
+
+		/**
+		 * Anti-alias the bottom-left uv_scale share of texture, a linearly filtered
+		 * colour target with texels of texel_size, into the bound framebuffer's
+		 * viewport.
+		 */
+		void apply(unsigned int texture, glm::vec2 uv_scale, glm::vec2 texel_size) const;
+
+	private:
+		Shader* shader = nullptr;
+		unsigned int empty_VAO = 0;
+	};
+}
+#endif//__ANTIALIASING_H__
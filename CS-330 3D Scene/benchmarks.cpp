@@ -0,0 +1,1899 @@
+/**
+ * "benchmarks.cpp" - Implementations for the command-line benchmarks. Function
+ *		prototypes defined in "benchmarks.h".
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "main.h"
+#include "benchmarks.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "instancing.h"
+#include "clustered.h"
+#include "deferred.h"
+#include "lights.h"
+#include "models.h"
+#include "shadows.h"
+#include "prepass.h"
+#include "lightmaps.h"
+#include "debug_draw.h"
+#include "resolution.h"
+#include "antialiasing.h"
+#include "ssao.h"
+#include "environment.h"
+#include "reflections.h"
+#include "visibility.h"
+#include "textures.h"
+#include "cooker.h"
+
+namespace bench {
+	/**
+	 * Wall-clock helper: milliseconds since an arbitrary epoch.
+	 */
+	static double now_ms() {
+		using namespace std::chrono;
+		return duration<double, std::milli>(high_resolution_clock::now().time_since_epoch()).count();
+	}
+
+	/**
+	 * Open a hidden window with an OpenGL 3.3 core context for the GPU benchmarks. Only
+	 * core 3.3 features are used, so this also works headlessly under Mesa llvmpipe
+	 * (e.g. "xvfb-run" with LIBGL_ALWAYS_SOFTWARE=1). Returns nullptr on failure.
+	 */
+	static GLFWwindow* open_hidden_context(int width, int height) {
+		textures::loader().forget();			// The last benchmark's textures went with its context
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, LOCAL_GL_VERSION[0]);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, LOCAL_GL_VERSION[1]);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+		GLFWwindow* window = glfwCreateWindow(width, height, "3D Scene Benchmark", NULL, NULL);
+		if (window == NULL) {
+			std::cerr << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return nullptr;
+		}
+
+		glfwMakeContextCurrent(window);
+		if (init_glad()) {
+			glfwTerminate();
+			return nullptr;
+		}
+
+		glfwSwapInterval(0);					// Never wait for vsync
+		glViewport(0, 0, width, height);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LESS);
+
+		return window;
+	}
+
+	struct entry {
+		const char* name;
+		void (*function)();
+	};
+
+	static const entry benchmarks[] = {
+		{ "culling", frustum_culling },
+		{ "bvh", bvh_scaling },
+		{ "occlusion", occlusion_culling },
+		{ "instancing", instance_culling },
+		{ "clustered", clustered_lighting },
+		{ "deferred", deferred_shading },
+		{ "shading", shading_cost },
+		{ "shadows", shadow_caching },
+		{ "prepass", depth_prepass },
+		{ "bake", lightmap_baking },
+		{ "lights", light_sprites },
+		{ "debug", debug_lines },
+		{ "resolution", dynamic_resolution },
+		{ "aa", antialiasing_cost },
+		{ "ssao", ambient_occlusion_cost },
+		{ "reflections", reflection_probes_cost },
+		{ "visibility", visibility_buffer_cost },
+		{ "textures", texture_loading },
+		{ "residency", texture_residency },
+	};
+
+	int run(int argc, char* argv[]) {
+		const char* only = argc > 2 ? argv[2] : nullptr;	// Optional benchmark name
+		bool ran = false;
+
+		for (const entry& benchmark : benchmarks) {
+			if (only != nullptr && std::strcmp(only, benchmark.name) != 0)
+				continue;
+
+			std::printf("== %s ==\n", benchmark.name);
+			benchmark.function();
+			ran = true;
+		}
+
+		if (!ran) {
+			std::fprintf(stderr, "Unknown benchmark \"%s\"\n", only);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	void frustum_culling() {
+		const size_t object_count = 100000;
+		const int iterations = 200;
+
+		/**
+		 * Scatter objects through a cube around the camera so only a small fraction of
+		 * them land in the view frustum, as in a large scene.
+		 */
+		std::mt19937 rng(330);
+		std::uniform_real_distribution<float> position(-100.f, 100.f);
+		std::uniform_real_distribution<float> size(0.1f, 2.f);
+
+		culling::BoundsSoA bounds;
+		bounds.resize(object_count);
+		for (size_t i = 0; i < object_count; ++i) {
+			glm::vec3 extent = glm::vec3(size(rng), size(rng), size(rng));
+			bounds.set(i, glm::vec3(position(rng), position(rng), position(rng)), extent, glm::length(extent));
+		}
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), 800.f / 600.f, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+		culling::Frustum frustum = culling::extract_frustum(projection * view);
+
+		std::vector<unsigned int> visible_scalar, visible_simd;
+		visible_scalar.reserve(object_count);
+		visible_simd.reserve(object_count);
+		culling::CullStats stats_scalar, stats_simd;
+
+		double start = now_ms();
+		for (int i = 0; i < iterations; ++i)
+			culling::cull_scalar(frustum, bounds, visible_scalar, stats_scalar);
+		double scalar_ms = (now_ms() - start) / iterations;
+
+		start = now_ms();
+		for (int i = 0; i < iterations; ++i)
+			culling::cull(frustum, bounds, visible_simd, stats_simd);
+		double simd_ms = (now_ms() - start) / iterations;
+
+#ifdef __AVX__
+		const char* simd_name = "AVX";
+#else
+		const char* simd_name = "SSE";
+#endif
+		std::printf("objects: %zu, visible: %u, culled: %u\n", object_count, stats_simd.visible, stats_simd.culled);
+		std::printf("scalar: %8.3f ms/pass  %6.2f ns/object\n", scalar_ms, scalar_ms * 1e6 / object_count);
+		std::printf("%-6s: %8.3f ms/pass  %6.2f ns/object  (%.2fx)\n", simd_name, simd_ms, simd_ms * 1e6 / object_count, scalar_ms / simd_ms);
+		std::printf("results match: %s\n", visible_scalar == visible_simd ? "yes" : "NO");
+	}
+
+	void bvh_scaling() {
+		const size_t scene_sizes[] = { 1000, 10000, 100000, 1000000 };
+		const int queries = 10000;
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), 800.f / 600.f, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+		culling::Frustum frustum = culling::extract_frustum(projection * view);
+
+		std::printf("%9s %10s %10s %9s %9s %10s %10s %10s %11s\n", "objects", "build 1t", "build mt", "refit", "move 1%",
+			"frustum", "flat cull", "10k rays", "10k spheres");
+
+		for (size_t object_count : scene_sizes) {
+			/**
+			 * Objects scattered through a cube whose volume grows with the object count,
+			 * keeping density (and so per-query result size) roughly constant.
+			 */
+			float half_size = 10.f * std::cbrt((float)object_count / 1000.f);
+			std::mt19937 rng(330);
+			std::uniform_real_distribution<float> position(-half_size, half_size);
+			std::uniform_real_distribution<float> size(0.1f, 1.f);
+			std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+			std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+			std::vector<bvh::AABB> bounds(object_count);
+			culling::BoundsSoA flat_bounds;
+			flat_bounds.resize(object_count);
+			for (size_t i = 0; i < object_count; ++i) {
+				glm::vec3 center = glm::vec3(position(rng), position(rng), position(rng));
+				glm::vec3 extent = glm::vec3(size(rng), size(rng), size(rng));
+				bounds[i].min = center - extent;
+				bounds[i].max = center + extent;
+				flat_bounds.set(i, center, extent, glm::length(extent));
+			}
+
+			bvh::Tree tree;
+			double start = now_ms();
+			tree.build(bounds, 1);
+			double build_single_ms = now_ms() - start;
+
+			start = now_ms();
+			tree.build(bounds);
+			double build_multi_ms = now_ms() - start;
+
+			/**
+			 * Move every object a little and refit.
+			 */
+			for (size_t i = 0; i < object_count; ++i) {
+				glm::vec3 offset = glm::vec3(jitter(rng), jitter(rng), jitter(rng));
+				bounds[i].min += offset;
+				bounds[i].max += offset;
+				tree.set_bounds((int)i, bounds[i]);
+			}
+			start = now_ms();
+			tree.refit();
+			double refit_ms = now_ms() - start;
+
+			/**
+			 * Move 1% of the objects a long way with incremental remove/insert.
+			 */
+			size_t moved = std::max<size_t>(1, object_count / 100);
+			start = now_ms();
+			for (size_t i = 0; i < moved; ++i) {
+				glm::vec3 offset = glm::vec3(position(rng), position(rng), position(rng)) * 0.5f;
+				bvh::AABB box = bounds[i];
+				box.min += offset;
+				box.max += offset;
+				tree.move((int)i, box);
+			}
+			double move_ms = now_ms() - start;
+
+			std::vector<unsigned int> results;
+			results.reserve(object_count);
+
+			start = now_ms();
+			tree.query_frustum(frustum, results);
+			double frustum_ms = now_ms() - start;
+
+			culling::CullStats stats;
+			start = now_ms();
+			culling::cull(frustum, flat_bounds, results, stats);
+			double flat_ms = now_ms() - start;
+
+			int hits = 0;
+			start = now_ms();
+			for (int i = 0; i < queries; ++i) {
+				glm::vec3 direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)));
+				int object;
+				if (tree.pick(glm::vec3(0.f), direction, 1000.f, object) >= 0.f)
+					hits++;
+			}
+			double ray_ms = now_ms() - start;
+
+			size_t neighbours = 0;
+			start = now_ms();
+			for (int i = 0; i < queries; ++i) {
+				results.clear();
+				tree.query_sphere(glm::vec3(position(rng), position(rng), position(rng)), 2.f, results);
+				neighbours += results.size();
+			}
+			double sphere_ms = now_ms() - start;
+
+			std::printf("%9zu %8.2fms %8.2fms %7.2fms %7.2fms %8.3fms %8.3fms %8.2fms %9.2fms\n", object_count, build_single_ms, build_multi_ms,
+				refit_ms, move_ms, frustum_ms, flat_ms, ray_ms, sphere_ms);
+		}
+	}
+
+	void occlusion_culling() {
+		const int width = 800, height = 600;
+		const int frames = 300;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+
+		/**
+		 * A wall (the desk stood on end) covering most of the view, with a grid of
+		 * oranges behind it. The oranges share one mesh and texture.
+		 */
+		std::vector<Model> scene;
+		Model wall = get_desk_model("data/wood.jpg");
+		wall.model = glm::translate(glm::mat4(1.f), glm::vec3(-1.f, 0.f, -3.f));
+		wall.model = glm::rotate(wall.model, glm::radians(90.f), glm::vec3(1.f, 0.f, 0.f));
+		wall.model = glm::scale(wall.model, glm::vec3(2.f, 1.f, 4.f));
+		scene.push_back(wall);
+
+		Model orange = get_orange_model("data/orange.jpg");
+		for (int x = 0; x < 20; ++x) {
+			for (int z = 0; z < 20; ++z) {
+				orange.model = glm::translate(glm::mat4(1.f), glm::vec3(-4.f + x * 0.4f, -1.f + (x % 5) * 0.5f, -5.f - z * 1.f));
+				orange.model = glm::scale(orange.model, glm::vec3(0.15f));
+				scene.push_back(orange);
+			}
+		}
+
+		culling::BoundsSoA bounds;
+		culling::update_bounds(bounds, scene);
+		std::vector<bvh::AABB> boxes;
+		for (const Model& model : scene)
+			boxes.push_back(bvh::model_bounds(model));
+		bvh::Tree tree;
+		tree.build(boxes);
+
+		glm::vec3 camera_position = glm::vec3(0.f);
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+		culling::Frustum frustum = culling::extract_frustum(projection * view);
+
+		occlusion::OcclusionCuller culler;
+		culler.init();
+		occlusion::OcclusionStats stats;
+		std::vector<unsigned int> visible;
+		culling::CullStats cull_stats;
+
+		for (int mode = 0; mode < 2; ++mode) {
+			double skipped_sum = 0.0;
+			unsigned int drawn_sum = 0;
+
+			double start = now_ms();
+			for (int frame = 0; frame < frames; ++frame) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+				if (mode == 0) {
+					culling::cull(frustum, bounds, visible, cull_stats);
+					for (unsigned int index : visible)
+						draw_model(scene[index], projection, view, point_light, dir_light, camera_position);
+					drawn_sum += cull_stats.visible;
+				}
+				else {
+					culler.render(tree, frustum, projection * view, camera_position, [&](unsigned int index) {
+						draw_model(scene[index], projection, view, point_light, dir_light, camera_position);
+					}, stats);
+					skipped_sum += stats.skipped_fraction();
+					drawn_sum += stats.drawn;
+				}
+
+				glfwSwapBuffers(window);
+				glFinish();									// Include GPU time in the measurement
+			}
+			double frame_ms = (now_ms() - start) / frames;
+
+			if (mode == 0)
+				std::printf("frustum only:    %7.3f ms/frame  %6.1f draws/frame\n", frame_ms, (double)drawn_sum / frames);
+			else
+				std::printf("occlusion:       %7.3f ms/frame  %6.1f draws/frame  %5.1f%% of in-frustum draws skipped\n",
+					frame_ms, (double)drawn_sum / frames, skipped_sum * 100.0 / frames);
+		}
+
+		glfwTerminate();
+	}
+
+	void instance_culling() {
+		const int width = 800, height = 600;
+		const size_t instance_count = 200000;
+		const int frames = 100;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+
+		/**
+		 * Napkins (two triangles each) scattered through a cube around the camera, so
+		 * the cost measured is culling and instance traffic rather than shading.
+		 */
+		Model napkin = get_napkin_model("data/napkin.jpg");
+
+		std::mt19937 rng(330);
+		std::uniform_real_distribution<float> position(-100.f, 100.f);
+		std::uniform_real_distribution<float> angle(0.f, 360.f);
+		std::uniform_real_distribution<float> size(0.2f, 1.f);
+
+		std::vector<glm::mat4> transforms(instance_count);
+		for (glm::mat4& transform : transforms) {
+			transform = glm::translate(glm::mat4(1.f), glm::vec3(position(rng), position(rng), position(rng)));
+			transform = glm::rotate(transform, glm::radians(angle(rng)), glm::vec3(0.f, 1.f, 0.f));
+			transform = glm::scale(transform, glm::vec3(size(rng)));
+		}
+
+		instancing::InstanceField field;
+		field.init(napkin, transforms);
+
+		glm::vec3 camera_position = glm::vec3(0.f);
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+
+		const char* names[] = { "CPU cull + upload:", "GPU, frame late:", "GPU, indirect:" };
+		for (int mode = 0; mode < 3; ++mode) {
+			field.use_indirect = mode == 2;
+			if (mode == 2 && !field.indirect()) {
+				std::printf("%-20s unavailable (needs OpenGL 4.2)\n", names[mode]);
+				continue;
+			}
+
+			double cull_ms = 0.0;
+			double visible_sum = 0.0;
+
+			double start = now_ms();
+			for (int frame = 0; frame < frames; ++frame) {
+				float yaw = glm::radians(frame * 3.6f);				// Turn in place so visibility changes every frame
+				glm::mat4 view = glm::lookAt(camera_position, glm::vec3(std::cos(yaw), 0.f, std::sin(yaw)), glm::vec3(0.f, 1.f, 0.f));
+				culling::Frustum frustum = culling::extract_frustum(projection * view);
+
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+				double cull_start = now_ms();
+				if (mode == 0)
+					field.cull_cpu(frustum);
+				else
+					field.cull(frustum);
+				cull_ms += now_ms() - cull_start;					// CPU time spent in the cull call
+
+				field.draw(projection, view, point_light, dir_light, camera_position);
+				visible_sum += field.visible();
+
+				glfwSwapBuffers(window);
+				glFinish();
+			}
+			double frame_ms = (now_ms() - start) / frames;
+
+			std::printf("%-20s %7.3f ms/frame  %7.3f ms in cull call  %8.1f visible\n", names[mode], frame_ms, cull_ms / frames, visible_sum / frames);
+		}
+
+		glfwTerminate();
+	}
+
+	void clustered_lighting() {
+		const int width = 800, height = 600;
+		const int iterations = 50;
+		const int frames = 30;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+
+		/**
+		 * Looking down at a large floor (the desk, scaled up) under a layer of lights.
+		 * The lights keep the same density as their count grows, so the lights touching
+		 * any one pixel stay about constant while the total count rises.
+		 */
+		Model floor = get_desk_model("data/wood.jpg");
+		floor.model = glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.f, 0.f)), glm::vec3(100.f, 1.f, 100.f));
+
+		glm::vec3 camera_position = glm::vec3(0.f, 6.f, 6.f);
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+
+		clustered::ClusterGrid grid;
+		grid.init();
+
+		for (int light_count : { 64, 256, 1024, 4096 }) {
+			float side = 2.f * std::sqrt((float)light_count);	// One light per 4 square units
+			std::mt19937 rng(330);
+			std::uniform_real_distribution<float> spread(-side * 0.5f, side * 0.5f);
+			std::uniform_real_distribution<float> channel(0.f, 0.5f);
+
+			std::vector<RadiantLight> lights(light_count);
+			for (RadiantLight& light : lights) {
+				light.position = glm::vec3(spread(rng), 0.3f, spread(rng));
+				light.color = glm::vec3(channel(rng), channel(rng), 0.5f);
+				light.attenuation_coefficients = glm::vec3(1.f, 1.4f, 7.2f);
+				light.radius = light_radius(light.attenuation_coefficients, light.color);
+			}
+
+			double start = now_ms();
+			for (int i = 0; i < iterations; ++i)
+				grid.assign_scalar(lights, view, projection);
+			double scalar_ms = (now_ms() - start) / iterations;
+			std::vector<unsigned int> scalar_indices = grid.indices();
+
+			start = now_ms();
+			for (int i = 0; i < iterations; ++i)
+				grid.assign(lights, view, projection);
+			double simd_ms = (now_ms() - start) / iterations;
+			bool match = grid.indices() == scalar_indices;
+
+			/**
+			 * Frame time with the floor lit by every light through the grid.
+			 */
+			grid.upload(lights);
+			models_bind_light_grid(&grid, width, height);
+
+			start = now_ms();
+			for (int frame = 0; frame < frames; ++frame) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				draw_model(floor, projection, view, point_light, dir_light, camera_position);
+				glfwSwapBuffers(window);
+				glFinish();
+			}
+			double frame_ms = (now_ms() - start) / frames;
+
+			std::printf("%5d lights: assign scalar %7.3f ms  SIMD %7.3f ms (%5.2fx, %s)  %4u in view  %3u max/cluster  frame %7.3f ms\n",
+				light_count, scalar_ms, simd_ms, scalar_ms / simd_ms, match ? "match" : "MISMATCH",
+				grid.stats().lights, grid.stats().max_per_cluster, frame_ms);
+		}
+
+		models_bind_light_grid(nullptr, width, height);
+		glfwTerminate();
+	}
+
+	void deferred_shading() {
+		const int frames = 10;
+		const int resolutions[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+
+		for (const auto& resolution : resolutions) {
+			const int width = resolution[0], height = resolution[1];
+
+			GLFWwindow* window = open_hidden_context(width, height);
+			if (window == nullptr)
+				return;
+
+			lights_init();
+			models_init();
+			RadiantLight point_light = get_point_light();
+			DirectionalLight dir_light = get_directional_light();
+
+			/**
+			 * A floor under rows of oranges seen at a grazing angle and drawn back to
+			 * front, so forward shading lights most pixels several times over while
+			 * deferred shading lights each pixel once.
+			 */
+			std::vector<Model> scene;
+			Model floor = get_desk_model("data/wood.jpg");
+			floor.model = glm::scale(glm::mat4(1.f), glm::vec3(20.f, 1.f, 20.f));
+			scene.push_back(floor);
+
+			Model orange = get_orange_model("data/orange.jpg");
+			for (int z = 0; z < 24; ++z) {
+				for (int x = 0; x < 24; ++x) {
+					orange.model = glm::translate(glm::mat4(1.f), glm::vec3(-6.f + x * 0.5f, 0.3f, -12.f + z * 0.5f));
+					orange.model = glm::scale(orange.model, glm::vec3(0.3f));
+					scene.push_back(orange);
+				}
+			}
+
+			glm::vec3 camera_position = glm::vec3(0.f, 1.f, 3.f);
+			glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f, 0.3f, -4.f), glm::vec3(0.f, 1.f, 0.f));
+
+			clustered::ClusterGrid grid;
+			grid.init();
+			deferred::DeferredRenderer renderer;
+			renderer.init(width, height);
+
+			for (int light_count : { 0, 64, 256, 1024 }) {
+				std::mt19937 rng(330);
+				std::uniform_real_distribution<float> spread_x(-6.f, 6.f);
+				std::uniform_real_distribution<float> spread_z(-12.f, 2.f);
+				std::uniform_real_distribution<float> channel(0.f, 0.5f);
+
+				std::vector<RadiantLight> lights(light_count);
+				for (RadiantLight& light : lights) {
+					light.position = glm::vec3(spread_x(rng), 0.6f, spread_z(rng));
+					light.color = glm::vec3(channel(rng), channel(rng), 0.5f);
+					light.attenuation_coefficients = glm::vec3(1.f, 1.4f, 7.2f);
+					light.radius = light_radius(light.attenuation_coefficients, light.color);
+				}
+
+				const clustered::ClusterGrid* light_grid = nullptr;
+				if (light_count > 0) {
+					grid.assign(lights, view, projection);
+					grid.upload(lights);
+					light_grid = &grid;
+				}
+
+				/**
+				 * Forward: every Model is fully lit as it is drawn.
+				 */
+				models_bind_light_grid(light_grid, width, height);
+
+				double start = now_ms();
+				for (int frame = 0; frame < frames; ++frame) {
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					for (const Model& model : scene)
+						draw_model(model, projection, view, point_light, dir_light, camera_position);
+					glfwSwapBuffers(window);
+					glFinish();
+				}
+				double forward_ms = (now_ms() - start) / frames;
+
+				/**
+				 * Deferred: fill the G-buffer, then light it in one pass.
+				 */
+				start = now_ms();
+				for (int frame = 0; frame < frames; ++frame) {
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					renderer.begin_geometry();
+					for (const Model& model : scene)
+						draw_model_gbuffer(model, projection, view);
+					renderer.shade(projection, view, point_light, dir_light, camera_position, light_grid, nullptr);
+					glfwSwapBuffers(window);
+					glFinish();
+				}
+				double deferred_ms = (now_ms() - start) / frames;
+
+				std::printf("%4dx%-4d %5d lights: forward %8.3f ms  deferred %8.3f ms (%5.2fx)\n",
+					width, height, light_count, forward_ms, deferred_ms, forward_ms / deferred_ms);
+			}
+
+			models_bind_light_grid(nullptr, width, height);
+			glfwTerminate();
+		}
+	}
+
+	void shading_cost() {
+		const int frames = 5;
+		const int layers = 8;									// Full-screen quads per frame
+		const int resolutions[][2] = { { 320, 240 }, { 800, 600 }, { 1920, 1080 } };
+
+		struct variant {
+			const char* name;
+			bool material;										// Drawn with a specular map
+			float shine;
+			bool blinn_phong;
+			bool fog;
+			bool clustered;
+			bool sh_ambient;
+		};
+		const variant variants[] = {
+			{ "phong", false, 0.5f, false, false, false, false },
+			{ "phong, no specular", false, 0.f, false, false, false, false },
+			{ "blinn-phong", false, 0.5f, true, false, false, false },
+			{ "specular map", true, 0.5f, false, false, false, false },
+			{ "fog", false, 0.5f, false, true, false, false },
+			{ "clustered, 256 lights", false, 0.5f, false, false, true, false },
+			{ "SH ambient", false, 0.5f, false, false, false, true },
+		};
+
+		for (const auto& resolution : resolutions) {
+			const int width = resolution[0], height = resolution[1];
+			float aspect_ratio = (float)width / (float)height;
+
+			GLFWwindow* window = open_hidden_context(width, height);
+			if (window == nullptr)
+				return;
+
+			lights_init();
+			models_init();
+			RadiantLight point_light = get_point_light();
+			DirectionalLight dir_light = get_directional_light();
+
+			/**
+			 * The napkin, stood up facing the camera and scaled to just overfill a 90
+			 * degree view, so every pixel is shaded once per layer. Depth testing is off
+			 * so every layer is shaded in full.
+			 */
+			Model quad = get_napkin_model("data/napkin.jpg");
+			quad.model = glm::scale(glm::mat4(1.f), glm::vec3(aspect_ratio * 1.05f, 1.05f, 1.f));
+			quad.model = glm::rotate(quad.model, glm::radians(90.f), glm::vec3(1.f, 0.f, 0.f));
+
+			Material material;
+			material.specular_map = quad.texture;
+			material.shine = 0.5f;
+
+			glm::vec3 camera_position = glm::vec3(0.f, 0.f, 1.f);
+			glm::mat4 projection = glm::perspective(glm::radians(90.f), aspect_ratio, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+			point_light.position = glm::vec3(0.f, 0.f, 0.5f);
+
+			/**
+			 * Clustered lights spread evenly over the quad, a few per cluster.
+			 */
+			std::mt19937 rng(330);
+			std::uniform_real_distribution<float> spread(-1.f, 1.f);
+			std::vector<RadiantLight> lights(256);
+			for (RadiantLight& light : lights) {
+				light.position = glm::vec3(spread(rng) * aspect_ratio, spread(rng), 0.1f);
+				light.color = glm::vec3(0.3f);
+				light.attenuation_coefficients = glm::vec3(1.f, 1.4f, 7.2f);
+				light.radius = 0.3f;
+			}
+			clustered::ClusterGrid grid;
+			grid.init();
+			grid.assign(lights, view, projection);
+			grid.upload(lights);
+
+			Fog fog;
+			fog.color = glm::vec3(0.5f);
+			fog.density = 0.15f;
+
+			environment::AmbientProbe probe;
+			probe.init();
+			probe.upload(environment::irradiance(environment::project(
+				environment::procedural_environment(16, glm::vec3(0.6f), glm::vec3(0.4f), glm::vec3(0.2f)))));
+
+			glDisable(GL_DEPTH_TEST);
+
+			for (const variant& v : variants) {
+				quad.shine = v.shine;
+				models_set_blinn_phong(v.blinn_phong);
+				models_set_fog(v.fog ? &fog : nullptr);
+				models_bind_light_grid(v.clustered ? &grid : nullptr, width, height);
+				models_set_sh_ambient(v.sh_ambient);
+
+				auto draw_frame = [&]() {
+					glClear(GL_COLOR_BUFFER_BIT);
+					for (int layer = 0; layer < layers; ++layer) {
+						if (v.material)
+							draw_material_model(quad, material, projection, view, point_light, dir_light, camera_position);
+						else
+							draw_model(quad, projection, view, point_light, dir_light, camera_position);
+					}
+					glfwSwapBuffers(window);
+					glFinish();
+				};
+
+				draw_frame();									// Compile the variant outside the timing
+
+				double frame_ms = 1e30;
+				for (int frame = 0; frame < frames; ++frame) {
+					double start = now_ms();
+					draw_frame();
+					frame_ms = std::min(frame_ms, now_ms() - start);	// Fastest frame: least disturbed by the rest of the system
+				}
+
+				double ns_per_pixel = frame_ms * 1e6 / ((double)layers * width * height);
+				std::printf("%4dx%-4d %-22s %7.2f ns/pixel  (%8.3f ms/frame)\n", width, height, v.name, ns_per_pixel, frame_ms);
+			}
+
+			models_set_blinn_phong(false);
+			models_set_fog(nullptr);
+			models_set_sh_ambient(false);
+			models_bind_light_grid(nullptr, width, height);
+			glfwTerminate();
+		}
+	}
+
+	void shadow_caching() {
+		const int frames = 20;
+		const int width = 1280, height = 720;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+		point_light.position = glm::vec3(0.f, 2.f, -3.f);
+
+		/**
+		 * A floor under a grid of static oranges, with one more orange rolling across
+		 * them as the only dynamic caster.
+		 */
+		std::vector<Model> static_casters;
+		Model floor = get_desk_model("data/wood.jpg");
+		floor.model = glm::scale(glm::mat4(1.f), glm::vec3(20.f, 1.f, 20.f));
+		static_casters.push_back(floor);
+
+		Model orange = get_orange_model("data/orange.jpg");
+		for (int z = 0; z < 14; ++z) {
+			for (int x = 0; x < 14; ++x) {
+				orange.model = glm::translate(glm::mat4(1.f), glm::vec3(-3.5f + x * 0.5f, 0.3f, -7.f + z * 0.5f));
+				orange.model = glm::scale(orange.model, glm::vec3(0.3f));
+				static_casters.push_back(orange);
+			}
+		}
+		std::vector<Model> dynamic_casters = { orange };
+
+		glm::vec3 camera_position = glm::vec3(0.f, 2.f, 3.f);
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f, 0.3f, -4.f), glm::vec3(0.f, 1.f, 0.f));
+
+		shadows::ShadowMaps shadow_maps;
+		shadow_maps.init();
+
+		struct variant {
+			const char* name;
+			bool shadows;
+			bool invalidate;									// Throw the static maps away every frame
+			bool dynamic;										// Move the dynamic caster every frame
+		};
+		const variant variants[] = {
+			{ "no shadows", false, false, false },
+			{ "uncached", true, true, false },
+			{ "cached, nothing moving", true, false, false },
+			{ "cached, one dynamic caster", true, false, true },
+		};
+
+		for (const variant& v : variants) {
+			shadows::ShadowStats totals;
+			auto draw_frame = [&](int frame) {
+				if (v.shadows) {
+					if (v.invalidate)
+						shadow_maps.invalidate_static();
+
+					static const std::vector<Model> no_casters;
+					dynamic_casters[0].model = glm::translate(glm::mat4(1.f), glm::vec3(-3.f + 0.3f * (frame % 20), 0.6f, -3.f));
+					dynamic_casters[0].model = glm::scale(dynamic_casters[0].model, glm::vec3(0.3f));
+					shadow_maps.update(static_casters, v.dynamic ? dynamic_casters : no_casters, dir_light, point_light, view, projection);
+					models_bind_shadows(&shadow_maps);
+					totals.static_passes += shadow_maps.stats().static_passes;
+					totals.dynamic_passes += shadow_maps.stats().dynamic_passes;
+				}
+				else {
+					models_bind_shadows(nullptr);
+				}
+
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				for (const Model& model : static_casters)
+					draw_model(model, projection, view, point_light, dir_light, camera_position);
+				if (v.dynamic)
+					draw_model(dynamic_casters[0], projection, view, point_light, dir_light, camera_position);
+				glfwSwapBuffers(window);
+				glFinish();
+			};
+
+			draw_frame(0);										// Compile the variant and fill the cache outside the timing
+			totals = shadows::ShadowStats();
+
+			double start = now_ms();
+			for (int frame = 1; frame <= frames; ++frame)
+				draw_frame(frame);
+			double frame_ms = (now_ms() - start) / frames;
+
+			std::printf("%-26s frame %8.3f ms  %6.2f static %6.2f dynamic passes/frame\n",
+				v.name, frame_ms, (double)totals.static_passes / frames, (double)totals.dynamic_passes / frames);
+		}
+
+		models_bind_shadows(nullptr);
+		glfwTerminate();
+	}
+
+	void depth_prepass() {
+		const int frames = 10;
+		const int width = 1280, height = 720;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+
+		/**
+		 * The deferred benchmark's floor and rows of oranges at a grazing angle, drawn
+		 * back to front (worst case) and front to back (best case, little to save),
+		 * and back to front again under 256 clustered lights so fragments cost more.
+		 */
+		std::vector<Model> back_to_front;
+		Model floor = get_desk_model("data/wood.jpg");
+		floor.model = glm::scale(glm::mat4(1.f), glm::vec3(20.f, 1.f, 20.f));
+		back_to_front.push_back(floor);
+
+		Model orange = get_orange_model("data/orange.jpg");
+		for (int z = 0; z < 24; ++z) {
+			for (int x = 0; x < 24; ++x) {
+				orange.model = glm::translate(glm::mat4(1.f), glm::vec3(-6.f + x * 0.5f, 0.3f, -12.f + z * 0.5f));
+				orange.model = glm::scale(orange.model, glm::vec3(0.3f));
+				back_to_front.push_back(orange);
+			}
+		}
+		std::vector<Model> front_to_back(back_to_front.rbegin(), back_to_front.rend());
+
+		glm::vec3 camera_position = glm::vec3(0.f, 1.f, 3.f);
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f, 0.3f, -4.f), glm::vec3(0.f, 1.f, 0.f));
+
+		std::mt19937 rng(330);
+		std::uniform_real_distribution<float> spread_x(-6.f, 6.f);
+		std::uniform_real_distribution<float> spread_z(-12.f, 2.f);
+		std::vector<RadiantLight> lights(256);
+		for (RadiantLight& light : lights) {
+			light.position = glm::vec3(spread_x(rng), 0.6f, spread_z(rng));
+			light.color = glm::vec3(0.3f);
+			light.attenuation_coefficients = glm::vec3(1.f, 1.4f, 7.2f);
+			light.radius = light_radius(light.attenuation_coefficients, light.color);
+		}
+		clustered::ClusterGrid grid;
+		grid.init();
+		grid.assign(lights, view, projection);
+		grid.upload(lights);
+
+		struct order {
+			const char* name;
+			const std::vector<Model>* scene;
+			bool clustered;
+		};
+		const order orders[] = {
+			{ "back to front", &back_to_front, false },
+			{ "front to back", &front_to_back, false },
+			{ "256 lights", &back_to_front, true },
+		};
+		const prepass::Mode modes[] = { prepass::Mode::OFF, prepass::Mode::ON, prepass::Mode::AUTO };
+		const char* mode_names[] = { "auto", "on", "off" };
+
+		for (const order& o : orders) {
+			models_bind_light_grid(o.clustered ? &grid : nullptr, width, height);
+
+			for (prepass::Mode mode : modes) {
+				prepass::DepthPrepass depth_prepass;
+				depth_prepass.settings.probe_interval = 5;		// Settle within the warm-up frames
+				depth_prepass.init();
+				depth_prepass.mode = mode;
+
+				unsigned int active_frames = 0;
+				auto draw_frame = [&]() {
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					if (depth_prepass.begin_frame(width, height)) {
+						depth_prepass.begin_depth();
+						for (const Model& model : *o.scene)
+							draw_model_depth(model, projection, view);
+						++active_frames;
+					}
+					depth_prepass.begin_color();
+					for (const Model& model : *o.scene)
+						draw_model(model, projection, view, point_light, dir_light, camera_position);
+					depth_prepass.end_frame();
+					glfwSwapBuffers(window);
+					glFinish();
+				};
+
+				for (int frame = 0; frame < 8; ++frame)
+					draw_frame();								// Compile shaders and let the automatic mode settle outside the timing
+				active_frames = 0;
+
+				double start = now_ms();
+				for (int frame = 0; frame < frames; ++frame)
+					draw_frame();
+				double frame_ms = (now_ms() - start) / frames;
+
+				/**
+				 * Overdraw is only known once a pre-pass frame has measured the visible
+				 * fragments.
+				 */
+				const prepass::PrepassStats& stats = depth_prepass.stats();
+				char overdraw[16] = "    -";
+				if (stats.visible_samples > 0)
+					std::snprintf(overdraw, sizeof(overdraw), "%5.2fx", stats.overdraw);
+
+				std::printf("%-13s pre-pass %-4s frame %8.3f ms  %2u/%d frames with pre-pass  overdraw %s  %5.2f lit fragments/pixel\n",
+					o.name, mode_names[(int)mode], frame_ms, active_frames, frames, overdraw,
+					(double)stats.lit_samples / ((double)width * height));
+			}
+		}
+
+		models_bind_light_grid(nullptr, width, height);
+		glfwTerminate();
+	}
+
+	void lightmap_baking() {
+		GLFWwindow* window = open_hidden_context(64, 64);
+		if (window == nullptr)
+			return;
+
+		models_init();
+
+		/**
+		 * Part of the desk scene, read back once; the bake itself needs no context.
+		 * Low resolution and sample counts keep each run to a few seconds.
+		 */
+		std::vector<lightmaps::BakeMesh> meshes;
+		meshes.push_back(lightmaps::gather(get_desk_model("data/wood.jpg")));
+		meshes.push_back(lightmaps::gather(get_orange_model("data/orange.jpg")));
+		meshes.push_back(lightmaps::gather(get_soda_model("data/soda.jpg")));
+		glfwTerminate();
+
+		DirectionalLight light = get_directional_light();
+		lightmaps::BakeSettings settings;
+		settings.resolution = 128;
+		settings.samples = 16;
+
+		unsigned int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+		double single_thread_ms = 0.0;
+
+		for (unsigned int threads = 1; ; threads *= 2) {
+			threads = std::min(threads, hardware_threads);
+			settings.thread_count = threads;
+
+			lightmaps::BakeStats stats;
+			lightmaps::bake(meshes, light, settings, stats);
+			if (threads == 1)
+				single_thread_ms = stats.trace_ms;
+
+			std::printf("%2u threads  %u triangles  %u texels  BVH build %7.2f ms  trace %9.2f ms  %6.2f Mrays/s  speedup %5.2fx\n",
+				stats.threads, stats.triangles, stats.texels, stats.build_ms, stats.trace_ms,
+				stats.rays / (stats.trace_ms * 1000.0), single_thread_ms / stats.trace_ms);
+
+			if (threads == hardware_threads)
+				break;
+		}
+	}
+
+	void light_sprites() {
+		const int frames = 20;
+		const int width = 1280, height = 720;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(glm::vec3(0.f, 4.f, 8.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+
+		std::mt19937 rng(330);
+		std::uniform_real_distribution<float> spread(-5.f, 5.f);
+		std::uniform_real_distribution<float> channel(0.f, 1.f);
+
+		for (int count : { 256, 1024, 4096 }) {
+			std::vector<RadiantLight> lights;
+			for (int i = 0; i < count; ++i) {
+				lights.push_back(get_point_light(glm::vec3(spread(rng), spread(rng) * 0.2f, spread(rng)),
+					glm::vec3(channel(rng), channel(rng), channel(rng)), glm::vec3(1.f, 1.4f, 7.2f)));
+			}
+
+			struct variant {
+				const char* name;
+				bool instanced;
+			};
+			const variant variants[] = {
+				{ "one draw per light", false },
+				{ "instanced", true },
+			};
+
+			for (const variant& v : variants) {
+				auto draw_frame = [&]() {
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					if (v.instanced) {
+						draw_radiant_lights(lights, projection, view);
+					}
+					else {
+						for (const RadiantLight& light : lights)
+							draw_radiant_light(light, projection, view);
+					}
+					glfwSwapBuffers(window);
+					glFinish();
+				};
+
+				draw_frame();
+				double start = now_ms();
+				for (int frame = 0; frame < frames; ++frame)
+					draw_frame();
+				double frame_ms = (now_ms() - start) / frames;
+
+				std::printf("%5d lights  %-19s frame %8.3f ms  %5d draws\n", count, v.name, frame_ms, v.instanced ? 1 : count);
+			}
+		}
+
+		glfwTerminate();
+	}
+
+	void debug_lines() {
+		const int frames = 20;
+		const int width = 1280, height = 720;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+
+		/**
+		 * The shadow benchmark's floor and oranges, with 256 light sprites over them.
+		 */
+		std::vector<Model> scene;
+		Model floor = get_desk_model("data/wood.jpg");
+		floor.model = glm::scale(glm::mat4(1.f), glm::vec3(20.f, 1.f, 20.f));
+		scene.push_back(floor);
+
+		Model orange = get_orange_model("data/orange.jpg");
+		for (int z = 0; z < 14; ++z) {
+			for (int x = 0; x < 14; ++x) {
+				orange.model = glm::translate(glm::mat4(1.f), glm::vec3(-3.5f + x * 0.5f, 0.3f, -7.f + z * 0.5f));
+				orange.model = glm::scale(orange.model, glm::vec3(0.3f));
+				scene.push_back(orange);
+			}
+		}
+
+		std::mt19937 rng(330);
+		std::uniform_real_distribution<float> spread(-4.f, 4.f);
+		std::vector<RadiantLight> lights(256);
+		for (RadiantLight& light : lights) {
+			light.position = glm::vec3(spread(rng), 0.6f, spread(rng) - 3.f);
+			light.color = glm::vec3(0.3f);
+			light.attenuation_coefficients = glm::vec3(1.f, 1.4f, 7.2f);
+			light.radius = light_radius(light.attenuation_coefficients, light.color);
+		}
+
+		glm::vec3 camera_position = glm::vec3(0.f, 2.f, 3.f);
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f, 0.3f, -4.f), glm::vec3(0.f, 1.f, 0.f));
+
+		debug_draw::LineBatch batch;
+		batch.init();
+
+		const debug_draw::Level levels[] = { debug_draw::Level::OFF, debug_draw::Level::GIZMOS, debug_draw::Level::NORMALS };
+		const char* level_names[] = { "off", "gizmos", "gizmos + normals" };
+
+		for (debug_draw::Level level : levels) {
+			double build_ms = 0.0;
+			auto draw_frame = [&]() {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				for (const Model& model : scene)
+					draw_model(model, projection, view, point_light, dir_light, camera_position);
+
+				if (level != debug_draw::Level::OFF) {
+					double start = now_ms();
+					batch.clear();
+					for (const Model& model : scene)
+						batch.box(bvh::model_bounds(model), glm::vec3(0.f, 1.f, 0.f));
+					for (const RadiantLight& light : lights)
+						batch.light_radius(light);
+					if (level == debug_draw::Level::NORMALS) {
+						for (const Model& model : scene)
+							batch.normals(model, 0.05f, glm::vec3(1.f, 1.f, 0.f));
+					}
+					build_ms += now_ms() - start;
+					batch.draw(projection, view);
+					draw_radiant_lights(lights, projection, view);
+				}
+				glfwSwapBuffers(window);
+				glFinish();
+			};
+
+			draw_frame();										// Compile shaders and fill the normal cache outside the timing
+			build_ms = 0.0;
+
+			double start = now_ms();
+			for (int frame = 0; frame < frames; ++frame)
+				draw_frame();
+			double frame_ms = (now_ms() - start) / frames;
+
+			std::printf("%-17s frame %8.3f ms  batch build %7.3f ms  %7zu lines in %3zu draws\n",
+				level_names[(int)level], frame_ms, build_ms / frames, level == debug_draw::Level::OFF ? (size_t)0 : batch.line_count(),
+				level == debug_draw::Level::OFF ? (size_t)0 : batch.draw_count());
+		}
+
+		glfwTerminate();
+	}
+
+	void dynamic_resolution() {
+		const int frames = 40;
+		const int width = 1280, height = 720;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+
+		/**
+		 * A floor and a few oranges under 256 clustered lights, seen at a grazing angle:
+		 * a fragment-heavy frame.
+		 */
+		std::vector<Model> scene;
+		Model floor = get_desk_model("data/wood.jpg");
+		floor.model = glm::scale(glm::mat4(1.f), glm::vec3(20.f, 1.f, 20.f));
+		scene.push_back(floor);
+
+		Model orange = get_orange_model("data/orange.jpg");
+		for (int z = 0; z < 8; ++z) {
+			for (int x = 0; x < 8; ++x) {
+				orange.model = glm::translate(glm::mat4(1.f), glm::vec3(-2.f + x * 0.5f, 0.3f, -4.f + z * 0.5f));
+				orange.model = glm::scale(orange.model, glm::vec3(0.3f));
+				scene.push_back(orange);
+			}
+		}
+
+		glm::vec3 camera_position = glm::vec3(0.f, 1.f, 3.f);
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f, 0.3f, -4.f), glm::vec3(0.f, 1.f, 0.f));
+
+		std::mt19937 rng(330);
+		std::uniform_real_distribution<float> spread_x(-6.f, 6.f);
+		std::uniform_real_distribution<float> spread_z(-12.f, 2.f);
+		std::vector<RadiantLight> lights(256);
+		for (RadiantLight& light : lights) {
+			light.position = glm::vec3(spread_x(rng), 0.6f, spread_z(rng));
+			light.color = glm::vec3(0.3f);
+			light.attenuation_coefficients = glm::vec3(1.f, 1.4f, 7.2f);
+			light.radius = light_radius(light.attenuation_coefficients, light.color);
+		}
+		clustered::ClusterGrid grid;
+		grid.init();
+		grid.assign(lights, view, projection);
+		grid.upload(lights);
+
+		resolution::DynamicResolution scaler;
+		scaler.init();
+
+		auto draw_frame = [&](bool scaled) {
+			int render_width = width, render_height = height;
+			if (scaled) {
+				scaler.begin_frame(width, height);
+				render_width = scaler.width();
+				render_height = scaler.height();
+			}
+			else {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			}
+
+			models_bind_light_grid(&grid, render_width, render_height);
+			for (const Model& model : scene)
+				draw_model(model, projection, view, point_light, dir_light, camera_position);
+
+			if (scaled)
+				scaler.end_frame();
+			glfwSwapBuffers(window);
+			glFinish();
+		};
+
+		/**
+		 * Time full resolution, then give the scaler 70% of that as its budget. Not all
+		 * of a frame's cost scales with its pixel count.
+		 */
+		draw_frame(false);
+		double start = now_ms();
+		for (int frame = 0; frame < 10; ++frame)
+			draw_frame(false);
+		double full_ms = (now_ms() - start) / 10;
+		std::printf("full resolution %dx%d  frame %8.3f ms\n", width, height, full_ms);
+
+		scaler.settings.target_ms = (float)(full_ms * 0.7);
+		std::printf("budget %.3f ms\n", scaler.settings.target_ms);
+
+		double settled_ms = 0.0;
+		for (int frame = 1; frame <= frames; ++frame) {
+			double frame_start = now_ms();
+			draw_frame(true);
+			double frame_ms = now_ms() - frame_start;
+			if (frame > frames - 10)
+				settled_ms += frame_ms / 10;
+
+			if (frame % 10 == 0) {
+				std::printf("frame %3d  scale %4.2f  %4dx%-4d  GPU %8.3f ms  frame %8.3f ms\n",
+					frame, scaler.stats().scale, scaler.width(), scaler.height(), scaler.stats().gpu_ms, frame_ms);
+			}
+		}
+		std::printf("settled frame %8.3f ms (%.0f%% of budget)\n", settled_ms, 100.0 * settled_ms / scaler.settings.target_ms);
+
+		models_bind_light_grid(nullptr, width, height);
+		glfwTerminate();
+	}
+
+	void antialiasing_cost() {
+		const int frames = 20;
+		const int resolutions[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+		const int samples = 4;
+
+		GLFWwindow* window = open_hidden_context(1920, 1080);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+
+		std::vector<Model> scene = {
+			get_desk_model("data/wood.jpg"),
+			get_switch_model("data/switch.jpg"),
+			get_napkin_model("data/napkin.jpg"),
+			get_orange_model("data/orange.jpg"),
+			get_soda_model("data/soda.jpg"),
+		};
+		glm::vec3 camera_position = glm::vec3(0.f, 0.f, 3.f);
+		glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+
+		antialiasing::Fxaa fxaa;
+		fxaa.init();
+		resolution::DynamicResolution offscreen;
+		offscreen.adaptive = false;						// Always full size: FXAA's own cost only
+		offscreen.init();
+
+		GLint max_samples = 0;
+		glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+		if (max_samples < samples)
+			std::printf("%dx MSAA not supported (GL_MAX_SAMPLES %d), skipped\n", samples, max_samples);
+
+		const char* mode_names[] = { "none", "FXAA", "4x MSAA" };
+		for (const auto& resolution : resolutions) {
+			int width = resolution[0], height = resolution[1];
+			glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+
+			/**
+			 * The MSAA target: multisampled colour and depth renderbuffers, resolved into
+			 * the window with a blit.
+			 */
+			unsigned int msaa_framebuffer = 0, msaa_renderbuffers[2] = { 0, 0 };
+			if (max_samples >= samples) {
+				glGenRenderbuffers(2, msaa_renderbuffers);
+				glBindRenderbuffer(GL_RENDERBUFFER, msaa_renderbuffers[0]);
+				glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+				glBindRenderbuffer(GL_RENDERBUFFER, msaa_renderbuffers[1]);
+				glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+				glGenFramebuffers(1, &msaa_framebuffer);
+				glBindFramebuffer(GL_FRAMEBUFFER, msaa_framebuffer);
+				glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msaa_renderbuffers[0]);
+				glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, msaa_renderbuffers[1]);
+				if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+					std::cerr << "ERROR::FRAMEBUFFER::MSAA::INCOMPLETE" << std::endl;
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			}
+
+			/**
+			 * Extra memory over drawing straight into the window: an RGBA8 colour and a
+			 * 32-bit depth target for FXAA, samples times both for MSAA (the window
+			 * itself receives the resolve).
+			 */
+			double pixels_mb = (double)width * height / (1024.0 * 1024.0);
+			double memory_mb[] = { 0.0, pixels_mb * 8.0, pixels_mb * 8.0 * samples };
+
+			for (int mode = 0; mode < 3; ++mode) {
+				if (mode == 2 && msaa_framebuffer == 0)
+					continue;
+
+				auto draw_frame = [&]() {
+					if (mode == 1) {
+						offscreen.begin_frame(width, height);
+					}
+					else {
+						glBindFramebuffer(GL_FRAMEBUFFER, mode == 2 ? msaa_framebuffer : 0);
+						glViewport(0, 0, width, height);
+						glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					}
+
+					for (const Model& model : scene)
+						draw_model(model, projection, view, point_light, dir_light, camera_position);
+
+					if (mode == 1) {
+						offscreen.end_frame(&fxaa);
+					}
+					else if (mode == 2) {
+						glBindFramebuffer(GL_READ_FRAMEBUFFER, msaa_framebuffer);
+						glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+						glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+						glBindFramebuffer(GL_FRAMEBUFFER, 0);
+					}
+					glfwSwapBuffers(window);
+					glFinish();
+				};
+
+				draw_frame();									// Compile shaders and allocate targets outside the timing
+				double start = now_ms();
+				for (int frame = 0; frame < frames; ++frame)
+					draw_frame();
+				double frame_ms = (now_ms() - start) / frames;
+
+				std::printf("%4dx%-4d  %-8s frame %8.3f ms  extra memory %6.1f MB\n",
+					width, height, mode_names[mode], frame_ms, memory_mb[mode]);
+			}
+
+			if (msaa_framebuffer != 0) {
+				glDeleteFramebuffers(1, &msaa_framebuffer);
+				glDeleteRenderbuffers(2, msaa_renderbuffers);
+			}
+		}
+
+		glfwTerminate();
+	}
+
+	void ambient_occlusion_cost() {
+		const int frames = 10;
+		const int resolutions[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+
+		for (const auto& resolution : resolutions) {
+			const int width = resolution[0], height = resolution[1];
+
+			GLFWwindow* window = open_hidden_context(width, height);
+			if (window == nullptr)
+				return;
+
+			lights_init();
+			models_init();
+			RadiantLight point_light = get_point_light();
+			DirectionalLight dir_light = get_directional_light();
+
+			/**
+			 * Oranges resting on a floor, seen from above: plenty of contact areas.
+			 */
+			std::vector<Model> scene;
+			Model floor = get_desk_model("data/wood.jpg");
+			floor.model = glm::scale(glm::mat4(1.f), glm::vec3(20.f, 1.f, 20.f));
+			scene.push_back(floor);
+
+			Model orange = get_orange_model("data/orange.jpg");
+			for (int z = 0; z < 8; ++z) {
+				for (int x = 0; x < 8; ++x) {
+					orange.model = glm::translate(glm::mat4(1.f), glm::vec3(-2.f + x * 0.5f, 0.15f, -4.f + z * 0.5f));
+					orange.model = glm::scale(orange.model, glm::vec3(0.3f));
+					scene.push_back(orange);
+				}
+			}
+
+			glm::vec3 camera_position = glm::vec3(0.f, 2.f, 2.f);
+			glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+			glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f, 0.f, -2.f), glm::vec3(0.f, 1.f, 0.f));
+
+			deferred::DeferredRenderer renderer;
+			renderer.init(width, height);
+			ssao::AmbientOcclusion ambient_occlusion;
+			ambient_occlusion.init();
+
+			const char* mode_names[] = { "off", "half", "quarter" };
+			for (int mode = 0; mode < 3; ++mode) {
+				ambient_occlusion.settings.resolution_divisor = mode == 1 ? 2 : 4;
+				renderer.ambient_occlusion = mode == 0 ? nullptr : &ambient_occlusion;
+
+				auto draw_frame = [&]() {
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					renderer.begin_geometry();
+					for (const Model& model : scene)
+						draw_model_gbuffer(model, projection, view);
+					renderer.shade(projection, view, point_light, dir_light, camera_position, nullptr, nullptr);
+					glfwSwapBuffers(window);
+					glFinish();
+				};
+
+				draw_frame();									// Compile the variant and allocate the targets outside the timing
+				double start = now_ms();
+				for (int frame = 0; frame < frames; ++frame)
+					draw_frame();
+				double frame_ms = (now_ms() - start) / frames;
+
+				if (mode == 0) {
+					std::printf("%4dx%-4d SSAO %-7s frame %8.3f ms\n", width, height, mode_names[mode], frame_ms);
+					continue;
+				}
+
+				/**
+				 * Texture fetches per full-resolution pixel: depth, normal, history and one
+				 * depth per sample at the reduced resolution, then the 4-tap upsample.
+				 */
+				int divisor = ambient_occlusion.settings.resolution_divisor;
+				float fetches = (3.f + ambient_occlusion.settings.samples) / (divisor * divisor) + 4.f;
+				std::printf("%4dx%-4d SSAO %-7s frame %8.3f ms  AO pass %4dx%-4d GPU %8.3f ms  %4.1f fetches/pixel\n",
+					width, height, mode_names[mode], frame_ms, ambient_occlusion.stats().width, ambient_occlusion.stats().height,
+					ambient_occlusion.stats().gpu_ms, fetches);
+			}
+
+			glfwTerminate();
+		}
+	}
+
+	void reflection_probes_cost() {
+		const int frames = 30;
+		const int width = 1280, height = 720;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+		point_light.position = glm::vec3(0.f, 2.f, -1.f);
+
+		/**
+		 * The SSAO benchmark's oranges on a floor, with one more orange rolling
+		 * between them as the only thing that moves.
+		 */
+		std::vector<Model> scene;
+		Model floor = get_desk_model("data/wood.jpg");
+		floor.model = glm::scale(glm::mat4(1.f), glm::vec3(20.f, 1.f, 20.f));
+		scene.push_back(floor);
+
+		Model orange = get_orange_model("data/orange.jpg");
+		for (int z = 0; z < 8; ++z) {
+			for (int x = 0; x < 8; ++x) {
+				orange.model = glm::translate(glm::mat4(1.f), glm::vec3(-2.f + x * 0.5f, 0.15f, -4.f + z * 0.5f));
+				orange.model = glm::scale(orange.model, glm::vec3(0.3f));
+				scene.push_back(orange);
+			}
+		}
+		Model rolling = orange;
+
+		glm::vec3 camera_position = glm::vec3(0.f, 2.f, 2.f);
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, 0.1f, 100.f);
+		glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f, 0.f, -2.f), glm::vec3(0.f, 1.f, 0.f));
+
+		reflections::ReflectionProbes probes;
+		probes.init();
+		bvh::AABB room;
+		room.min = glm::vec3(-10.f, -0.1f, -10.f);
+		room.max = glm::vec3(10.f, 5.f, 10.f);
+		probes.add_probe(glm::vec3(-1.f, 0.5f, -1.f), room);
+		probes.add_probe(glm::vec3(1.f, 0.5f, -3.f), room);
+
+		struct variant {
+			const char* name;
+			bool probes;
+			bool every_frame;									// Refresh every probe completely every frame
+			bool moving;										// Move an orange and invalidate what it touches every frame
+		};
+		const variant variants[] = {
+			{ "no probes", false, false, false },
+			{ "refreshed every frame", true, true, false },
+			{ "amortized, one moving", true, false, true },
+			{ "amortized, nothing moving", true, false, false },
+		};
+
+		auto draw_probe_face = [&](const glm::mat4& probe_projection, const glm::mat4& probe_view, glm::vec3 eye) {
+			for (const Model& model : scene)
+				draw_model(model, probe_projection, probe_view, point_light, dir_light, eye);
+			draw_model(rolling, probe_projection, probe_view, point_light, dir_light, eye);
+		};
+
+		for (const variant& v : variants) {
+			unsigned int faces = 0, mips = 0;
+			double worst_ms = 0.;
+			auto draw_frame = [&](int frame) {
+				rolling.model = glm::translate(glm::mat4(1.f), glm::vec3(-2.f + 0.2f * (frame % 20), 0.15f, -1.75f));
+				rolling.model = glm::scale(rolling.model, glm::vec3(0.3f));
+
+				models_bind_reflections(nullptr);
+				if (v.probes) {
+					probes.settings.steps_per_frame = v.every_frame ? reflections::STEPS * (int)probes.size() : 1;
+					if (v.every_frame)
+						probes.invalidate_all();
+					if (v.moving)
+						probes.invalidate(bvh::model_bounds(rolling));
+					probes.update(draw_probe_face);
+					faces += probes.stats().faces_rendered;
+					mips += probes.stats().mips_filtered;
+					models_bind_reflections(&probes);
+				}
+
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				for (const Model& model : scene)
+					draw_model(model, projection, view, point_light, dir_light, camera_position);
+				draw_model(rolling, projection, view, point_light, dir_light, camera_position);
+				glfwSwapBuffers(window);
+				glFinish();
+			};
+
+			/**
+			 * Start every variant with the probes up to date, as they are once the scene
+			 * has run for a moment, and compile the variants outside the timing.
+			 */
+			probes.invalidate_all();
+			probes.settings.steps_per_frame = 2 * reflections::STEPS * (int)probes.size();	// Also finishes a refresh the last variant left in progress
+			probes.update(draw_probe_face);
+			draw_frame(0);
+			faces = mips = 0;
+
+			double start = now_ms();
+			for (int frame = 1; frame <= frames; ++frame) {
+				double frame_start = now_ms();
+				draw_frame(frame);
+				worst_ms = std::max(worst_ms, now_ms() - frame_start);
+			}
+			double frame_ms = (now_ms() - start) / frames;
+
+			std::printf("%-26s frame %8.3f ms  worst %8.3f ms  %5.2f faces %5.2f mips/frame\n",
+				v.name, frame_ms, worst_ms, (double)faces / frames, (double)mips / frames);
+		}
+
+		models_bind_reflections(nullptr);
+		glfwTerminate();
+	}
+
+	void visibility_buffer_cost() {
+		const int frames = 5;
+		const int width = 1280, height = 720;
+
+		GLFWwindow* window = open_hidden_context(width, height);
+		if (window == nullptr)
+			return;
+
+		lights_init();
+		models_init();
+		RadiantLight point_light = get_point_light();
+		DirectionalLight dir_light = get_directional_light();
+
+		Model floor = get_desk_model("data/wood.jpg");
+		Model soda = get_soda_model("data/soda.jpg");
+		glm::mat4 can_shape = soda.model;
+		can_shape[3] = glm::vec4(0.f, 0.f, 0.f, 1.f);			// Scale and rotation only
+
+		deferred::DeferredRenderer deferred_renderer;
+		deferred_renderer.init(width, height);
+		visibility::VisibilityRenderer visibility_renderer;
+		visibility_renderer.init(width, height);
+
+		/**
+		 * A square grid of soda cans on a floor, with the camera backing away as the grid
+		 * grows so it covers about the same part of the screen: the denser the grid, the
+		 * smaller the cans and their triangles.
+		 */
+		const int grid_sizes[] = { 4, 8, 16, 32 };
+		for (int grid_size : grid_sizes) {
+			const float spacing = 0.2f;
+			float extent = grid_size * spacing;
+
+			std::vector<Model> scene;
+			floor.model = glm::scale(glm::mat4(1.f), glm::vec3(extent, 1.f, extent));
+			scene.push_back(floor);
+			for (int z = 0; z < grid_size; ++z) {
+				for (int x = 0; x < grid_size; ++x) {
+					soda.model = glm::translate(glm::mat4(1.f), glm::vec3((x - grid_size * 0.5f + 0.5f) * spacing, 0.08f, (z - grid_size * 0.5f + 0.5f) * spacing)) * can_shape;
+					scene.push_back(soda);
+				}
+			}
+			unsigned long long triangles = 0;
+			for (const Model& model : scene)
+				triangles += model.number_of_vertices / 3;
+
+			glm::vec3 camera_position = glm::vec3(0.f, extent * 0.5f, extent * 0.9f);
+			glm::mat4 projection = glm::perspective(glm::radians(45.f), (float)width / (float)height, extent * 0.05f, extent * 4.f);
+			glm::mat4 view = glm::lookAt(camera_position, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+
+			const char* path_names[] = { "forward", "deferred", "visibility buffer" };
+			for (int path = 0; path < 3; ++path) {
+				auto draw_frame = [&]() {
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					if (path == 0) {
+						for (const Model& model : scene)
+							draw_model(model, projection, view, point_light, dir_light, camera_position);
+					}
+					else if (path == 1) {
+						deferred_renderer.begin_geometry();
+						for (const Model& model : scene)
+							draw_model_gbuffer(model, projection, view);
+						deferred_renderer.shade(projection, view, point_light, dir_light, camera_position, nullptr, nullptr);
+					}
+					else {
+						visibility_renderer.begin_geometry();
+						for (const Model& model : scene)
+							visibility_renderer.draw(model, projection, view);
+						visibility_renderer.resolve(projection, view, point_light, dir_light, camera_position, nullptr, nullptr);
+					}
+					glfwSwapBuffers(window);
+					glFinish();
+				};
+
+				draw_frame();									// Compile shaders outside the timing
+				double start = now_ms();
+				for (int frame = 0; frame < frames; ++frame)
+					draw_frame();
+				double frame_ms = (now_ms() - start) / frames;
+
+				std::printf("%5d cans %6.2fM triangles  %-17s frame %8.3f ms\n",
+					grid_size * grid_size, triangles / 1e6, path_names[path], frame_ms);
+			}
+		}
+
+		glfwTerminate();
+	}
+
+	/**
+	 * The scene's textures, for the texture benchmarks.
+	 */
+	struct image {
+		const char* path;
+		textures::Usage usage;
+	};
+	static const image images[] = {
+		{ "data/wood.jpg", textures::Usage::ALBEDO },
+		{ "data/switch.jpg", textures::Usage::ALBEDO },
+		{ "data/orange.jpg", textures::Usage::ALBEDO },
+		{ "data/napkin.jpg", textures::Usage::ALBEDO },
+		{ "data/soda.jpg", textures::Usage::ALBEDO },
+		{ "data/switch_specular_map.jpg", textures::Usage::MASK },
+	};
+	static const int image_count = sizeof(images) / sizeof(images[0]);
+
+	static std::string bench_cache_path(const char* path) {
+		std::string name = cooker::cooked_path(path);
+		name = name.substr(name.find_last_of('/') + 1);
+		return name.substr(0, name.size() - 5) + ".texcache";		// In the working directory
+	}
+
+	void texture_loading() {
+		GLFWwindow* window = open_hidden_context(64, 64);
+		if (window == nullptr)
+			return;
+
+		unsigned int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+
+		/**
+		 * Cook every image into the working directory, so the cooked variants do not
+		 * depend on (or overwrite) what "--cook" left in data/.
+		 */
+		std::vector<std::string> cooked_paths;
+		cooker::CookSettings cook_settings;
+		cooker::CookStats cook_stats;
+		for (int i = 0; i < image_count; ++i) {
+			cooked_paths.push_back("bench_texture_" + std::to_string(i) + ".ktx2");
+			cooker::cook(images[i].path, cooked_paths.back(), images[i].usage, cook_settings, cook_stats);
+		}
+		std::printf("cooked on %u threads: decode %.2f ms, encode %.2f ms, %.1f MB to %.1f MB with mipmaps\n", cook_stats.threads,
+			cook_stats.decode_ms, cook_stats.encode_ms, cook_stats.source_bytes / (1024.0 * 1024.0), cook_stats.cooked_bytes / (1024.0 * 1024.0));
+
+		struct variant {
+			const char* name;
+			bool asynchronous;
+			unsigned int threads;
+			bool cooked;
+			bool s3tc;
+			int cache;								// 0 off, 1 written (first launch), 2 read (later launches)
+			bool progressive;
+			size_t budget;
+		};
+		const size_t budget = 4 * 1024 * 1024;
+		const variant variants[] = {
+			{ "serial, one at a time", false, 1, false, true, 0, false, 0 },
+			{ "async, 1 worker", true, 1, false, true, 0, false, 0 },
+			{ "async, all cores", true, hardware_threads, false, true, 0, false, 0 },
+			{ "cache, first launch", true, hardware_threads, false, true, 1, false, 0 },
+			{ "cache, later launch", true, hardware_threads, false, true, 2, false, 0 },
+			{ "cache, streamed", true, hardware_threads, false, true, 2, true, budget },
+			{ "cooked, all cores", true, hardware_threads, true, true, 0, false, 0 },
+			{ "cooked, no S3TC", true, hardware_threads, true, false, 0, false, 0 },
+			{ "cooked, streamed", true, hardware_threads, true, true, 0, true, budget },
+		};
+
+		/**
+		 * Cache files go in the working directory too, named after each image.
+		 */
+		std::vector<std::string> cache_paths;
+		for (int i = 0; i < image_count; ++i)
+			cache_paths.push_back(bench_cache_path(images[i].path));
+
+		/**
+		 * "first frame" is how long the GL thread is blocked before it could draw,
+		 * "preview" how long until no texture shows its placeholder, "resident" how long
+		 * until every texture holds its whole image, and "worst update" the longest the
+		 * loader held up a frame. Streamed variants upload at most 4 MB an update, the
+		 * others everything that is ready. The first round is not printed, so every
+		 * variant reads the files from the page cache.
+		 */
+		for (int round = 0; round < 2; ++round) {
+			for (const variant& v : variants) {
+				textures::LoaderSettings settings;
+				settings.thread_count = v.threads;
+				settings.upload_budget = v.budget;
+				settings.progressive = v.progressive;
+				settings.use_cooked = v.cooked;
+				settings.s3tc = v.s3tc;
+				settings.use_cache = v.cache != 0;
+				settings.cache_directory = "./";
+				if (v.cache == 1) {
+					for (const std::string& path : cache_paths)
+						std::remove(path.c_str());
+				}
+				textures::TextureLoader loader(settings);
+				loader.asynchronous = v.asynchronous;
+
+				std::vector<unsigned int> loaded;
+				double start = now_ms();
+				for (int i = 0; i < image_count; ++i)
+					loaded.push_back(loader.load(v.cooked ? cooked_paths[i].c_str() : images[i].path, images[i].usage));
+				double first_frame_ms = now_ms() - start;
+				double preview_ms = loader.placeholders() == 0 ? first_frame_ms : 0.0, worst_update_ms = 0.0;
+				while (loader.pending() > 0) {
+					double update_start = now_ms();
+					loader.update();						// As the render loop would, minus the frames
+					glFinish();
+					worst_update_ms = std::max(worst_update_ms, now_ms() - update_start);
+					if (preview_ms == 0.0 && loader.placeholders() == 0)
+						preview_ms = now_ms() - start;
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				glFinish();
+				double resident_ms = now_ms() - start;
+
+				if (round == 1) {
+					std::printf("%-22s %u threads  first frame %7.2f ms  preview %7.2f ms  resident %7.2f ms  worst update %7.2f ms  decode sum %7.2f ms  slowest %7.2f ms  %6.1f MB\n",
+						v.name, v.threads, first_frame_ms, preview_ms, resident_ms, worst_update_ms, loader.stats().decode_ms,
+						loader.stats().slowest_decode_ms, loader.stats().texture_bytes / (1024.0 * 1024.0));
+				}
+				glDeleteTextures((GLsizei)loaded.size(), loaded.data());
+			}
+		}
+		std::printf("%d textures; MB is level 0, with the specular map as R8 or BC4\n", image_count);
+
+		for (const std::string& path : cooked_paths)
+			std::remove(path.c_str());
+		for (const std::string& path : cache_paths)
+			std::remove(path.c_str());
+		glfwTerminate();
+	}
+
+	void texture_residency() {
+		GLFWwindow* window = open_hidden_context(64, 64);
+		if (window == nullptr)
+			return;
+
+		/**
+		 * Cache every image first, so the measured loader reads levels it can give up
+		 * and read again.
+		 */
+		textures::LoaderSettings settings;
+		settings.use_cooked = false;
+		settings.cache_directory = "./";
+		settings.upload_budget = 0;
+		{
+			textures::TextureLoader primer(settings);
+			for (int i = 0; i < image_count; ++i) {
+				unsigned int texture = primer.load(images[i].path, images[i].usage);
+				glDeleteTextures(1, &texture);
+			}
+		}
+
+		/**
+		 * 24 Models, four with each image, as a scene of repeated props would load them.
+		 */
+		settings.idle_frames = 30;
+		textures::TextureLoader loader(settings);
+		std::vector<unsigned int> references;
+		for (int copy = 0; copy < 4; ++copy) {
+			for (int i = 0; i < image_count; ++i)
+				references.push_back(loader.load(images[i].path, images[i].usage));
+		}
+		loader.finish();
+		size_t full = loader.resident_bytes();
+		std::printf("%u loads: %u textures, %u shared, %.1f MB\n", loader.stats().requested, loader.loaded(), loader.stats().shared, full / (1024.0 * 1024.0));
+
+		/**
+		 * Use one image at a time, 40 frames each, within half the memory they take.
+		 */
+		loader.settings.memory_budget = full / 2;
+		size_t peak = 0, lowest = full;
+		int over_budget = 0;
+		double worst_update_ms = 0.0;
+		for (int frame = 0; frame < 240; ++frame) {
+			int used = (frame / 40) % image_count;
+			for (int copy = 0; copy < 4; ++copy)
+				loader.prioritize(references[copy * image_count + used], 1.f);
+
+			double start = now_ms();
+			loader.update();
+			glFinish();
+			worst_update_ms = std::max(worst_update_ms, now_ms() - start);
+			peak = std::max(peak, loader.resident_bytes());
+			lowest = std::min(lowest, loader.resident_bytes());
+			over_budget += loader.resident_bytes() > loader.settings.memory_budget ? 1 : 0;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		std::printf("budget %.1f MB: resident %.1f-%.1f MB, %d of 240 frames over, %u levels given up, %u textures read again, worst update %.2f ms\n",
+			loader.settings.memory_budget / (1024.0 * 1024.0), lowest / (1024.0 * 1024.0), peak / (1024.0 * 1024.0), over_budget,
+			loader.stats().dropped_levels, loader.stats().restreamed, worst_update_ms);
+
+		/**
+		 * Release the first three images' Models: within the budget they stay loaded,
+		 * for the next load of the same paths, until memory is needed or there is no
+		 * budget.
+		 */
+		loader.finish();
+		for (int copy = 0; copy < 4; ++copy) {
+			for (int i = 0; i < 3; ++i)
+				loader.release(references[copy * image_count + i]);
+		}
+		loader.update();
+		std::printf("3 images released: %u textures, %u evicted, %.1f MB\n", loader.loaded(), loader.stats().evicted, loader.resident_bytes() / (1024.0 * 1024.0));
+		loader.settings.memory_budget = 0;
+		loader.update();
+		std::printf("no budget: %u textures, %u evicted, %.1f MB\n", loader.loaded(), loader.stats().evicted, loader.resident_bytes() / (1024.0 * 1024.0));
+
+		for (int i = 0; i < image_count; ++i)
+			std::remove(bench_cache_path(images[i].path).c_str());
+		glfwTerminate();
+	}
+}
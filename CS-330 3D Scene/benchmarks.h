@@ -0,0 +1,33 @@
+/**
+ * "benchmarks.h" - Function prototypes for the command-line benchmarks. Run with
+ *		"--bench [name]"; with no name every benchmark is run. Results are printed to
+ *		stdout. Function implementations defined in "benchmarks.cpp".
+ */
+#pragma once
+#ifndef __BENCHMARKS_H__
+#define __BENCHMARKS_H__
+
+namespace bench {
+	int run(int argc, char* argv[]);	// Entry point for "--bench". Returns the process exit code
+
+	void frustum_culling();				// Scalar vs SIMD frustum culling of 100k bounding volumes
+	void bvh_scaling();					// BVH build, refit and query times at several scene sizes
+	void occlusion_culling();			// Frame time and skipped draws with occlusion queries, in a hidden window
+	void clustered_lighting();			// Cluster assignment (scalar vs SIMD) and frame time as the light count grows
+	void instance_culling();			// CPU vs transform feedback culling of a 200k instance field, in a hidden window
+	void deferred_shading();			// Forward vs deferred frame time across light counts and resolutions
+	void shading_cost();				// Fragment shading cost (ns/pixel) of each Model shader variant on full-screen quads
+	void shadow_caching();				// Frame time without shadows, with uncached shadow maps and with cached ones
+	void depth_prepass();				// Forward frame time and overdraw with the depth pre-pass off, on and automatic
+	void lightmap_baking();				// Lightmap bake time and ray throughput as the thread count grows
+	void light_sprites();				// Light gizmo draw time, one draw per light vs one instanced draw
+	void debug_lines();					// Frame time and line counts with the batched debug lines off, gizmos only and with normals
+	void dynamic_resolution();			// Render scale and GPU frame time as dynamic resolution settles on a budget
+	void antialiasing_cost();			// Frame time and target memory with no anti-aliasing, FXAA and 4x MSAA
+	void ambient_occlusion_cost();		// Deferred frame time and SSAO pass GPU time at half and quarter resolution
+	void reflection_probes_cost();		// Frame time with reflection probes refreshed every frame vs amortized over frames
+	void visibility_buffer_cost();		// Forward vs deferred vs visibility buffer frame time as ever more, ever smaller soda cans fill the view
+	void texture_loading();				// Cold-start texture load time: serial, decoded on worker threads, and cooked
+	void texture_residency();			// Shared loads, and texture memory against a budget as the textures in use change
+}
+#endif//__BENCHMARKS_H__
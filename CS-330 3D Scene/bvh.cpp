@@ -0,0 +1,675 @@
+/**
+ * "bvh.cpp" - Implementations for the dynamic bounding volume hierarchy. Function
+ *		prototypes defined in "bvh.h".
+ */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include "bvh.h"
+
+namespace bvh {
+	float AABB::surface_area() const {
+		glm::vec3 size = max - min;
+		return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	bool AABB::contains(const AABB& other) const {
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+			&& max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+	}
+
+	bool AABB::overlaps(const AABB& other) const {
+		return min.x <= other.max.x && min.y <= other.max.y && min.z <= other.max.z
+			&& max.x >= other.min.x && max.y >= other.min.y && max.z >= other.min.z;
+	}
+
+	AABB merge(const AABB& a, const AABB& b) {
+		AABB merged;
+		merged.min = glm::min(a.min, b.min);
+		merged.max = glm::max(a.max, b.max);
+		return merged;
+	}
+
+	AABB model_bounds(const Model& model) {
+		glm::vec3 center, extent;
+		float radius;
+		culling::world_bounds(model, center, extent, radius);
+
+		AABB box;
+		box.min = center - extent;
+		box.max = center + extent;
+		return box;
+	}
+
+	bool ray_aabb(glm::vec3 origin, glm::vec3 inverse_direction, const AABB& box, float max_distance, float& entry) {
+		glm::vec3 t0 = (box.min - origin) * inverse_direction;
+		glm::vec3 t1 = (box.max - origin) * inverse_direction;
+		glm::vec3 t_near = glm::min(t0, t1);
+		glm::vec3 t_far = glm::max(t0, t1);
+
+		entry = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.f));
+		float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_distance));
+
+		return entry <= exit;
+	}
+
+	/**
+	 * Top-down binned SAH build
+	 */
+	namespace {
+		const int SAH_BINS = 16;
+		const int PARALLEL_MIN_OBJECTS = 4096;		// Don't hand ranges smaller than this to a new thread
+
+		struct build_ref {
+			AABB bounds;
+			glm::vec3 centroid;
+			int object;
+		};
+
+		struct build_context {
+			std::vector<Node>& nodes;
+			std::vector<build_ref>& refs;
+			std::vector<int>& object_leaves;
+			std::atomic<int> next_node;
+
+			build_context(std::vector<Node>& n, std::vector<build_ref>& r, std::vector<int>& l) : nodes(n), refs(r), object_leaves(l), next_node(0) {}
+		};
+
+		/**
+		 * Pick the split of refs[begin, end) with the lowest SAH cost among SAH_BINS-1
+		 * planes along the axis of greatest centroid spread, partition the range around
+		 * it and return the index of the first ref on the right side.
+		 */
+		int sah_partition(std::vector<build_ref>& refs, int begin, int end) {
+			AABB centroid_bounds;
+			centroid_bounds.min = centroid_bounds.max = refs[begin].centroid;
+			for (int i = begin + 1; i < end; ++i) {
+				centroid_bounds.min = glm::min(centroid_bounds.min, refs[i].centroid);
+				centroid_bounds.max = glm::max(centroid_bounds.max, refs[i].centroid);
+			}
+
+			glm::vec3 spread = centroid_bounds.max - centroid_bounds.min;
+			int axis = (spread.x > spread.y && spread.x > spread.z) ? 0 : (spread.y > spread.z ? 1 : 2);
+			int middle = begin + (end - begin) / 2;
+
+			if (spread[axis] <= 1e-6f)
+				return middle;											// All centroids coincide: split by count
+
+			/**
+			 * Bin refs by centroid.
+			 */
+			int bin_count[SAH_BINS] = { 0 };
+			AABB bin_bounds[SAH_BINS];
+			float bin_scale = SAH_BINS / spread[axis] * 0.9999f;
+
+			for (int i = begin; i < end; ++i) {
+				int bin = (int)((refs[i].centroid[axis] - centroid_bounds.min[axis]) * bin_scale);
+				bin_bounds[bin] = bin_count[bin] == 0 ? refs[i].bounds : merge(bin_bounds[bin], refs[i].bounds);
+				bin_count[bin]++;
+			}
+
+			/**
+			 * Sweep from the right to get the area and count right of each plane, then from
+			 * the left to evaluate the cost of each plane.
+			 */
+			float right_area[SAH_BINS];
+			int right_count[SAH_BINS];
+			AABB accumulated;
+			int count = 0;
+			for (int bin = SAH_BINS - 1; bin > 0; --bin) {
+				if (bin_count[bin] > 0)
+					accumulated = count == 0 ? bin_bounds[bin] : merge(accumulated, bin_bounds[bin]);
+				count += bin_count[bin];
+				right_area[bin] = count > 0 ? accumulated.surface_area() : 0.f;
+				right_count[bin] = count;
+			}
+
+			float best_cost = INFINITY;
+			int best_split = -1;
+			count = 0;
+			for (int bin = 0; bin < SAH_BINS - 1; ++bin) {
+				if (bin_count[bin] > 0)
+					accumulated = count == 0 ? bin_bounds[bin] : merge(accumulated, bin_bounds[bin]);
+				count += bin_count[bin];
+
+				if (count == 0 || right_count[bin + 1] == 0)
+					continue;
+
+				float cost = accumulated.surface_area() * count + right_area[bin + 1] * right_count[bin + 1];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_split = bin;
+				}
+			}
+
+			if (best_split < 0)
+				return middle;
+
+			build_ref* split = std::partition(&refs[begin], &refs[begin] + (end - begin), [&](const build_ref& ref) {
+				return (int)((ref.centroid[axis] - centroid_bounds.min[axis]) * bin_scale) <= best_split;
+			});
+
+			int split_index = (int)(split - &refs[0]);
+			return (split_index == begin || split_index == end) ? middle : split_index;
+		}
+
+		int build_range(build_context& context, int begin, int end, int parent, int parallel_depth) {
+			int index = context.next_node++;
+			Node& node = context.nodes[index];							// Pool is pre-sized, so this reference stays valid
+			node.parent = parent;
+
+			if (end - begin == 1) {
+				node.bounds = context.refs[begin].bounds;
+				node.object = context.refs[begin].object;
+				node.left = node.right = NULL_NODE;
+				node.height = 0;
+				context.object_leaves[node.object] = index;
+				return index;
+			}
+
+			int split = sah_partition(context.refs, begin, end);
+
+			int left, right;
+			if (parallel_depth > 0 && end - begin >= PARALLEL_MIN_OBJECTS) {
+				std::thread left_thread([&]() { left = build_range(context, begin, split, index, parallel_depth - 1); });
+				right = build_range(context, split, end, index, parallel_depth - 1);
+				left_thread.join();
+			}
+			else {
+				left = build_range(context, begin, split, index, 0);
+				right = build_range(context, split, end, index, 0);
+			}
+
+			node.left = left;
+			node.right = right;
+			node.object = -1;
+			node.height = 1 + std::max(context.nodes[left].height, context.nodes[right].height);
+			node.bounds = merge(context.nodes[left].bounds, context.nodes[right].bounds);
+			return index;
+		}
+	}
+
+	void Tree::build(const std::vector<AABB>& bounds, unsigned int thread_count) {
+		clear();
+		if (bounds.empty())
+			return;
+
+		if (thread_count == 0)
+			thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<build_ref> refs(bounds.size());
+		for (size_t i = 0; i < bounds.size(); ++i) {
+			refs[i].bounds = bounds[i];
+			refs[i].centroid = (bounds[i].min + bounds[i].max) * 0.5f;
+			refs[i].object = (int)i;
+		}
+
+		node_pool.resize(bounds.size() * 2 - 1);					// A binary tree with one object per leaf
+		object_leaves.assign(bounds.size(), NULL_NODE);
+		object_count = bounds.size();
+
+		int parallel_depth = 0;
+		while ((1u << parallel_depth) < thread_count)
+			++parallel_depth;											// Each level of parallel splits doubles the threads in use
+
+		build_context context(node_pool, refs, object_leaves);
+		root_node = build_range(context, 0, (int)refs.size(), NULL_NODE, parallel_depth);
+	}
+
+	void Tree::clear() {
+		node_pool.clear();
+		object_leaves.clear();
+		root_node = NULL_NODE;
+		free_list = NULL_NODE;
+		object_count = 0;
+	}
+
+	/**
+	 * Incremental updates, following the approach of Box2D's b2DynamicTree: new leaves
+	 * descend towards the sibling that increases the total surface area least, and
+	 * ancestors are rebalanced with rotations on the way back up.
+	 */
+	int Tree::allocate_node() {
+		if (free_list == NULL_NODE) {
+			node_pool.push_back(Node());
+			return (int)node_pool.size() - 1;
+		}
+
+		int node = free_list;
+		free_list = node_pool[node].parent;
+		node_pool[node] = Node();
+		return node;
+	}
+
+	void Tree::free_node(int node) {
+		node_pool[node].parent = free_list;
+		node_pool[node].height = -1;
+		free_list = node;
+	}
+
+	void Tree::insert(int object, const AABB& bounds) {
+		if (leaf_of(object) != NULL_NODE)
+			return;								// Already in the tree; move() changes its bounds
+
+		if (object >= (int)object_leaves.size())
+			object_leaves.resize(object + 1, NULL_NODE);
+
+		int leaf = allocate_node();
+		node_pool[leaf].bounds = bounds;
+		node_pool[leaf].object = object;
+		object_leaves[object] = leaf;
+		object_count++;
+
+		insert_leaf(leaf);
+	}
+
+	void Tree::remove(int object) {
+		int leaf = leaf_of(object);
+		if (leaf == NULL_NODE)
+			return;
+
+		remove_leaf(leaf);
+		free_node(leaf);
+		object_leaves[object] = NULL_NODE;
+		object_count--;
+	}
+
+	void Tree::move(int object, const AABB& bounds) {
+		int leaf = leaf_of(object);
+		if (leaf == NULL_NODE)
+			return;
+
+		remove_leaf(leaf);
+		node_pool[leaf].bounds = bounds;
+		insert_leaf(leaf);
+	}
+
+	void Tree::set_bounds(int object, const AABB& bounds) {
+		int leaf = leaf_of(object);
+		if (leaf == NULL_NODE)
+			return;
+
+		node_pool[leaf].bounds = bounds;
+	}
+
+	void Tree::insert_leaf(int leaf) {
+		if (root_node == NULL_NODE) {
+			root_node = leaf;
+			node_pool[leaf].parent = NULL_NODE;
+			return;
+		}
+
+		/**
+		 * Find the best sibling for the new leaf.
+		 */
+		AABB leaf_bounds = node_pool[leaf].bounds;
+		int index = root_node;
+		while (!node_pool[index].is_leaf()) {
+			const Node& node = node_pool[index];
+
+			float area = node.bounds.surface_area();
+			float combined_area = merge(node.bounds, leaf_bounds).surface_area();
+
+			float cost = 2.f * combined_area;							// Cost of making a new parent for this node and the leaf
+			float inheritance_cost = 2.f * (combined_area - area);		// Minimum cost of pushing the leaf further down
+
+			float child_cost[2];
+			int children[2] = { node.left, node.right };
+			for (int c = 0; c < 2; ++c) {
+				const Node& child = node_pool[children[c]];
+				float enlarged = merge(leaf_bounds, child.bounds).surface_area();
+				child_cost[c] = (child.is_leaf() ? enlarged : enlarged - child.bounds.surface_area()) + inheritance_cost;
+			}
+
+			if (cost < child_cost[0] && cost < child_cost[1])
+				break;
+
+			index = child_cost[0] < child_cost[1] ? node.left : node.right;
+		}
+
+		/**
+		 * Create a new parent for the sibling and the leaf.
+		 */
+		int sibling = index;
+		int old_parent = node_pool[sibling].parent;
+		int new_parent = allocate_node();
+
+		node_pool[new_parent].parent = old_parent;
+		node_pool[new_parent].bounds = merge(leaf_bounds, node_pool[sibling].bounds);
+		node_pool[new_parent].height = node_pool[sibling].height + 1;
+		node_pool[new_parent].left = sibling;
+		node_pool[new_parent].right = leaf;
+		node_pool[sibling].parent = new_parent;
+		node_pool[leaf].parent = new_parent;
+
+		if (old_parent == NULL_NODE) {
+			root_node = new_parent;
+		}
+		else if (node_pool[old_parent].left == sibling) {
+			node_pool[old_parent].left = new_parent;
+		}
+		else {
+			node_pool[old_parent].right = new_parent;
+		}
+
+		refit_ancestors(node_pool[leaf].parent);
+	}
+
+	void Tree::remove_leaf(int leaf) {
+		if (leaf == root_node) {
+			root_node = NULL_NODE;
+			return;
+		}
+
+		int parent = node_pool[leaf].parent;
+		int grand_parent = node_pool[parent].parent;
+		int sibling = node_pool[parent].left == leaf ? node_pool[parent].right : node_pool[parent].left;
+
+		if (grand_parent == NULL_NODE) {
+			root_node = sibling;
+			node_pool[sibling].parent = NULL_NODE;
+			free_node(parent);
+			return;
+		}
+
+		/**
+		 * Replace the parent with the sibling and refit.
+		 */
+		if (node_pool[grand_parent].left == parent)
+			node_pool[grand_parent].left = sibling;
+		else
+			node_pool[grand_parent].right = sibling;
+
+		node_pool[sibling].parent = grand_parent;
+		free_node(parent);
+
+		refit_ancestors(grand_parent);
+	}
+
+	void Tree::refit_ancestors(int index) {
+		while (index != NULL_NODE) {
+			index = balance(index);
+
+			Node& node = node_pool[index];
+			node.height = 1 + std::max(node_pool[node.left].height, node_pool[node.right].height);
+			node.bounds = merge(node_pool[node.left].bounds, node_pool[node.right].bounds);
+
+			index = node.parent;
+		}
+	}
+
+	/**
+	 * Rotate node A up if one of its subtrees is more than one level taller than the
+	 * other. Returns the index of the node now at A's position.
+	 *
+	 *       A
+	 *     /   \
+	 *    B     C
+	 *   / \   / \
+	 *  D   E F   G
+	 */
+	int Tree::balance(int a_index) {
+		Node& a = node_pool[a_index];
+		if (a.is_leaf() || a.height < 2)
+			return a_index;
+
+		int b_index = a.left;
+		int c_index = a.right;
+		Node& b = node_pool[b_index];
+		Node& c = node_pool[c_index];
+
+		int height_difference = c.height - b.height;
+
+		/**
+		 * Rotate C up (or, mirrored, B up). The taller grandchild stays under the
+		 * promoted node and the shorter one moves under A.
+		 */
+		auto rotate_up = [&](int up_index, int other_index, bool up_was_right) {
+			Node& up = node_pool[up_index];
+			int f_index = up.left;
+			int g_index = up.right;
+			Node& f = node_pool[f_index];
+			Node& g = node_pool[g_index];
+
+			up.left = a_index;
+			up.parent = a.parent;
+			a.parent = up_index;
+
+			if (up.parent != NULL_NODE) {
+				if (node_pool[up.parent].left == a_index)
+					node_pool[up.parent].left = up_index;
+				else
+					node_pool[up.parent].right = up_index;
+			}
+			else {
+				root_node = up_index;
+			}
+
+			int keep_index = f.height > g.height ? f_index : g_index;
+			int move_index = f.height > g.height ? g_index : f_index;
+
+			up.right = keep_index;
+			if (up_was_right)
+				a.right = move_index;
+			else
+				a.left = move_index;
+			node_pool[move_index].parent = a_index;
+
+			const Node& other = node_pool[other_index];
+			const Node& moved = node_pool[move_index];
+			const Node& kept = node_pool[keep_index];
+
+			a.bounds = merge(other.bounds, moved.bounds);
+			a.height = 1 + std::max(other.height, moved.height);
+			up.bounds = merge(a.bounds, kept.bounds);
+			up.height = 1 + std::max(a.height, kept.height);
+
+			return up_index;
+		};
+
+		if (height_difference > 1)
+			return rotate_up(c_index, b_index, true);
+
+		if (height_difference < -1)
+			return rotate_up(b_index, c_index, false);
+
+		return a_index;
+	}
+
+	void Tree::refit() {
+		if (root_node == NULL_NODE)
+			return;
+
+		/**
+		 * Collect nodes in pre-order; walking that list backwards visits every child
+		 * before its parent.
+		 */
+		std::vector<int> order;
+		order.reserve(node_pool.size());
+		std::vector<int> stack(1, root_node);
+		while (!stack.empty()) {
+			int index = stack.back();
+			stack.pop_back();
+			order.push_back(index);
+
+			if (!node_pool[index].is_leaf()) {
+				stack.push_back(node_pool[index].left);
+				stack.push_back(node_pool[index].right);
+			}
+		}
+
+		for (auto it = order.rbegin(); it != order.rend(); ++it) {
+			Node& node = node_pool[*it];
+			if (!node.is_leaf())
+				node.bounds = merge(node_pool[node.left].bounds, node_pool[node.right].bounds);
+		}
+	}
+
+	/**
+	 * Queries
+	 */
+	namespace {
+		void append_leaves(const std::vector<Node>& nodes, int index, std::vector<unsigned int>& out, std::vector<int>& stack) {
+			size_t base = stack.size();
+			stack.push_back(index);
+			while (stack.size() > base) {
+				const Node& node = nodes[stack.back()];
+				stack.pop_back();
+
+				if (node.is_leaf()) {
+					out.push_back((unsigned int)node.object);
+				}
+				else {
+					stack.push_back(node.left);
+					stack.push_back(node.right);
+				}
+			}
+		}
+	}
+
+	void Tree::query_frustum(const culling::Frustum& frustum, std::vector<unsigned int>& visible) const {
+		if (root_node == NULL_NODE)
+			return;
+
+		glm::vec3 abs_normals[6];
+		for (int p = 0; p < 6; ++p)
+			abs_normals[p] = glm::abs(glm::vec3(frustum.planes[p]));
+
+		/**
+		 * Each stack entry carries a bit mask of the planes its parent still straddled;
+		 * planes a node is fully inside of are not tested again further down.
+		 */
+		thread_local std::vector<int> stack;
+		thread_local std::vector<int> masks;
+		thread_local std::vector<int> leaf_stack;
+		stack.assign(1, root_node);
+		masks.assign(1, 0x3f);
+
+		while (!stack.empty()) {
+			int index = stack.back();
+			int mask = masks.back();
+			stack.pop_back();
+			masks.pop_back();
+
+			const Node& node = node_pool[index];
+			glm::vec3 center = (node.bounds.min + node.bounds.max) * 0.5f;
+			glm::vec3 extent = (node.bounds.max - node.bounds.min) * 0.5f;
+
+			bool outside = false;
+			for (int p = 0; p < 6 && !outside; ++p) {
+				if (!(mask & (1 << p)))
+					continue;
+
+				float distance = glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w;
+				float reach = glm::dot(abs_normals[p], extent);
+
+				if (distance + reach < 0.f)
+					outside = true;										// Entirely behind this plane
+				else if (distance - reach >= 0.f)
+					mask &= ~(1 << p);									// Entirely in front of this plane
+			}
+
+			if (outside)
+				continue;
+
+			if (mask == 0) {
+				append_leaves(node_pool, index, visible, leaf_stack);	// Entirely inside the frustum
+			}
+			else if (node.is_leaf()) {
+				visible.push_back((unsigned int)node.object);
+			}
+			else {
+				stack.push_back(node.left);
+				masks.push_back(mask);
+				stack.push_back(node.right);
+				masks.push_back(mask);
+			}
+		}
+	}
+
+	void Tree::query_aabb(const AABB& box, std::vector<unsigned int>& results) const {
+		if (root_node == NULL_NODE)
+			return;
+
+		thread_local std::vector<int> stack;
+		stack.assign(1, root_node);
+		while (!stack.empty()) {
+			const Node& node = node_pool[stack.back()];
+			stack.pop_back();
+
+			if (!node.bounds.overlaps(box))
+				continue;
+
+			if (node.is_leaf()) {
+				results.push_back((unsigned int)node.object);
+			}
+			else {
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+	}
+
+	void Tree::query_sphere(glm::vec3 center, float radius, std::vector<unsigned int>& results) const {
+		if (root_node == NULL_NODE)
+			return;
+
+		float radius_squared = radius * radius;
+
+		thread_local std::vector<int> stack;
+		stack.assign(1, root_node);
+		while (!stack.empty()) {
+			const Node& node = node_pool[stack.back()];
+			stack.pop_back();
+
+			glm::vec3 closest = glm::min(glm::max(center, node.bounds.min), node.bounds.max);	// Closest point of the box to the center
+			glm::vec3 offset = closest - center;
+			if (glm::dot(offset, offset) > radius_squared)
+				continue;
+
+			if (node.is_leaf()) {
+				results.push_back((unsigned int)node.object);
+			}
+			else {
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+	}
+
+	float Tree::pick(glm::vec3 origin, glm::vec3 direction, float max_distance, int& hit_object) const {
+		glm::vec3 inverse_direction = glm::vec3(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+
+		return raycast(origin, direction, max_distance, [&](int object, float nearest) {
+			float entry;
+			return ray_aabb(origin, inverse_direction, node_pool[object_leaves[object]].bounds, nearest, entry) ? entry : -1.f;
+		}, hit_object);
+	}
+
+	float Tree::sah_cost() const {
+		if (root_node == NULL_NODE)
+			return 0.f;
+
+		float root_area = node_pool[root_node].bounds.surface_area();
+		if (root_area <= 0.f)
+			return 0.f;
+
+		float cost = 0.f;
+		std::vector<int> stack(1, root_node);
+		while (!stack.empty()) {
+			const Node& node = node_pool[stack.back()];
+			stack.pop_back();
+
+			cost += node.bounds.surface_area() / root_area;				// Traversal and intersection costs weighted equally
+
+			if (!node.is_leaf()) {
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+
+		return cost;
+	}
+}
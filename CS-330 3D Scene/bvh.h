@@ -0,0 +1,171 @@
+/**
+ * "bvh.h" - A dynamic bounding volume hierarchy over world-space object bounds. The
+ *		tree is built top-down with binned SAH splits on multiple threads, can be
+ *		refit after objects move, and supports incremental insert/remove. It answers
+ *		frustum, ray and proximity queries. Function implementations defined in
+ *		"bvh.cpp".
+ */
+#pragma once
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+
+namespace bvh {
+	/**
+	 * Axis-aligned bounding box.
+	 */
+	struct AABB {
+		glm::vec3 min = glm::vec3(0.f);
+		glm::vec3 max = glm::vec3(0.f);
+
+		float surface_area() const;
+		bool contains(const AABB& other) const;
+		bool overlaps(const AABB& other) const;
+	};
+
+	AABB merge(const AABB& a, const AABB& b);
+	AABB model_bounds(const Model& model);				// World-space box of a Model
+
+	const int NULL_NODE = -1;
+
+	/**
+	 * A tree node. Leaves hold exactly one object and have no children.
+	 */
+	struct Node {
+		AABB bounds;
+		int parent = NULL_NODE;
+		int left = NULL_NODE;
+		int right = NULL_NODE;
+		int object = -1;								// Object index for leaves, -1 for internal nodes
+		int height = 0;									// 0 for leaves
+
+		bool is_leaf() const { return left == NULL_NODE; }
+	};
+
+	class Tree {
+	public:
+		/**
+		 * Rebuild the tree from scratch with object i bounded by bounds[i]. Work is split
+		 * across thread_count threads (0 = hardware concurrency).
+		 */
+		void build(const std::vector<AABB>& bounds, unsigned int thread_count = 0);
+
+		void insert(int object, const AABB& bounds);	// Add an object not yet in the tree; ignored if it is
+		void remove(int object);						// Remove an object from the tree; ignored if it is not in it
+		void move(int object, const AABB& bounds);		// Remove and re-insert an object whose bounds changed a lot
+
+		/**
+		 * Change an object's bounds without restructuring; call refit() once all moving
+		 * objects have been updated. Cheaper than move() but lets tree quality decay.
+		 */
+		void set_bounds(int object, const AABB& bounds);
+		void refit();									// Recompute every internal node's bounds bottom-up
+
+		void clear();
+
+		/**
+		 * Append every object whose bounds intersect the frustum to visible. Subtrees
+		 * fully inside the frustum are appended without further plane tests.
+		 */
+		void query_frustum(const culling::Frustum& frustum, std::vector<unsigned int>& visible) const;
+		void query_sphere(glm::vec3 center, float radius, std::vector<unsigned int>& results) const;	// Proximity query
+		void query_aabb(const AABB& box, std::vector<unsigned int>& results) const;
+
+		/**
+		 * Find the nearest object along a ray. intersect(object, max_distance) must return
+		 * the hit distance along the ray (or a negative value for a miss); boxes further
+		 * than the nearest hit so far are skipped. Returns the hit distance, or a negative
+		 * value when nothing was hit, and writes the hit object to hit_object.
+		 */
+		template <typename Intersect>
+		float raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, Intersect intersect, int& hit_object) const;
+
+		/**
+		 * Ray pick against object bounds only.
+		 */
+		float pick(glm::vec3 origin, glm::vec3 direction, float max_distance, int& hit_object) const;
+
+		int root() const { return root_node; }
+		const std::vector<Node>& nodes() const { return node_pool; }
+		int leaf_of(int object) const { return object >= 0 && object < (int)object_leaves.size() ? object_leaves[object] : NULL_NODE; }
+		int height() const { return root_node == NULL_NODE ? 0 : node_pool[root_node].height; }
+		size_t size() const { return object_count; }
+
+		float sah_cost() const;							// Total SAH cost of the tree, for comparing build quality
+
+	private:
+		std::vector<Node> node_pool;
+		std::vector<int> object_leaves;					// object index -> leaf node
+		int root_node = NULL_NODE;
+		int free_list = NULL_NODE;						// Free nodes are chained through Node::parent
+		size_t object_count = 0;
+
+		int allocate_node();
+		void free_node(int node);
+		void insert_leaf(int leaf);
+		void remove_leaf(int leaf);
+		int balance(int node);
+		void refit_ancestors(int node);
+	};
+
+	bool ray_aabb(glm::vec3 origin, glm::vec3 inverse_direction, const AABB& box, float max_distance, float& entry);	// Slab test
+
+	template <typename Intersect>
+	float Tree::raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, Intersect intersect, int& hit_object) const {
+		hit_object = -1;
+		if (root_node == NULL_NODE)
+			return -1.f;
+
+		glm::vec3 inverse_direction = glm::vec3(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+		float nearest = max_distance;
+
+		thread_local std::vector<int> stack;			// Reused between calls to avoid allocating per ray
+		stack.clear();
+		stack.push_back(root_node);
+
+		while (!stack.empty()) {
+			const Node& node = node_pool[stack.back()];
+			stack.pop_back();
+
+			float entry;
+			if (!ray_aabb(origin, inverse_direction, node.bounds, nearest, entry))
+				continue;
+
+			if (node.is_leaf()) {
+				float distance = intersect(node.object, nearest);
+				if (distance >= 0.f && distance < nearest) {
+					nearest = distance;
+					hit_object = node.object;
+				}
+				continue;
+			}
+
+			/**
+			 * Visit the nearer child first so that later boxes are more likely to be
+			 * rejected by the shrinking hit distance.
+			 */
+			float left_entry, right_entry;
+			bool left_hit = ray_aabb(origin, inverse_direction, node_pool[node.left].bounds, nearest, left_entry);
+			bool right_hit = ray_aabb(origin, inverse_direction, node_pool[node.right].bounds, nearest, right_entry);
+
+			if (left_hit && right_hit) {
+				stack.push_back(left_entry < right_entry ? node.right : node.left);
+				stack.push_back(left_entry < right_entry ? node.left : node.right);
+			}
+			else if (left_hit) {
+				stack.push_back(node.left);
+			}
+			else if (right_hit) {
+				stack.push_back(node.right);
+			}
+		}
+
+		return hit_object == -1 ? -1.f : nearest;
+	}
+}
+#endif//__BVH_H__
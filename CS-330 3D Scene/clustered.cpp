@@ -0,0 +1,309 @@
+/**
+ * "clustered.cpp" - Implementations for clustered forward lighting. Function prototypes
+ *		defined in "clustered.h".
+ */
+#include <glad/glad.h>
+
+#include <cmath>
+#include <algorithm>
+
+#include <immintrin.h>
+
+#include "clustered.h"
+
+namespace clustered {
+	/**
+	 * Near and far plane distances of a perspective or orthographic projection matrix.
+	 */
+	static void depth_range(const glm::mat4& projection, float& near_plane, float& far_plane) {
+		if (projection[3][3] == 0.f) {
+			near_plane = projection[3][2] / (projection[2][2] - 1.f);
+			far_plane = projection[3][2] / (projection[2][2] + 1.f);
+		}
+		else {
+			near_plane = (projection[3][2] + 1.f) / projection[2][2];
+			far_plane = (projection[3][2] - 1.f) / projection[2][2];
+		}
+	}
+
+	/**
+	 * Slices are spaced exponentially in view depth so clusters stay roughly cubic: the
+	 * boundary of slice k is near * (far / near)^(k / slices).
+	 */
+	void ClusterGrid::build_bounds(const glm::mat4& projection) {
+		depth_range(projection, near_plane, far_plane);
+		glm::mat4 inverse_projection = glm::inverse(projection);
+
+		size_t count = (size_t)cluster_count();
+		min_x.resize(count); min_y.resize(count); min_z.resize(count);
+		max_x.resize(count); max_y.resize(count); max_z.resize(count);
+
+		for (int slice = 0; slice < slices; ++slice) {
+			float slice_near = near_plane * std::pow(far_plane / near_plane, (float)slice / slices);
+			float slice_far = near_plane * std::pow(far_plane / near_plane, (float)(slice + 1) / slices);
+
+			for (int y = 0; y < tiles_y; ++y) {
+				for (int x = 0; x < tiles_x; ++x) {
+					glm::vec3 lower = glm::vec3(INFINITY);
+					glm::vec3 upper = glm::vec3(-INFINITY);
+
+					/**
+					 * Follow each tile corner's view ray (a line through the near and far
+					 * planes, which also covers orthographic projections) to both ends of
+					 * the slice.
+					 */
+					for (int corner = 0; corner < 4; ++corner) {
+						float ndc_x = -1.f + 2.f * (float)(x + (corner & 1)) / tiles_x;
+						float ndc_y = -1.f + 2.f * (float)(y + (corner >> 1)) / tiles_y;
+
+						glm::vec4 on_near = inverse_projection * glm::vec4(ndc_x, ndc_y, -1.f, 1.f);
+						glm::vec4 on_far = inverse_projection * glm::vec4(ndc_x, ndc_y, 1.f, 1.f);
+						glm::vec3 a = glm::vec3(on_near) / on_near.w;
+						glm::vec3 b = glm::vec3(on_far) / on_far.w;
+
+						for (float depth : { slice_near, slice_far }) {
+							glm::vec3 point = a + (b - a) * ((-depth - a.z) / (b.z - a.z));
+							lower = glm::min(lower, point);
+							upper = glm::max(upper, point);
+						}
+					}
+
+					int index = cluster_index(x, y, slice);
+					min_x[index] = lower.x; min_y[index] = lower.y; min_z[index] = lower.z;
+					max_x[index] = upper.x; max_y[index] = upper.y; max_z[index] = upper.z;
+				}
+			}
+		}
+
+		bounds_projection = projection;
+	}
+
+	/**
+	 * The slices a view-space sphere overlaps. Returns false when it is in front of the
+	 * near plane or behind the far plane.
+	 */
+	bool ClusterGrid::slice_range(const glm::vec3& center, float radius, int& first, int& last) const {
+		float nearest = -center.z - radius;
+		float farthest = -center.z + radius;
+		if (farthest < near_plane || nearest > far_plane)
+			return false;
+
+		float scale = (float)slices / std::log(far_plane / near_plane);
+		first = (int)std::floor(std::log(std::max(nearest, near_plane) / near_plane) * scale);
+		last = (int)std::floor(std::log(std::min(farthest, far_plane) / near_plane) * scale);
+		first = std::max(0, std::min(first, slices - 1));
+		last = std::max(0, std::min(last, slices - 1));
+		return true;
+	}
+
+	/**
+	 * Counting sort of the (cluster, light) references into per-cluster lists. Lights
+	 * were visited in order, so each list stays sorted by light index.
+	 */
+	void ClusterGrid::gather() {
+		size_t count = (size_t)cluster_count();
+		cluster_counts.assign(count, 0);
+		cluster_offsets.assign(count, 0);
+		light_indices.resize(references.size());
+
+		for (const reference& r : references)
+			cluster_counts[r.cluster]++;
+
+		unsigned int offset = 0;
+		last_stats.max_per_cluster = 0;
+		for (size_t i = 0; i < count; ++i) {
+			cluster_offsets[i] = offset;
+			offset += cluster_counts[i];
+			last_stats.max_per_cluster = std::max(last_stats.max_per_cluster, cluster_counts[i]);
+		}
+
+		std::vector<unsigned int> cursor = cluster_offsets;
+		for (const reference& r : references)
+			light_indices[cursor[r.cluster]++] = r.light;
+
+		last_stats.references = (unsigned int)references.size();
+	}
+
+	/**
+	 * Sphere vs box: the squared distance from the sphere's center to the nearest point
+	 * of the box must not exceed the squared radius.
+	 */
+	static inline bool sphere_touches_cluster(const glm::vec3& c, float radius_squared,
+		float lx, float ly, float lz, float ux, float uy, float uz) {
+		float dx = std::max(std::max(lx - c.x, 0.f), c.x - ux);
+		float dy = std::max(std::max(ly - c.y, 0.f), c.y - uy);
+		float dz = std::max(std::max(lz - c.z, 0.f), c.z - uz);
+		return dx * dx + dy * dy + dz * dz <= radius_squared;
+	}
+
+	void ClusterGrid::assign_scalar(const std::vector<RadiantLight>& lights, const glm::mat4& view, const glm::mat4& projection) {
+		if (projection != bounds_projection || (int)min_x.size() != cluster_count())
+			build_bounds(projection);
+
+		references.clear();
+		last_stats = ClusterStats();
+		const int per_slice = tiles_x * tiles_y;
+
+		for (size_t light = 0; light < lights.size(); ++light) {
+			glm::vec3 center = glm::vec3(view * glm::vec4(lights[light].position, 1.f));
+			float radius = lights[light].radius;
+
+			int first, last;
+			if (radius <= 0.f || !slice_range(center, radius, first, last))
+				continue;
+
+			size_t before = references.size();
+			for (int i = first * per_slice; i < (last + 1) * per_slice; ++i)
+				if (sphere_touches_cluster(center, radius * radius, min_x[i], min_y[i], min_z[i], max_x[i], max_y[i], max_z[i]))
+					references.push_back({ (unsigned int)i, (unsigned int)light });
+
+			if (references.size() != before)
+				last_stats.lights++;
+		}
+
+		gather();
+	}
+
+	void ClusterGrid::assign(const std::vector<RadiantLight>& lights, const glm::mat4& view, const glm::mat4& projection) {
+		if (projection != bounds_projection || (int)min_x.size() != cluster_count())
+			build_bounds(projection);
+
+		references.clear();
+		last_stats = ClusterStats();
+		const int per_slice = tiles_x * tiles_y;
+
+		for (size_t light = 0; light < lights.size(); ++light) {
+			glm::vec3 center = glm::vec3(view * glm::vec4(lights[light].position, 1.f));
+			float radius = lights[light].radius;
+
+			int first, last;
+			if (radius <= 0.f || !slice_range(center, radius, first, last))
+				continue;
+
+			size_t before = references.size();
+			int i = first * per_slice;
+			const int end = (last + 1) * per_slice;
+
+#ifdef __AVX__
+			/**
+			 * 8 clusters per iteration.
+			 */
+			const __m256 cx8 = _mm256_set1_ps(center.x), cy8 = _mm256_set1_ps(center.y), cz8 = _mm256_set1_ps(center.z);
+			const __m256 r8 = _mm256_set1_ps(radius * radius);
+			const __m256 zero8 = _mm256_setzero_ps();
+
+			for (; i + 8 <= end; i += 8) {
+				__m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&min_x[i]), cx8), zero8), _mm256_sub_ps(cx8, _mm256_loadu_ps(&max_x[i])));
+				__m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&min_y[i]), cy8), zero8), _mm256_sub_ps(cy8, _mm256_loadu_ps(&max_y[i])));
+				__m256 dz = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&min_z[i]), cz8), zero8), _mm256_sub_ps(cz8, _mm256_loadu_ps(&max_z[i])));
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+				int mask = _mm256_movemask_ps(_mm256_cmp_ps(distance, r8, _CMP_LE_OQ));
+				for (int lane = 0; lane < 8; ++lane)
+					if (mask & (1 << lane))
+						references.push_back({ (unsigned int)(i + lane), (unsigned int)light });
+			}
+#endif
+			/**
+			 * 4 clusters per iteration (also handles the AVX remainder).
+			 */
+			const __m128 cx4 = _mm_set1_ps(center.x), cy4 = _mm_set1_ps(center.y), cz4 = _mm_set1_ps(center.z);
+			const __m128 r4 = _mm_set1_ps(radius * radius);
+			const __m128 zero4 = _mm_setzero_ps();
+
+			for (; i + 4 <= end; i += 4) {
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&min_x[i]), cx4), zero4), _mm_sub_ps(cx4, _mm_loadu_ps(&max_x[i])));
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&min_y[i]), cy4), zero4), _mm_sub_ps(cy4, _mm_loadu_ps(&max_y[i])));
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&min_z[i]), cz4), zero4), _mm_sub_ps(cz4, _mm_loadu_ps(&max_z[i])));
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+				int mask = _mm_movemask_ps(_mm_cmple_ps(distance, r4));
+				for (int lane = 0; lane < 4; ++lane)
+					if (mask & (1 << lane))
+						references.push_back({ (unsigned int)(i + lane), (unsigned int)light });
+			}
+
+			for (; i < end; ++i)													// Remaining 0-3 clusters
+				if (sphere_touches_cluster(center, radius * radius, min_x[i], min_y[i], min_z[i], max_x[i], max_y[i], max_z[i]))
+					references.push_back({ (unsigned int)i, (unsigned int)light });
+
+			if (references.size() != before)
+				last_stats.lights++;
+		}
+
+		gather();
+	}
+
+	static void create_texture_buffer(unsigned int& buffer, unsigned int& texture, GLenum format) {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);			// Resized on upload
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void ClusterGrid::init() {
+		create_texture_buffer(light_buffer, light_texture, GL_RGBA32F);		// 3 texels per light
+		create_texture_buffer(grid_buffer, grid_texture, GL_RG32UI);			// (offset, count) per cluster
+		create_texture_buffer(index_buffer, index_texture, GL_R32UI);			// Light indices
+	}
+
+	/**
+	 * Buffers are re-specified every frame (orphaned), so the driver never has to wait
+	 * for the previous frame's draws to finish reading them.
+	 */
+	static void stream(unsigned int buffer, size_t size, const void* data) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+		if (size > 0)
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	}
+
+	void ClusterGrid::upload(const std::vector<RadiantLight>& lights) {
+		light_data.clear();
+		for (const RadiantLight& light : lights) {
+			light_data.insert(light_data.end(), { light.position.x, light.position.y, light.position.z, light.radius });
+			light_data.insert(light_data.end(), { light.color.r, light.color.g, light.color.b, 0.f });
+			light_data.insert(light_data.end(), { light.attenuation_coefficients.x, light.attenuation_coefficients.y, light.attenuation_coefficients.z, 0.f });
+		}
+
+		grid_data.resize(cluster_offsets.size() * 2);
+		for (size_t i = 0; i < cluster_offsets.size(); ++i) {
+			grid_data[2 * i] = cluster_offsets[i];
+			grid_data[2 * i + 1] = cluster_counts[i];
+		}
+
+		stream(light_buffer, light_data.size() * sizeof(float), light_data.data());
+		stream(grid_buffer, grid_data.size() * sizeof(unsigned int), grid_data.data());
+		stream(index_buffer, light_indices.size() * sizeof(unsigned int), light_indices.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void set_texture_units(Shader& shader, int first_unit) {
+		shader.use();
+		shader.setInt("clusterLights", first_unit);
+		shader.setInt("clusterGrid", first_unit + 1);
+		shader.setInt("clusterLightIndices", first_unit + 2);
+	}
+
+	void ClusterGrid::bind(Shader& shader, int viewport_width, int viewport_height, int first_unit) const {
+		const unsigned int textures[3] = { light_texture, grid_texture, index_texture };
+		for (int i = 0; i < 3; ++i) {
+			glActiveTexture(GL_TEXTURE0 + first_unit + i);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+
+		float scale = (float)slices / std::log(far_plane / near_plane);
+
+		set_texture_units(shader, first_unit);
+		glUniform3i(glGetUniformLocation(shader.ID, "clusterDimensions"), tiles_x, tiles_y, slices);
+		shader.setVec2("clusterTileSize", (float)viewport_width / tiles_x, (float)viewport_height / tiles_y);
+		shader.setVec2("clusterDepthScaleBias", scale, scale * std::log(near_plane));	// slice = log(depth) * scale - bias
+	}
+}
@@ -0,0 +1,106 @@
+/**
+ * "clustered.h" - Clustered forward lighting for many point lights. The view frustum is
+ *		split into a grid of clusters (screen tiles by exponential depth slices), each
+ *		frame every light's bounding sphere is tested against the clusters it can reach
+ *		on the CPU, 4 (SSE) or 8 (AVX) clusters at a time, and the resulting per-cluster
+ *		light lists are uploaded in texture buffers. The fragment shaders then only loop
+ *		over the lights of the cluster a fragment falls in, so shading cost follows local
+ *		light density rather than the total light count. Function implementations
+ *		defined in "clustered.cpp".
+ */
+#pragma once
+#ifndef __CLUSTERED_H__
+#define __CLUSTERED_H__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "lights.h"
+#include "shader.h"
+
+namespace clustered {
+	const int FIRST_TEXTURE_UNIT = 4;			// Units FIRST_TEXTURE_UNIT..+2 hold the cluster texture buffers
+
+	/**
+	 * Point a shader's cluster samplers at their texture units, so the buffer samplers
+	 * never share unit 0 with a 2D sampler. bind() also does this.
+	 */
+	void set_texture_units(Shader& shader, int first_unit = FIRST_TEXTURE_UNIT);
+
+	/**
+	 * Counters for the most recent assign().
+	 */
+	struct ClusterStats {
+		unsigned int lights = 0;				// Lights that touched at least one cluster
+		unsigned int references = 0;			// Total entries over all cluster light lists
+		unsigned int max_per_cluster = 0;		// Longest cluster light list
+	};
+
+	class ClusterGrid {
+	public:
+		/**
+		 * Grid dimensions; change before the first assign().
+		 */
+		int tiles_x = 16;
+		int tiles_y = 9;
+		int slices = 24;
+
+		/**
+		 * Build the per-cluster light lists for lights as seen through view and
+		 * projection (perspective or orthographic). Lights are culled by their cutoff
+		 * radius. Pure CPU work; call upload() to hand the result to the GPU.
+		 */
+		void assign(const std::vector<RadiantLight>& lights, const glm::mat4& view, const glm::mat4& projection);
+		void assign_scalar(const std::vector<RadiantLight>& lights, const glm::mat4& view, const glm::mat4& projection);	// Reference implementation for testing and benchmarks
+
+		void init();							// Create the texture buffers; requires a GL context
+		void upload(const std::vector<RadiantLight>& lights);	// Upload light data and the lists from the last assign()
+
+		/**
+		 * Bind the texture buffers to texture units first_unit..first_unit+2 and set the
+		 * cluster uniforms of shader, a variant compiled with CLUSTERED_LIGHTS (see
+		 * permutations.h). viewport_width/height are in pixels.
+		 */
+		void bind(Shader& shader, int viewport_width, int viewport_height, int first_unit = FIRST_TEXTURE_UNIT) const;
+
+		int cluster_count() const { return tiles_x * tiles_y * slices; }
+		int cluster_index(int x, int y, int slice) const { return x + tiles_x * (y + tiles_y * slice); }
+
+		const std::vector<unsigned int>& offsets() const { return cluster_offsets; }	// First entry of each cluster's list in indices()
+		const std::vector<unsigned int>& counts() const { return cluster_counts; }		// Length of each cluster's list
+		const std::vector<unsigned int>& indices() const { return light_indices; }		// Light indices, grouped by cluster
+		const ClusterStats& stats() const { return last_stats; }
+
+	private:
+		/**
+		 * View-space bounds of every cluster in structure-of-arrays layout, indexed
+		 * like cluster_index().
+		 */
+		std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+		glm::mat4 bounds_projection = glm::mat4(0.f);	// Projection the bounds were built for
+		float near_plane = 0.1f;
+		float far_plane = 100.f;
+
+		struct reference {
+			unsigned int cluster;
+			unsigned int light;
+		};
+		std::vector<reference> references;
+		std::vector<unsigned int> cluster_offsets;
+		std::vector<unsigned int> cluster_counts;
+		std::vector<unsigned int> light_indices;
+		ClusterStats last_stats;
+
+		unsigned int light_buffer = 0, light_texture = 0;
+		unsigned int grid_buffer = 0, grid_texture = 0;
+		unsigned int index_buffer = 0, index_texture = 0;
+		std::vector<float> light_data;
+		std::vector<unsigned int> grid_data;
+
+		void build_bounds(const glm::mat4& projection);
+		bool slice_range(const glm::vec3& center, float radius, int& first, int& last) const;
+		void gather();							// Turn references into offsets/counts/indices
+	};
+}
+#endif//__CLUSTERED_H__
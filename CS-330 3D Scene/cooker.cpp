@@ -0,0 +1,628 @@
+/**
+ * "cooker.cpp" - Implementations for the offline texture cooker. Function prototypes
+ *		defined in "cooker.h".
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+
+#include "stb_image.h"
+#include "cooker.h"
+
+namespace cooker {
+	static double now_ms() {
+		using namespace std::chrono;
+		return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	BlockFormat choose_block_format(int channels, textures::Usage usage) {
+		if (usage == textures::Usage::MASK || channels == 1)
+			return BlockFormat::BC4;
+		if (channels == 2)
+			return BlockFormat::BC5;
+		return channels == 4 ? BlockFormat::BC3 : BlockFormat::BC1;
+	}
+
+	int block_bytes(BlockFormat format) {
+		return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+	}
+
+	int source_components(BlockFormat format) {
+		switch (format) {
+		case BlockFormat::BC4: return 1;
+		case BlockFormat::BC5: return 2;
+		default: return 4;
+		}
+	}
+
+	/**
+	 * BC1 color endpoints are RGB 5:6:5, expanded to 8 bits by repeating their top
+	 * bits as GPUs do.
+	 */
+	static uint16_t pack_565(const float color[3]) {
+		int r = std::min(std::max((int)(color[0] * 31.f / 255.f + 0.5f), 0), 31);
+		int g = std::min(std::max((int)(color[1] * 63.f / 255.f + 0.5f), 0), 63);
+		int b = std::min(std::max((int)(color[2] * 31.f / 255.f + 0.5f), 0), 31);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	static void unpack_565(uint16_t packed, int rgb[3]) {
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	/**
+	 * The four colors a BC1 block can pick from. Blocks with color0 <= color1 have
+	 * only three plus black, except inside BC3, which always has four.
+	 */
+	static void color_palette(uint16_t color0, uint16_t color1, bool four_colors, int palette[4][3]) {
+		unpack_565(color0, palette[0]);
+		unpack_565(color1, palette[1]);
+		for (int c = 0; c < 3; ++c) {
+			if (four_colors) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+			}
+			else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+	}
+
+	/**
+	 * Quantize a pair of endpoints, pick each texel's nearest palette entry and
+	 * return the block's squared error.
+	 */
+	static int fit_colors(const float texels[16][3], const float end0[3], const float end1[3], uint16_t& color0, uint16_t& color1, uint32_t& indices) {
+		color0 = pack_565(end0);
+		color1 = pack_565(end1);
+		if (color0 < color1)
+			std::swap(color0, color1);				// color0 > color1 selects four colors in BC1 too
+
+		int palette[4][3];
+		color_palette(color0, color1, true, palette);
+		int entries = color0 == color1 ? 1 : 4;		// Equal endpoints read as three colors and black in BC1
+
+		int error = 0;
+		indices = 0;
+		for (int i = 0; i < 16; ++i) {
+			int best = 0, best_error = INT32_MAX;
+			for (int entry = 0; entry < entries; ++entry) {
+				int entry_error = 0;
+				for (int c = 0; c < 3; ++c) {
+					int d = (int)texels[i][c] - palette[entry][c];
+					entry_error += d * d;
+				}
+				if (entry_error < best_error) {
+					best = entry;
+					best_error = entry_error;
+				}
+			}
+			indices |= (uint32_t)best << (2 * i);
+			error += best_error;
+		}
+		return error;
+	}
+
+	/**
+	 * Endpoints start at the ends of the texels' principal axis, then are refitted by
+	 * least squares to the palette weights their indices chose.
+	 */
+	static void encode_colors(const unsigned char* texels, unsigned char* block) {
+		float colors[16][3];
+		float mean[3] = { 0.f, 0.f, 0.f };
+		for (int i = 0; i < 16; ++i) {
+			for (int c = 0; c < 3; ++c) {
+				colors[i][c] = texels[i * 4 + c];
+				mean[c] += colors[i][c] / 16.f;
+			}
+		}
+
+		float covariance[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };		// rr rg rb gg gb bb
+		for (int i = 0; i < 16; ++i) {
+			float d[3] = { colors[i][0] - mean[0], colors[i][1] - mean[1], colors[i][2] - mean[2] };
+			covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+			covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+		}
+		float axis[3] = { covariance[0], covariance[1], covariance[2] };		// Start from the column of the widest channel
+		if (covariance[3] > covariance[0] && covariance[3] >= covariance[5]) {
+			axis[0] = covariance[1]; axis[1] = covariance[3]; axis[2] = covariance[4];
+		}
+		else if (covariance[5] > covariance[0] && covariance[5] > covariance[3]) {
+			axis[0] = covariance[2]; axis[1] = covariance[4]; axis[2] = covariance[5];
+		}
+		for (int iteration = 0; iteration < 8; ++iteration) {
+			float next[3] = {
+				covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+				covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+				covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+			};
+			float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+			if (length < 1e-6f)
+				break;								// Flat block: any axis will do
+			for (int c = 0; c < 3; ++c)
+				axis[c] = next[c] / length;
+		}
+
+		float lowest = 0.f, highest = 0.f;
+		for (int i = 0; i < 16; ++i) {
+			float t = (colors[i][0] - mean[0]) * axis[0] + (colors[i][1] - mean[1]) * axis[1] + (colors[i][2] - mean[2]) * axis[2];
+			lowest = std::min(lowest, t);
+			highest = std::max(highest, t);
+		}
+		float end0[3], end1[3];
+		for (int c = 0; c < 3; ++c) {
+			end0[c] = mean[c] + axis[c] * highest;
+			end1[c] = mean[c] + axis[c] * lowest;
+		}
+
+		uint16_t color0, color1;
+		uint32_t indices;
+		int error = fit_colors(colors, end0, end1, color0, color1, indices);
+
+		static const float weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };	// Of color0, per index
+		for (int refinement = 0; refinement < 2 && error > 0; ++refinement) {
+			float aa = 0.f, ab = 0.f, bb = 0.f, ax[3] = { 0.f, 0.f, 0.f }, bx[3] = { 0.f, 0.f, 0.f };
+			for (int i = 0; i < 16; ++i) {
+				float a = weights[(indices >> (2 * i)) & 3], b = 1.f - a;
+				aa += a * a; ab += a * b; bb += b * b;
+				for (int c = 0; c < 3; ++c) {
+					ax[c] += a * colors[i][c];
+					bx[c] += b * colors[i][c];
+				}
+			}
+			float determinant = aa * bb - ab * ab;
+			if (std::fabs(determinant) < 1e-6f)
+				break;
+			for (int c = 0; c < 3; ++c) {
+				end0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+				end1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+			}
+
+			uint16_t refined0, refined1;
+			uint32_t refined_indices;
+			int refined_error = fit_colors(colors, end0, end1, refined0, refined1, refined_indices);
+			if (refined_error >= error)
+				break;
+			color0 = refined0;
+			color1 = refined1;
+			indices = refined_indices;
+			error = refined_error;
+		}
+
+		block[0] = color0 & 0xFF; block[1] = color0 >> 8;
+		block[2] = color1 & 0xFF; block[3] = color1 >> 8;
+		for (int i = 0; i < 4; ++i)
+			block[4 + i] = (indices >> (8 * i)) & 0xFF;
+	}
+
+	/**
+	 * BC4: the block's extremes and six values between them, 3-bit indices.
+	 * stride is the distance between the channel's values in texels.
+	 */
+	static void encode_channel(const unsigned char* texels, int stride, unsigned char* block) {
+		int lowest = 255, highest = 0;
+		for (int i = 0; i < 16; ++i) {
+			lowest = std::min(lowest, (int)texels[i * stride]);
+			highest = std::max(highest, (int)texels[i * stride]);
+		}
+
+		int palette[8] = { highest, lowest };
+		for (int i = 1; i < 7; ++i)
+			palette[i + 1] = ((7 - i) * highest + i * lowest + 3) / 7;
+
+		uint64_t indices = 0;
+		if (highest != lowest) {					// Equal extremes decode as six values, of which index 0 is still the value
+			for (int i = 0; i < 16; ++i) {
+				int value = texels[i * stride], best = 0;
+				for (int entry = 1; entry < 8; ++entry) {
+					if (std::abs(palette[entry] - value) < std::abs(palette[best] - value))
+						best = entry;
+				}
+				indices |= (uint64_t)best << (3 * i);
+			}
+		}
+
+		block[0] = (unsigned char)highest;
+		block[1] = (unsigned char)lowest;
+		for (int i = 0; i < 6; ++i)
+			block[2 + i] = (indices >> (8 * i)) & 0xFF;
+	}
+
+	void encode_block(BlockFormat format, const unsigned char* texels, unsigned char* block) {
+		switch (format) {
+		case BlockFormat::BC1:
+			encode_colors(texels, block);
+			break;
+		case BlockFormat::BC3:
+			encode_channel(texels + 3, 4, block);
+			encode_colors(texels, block + 8);
+			break;
+		case BlockFormat::BC4:
+			encode_channel(texels, 1, block);
+			break;
+		case BlockFormat::BC5:
+			encode_channel(texels, 2, block);
+			encode_channel(texels + 1, 2, block + 8);
+			break;
+		}
+	}
+
+	static void decode_colors(const unsigned char* block, bool four_colors, unsigned char* rgba) {
+		uint16_t color0 = (uint16_t)(block[0] | (block[1] << 8));
+		uint16_t color1 = (uint16_t)(block[2] | (block[3] << 8));
+		int palette[4][3];
+		color_palette(color0, color1, four_colors || color0 > color1, palette);
+		for (int i = 0; i < 16; ++i) {
+			int index = (block[4 + i / 4] >> (2 * (i % 4))) & 3;
+			for (int c = 0; c < 3; ++c)
+				rgba[i * 4 + c] = (unsigned char)palette[index][c];
+		}
+	}
+
+	static void decode_channel(const unsigned char* block, unsigned char* texels, int stride) {
+		int palette[8] = { block[0], block[1] };
+		if (block[0] > block[1]) {
+			for (int i = 1; i < 7; ++i)
+				palette[i + 1] = ((7 - i) * block[0] + i * block[1] + 3) / 7;
+		}
+		else {
+			for (int i = 1; i < 5; ++i)
+				palette[i + 1] = ((5 - i) * block[0] + i * block[1] + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; ++i)
+			indices |= (uint64_t)block[2 + i] << (8 * i);
+		for (int i = 0; i < 16; ++i)
+			texels[i * stride] = (unsigned char)palette[(indices >> (3 * i)) & 7];
+	}
+
+	void decode_block(BlockFormat format, const unsigned char* block, unsigned char* rgba) {
+		for (int i = 0; i < 16; ++i) {
+			rgba[i * 4 + 0] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = 0;
+			rgba[i * 4 + 3] = 255;
+		}
+		switch (format) {
+		case BlockFormat::BC1:
+			decode_colors(block, false, rgba);
+			break;
+		case BlockFormat::BC3:
+			decode_channel(block, rgba + 3, 4);
+			decode_colors(block + 8, true, rgba);
+			break;
+		case BlockFormat::BC4:
+			decode_channel(block, rgba, 4);
+			break;
+		case BlockFormat::BC5:
+			decode_channel(block, rgba, 4);
+			decode_channel(block + 8, rgba + 1, 4);
+			break;
+		}
+	}
+
+	std::string cooked_path(const std::string& source) {
+		size_t dot = source.find_last_of('.');
+		size_t slash = source.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return source + ".ktx2";
+		return source.substr(0, dot) + ".ktx2";
+	}
+
+	/**
+	 * KTX2 layout: identifier, header, level index (level 0 first), data format
+	 * descriptor, key/value data, then the levels themselves, smallest first.
+	 */
+	static const unsigned char ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	static const size_t ktx2_header_size = 80;
+	static const size_t ktx2_level_index_entry = 24;
+
+	static uint32_t vk_format(BlockFormat format) {
+		switch (format) {
+		case BlockFormat::BC1: return 131;			// VK_FORMAT_BC1_RGB_UNORM_BLOCK
+		case BlockFormat::BC3: return 137;			// VK_FORMAT_BC3_UNORM_BLOCK
+		case BlockFormat::BC4: return 139;			// VK_FORMAT_BC4_UNORM_BLOCK
+		default: return 141;						// VK_FORMAT_BC5_UNORM_BLOCK
+		}
+	}
+
+	static void put_u32(std::vector<unsigned char>& out, size_t offset, uint32_t value) {
+		std::memcpy(&out[offset], &value, 4);
+	}
+
+	static void put_u64(std::vector<unsigned char>& out, size_t offset, uint64_t value) {
+		std::memcpy(&out[offset], &value, 8);
+	}
+
+	static uint32_t get_u32(const unsigned char* in) {
+		uint32_t value;
+		std::memcpy(&value, in, 4);
+		return value;
+	}
+
+	static uint64_t get_u64(const unsigned char* in) {
+		uint64_t value;
+		std::memcpy(&value, in, 8);
+		return value;
+	}
+
+	/**
+	 * The basic data format descriptor block: the color model names the block
+	 * format, and each sample one channel's 64 bits of the block.
+	 */
+	static std::vector<uint32_t> data_format_descriptor(BlockFormat format) {
+		struct sample {
+			uint32_t channel;
+			uint32_t bit_offset;
+		};
+		std::vector<sample> samples;
+		uint32_t color_model = 0;
+		switch (format) {
+		case BlockFormat::BC1: color_model = 128; samples = { { 0, 0 } }; break;				// KHR_DF_MODEL_BC1A, color
+		case BlockFormat::BC3: color_model = 130; samples = { { 15, 0 }, { 0, 64 } }; break;	// KHR_DF_MODEL_BC3, alpha then color
+		case BlockFormat::BC4: color_model = 131; samples = { { 0, 0 } }; break;				// KHR_DF_MODEL_BC4, data
+		case BlockFormat::BC5: color_model = 132; samples = { { 0, 0 }, { 1, 64 } }; break;	// KHR_DF_MODEL_BC5, red then green
+		}
+
+		uint32_t block_size = 24 + 16 * (uint32_t)samples.size();
+		std::vector<uint32_t> words = {
+			4 + block_size,									// dfdTotalSize
+			0,												// Khronos vendor, basic descriptor type
+			2 | (block_size << 16),							// Version 2
+			color_model | (1 << 8) | (1 << 16),				// BT.709 primaries, linear transfer, straight alpha
+			3 | (3 << 8),									// 4x4x1x1 texel blocks, stored minus one
+			(uint32_t)block_bytes(format),
+			0,
+		};
+		for (const sample& s : samples) {
+			words.push_back(s.bit_offset | (63u << 16) | (s.channel << 24));
+			words.push_back(0);
+			words.push_back(0);
+			words.push_back(0xFFFFFFFFu);
+		}
+		return words;
+	}
+
+	/**
+	 * Key/value data: each pair's length, then the key and value with their
+	 * terminators, padded to 4 bytes. Keys are sorted, as KTX2 requires.
+	 */
+	static std::vector<unsigned char> key_value_data(long long source_modified, unsigned long long source_size) {
+		const std::string pairs[] = {
+			std::string("KTXorientation\0ru", 17),				// Rows bottom-up, as OpenGL reads them
+			std::string("sourceModified\0", 15) + std::to_string(source_modified),
+			std::string("sourceSize\0", 11) + std::to_string(source_size),
+		};
+		std::vector<unsigned char> kvd;
+		for (const std::string& pair : pairs) {
+			size_t at = kvd.size();
+			uint32_t length = (uint32_t)pair.size() + 1;
+			kvd.resize(at + ((4 + length + 3) & ~(size_t)3), 0);
+			std::memcpy(&kvd[at], &length, 4);
+			std::memcpy(&kvd[at + 4], pair.data(), pair.size());
+		}
+		return kvd;
+	}
+
+	static bool write_ktx2(const std::string& path, BlockFormat format, const std::vector<CookedLevel>& levels, const std::vector<std::vector<unsigned char>>& data,
+		long long source_modified, unsigned long long source_size) {
+		std::vector<uint32_t> dfd = data_format_descriptor(format);
+		std::vector<unsigned char> kvd = key_value_data(source_modified, source_size);
+
+		size_t dfd_offset = ktx2_header_size + ktx2_level_index_entry * levels.size();
+		size_t kvd_offset = dfd_offset + dfd.size() * 4;
+		size_t kvd_size = kvd.size();
+		size_t data_offset = kvd_offset + kvd_size;
+		data_offset = (data_offset + 15) & ~(size_t)15;			// Levels start on a whole block
+
+		std::vector<unsigned char> head(data_offset, 0);
+		std::memcpy(&head[0], ktx2_identifier, 12);
+		put_u32(head, 12, vk_format(format));
+		put_u32(head, 16, 1);									// typeSize
+		put_u32(head, 20, (uint32_t)levels[0].width);
+		put_u32(head, 24, (uint32_t)levels[0].height);
+		put_u32(head, 28, 0);									// pixelDepth
+		put_u32(head, 32, 0);									// layerCount
+		put_u32(head, 36, 1);									// faceCount
+		put_u32(head, 40, (uint32_t)levels.size());
+		put_u32(head, 44, 0);									// No supercompression
+		put_u32(head, 48, (uint32_t)dfd_offset);
+		put_u32(head, 52, (uint32_t)(dfd.size() * 4));
+		put_u32(head, 56, (uint32_t)kvd_offset);
+		put_u32(head, 60, (uint32_t)kvd_size);
+		put_u64(head, 64, 0);									// No supercompression global data
+		put_u64(head, 72, 0);
+
+		size_t offset = data_offset;
+		for (size_t level = levels.size(); level-- > 0; ) {
+			size_t entry = ktx2_header_size + ktx2_level_index_entry * level;
+			put_u64(head, entry, offset);
+			put_u64(head, entry + 8, levels[level].size);
+			put_u64(head, entry + 16, levels[level].size);
+			offset += levels[level].size;
+		}
+		std::memcpy(&head[dfd_offset], dfd.data(), dfd.size() * 4);
+		std::memcpy(&head[kvd_offset], kvd.data(), kvd.size());
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		file.write((const char*)head.data(), head.size());
+		for (size_t level = levels.size(); level-- > 0; )
+			file.write((const char*)data[level].data(), data[level].size());
+		return (bool)file;
+	}
+
+	bool read_header(const std::string& path, CookedHeader& header) {
+		std::ifstream file(path, std::ios::binary);
+		unsigned char head[ktx2_header_size];
+		if (!file.read((char*)head, sizeof(head)) || std::memcmp(head, ktx2_identifier, 12) != 0)
+			return false;
+
+		uint32_t format = get_u32(head + 12);
+		uint32_t width = get_u32(head + 20), height = get_u32(head + 24);
+		uint32_t level_count = get_u32(head + 40);
+		if (get_u32(head + 28) > 1 || get_u32(head + 32) > 1 || get_u32(head + 36) != 1 || get_u32(head + 44) != 0 || level_count == 0 || level_count > 32)
+			return false;								// Only the plain 2D, uncompressed-container files cook() writes
+		if (format == 131) header.format = BlockFormat::BC1;
+		else if (format == 137) header.format = BlockFormat::BC3;
+		else if (format == 139) header.format = BlockFormat::BC4;
+		else if (format == 141) header.format = BlockFormat::BC5;
+		else return false;
+
+		std::vector<unsigned char> index(ktx2_level_index_entry * level_count);
+		if (!file.read((char*)index.data(), index.size()))
+			return false;
+		header.levels.clear();
+		for (uint32_t level = 0; level < level_count; ++level) {
+			CookedLevel cooked;
+			cooked.width = std::max((int)(width >> level), 1);
+			cooked.height = std::max((int)(height >> level), 1);
+			cooked.offset = (size_t)get_u64(&index[ktx2_level_index_entry * level]);
+			cooked.size = (size_t)get_u64(&index[ktx2_level_index_entry * level + 8]);
+			size_t blocks = (size_t)((cooked.width + 3) / 4) * ((cooked.height + 3) / 4);
+			if (cooked.size != blocks * block_bytes(header.format))
+				return false;
+			header.levels.push_back(cooked);
+		}
+
+		/**
+		 * KTX2 defaults to top-down rows; only bottom-up files can be uploaded as they
+		 * are.
+		 */
+		uint32_t kvd_offset = get_u32(head + 56), kvd_size = get_u32(head + 60);
+		std::vector<unsigned char> kvd(kvd_size);
+		if (kvd_size == 0 || !file.seekg(kvd_offset) || !file.read((char*)kvd.data(), kvd_size))
+			return false;
+		bool bottom_up = false;
+		header.source_modified = 0;
+		header.source_size = 0;
+		for (size_t at = 0; at + 4 <= kvd.size(); ) {
+			uint32_t length = get_u32(&kvd[at]);
+			if (at + 4 + length > kvd.size())
+				break;
+			std::string entry((const char*)&kvd[at + 4], length);
+			std::string key = entry.substr(0, entry.find('\0'));
+			std::string value = key.size() < entry.size() ? entry.substr(key.size() + 1) : std::string();
+			if (key == "KTXorientation")
+				bottom_up = value.compare(0, 2, "ru") == 0;
+			else if (key == "sourceModified")
+				header.source_modified = std::strtoll(value.c_str(), nullptr, 10);
+			else if (key == "sourceSize")
+				header.source_size = std::strtoull(value.c_str(), nullptr, 10);
+			at += (4 + length + 3) & ~(size_t)3;
+		}
+		return bottom_up;
+	}
+
+	bool cook(const std::string& source, const std::string& destination, textures::Usage usage, const CookSettings& settings, CookStats& stats) {
+		double start = now_ms();
+		struct stat info;
+		int width, height, channels;
+		if (stat(source.c_str(), &info) != 0 || !stbi_info(source.c_str(), &width, &height, &channels)) {
+			std::cerr << "ERROR::COOKER::SOURCE::LOADING_FAILED " << source << std::endl;
+			return false;
+		}
+		BlockFormat format = choose_block_format(channels, usage);
+		int components = source_components(format);
+		unsigned char* img_data = stbi_load(source.c_str(), &width, &height, &channels, components);
+		if (img_data == nullptr) {
+			std::cerr << "ERROR::COOKER::SOURCE::LOADING_FAILED " << source << std::endl;
+			return false;
+		}
+
+		/**
+		 * Every level of the mip chain, bottom-up like the loader's uploads.
+		 */
+		std::vector<std::vector<unsigned char>> images(1, std::vector<unsigned char>((size_t)width * height * components));
+		textures::copy_flipped(img_data, images[0].data(), width, height, components);
+		stbi_image_free(img_data);
+
+		std::vector<CookedLevel> levels;
+		int stored_components = textures::choose_format(channels, usage, false).components;
+		for (int level_width = width, level_height = height; ; ) {
+			CookedLevel level;
+			level.width = level_width;
+			level.height = level_height;
+			level.size = (size_t)((level_width + 3) / 4) * ((level_height + 3) / 4) * block_bytes(format);
+			levels.push_back(level);
+			stats.source_bytes += (size_t)level_width * level_height * stored_components;
+			stats.cooked_bytes += level.size;
+			if (level_width == 1 && level_height == 1)
+				break;
+			images.push_back(textures::downsample(images.back(), level_width, level_height, components));
+			level_width = std::max(level_width / 2, 1);
+			level_height = std::max(level_height / 2, 1);
+		}
+		stats.decode_ms += now_ms() - start;
+
+		/**
+		 * Every row of blocks in every level is one work item, taken in turn by each
+		 * thread, as the lightmap baker splits its texels.
+		 */
+		start = now_ms();
+		struct block_row {
+			size_t level;
+			int row;
+		};
+		std::vector<block_row> rows;
+		for (size_t level = 0; level < levels.size(); ++level) {
+			for (int row = 0; row < (levels[level].height + 3) / 4; ++row)
+				rows.push_back({ level, row });
+		}
+
+		std::vector<std::vector<unsigned char>> blocks(levels.size());
+		for (size_t level = 0; level < levels.size(); ++level)
+			blocks[level].resize(levels[level].size);
+
+		std::atomic<size_t> next_row(0);
+		auto encode_rows = [&]() {
+			unsigned char texels[16 * 4];
+			for (size_t item = next_row++; item < rows.size(); item = next_row++) {
+				const CookedLevel& level = levels[rows[item].level];
+				const std::vector<unsigned char>& image = images[rows[item].level];
+				int blocks_wide = (level.width + 3) / 4;
+				for (int bx = 0; bx < blocks_wide; ++bx) {
+					for (int i = 0; i < 16; ++i) {
+						int x = std::min(bx * 4 + i % 4, level.width - 1);				// Repeat the edge into blocks past it
+						int y = std::min(rows[item].row * 4 + i / 4, level.height - 1);
+						std::memcpy(texels + i * components, &image[((size_t)y * level.width + x) * components], components);
+					}
+					size_t block = (size_t)rows[item].row * blocks_wide + bx;
+					encode_block(format, texels, &blocks[rows[item].level][block * block_bytes(format)]);
+				}
+			}
+		};
+
+		unsigned int thread_count = settings.thread_count != 0 ? settings.thread_count : std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < thread_count; ++i)
+			threads.emplace_back(encode_rows);
+		encode_rows();
+		for (std::thread& thread : threads)
+			thread.join();
+		stats.encode_ms += now_ms() - start;
+		stats.threads = thread_count;
+
+		if (!write_ktx2(destination, format, levels, blocks, (long long)info.st_mtime, (unsigned long long)info.st_size)) {
+			std::cerr << "ERROR::COOKER::FILE::WRITING_FAILED " << destination << std::endl;
+			return false;
+		}
+		++stats.images;
+		return true;
+	}
+}
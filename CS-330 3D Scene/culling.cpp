@@ -0,0 +1,238 @@
+/**
+ * "culling.cpp" - Implementations for the frustum culling stage. Function prototypes
+ *		defined in "culling.h".
+ */
+#include <cmath>
+#include <algorithm>
+
+#include <immintrin.h>
+
+#include "culling.h"
+
+namespace culling {
+	void BoundsSoA::resize(size_t count) {
+		center_x.resize(count);
+		center_y.resize(count);
+		center_z.resize(count);
+		extent_x.resize(count);
+		extent_y.resize(count);
+		extent_z.resize(count);
+		radius.resize(count);
+	}
+
+	void BoundsSoA::set(size_t index, glm::vec3 center, glm::vec3 extent, float sphere_radius) {
+		center_x[index] = center.x;
+		center_y[index] = center.y;
+		center_z[index] = center.z;
+		extent_x[index] = extent.x;
+		extent_y[index] = extent.y;
+		extent_z[index] = extent.z;
+		radius[index] = sphere_radius;
+	}
+
+	/**
+	 * Gribb/Hartmann plane extraction: each plane is the sum or difference of the
+	 * fourth row of the view-projection matrix and one of the other rows.
+	 */
+	Frustum extract_frustum(const glm::mat4& m) {
+		Frustum frustum;
+
+		glm::vec4 row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		frustum.planes[0] = row3 + row0;	// left
+		frustum.planes[1] = row3 - row0;	// right
+		frustum.planes[2] = row3 + row1;	// bottom
+		frustum.planes[3] = row3 - row1;	// top
+		frustum.planes[4] = row3 + row2;	// near
+		frustum.planes[5] = row3 - row2;	// far
+
+		for (int i = 0; i < 6; ++i) {
+			float length = glm::length(glm::vec3(frustum.planes[i]));
+			frustum.planes[i] /= length;	// normalize so plane distances are in world units
+		}
+
+		return frustum;
+	}
+
+	/**
+	 * Arvo's method: the world-space box is centered on the transformed center with
+	 * extents given by the absolute value of the upper 3x3 times the local extents.
+	 * The sphere is the local box's circumsphere scaled by the largest axis scale,
+	 * which is tighter than the world box for rotated objects.
+	 */
+	void world_bounds(const Model& model, glm::vec3& center, glm::vec3& extent, float& sphere_radius) {
+		glm::vec3 local_center = (model.bounds_min + model.bounds_max) * 0.5f;
+		glm::vec3 local_extent = (model.bounds_max - model.bounds_min) * 0.5f;
+
+		glm::mat3 basis = glm::mat3(model.model);
+		glm::mat3 abs_basis = glm::mat3(glm::abs(basis[0]), glm::abs(basis[1]), glm::abs(basis[2]));
+
+		center = glm::vec3(model.model * glm::vec4(local_center, 1.f));
+		extent = abs_basis * local_extent;
+
+		float max_scale = std::max(glm::length(basis[0]), std::max(glm::length(basis[1]), glm::length(basis[2])));
+		sphere_radius = glm::length(local_extent) * max_scale;
+	}
+
+	void update_bounds(BoundsSoA& bounds, const std::vector<Model>& models) {
+		bounds.resize(models.size());
+
+		for (size_t i = 0; i < models.size(); ++i) {
+			glm::vec3 center, extent;
+			float radius;
+
+			world_bounds(models[i], center, extent, radius);
+			bounds.set(i, center, extent, radius);
+		}
+	}
+
+	/**
+	 * Test object i against a single plane. An object is outside when its center is
+	 * further behind the plane than the smaller of its sphere radius and its box's
+	 * projected half-width.
+	 */
+	static inline bool outside_plane(const glm::vec4& plane, const BoundsSoA& bounds, size_t i) {
+		float distance = plane.x * bounds.center_x[i] + plane.y * bounds.center_y[i] + plane.z * bounds.center_z[i] + plane.w;
+		float box_reach = std::fabs(plane.x) * bounds.extent_x[i] + std::fabs(plane.y) * bounds.extent_y[i] + std::fabs(plane.z) * bounds.extent_z[i];
+
+		return distance + std::min(bounds.radius[i], box_reach) < 0.f;
+	}
+
+	static inline void cull_range_scalar(const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, std::vector<unsigned int>& visible) {
+		for (size_t i = begin; i < end; ++i) {
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; ++p)
+				inside = !outside_plane(frustum.planes[p], bounds, i);
+
+			if (inside)
+				visible.push_back((unsigned int)i);
+		}
+	}
+
+	void cull_scalar(const Frustum& frustum, const BoundsSoA& bounds, std::vector<unsigned int>& visible, CullStats& stats) {
+		visible.clear();
+		cull_range_scalar(frustum, bounds, 0, bounds.size(), visible);
+
+		stats.visible = (unsigned int)visible.size();
+		stats.culled = (unsigned int)(bounds.size() - visible.size());
+	}
+
+	void cull(const Frustum& frustum, const BoundsSoA& bounds, std::vector<unsigned int>& visible, CullStats& stats) {
+		visible.clear();
+
+		const size_t count = bounds.size();
+		size_t i = 0;
+
+#ifdef __AVX__
+		/**
+		 * 8 objects per iteration.
+		 */
+		__m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+		__m256 abs_x[6], abs_y[6], abs_z[6];
+		for (int p = 0; p < 6; ++p) {
+			plane_x[p] = _mm256_set1_ps(frustum.planes[p].x);
+			plane_y[p] = _mm256_set1_ps(frustum.planes[p].y);
+			plane_z[p] = _mm256_set1_ps(frustum.planes[p].z);
+			plane_w[p] = _mm256_set1_ps(frustum.planes[p].w);
+			abs_x[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].x));
+			abs_y[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].y));
+			abs_z[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].z));
+		}
+		const __m256 zero8 = _mm256_setzero_ps();
+
+		for (; i + 8 <= count; i += 8) {
+			__m256 cx = _mm256_loadu_ps(&bounds.center_x[i]);
+			__m256 cy = _mm256_loadu_ps(&bounds.center_y[i]);
+			__m256 cz = _mm256_loadu_ps(&bounds.center_z[i]);
+			__m256 ex = _mm256_loadu_ps(&bounds.extent_x[i]);
+			__m256 ey = _mm256_loadu_ps(&bounds.extent_y[i]);
+			__m256 ez = _mm256_loadu_ps(&bounds.extent_z[i]);
+			__m256 r = _mm256_loadu_ps(&bounds.radius[i]);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; ++p) {
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(plane_x[p], cx), _mm256_mul_ps(plane_y[p], cy)),
+					_mm256_add_ps(_mm256_mul_ps(plane_z[p], cz), plane_w[p]));
+				__m256 box_reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(abs_x[p], ex), _mm256_mul_ps(abs_y[p], ey)), _mm256_mul_ps(abs_z[p], ez));
+				__m256 reach = _mm256_min_ps(r, box_reach);
+
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero8, _CMP_GE_OQ));
+			}
+
+			int mask = _mm256_movemask_ps(inside);
+			for (int lane = 0; lane < 8; ++lane)
+				if (mask & (1 << lane))
+					visible.push_back((unsigned int)(i + lane));
+		}
+#endif
+		/**
+		 * 4 objects per iteration (also handles the AVX remainder).
+		 */
+		__m128 plane_x4[6], plane_y4[6], plane_z4[6], plane_w4[6];
+		__m128 abs_x4[6], abs_y4[6], abs_z4[6];
+		for (int p = 0; p < 6; ++p) {
+			plane_x4[p] = _mm_set1_ps(frustum.planes[p].x);
+			plane_y4[p] = _mm_set1_ps(frustum.planes[p].y);
+			plane_z4[p] = _mm_set1_ps(frustum.planes[p].z);
+			plane_w4[p] = _mm_set1_ps(frustum.planes[p].w);
+			abs_x4[p] = _mm_set1_ps(std::fabs(frustum.planes[p].x));
+			abs_y4[p] = _mm_set1_ps(std::fabs(frustum.planes[p].y));
+			abs_z4[p] = _mm_set1_ps(std::fabs(frustum.planes[p].z));
+		}
+		const __m128 zero4 = _mm_setzero_ps();
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 cx = _mm_loadu_ps(&bounds.center_x[i]);
+			__m128 cy = _mm_loadu_ps(&bounds.center_y[i]);
+			__m128 cz = _mm_loadu_ps(&bounds.center_z[i]);
+			__m128 ex = _mm_loadu_ps(&bounds.extent_x[i]);
+			__m128 ey = _mm_loadu_ps(&bounds.extent_y[i]);
+			__m128 ez = _mm_loadu_ps(&bounds.extent_z[i]);
+			__m128 r = _mm_loadu_ps(&bounds.radius[i]);
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; ++p) {
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane_x4[p], cx), _mm_mul_ps(plane_y4[p], cy)),
+					_mm_add_ps(_mm_mul_ps(plane_z4[p], cz), plane_w4[p]));
+				__m128 box_reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_x4[p], ex), _mm_mul_ps(abs_y4[p], ey)), _mm_mul_ps(abs_z4[p], ez));
+				__m128 reach = _mm_min_ps(r, box_reach);
+
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero4));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (int lane = 0; lane < 4; ++lane)
+				if (mask & (1 << lane))
+					visible.push_back((unsigned int)(i + lane));
+		}
+
+		cull_range_scalar(frustum, bounds, i, count, visible);	// Remaining 0-3 objects
+
+		stats.visible = (unsigned int)visible.size();
+		stats.culled = (unsigned int)(count - visible.size());
+	}
+
+	bool sphere_visible(const Frustum& frustum, glm::vec3 center, float radius) {
+		for (int p = 0; p < 6; ++p)
+			if (glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w < -radius)
+				return false;
+
+		return true;
+	}
+
+	bool aabb_visible(const Frustum& frustum, glm::vec3 aabb_min, glm::vec3 aabb_max) {
+		glm::vec3 center = (aabb_min + aabb_max) * 0.5f;
+		glm::vec3 extent = (aabb_max - aabb_min) * 0.5f;
+
+		for (int p = 0; p < 6; ++p) {
+			glm::vec3 normal = glm::vec3(frustum.planes[p]);
+			if (glm::dot(normal, center) + frustum.planes[p].w + glm::dot(glm::abs(normal), extent) < 0.f)
+				return false;
+		}
+
+		return true;
+	}
+}
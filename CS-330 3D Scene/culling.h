@@ -0,0 +1,75 @@
+/**
+ * "culling.h" - Frustum culling of Models against the camera's view-projection matrix.
+ *		World-space bounds are kept in structure-of-arrays form so that the plane tests
+ *		can be run on 4 (SSE) or 8 (AVX) objects per iteration. Function implementations
+ *		defined in "culling.cpp".
+ */
+#pragma once
+#ifndef __CULLING_H__
+#define __CULLING_H__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "models.h"
+
+namespace culling {
+	/**
+	 * The six planes of a view frustum, stored as (normal.xyz, distance) with the normals
+	 * pointing into the frustum. Order: left, right, bottom, top, near, far.
+	 */
+	struct Frustum {
+		glm::vec4 planes[6];
+	};
+
+	/**
+	 * World-space bounding volumes of a set of objects in structure-of-arrays layout.
+	 * Each object has a bounding sphere (center, radius) and an axis-aligned box that
+	 * shares the sphere's center (center, extent). An object is only culled when the
+	 * tighter of the two volumes is outside a plane.
+	 */
+	struct BoundsSoA {
+		std::vector<float> center_x;
+		std::vector<float> center_y;
+		std::vector<float> center_z;
+		std::vector<float> extent_x;
+		std::vector<float> extent_y;
+		std::vector<float> extent_z;
+		std::vector<float> radius;
+
+		size_t size() const { return radius.size(); }
+		void resize(size_t count);
+		void set(size_t index, glm::vec3 center, glm::vec3 extent, float sphere_radius);
+	};
+
+	/**
+	 * Counters for the most recent culling pass.
+	 */
+	struct CullStats {
+		unsigned int visible = 0;
+		unsigned int culled = 0;
+	};
+
+	Frustum extract_frustum(const glm::mat4& view_projection);			// Extract (normalized) frustum planes from a view-projection matrix
+
+	void world_bounds(const Model& model, glm::vec3& center, glm::vec3& extent, float& sphere_radius);	// Transform a Model's object-space box into world-space bounds
+
+	void update_bounds(BoundsSoA& bounds, const std::vector<Model>& models);	// Refresh bounds from the Models' current model matrices
+
+	/**
+	 * Test every object in bounds against the frustum and write the indices of the
+	 * visible ones to visible (cleared first). Uses AVX when compiled with it, otherwise
+	 * SSE.
+	 */
+	void cull(const Frustum& frustum, const BoundsSoA& bounds, std::vector<unsigned int>& visible, CullStats& stats);
+
+	/**
+	 * Scalar reference implementation of cull(), kept for validation and benchmarking.
+	 */
+	void cull_scalar(const Frustum& frustum, const BoundsSoA& bounds, std::vector<unsigned int>& visible, CullStats& stats);
+
+	bool sphere_visible(const Frustum& frustum, glm::vec3 center, float radius);	// Test a single bounding sphere
+	bool aabb_visible(const Frustum& frustum, glm::vec3 aabb_min, glm::vec3 aabb_max);	// Test a single axis-aligned box
+}
+#endif//__CULLING_H__
@@ -0,0 +1,176 @@
+/**
+ * "debug_draw.cpp" - Implementations for the debug line batch. Function prototypes
+ *		defined in "debug_draw.h".
+ */
+#include <glad/glad.h>
+
+#include <cmath>
+#include <cstddef>
+
+#include "debug_draw.h"
+
+namespace debug_draw {
+	static const int CIRCLE_SEGMENTS = 24;
+
+	void LineBatch::init() {
+		shader = new Shader("shaders/debug_lines.vs.glsl", "shaders/debug_lines.fs.glsl");
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(line_vertex), (void*)offsetof(line_vertex, position));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(line_vertex), (void*)offsetof(line_vertex, color));
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void LineBatch::clear() {
+		vertices.clear();						// Keeps its capacity, so a steady frame allocates nothing
+		normal_draws_used = 0;					// Last frame's normal lines stay for normals() to compare against
+		normal_line_count = 0;
+		normals_changed = false;
+	}
+
+	void LineBatch::line(const glm::vec3& from, const glm::vec3& to, const glm::vec3& color) {
+		vertices.push_back({ from, color });
+		vertices.push_back({ to, color });
+	}
+
+	/**
+	 * Twelve edges between eight corners; bit i of a corner index picks min or max on
+	 * axis i.
+	 */
+	static void add_cube_edges(LineBatch& batch, const glm::vec3 corners[8], const glm::vec3& color) {
+		for (int corner = 0; corner < 8; ++corner) {
+			for (int axis = 0; axis < 3; ++axis) {
+				if (!(corner & (1 << axis)))
+					batch.line(corners[corner], corners[corner | (1 << axis)], color);
+			}
+		}
+	}
+
+	void LineBatch::box(const bvh::AABB& box, const glm::vec3& color) {
+		glm::vec3 corners[8];
+		for (int corner = 0; corner < 8; ++corner) {
+			corners[corner] = glm::vec3(corner & 1 ? box.max.x : box.min.x,
+				corner & 2 ? box.max.y : box.min.y,
+				corner & 4 ? box.max.z : box.min.z);
+		}
+		add_cube_edges(*this, corners, color);
+	}
+
+	void LineBatch::frustum(const glm::mat4& view_projection, const glm::vec3& color) {
+		glm::mat4 inverse = glm::inverse(view_projection);
+		glm::vec3 corners[8];
+		for (int corner = 0; corner < 8; ++corner) {
+			glm::vec4 ndc = glm::vec4(corner & 1 ? 1.f : -1.f, corner & 2 ? 1.f : -1.f, corner & 4 ? 1.f : -1.f, 1.f);
+			glm::vec4 world = inverse * ndc;
+			corners[corner] = glm::vec3(world) / world.w;
+		}
+		add_cube_edges(*this, corners, color);
+	}
+
+	void LineBatch::light_radius(const RadiantLight& light) {
+		if (!(light.radius > 0.f) || !std::isfinite(light.radius))
+			return;								// No cutoff: no sphere to draw
+
+		for (int axis = 0; axis < 3; ++axis) {
+			int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			glm::vec3 previous = light.position;
+			previous[u] += light.radius;
+			for (int segment = 1; segment <= CIRCLE_SEGMENTS; ++segment) {
+				float angle = 6.28318531f * segment / CIRCLE_SEGMENTS;
+				glm::vec3 point = light.position;
+				point[u] += light.radius * std::cos(angle);
+				point[v] += light.radius * std::sin(angle);
+				line(previous, point, light.color);
+				previous = point;
+			}
+		}
+	}
+
+	void LineBatch::normals(const Model& model, float length, const glm::vec3& color) {
+		auto cached = normal_cache.find(model.VAO);
+		if (cached == normal_cache.end()) {
+			cached = normal_cache.emplace(model.VAO, normal_mesh()).first;
+			normal_mesh& mesh = cached->second;
+
+			std::vector<glm::vec3> positions, normals;
+			read_back_vertices(model, positions, normals);
+			for (size_t i = 0; i < positions.size(); ++i) {
+				if (normals[i] == glm::vec3(0.f))
+					continue;					// No direction to draw
+				mesh.positions.push_back(positions[i]);
+				mesh.normals.push_back(normals[i]);
+			}
+		}
+
+		const normal_mesh& mesh = cached->second;
+		if (mesh.positions.empty())
+			return;
+
+		if (normal_draws_used == normal_draws.size())
+			normal_draws.emplace_back();
+		normal_draw& d = normal_draws[normal_draws_used++];
+		normal_line_count += mesh.positions.size();
+		if (d.mesh == &mesh && d.model == model.model && d.length == length && d.color == color)
+			return;								// Same lines as last frame
+
+		d.mesh = &mesh;
+		d.model = model.model;
+		d.length = length;
+		d.color = color;
+		d.lines.clear();
+		d.lines.reserve(mesh.positions.size() * 2);
+		glm::mat3 normal_model = glm::transpose(glm::inverse(glm::mat3(model.model)));
+		for (size_t i = 0; i < mesh.positions.size(); ++i) {
+			glm::vec3 from = glm::vec3(model.model * glm::vec4(mesh.positions[i], 1.f));
+			d.lines.push_back({ from, color });
+			d.lines.push_back({ from + glm::normalize(normal_model * mesh.normals[i]) * length, color });
+		}
+		normals_changed = true;
+	}
+
+	void LineBatch::draw(const glm::mat4& projection, const glm::mat4& view) {
+		size_t normal_vertices = normal_line_count * 2;
+		size_t total = normal_vertices + vertices.size();
+		if (total == 0)
+			return;
+
+		/**
+		 * The normals go first. When they are the same as last frame's they are left
+		 * in place and only the lines after them are replaced; otherwise the buffer is
+		 * orphaned, so the driver never has to wait for last frame's draw, and filled
+		 * again. It grows geometrically.
+		 */
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		bool keep_normals = !normals_changed && normal_draws_used == uploaded_normal_draws && total <= capacity;
+		if (keep_normals) {
+			if (!vertices.empty())
+				glBufferSubData(GL_ARRAY_BUFFER, normal_vertices * sizeof(line_vertex), vertices.size() * sizeof(line_vertex), vertices.data());
+		}
+		else {
+			if (total > capacity)
+				capacity = total + total / 2;
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(line_vertex), NULL, GL_STREAM_DRAW);
+			size_t offset = 0;
+			for (size_t i = 0; i < normal_draws_used; ++i) {
+				const std::vector<line_vertex>& lines = normal_draws[i].lines;
+				glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(line_vertex), lines.size() * sizeof(line_vertex), lines.data());
+				offset += lines.size();
+			}
+			glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(line_vertex), vertices.size() * sizeof(line_vertex), vertices.data());
+			uploaded_normal_draws = normal_draws_used;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		shader->use();
+		shader->setMat4("viewProjection", projection * view);
+		glBindVertexArray(VAO);
+		glDrawArrays(GL_LINES, 0, (GLsizei)total);
+		glBindVertexArray(0);
+	}
+}
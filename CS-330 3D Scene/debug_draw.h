@@ -0,0 +1,90 @@
+/**
+ * "debug_draw.h" - Debug visualization. Vertex normals, bounding boxes, light radii
+ *		and frustums are added as world-space lines to one CPU-side batch, uploaded
+ *		into a single vertex buffer and drawn with one GL_LINES call per frame. Normals
+ *		are read back from a Model's vertex buffer once per mesh (VAO) and transformed
+ *		only when a Model's matrix changes; while the frame's normals match the last
+ *		frame's they stay in the buffer and only the other lines are uploaded. Function
+ *		implementations defined in "debug_draw.cpp".
+ */
+#pragma once
+#ifndef __DEBUG_DRAW_H__
+#define __DEBUG_DRAW_H__
+
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "lights.h"
+#include "models.h"
+#include "shader.h"
+
+namespace debug_draw {
+	/**
+	 * What the scene adds to the batch; each level includes the previous one.
+	 */
+	enum class Level {
+		OFF,
+		GIZMOS,									// Bounding boxes, shadow cascade frustums and light radii
+		NORMALS,								// ...plus vertex normals
+	};
+
+	class LineBatch {
+	public:
+		void init();							// Create the shader and buffers; requires a GL context
+
+		void clear();							// Start a new frame's batch
+		void line(const glm::vec3& from, const glm::vec3& to, const glm::vec3& color);
+		void box(const bvh::AABB& box, const glm::vec3& color);
+		void frustum(const glm::mat4& view_projection, const glm::vec3& color);	// Edges of the volume view_projection maps to clip space
+		void light_radius(const RadiantLight& light);	// One circle of the cutoff radius around each axis, in the light's color; nothing without a cutoff
+
+		void normals(const Model& model, float length, const glm::vec3& color);	// One line per vertex; requires a GL context the first time a mesh is seen
+
+		/**
+		 * Upload the batch and draw it, normals included, in one call. Lines are depth
+		 * tested against whatever has been drawn.
+		 */
+		void draw(const glm::mat4& projection, const glm::mat4& view);
+
+		size_t line_count() const { return vertices.size() / 2 + normal_line_count; }
+		size_t draw_count() const { return line_count() == 0 ? 0 : 1; }
+
+	private:
+		struct line_vertex {
+			glm::vec3 position;
+			glm::vec3 color;
+		};
+
+		struct normal_mesh {
+			std::vector<glm::vec3> positions;	// Object space
+			std::vector<glm::vec3> normals;		// Object space, never zero
+		};
+
+		/**
+		 * The world-space lines of one normals() call. Kept across frames so that the
+		 * same Model in the same place in the call order is not transformed again.
+		 */
+		struct normal_draw {
+			const normal_mesh* mesh = nullptr;
+			glm::mat4 model;
+			float length = 0.f;
+			glm::vec3 color;
+			std::vector<line_vertex> lines;
+		};
+
+		std::vector<line_vertex> vertices;		// Everything but the normals
+		std::unordered_map<unsigned int, normal_mesh> normal_cache;		// By Model VAO
+		std::vector<normal_draw> normal_draws;	// In call order; only the first normal_draws_used are this frame's
+		size_t normal_draws_used = 0;
+		size_t normal_line_count = 0;
+		bool normals_changed = false;			// A call this frame differs from the same call last frame
+		size_t uploaded_normal_draws = 0;		// normal_draws in the VBO, ahead of the other lines
+		Shader* shader = nullptr;
+		unsigned int VAO = 0, VBO = 0;
+		size_t capacity = 0;					// Vertices the VBO has room for
+	};
+}
+#endif//__DEBUG_DRAW_H__
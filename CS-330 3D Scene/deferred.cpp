@@ -0,0 +1,185 @@
+/**
+ * "deferred.cpp" - Implementations for the deferred shading path. Function prototypes
+ *		defined in "deferred.h".
+ */
+#include <glad/glad.h>
+
+#include <iostream>
+
+#include "deferred.h"
+#include "models.h"
+#include "shadows.h"
+#include "environment.h"
+#include "reflections.h"
+
+namespace deferred {
+	static unsigned int create_target(GLenum internal_format, GLenum format, GLenum type, int width, int height) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);		// Lighting reads exactly one texel per pixel
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+
+	void setup_lighting_shader(Shader& shader, unsigned int features) {
+		shader.setInt("gAlbedoSpecular", 0);
+		shader.setInt("gNormal", 1);
+		shader.setInt("gDepth", 2);
+		if (features & permutations::CLUSTERED_LIGHTS)
+			clustered::set_texture_units(shader);
+		if (features & permutations::SHADOWS) {
+			shader.setInt("dirShadowMap", shadows::FIRST_TEXTURE_UNIT);
+			shader.setInt("pointShadowMap", shadows::FIRST_TEXTURE_UNIT + 1);
+		}
+		if (features & permutations::AMBIENT_OCCLUSION)
+			shader.setInt("aoTexture", ssao::TEXTURE_UNIT);
+		if (features & permutations::SH_AMBIENT)
+			environment::bind_uniform_block(shader);
+		if (features & permutations::REFLECTIONS)
+			reflections::set_texture_units(shader);
+	}
+
+	unsigned int lighting_features(const clustered::ClusterGrid* grid, const Fog* fog) {
+		unsigned int features = 0;
+		if (grid != nullptr)
+			features |= permutations::CLUSTERED_LIGHTS;
+		if (fog != nullptr)
+			features |= permutations::FOG;
+		if (models_blinn_phong())
+			features |= permutations::BLINN_PHONG;
+		if (models_shadows() != nullptr)
+			features |= permutations::SHADOWS;
+		if (models_sh_ambient())
+			features |= permutations::SH_AMBIENT;
+		if (models_reflections() != nullptr)
+			features |= permutations::REFLECTIONS;
+		return features;
+	}
+
+	void set_lighting_uniforms(Shader& shader, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos,
+		const clustered::ClusterGrid* grid, const Fog* fog, int width, int height) {
+		shader.use();
+		shader.setMat4("inverseViewProjection", glm::inverse(projection * view));
+		shader.setMat4("view", view);
+		shader.setFloat("ambientStrength", glob::ambient_strength);
+		shader.setVec3("pointLight.position", point_light.position);
+		shader.setVec3("pointLight.color", point_light.color);
+		shader.setVec3("dirLight.direction", dir_light.direction);
+		shader.setVec3("dirLight.color", dir_light.color);
+		shader.setVec3("attenCoeff", point_light.attenuation_coefficients);
+		shader.setVec3("viewPos", viewPos);
+
+		if (grid != nullptr)
+			grid->bind(shader, width, height);
+
+		if (models_shadows() != nullptr)
+			models_shadows()->bind(shader);
+
+		if (models_reflections() != nullptr)
+			models_reflections()->bind(shader);
+
+		if (fog != nullptr) {
+			shader.setVec3("fogColor", fog->color);
+			shader.setFloat("fogDensity", fog->density);
+		}
+	}
+
+	void DeferredRenderer::init(int width, int height) {
+		lighting_shaders = new permutations::ShaderCache("shaders/fullscreen.vs.glsl", "shaders/deferred_lighting.fs.glsl", setup_lighting_shader, "shaders/lighting.glsl");
+
+		glGenVertexArrays(1, &empty_VAO);
+		resize(width, height);
+	}
+
+	void DeferredRenderer::release() {
+		if (framebuffer == 0)
+			return;
+
+		glDeleteFramebuffers(1, &framebuffer);
+		unsigned int textures[3] = { albedo_specular, normal, depth };
+		glDeleteTextures(3, textures);
+		framebuffer = 0;
+	}
+
+	void DeferredRenderer::resize(int width, int height) {
+		release();
+		buffer_width = width;
+		buffer_height = height;
+
+		albedo_specular = create_target(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+		normal = create_target(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+		depth = create_target(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);	// Matches the default framebuffer so depth can be blitted
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo_specular, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+
+		const GLenum draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, draw_buffers);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cerr << "ERROR::FRAMEBUFFER::GBUFFER::INCOMPLETE" << std::endl;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void DeferredRenderer::begin_geometry() {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, buffer_width, buffer_height);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	void DeferredRenderer::shade(glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos,
+		const clustered::ClusterGrid* grid, const Fog* fog, unsigned int output_framebuffer) {
+		if (ambient_occlusion != nullptr)
+			ambient_occlusion->compute(depth, normal, buffer_width, buffer_height, projection, view);
+		glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+
+		unsigned int features = lighting_features(grid, fog);
+		if (ambient_occlusion != nullptr)
+			features |= permutations::AMBIENT_OCCLUSION;
+
+		Shader& lighting_shader = lighting_shaders->get(features);
+		set_lighting_uniforms(lighting_shader, projection, view, point_light, dir_light, viewPos, grid, fog, buffer_width, buffer_height);
+		if (ambient_occlusion != nullptr)
+			ambient_occlusion->bind(lighting_shader);
+
+		const unsigned int targets[3] = { albedo_specular, normal, depth };
+		for (int i = 0; i < 3; ++i) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, targets[i]);
+		}
+
+		/**
+		 * The lighting pass replaces every covered pixel and must not be depth tested
+		 * or clipped by wireframe mode.
+		 */
+		GLint polygon_mode[2];
+		glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glDisable(GL_DEPTH_TEST);
+
+		glBindVertexArray(empty_VAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+
+		glEnable(GL_DEPTH_TEST);
+		glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+		glActiveTexture(GL_TEXTURE0);
+
+		/**
+		 * Copy the G-buffer's depth into the output framebuffer.
+		 */
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output_framebuffer);
+		glBlitFramebuffer(0, 0, buffer_width, buffer_height, 0, 0, buffer_width, buffer_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+	}
+}
@@ -0,0 +1,87 @@
+/**
+ * "deferred.h" - Deferred shading path, selectable at runtime next to forward shading.
+ *		The geometry pass writes a compact G-buffer (12 bytes per pixel):
+ *			RGBA8	albedo, specular strength
+ *			RG16	octahedral-encoded normal
+ *			D24S8	depth, from which the lighting pass reconstructs position
+ *		A full-screen lighting pass then shades every pixel once, however much overdraw
+ *		the geometry had, using the same point/directional lights as the forward
+ *		shaders plus the clustered light lists, and optionally darkens ambient light
+ *		with screen-space ambient occlusion (see ssao.h). Function implementations
+ *		defined in "deferred.cpp".
+ */
+#pragma once
+#ifndef __DEFERRED_H__
+#define __DEFERRED_H__
+
+#include <glm/glm.hpp>
+
+#include "clustered.h"
+#include "lights.h"
+#include "models.h"
+#include "permutations.h"
+#include "ssao.h"
+
+namespace deferred {
+	/**
+	 * Where the scene Models are lit: per fragment as they are drawn, per pixel from
+	 * the G-buffer, or per pixel from the visibility buffer (see visibility.h).
+	 */
+	enum class Path {
+		FORWARD,
+		DEFERRED,
+		VISIBILITY_BUFFER,
+	};
+
+	/**
+	 * The lighting pass, shared with the visibility buffer's resolve: the features of
+	 * deferred_lighting.fs.glsl that the Model shaders' current state turns on, the
+	 * texture units of a newly compiled variant, and its light, shadow, probe and fog
+	 * uniforms.
+	 */
+	unsigned int lighting_features(const clustered::ClusterGrid* grid, const Fog* fog);
+	void setup_lighting_shader(Shader& shader, unsigned int features);
+	void set_lighting_uniforms(Shader& shader, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos,
+		const clustered::ClusterGrid* grid, const Fog* fog, int width, int height);
+
+	class DeferredRenderer {
+	public:
+		ssao::AmbientOcclusion* ambient_occlusion = nullptr;	// Computed from the G-buffer in shade() when set
+
+		void init(int width, int height);		// Create the G-buffer and shaders; requires a GL context
+		void resize(int width, int height);		// Recreate the G-buffer attachments at a new size
+
+		/**
+		 * Bind and clear the G-buffer. Draw Models with draw_model_gbuffer() until
+		 * shade() is called.
+		 */
+		void begin_geometry();
+
+		/**
+		 * Light the G-buffer into output_framebuffer (the default framebuffer unless
+		 * given), then copy its depth there so forward-rendered objects drawn afterwards
+		 * are still depth tested. The output needs a D24S8 depth buffer at least as large
+		 * as the G-buffer. grid may be null to skip clustered lights, and fog null to skip
+		 * fog. With ambient_occlusion set its pass runs first, on this frame's G-buffer.
+		 */
+		void shade(glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos,
+			const clustered::ClusterGrid* grid, const Fog* fog, unsigned int output_framebuffer = 0);
+
+		int width() const { return buffer_width; }
+		int height() const { return buffer_height; }
+
+	private:
+		unsigned int framebuffer = 0;
+		unsigned int albedo_specular = 0;		// RGBA8
+		unsigned int normal = 0;				// RG16
+		unsigned int depth = 0;					// DEPTH24_STENCIL8
+		unsigned int empty_VAO = 0;				// Core profile needs a VAO bound even for attribute-less draws
+		int buffer_width = 0;
+		int buffer_height = 0;
+
+		permutations::ShaderCache* lighting_shaders = nullptr;	// CLUSTERED_LIGHTS and FOG variants
+
+		void release();
+	};
+}
+#endif//__DEFERRED_H__
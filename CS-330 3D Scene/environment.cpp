@@ -0,0 +1,143 @@
+/**
+ * "environment.cpp" - Implementations for environment lighting. Function prototypes
+ *		defined in "environment.h".
+ */
+#include <glad/glad.h>
+
+#include <cmath>
+
+#include "environment.h"
+
+namespace environment {
+	/**
+	 * The real SH basis constants for bands 0-2, in the order the coefficients are
+	 * stored: 1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2.
+	 */
+	static const float basis_constants[SH_COEFFICIENTS] = {
+		0.282095f,
+		0.488603f, 0.488603f, 0.488603f,
+		1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f,
+	};
+
+	static void basis(glm::vec3 d, float result[SH_COEFFICIENTS]) {
+		const float polynomial[SH_COEFFICIENTS] = {
+			1.f,
+			d.y, d.z, d.x,
+			d.x * d.y, d.y * d.z, 3.f * d.z * d.z - 1.f, d.x * d.z, d.x * d.x - d.y * d.y,
+		};
+		for (int i = 0; i < SH_COEFFICIENTS; ++i)
+			result[i] = basis_constants[i] * polynomial[i];
+	}
+
+	glm::vec3 cubemap_direction(int face, int x, int y, int size) {
+		float u = 2.f * (x + 0.5f) / size - 1.f;
+		float v = 2.f * (y + 0.5f) / size - 1.f;
+
+		glm::vec3 direction;
+		switch (face) {
+		case 0: direction = glm::vec3(1.f, -v, -u); break;
+		case 1: direction = glm::vec3(-1.f, -v, u); break;
+		case 2: direction = glm::vec3(u, 1.f, v); break;
+		case 3: direction = glm::vec3(u, -1.f, -v); break;
+		case 4: direction = glm::vec3(u, -v, 1.f); break;
+		default: direction = glm::vec3(-u, -v, -1.f); break;
+		}
+		return glm::normalize(direction);
+	}
+
+	Cubemap procedural_environment(int size, glm::vec3 sky, glm::vec3 horizon, glm::vec3 ground) {
+		Cubemap cubemap;
+		cubemap.size = size;
+		for (int face = 0; face < 6; ++face) {
+			cubemap.faces[face].resize((size_t)size * size);
+			for (int y = 0; y < size; ++y) {
+				for (int x = 0; x < size; ++x) {
+					float height = cubemap_direction(face, x, y, size).y;
+					glm::vec3 color = height >= 0.f ? glm::mix(horizon, sky, std::sqrt(height)) : glm::mix(horizon, ground, std::sqrt(-height));
+					cubemap.faces[face][(size_t)y * size + x] = color;
+				}
+			}
+		}
+		return cubemap;
+	}
+
+	/**
+	 * Solid angle of the part of a cube face from its centre to (x, y), in face
+	 * coordinates; differences of four of these give a texel's solid angle.
+	 */
+	static float area_element(float x, float y) {
+		return std::atan2(x * y, std::sqrt(x * x + y * y + 1.f));
+	}
+
+	SH9 project(const Cubemap& cubemap) {
+		SH9 sh = {};
+		float total_weight = 0.f;
+		float texel = 2.f / cubemap.size;
+
+		for (int face = 0; face < 6; ++face) {
+			for (int y = 0; y < cubemap.size; ++y) {
+				for (int x = 0; x < cubemap.size; ++x) {
+					float u0 = x * texel - 1.f, v0 = y * texel - 1.f;
+					float weight = area_element(u0, v0) - area_element(u0, v0 + texel) - area_element(u0 + texel, v0) + area_element(u0 + texel, v0 + texel);
+
+					float values[SH_COEFFICIENTS];
+					basis(cubemap_direction(face, x, y, cubemap.size), values);
+					glm::vec3 radiance = cubemap.faces[face][(size_t)y * cubemap.size + x];
+					for (int i = 0; i < SH_COEFFICIENTS; ++i)
+						sh.coefficients[i] += radiance * values[i] * weight;
+					total_weight += weight;
+				}
+			}
+		}
+
+		/**
+		 * The texel solid angles add up to 4 pi up to rounding; normalize so a constant
+		 * environment projects exactly.
+		 */
+		for (int i = 0; i < SH_COEFFICIENTS; ++i)
+			sh.coefficients[i] *= 4.f * 3.14159265f / total_weight;
+		return sh;
+	}
+
+	SH9 irradiance(const SH9& radiance) {
+		const float band_scale[3] = { 1.f, 2.f / 3.f, 1.f / 4.f };	// pi, 2 pi / 3, pi / 4, over pi
+		SH9 result;
+		for (int i = 0; i < SH_COEFFICIENTS; ++i)
+			result.coefficients[i] = radiance.coefficients[i] * band_scale[i == 0 ? 0 : i < 4 ? 1 : 2];
+		return result;
+	}
+
+	glm::vec3 evaluate(const SH9& sh, glm::vec3 direction) {
+		float values[SH_COEFFICIENTS];
+		basis(glm::normalize(direction), values);
+
+		glm::vec3 result(0.f);
+		for (int i = 0; i < SH_COEFFICIENTS; ++i)
+			result += sh.coefficients[i] * values[i];
+		return result;
+	}
+
+	void AmbientProbe::init() {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, SH_COEFFICIENTS * sizeof(glm::vec4), NULL, GL_STATIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING, buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void AmbientProbe::upload(const SH9& irradiance) {
+		glm::vec4 data[SH_COEFFICIENTS];						// std140 pads each vec3 array element to a vec4
+		for (int i = 0; i < SH_COEFFICIENTS; ++i)
+			data[i] = glm::vec4(irradiance.coefficients[i] * basis_constants[i], 0.f);
+
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void bind_uniform_block(const Shader& shader) {
+		unsigned int index = glGetUniformBlockIndex(shader.ID, "AmbientSH");
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(shader.ID, index, UNIFORM_BINDING);
+	}
+}
@@ -0,0 +1,75 @@
+/**
+ * "environment.h" - Environment lighting. An environment cube map is projected onto
+ *		2nd-order spherical harmonics (9 RGB coefficients) on the CPU and convolved with
+ *		the clamped cosine lobe (after Ramamoorthi and Hanrahan, "An Efficient
+ *		Representation for Irradiance Environment Maps", 2001), so the ambient light
+ *		reaching any surface orientation is a 9-term polynomial in its normal. The
+ *		coefficients are uploaded once to a uniform buffer that every SH_AMBIENT shader
+ *		variant (see permutations.h) reads, replacing the constant ambient term at the
+ *		cost of a few multiply-adds per pixel and no texture fetch. Function
+ *		implementations defined in "environment.cpp".
+ */
+#pragma once
+#ifndef __ENVIRONMENT_H__
+#define __ENVIRONMENT_H__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+namespace environment {
+	const int SH_COEFFICIENTS = 9;
+	const unsigned int UNIFORM_BINDING = 0;		// Binding point of the shaders' "AmbientSH" uniform block
+
+	struct SH9 {
+		glm::vec3 coefficients[SH_COEFFICIENTS];
+	};
+
+	/**
+	 * A cube map's faces as linear RGB radiance, size x size texels each, in OpenGL's
+	 * face order (+X, -X, +Y, -Y, +Z, -Z) with rows from t = 0, so the faces can be
+	 * uploaded as they are.
+	 */
+	struct Cubemap {
+		int size = 0;
+		std::vector<glm::vec3> faces[6];
+	};
+
+	glm::vec3 cubemap_direction(int face, int x, int y, int size);	// Unit direction through a texel's centre
+
+	/**
+	 * A room-like environment: sky straight up, horizon around the sides and ground
+	 * straight down, blended smoothly in between.
+	 */
+	Cubemap procedural_environment(int size, glm::vec3 sky, glm::vec3 horizon, glm::vec3 ground);
+
+	SH9 project(const Cubemap& cubemap);		// Radiance coefficients, each texel weighted by its solid angle
+
+	/**
+	 * Convolve radiance coefficients with the clamped cosine lobe and divide by pi:
+	 * the result evaluates to the ambient light a diffuse surface facing a direction
+	 * reflects per unit albedo, like the constant ambient term it replaces.
+	 */
+	SH9 irradiance(const SH9& radiance);
+
+	glm::vec3 evaluate(const SH9& sh, glm::vec3 direction);
+
+	class AmbientProbe {
+	public:
+		void init();							// Create the uniform buffer; requires a GL context
+
+		/**
+		 * Upload irradiance coefficients (see irradiance()), pre-scaled by the basis
+		 * constants so the shaders only multiply by powers of the normal.
+		 */
+		void upload(const SH9& irradiance);
+
+	private:
+		unsigned int buffer = 0;
+	};
+
+	void bind_uniform_block(const Shader& shader);	// Point an SH_AMBIENT variant's "AmbientSH" block at UNIFORM_BINDING
+}
+#endif//__ENVIRONMENT_H__
@@ -0,0 +1,287 @@
+/**
+ * "instancing.cpp" - Implementations for GPU-culled instanced drawing. Function
+ *		prototypes defined in "instancing.h".
+ */
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <iostream>
+
+#include "instancing.h"
+
+namespace instancing {
+	/**
+	 * Layout of the indirect draw buffer (DrawArraysIndirectCommand).
+	 */
+	struct draw_command {
+		GLuint count;
+		GLuint instance_count;						// Incremented by the culling geometry shader
+		GLuint first;
+		GLuint base_instance;
+	};
+
+	/**
+	 * Point a VAO's attributes location..location+3 at consecutive mat4s in the bound
+	 * GL_ARRAY_BUFFER.
+	 */
+	static void matrix_attribute(unsigned int location, unsigned int divisor) {
+		for (unsigned int column = 0; column < 4; ++column) {
+			glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+			glEnableVertexAttribArray(location + column);
+			glVertexAttribDivisor(location + column, divisor);
+		}
+	}
+
+	/**
+	 * Transform feedback varyings must be set before linking, which the Shader class
+	 * has already done, so the program is linked a second time.
+	 */
+	Shader* InstanceField::create_cull_shader(const char* geometry_path) {
+		Shader* shader = new Shader("shaders/instance_cull.vs.glsl", "shaders/instance_cull.fs.glsl", geometry_path);
+
+		const char* varyings[] = { "instanceModel" };
+		glTransformFeedbackVaryings(shader->ID, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+		glLinkProgram(shader->ID);
+
+		GLint success;
+		glGetProgramiv(shader->ID, GL_LINK_STATUS, &success);
+		if (!success) {
+			char info_log[512];
+			glGetProgramInfoLog(shader->ID, 512, NULL, info_log);
+			std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << info_log << std::endl;
+		}
+
+		return shader;
+	}
+
+	void InstanceField::init(const Model& model, const std::vector<glm::mat4>& instance_transforms) {
+		mesh = model;
+		bounding_sphere = glm::vec4((mesh.bounds_min + mesh.bounds_max) * 0.5f, glm::length(mesh.bounds_max - mesh.bounds_min) * 0.5f);
+
+		cull_shader = create_cull_shader("shaders/instance_cull.gs.glsl");
+
+		/**
+		 * Atomic counters and indirect draws need OpenGL 4.2.
+		 */
+		indirect_supported = GLAD_GL_VERSION_4_2 != 0;
+		if (indirect_supported) {
+			indirect_cull_shader = create_cull_shader("shaders/instance_cull_indirect.gs.glsl");
+
+			draw_command command = { mesh.number_of_vertices, 0, 0, 0 };
+			glGenBuffers(1, &indirect_buffer);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), &command, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+
+		/**
+		 * Every instance matrix, read one per point by the culling pass.
+		 */
+		glGenVertexArrays(1, &cull_VAO);
+		glGenBuffers(1, &transform_buffer);
+
+		glBindVertexArray(cull_VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, transform_buffer);
+		matrix_attribute(0, 0);						// Storage is allocated by update()
+
+		/**
+		 * The mesh's own vertex buffer is shared by the instanced VAOs.
+		 */
+		GLint mesh_VBO = 0;
+		glBindVertexArray(mesh.VAO);
+		glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &mesh_VBO);
+
+		const int stride = 8 * sizeof(float);		// Position, normal, texture coordinate
+		for (slot& s : slots) {
+			glGenVertexArrays(1, &s.VAO);
+			glGenBuffers(1, &s.buffer);
+			glGenQueries(1, &s.query);
+
+			glBindVertexArray(s.VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, mesh_VBO);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+			glEnableVertexAttribArray(2);
+
+			glBindBuffer(GL_ARRAY_BUFFER, s.buffer);
+			matrix_attribute(3, 1);
+		}
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		update(instance_transforms);
+	}
+
+	void InstanceField::update(const std::vector<glm::mat4>& instance_transforms) {
+		transforms = instance_transforms;
+		size_t bytes = transforms.size() * sizeof(glm::mat4);
+
+		glBindBuffer(GL_ARRAY_BUFFER, transform_buffer);
+		if (transforms.size() != allocated) {
+			/**
+			 * A new count gets new storage for every instance buffer. The culling
+			 * results in the old slot buffers are gone, so nothing is drawn until the
+			 * next cull().
+			 */
+			glBufferData(GL_ARRAY_BUFFER, bytes, transforms.data(), GL_DYNAMIC_DRAW);
+			for (slot& s : slots) {
+				glBindBuffer(GL_ARRAY_BUFFER, s.buffer);
+				glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_DYNAMIC_COPY);	// Written and read only by the GPU
+				s.query_issued = false;
+			}
+			allocated = transforms.size();
+			visible_count = 0;
+			draw_slot = -1;
+			draw_count = 0;
+		}
+		else {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, transforms.data());
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		/**
+		 * World bounds are only needed by cull_cpu().
+		 */
+		bounds.resize(transforms.size());
+		Model instance = mesh;
+		for (size_t i = 0; i < transforms.size(); ++i) {
+			glm::vec3 center, extent;
+			float radius;
+
+			instance.model = transforms[i];
+			culling::world_bounds(instance, center, extent, radius);
+			bounds.set(i, center, extent, radius);
+		}
+	}
+
+	void InstanceField::read_visible_count(slot& s, bool wait) {
+		if (!s.query_issued)
+			return;
+
+		if (!wait) {
+			GLuint available = 0;
+			glGetQueryObjectuiv(s.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				return;
+		}
+
+		glGetQueryObjectuiv(s.query, GL_QUERY_RESULT, &visible_count);
+	}
+
+	void InstanceField::cull(const culling::Frustum& frustum) {
+		if (transforms.empty())
+			return;
+
+		current ^= 1;
+		slot& s = slots[current];
+		bool use_counter = indirect();
+
+		Shader* shader = use_counter ? indirect_cull_shader : cull_shader;
+		shader->use();
+		glUniform4fv(glGetUniformLocation(shader->ID, "frustumPlanes"), 6, &frustum.planes[0][0]);
+		shader->setVec4("boundingSphere", bounding_sphere);
+
+		if (use_counter) {
+			const GLuint zero = 0;
+			glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, indirect_buffer);
+			glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, offsetof(draw_command, instance_count), sizeof(zero), &zero);	// Reset the instance count
+			glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, indirect_buffer);
+		}
+
+		/**
+		 * One point per instance; only visible ones reach the transform feedback buffer.
+		 */
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, s.buffer);
+		glBindVertexArray(cull_VAO);
+
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, s.query);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, (GLsizei)transforms.size());
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		s.query_issued = true;
+
+		glBindVertexArray(0);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glDisable(GL_RASTERIZER_DISCARD);
+
+		slot& previous = slots[current ^ 1];
+		if (use_counter) {
+			/**
+			 * The draw reads its instance count straight from the counter, so this
+			 * frame's result is drawn this frame. The query is only for statistics and
+			 * is read without waiting.
+			 */
+			glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, 0);
+			glMemoryBarrier(GL_COMMAND_BARRIER_BIT);	// Counter writes must land before the indirect draw reads them
+
+			draw_is_indirect = true;
+			draw_slot = current;
+			read_visible_count(previous, false);
+		}
+		else if (previous.query_issued) {
+			/**
+			 * Draw the previous frame's result with its count. Its query was issued a
+			 * frame ago, so reading it rarely waits.
+			 */
+			draw_is_indirect = false;
+			draw_slot = current ^ 1;
+			read_visible_count(previous, true);
+			draw_count = visible_count;
+		}
+		else {
+			draw_is_indirect = false;				// First frame: nothing older to draw
+			draw_slot = current;
+			read_visible_count(s, true);
+			draw_count = visible_count;
+		}
+	}
+
+	void InstanceField::cull_cpu(const culling::Frustum& frustum) {
+		culling::CullStats stats;
+		culling::cull(frustum, bounds, cpu_indices, stats);
+
+		cpu_visible.clear();
+		for (unsigned int index : cpu_indices)
+			cpu_visible.push_back(transforms[index]);
+
+		current ^= 1;
+		slot& s = slots[current];
+		glBindBuffer(GL_ARRAY_BUFFER, s.buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, cpu_visible.size() * sizeof(glm::mat4), cpu_visible.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		s.query_issued = false;						// Buffer no longer matches its query
+
+		draw_is_indirect = false;
+		draw_slot = current;
+		draw_count = (unsigned int)cpu_visible.size();
+		visible_count = draw_count;
+	}
+
+	void InstanceField::draw(glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos) {
+		if (draw_slot < 0 || (!draw_is_indirect && draw_count == 0))
+			return;
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, mesh.texture);
+
+		Shader& draw_shader = use_model_shader(permutations::INSTANCED, projection, view, point_light, dir_light, viewPos);	// Same lighting as draw_model()
+		draw_shader.setFloat("specularStrength", mesh.shine);
+
+		glBindVertexArray(slots[draw_slot].VAO);
+		if (draw_is_indirect) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+			glDrawArraysIndirect(GL_TRIANGLES, (void*)0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		else {
+			glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.number_of_vertices, draw_count);
+		}
+		glBindVertexArray(0);
+	}
+}
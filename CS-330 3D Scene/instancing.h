@@ -0,0 +1,93 @@
+/**
+ * "instancing.h" - Instanced drawing of large prop fields (many copies of one Model)
+ *		with frustum culling done on the GPU. Each frame the instance matrices are run
+ *		through a vertex + geometry shader that tests the mesh's bounding sphere against
+ *		the frustum, and transform feedback packs the matrices of visible instances into
+ *		the buffer the instanced draw reads from, so the CPU never touches per-instance
+ *		data. On OpenGL 3.3 the visible count comes from a transform feedback
+ *		primitives-written query read back a frame late; on 4.2+ the geometry shader
+ *		also increments an atomic counter that is the instance count of an indirect
+ *		draw, so nothing is read back at all. Function implementations defined in "instancing.cpp".
+ */
+#pragma once
+#ifndef __INSTANCING_H__
+#define __INSTANCING_H__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+#include "lights.h"
+#include "models.h"
+#include "shader.h"
+
+namespace instancing {
+	class InstanceField {
+	public:
+		bool use_indirect = true;					// Use the 4.2+ indirect path when the context supports it
+
+		/**
+		 * Upload one instance of mesh per transform. Requires a GL context. The mesh's
+		 * texture and vertex buffer are shared, not copied.
+		 */
+		void init(const Model& mesh, const std::vector<glm::mat4>& transforms);
+		void update(const std::vector<glm::mat4>& transforms);		// Replace every transform; a new count reallocates the instance buffers
+
+		/**
+		 * Cull every instance against frustum on the GPU. The result is drawn by the
+		 * next draw() call.
+		 */
+		void cull(const culling::Frustum& frustum);
+
+		/**
+		 * Cull on the CPU instead (SIMD over world bounds, then upload the visible
+		 * matrices), for comparison with cull().
+		 */
+		void cull_cpu(const culling::Frustum& frustum);
+
+		void draw(glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos);
+
+		unsigned int size() const { return (unsigned int)transforms.size(); }
+		unsigned int visible() const { return visible_count; }	// Most recent known count; may lag a frame behind
+		bool indirect() const { return use_indirect && indirect_supported; }
+
+	private:
+		/**
+		 * Culling output is double buffered so one frame's result can be drawn while
+		 * the next one is written.
+		 */
+		struct slot {
+			unsigned int buffer = 0;				// Packed visible instance matrices
+			unsigned int VAO = 0;					// Mesh attributes plus the matrices as per-instance attributes
+			unsigned int query = 0;					// Primitives written by the cull that filled buffer
+			bool query_issued = false;
+		};
+
+		Model mesh;
+		std::vector<glm::mat4> transforms;
+		culling::BoundsSoA bounds;					// World bounds of each instance, for cull_cpu()
+		std::vector<unsigned int> cpu_indices;
+		std::vector<glm::mat4> cpu_visible;
+
+		Shader* cull_shader = nullptr;
+		Shader* indirect_cull_shader = nullptr;		// Null without OpenGL 4.2
+		unsigned int transform_buffer = 0;			// Every instance matrix
+		size_t allocated = 0;						// Instances transform_buffer and the slot buffers have room for
+		unsigned int cull_VAO = 0;
+		unsigned int indirect_buffer = 0;			// DrawArraysIndirectCommand; instanceCount doubles as the atomic counter
+		slot slots[2];
+		int current = 0;							// Slot written by the most recent cull
+
+		bool indirect_supported = false;
+		bool draw_is_indirect = false;				// How the most recent cull expects to be drawn
+		int draw_slot = -1;
+		unsigned int draw_count = 0;
+		unsigned int visible_count = 0;
+		glm::vec4 bounding_sphere = glm::vec4(0.f);	// Object-space center and radius of mesh
+
+		Shader* create_cull_shader(const char* geometry_path);
+		void read_visible_count(slot& s, bool wait);
+	};
+}
+#endif//__INSTANCING_H__
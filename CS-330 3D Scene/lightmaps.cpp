@@ -0,0 +1,483 @@
+/**
+ * "lightmaps.cpp" - Implementations for the lightmap baker. Function prototypes defined
+ *		in "lightmaps.h".
+ */
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "lightmaps.h"
+#include "bvh.h"
+
+namespace lightmaps {
+	namespace {
+		const float UV_MARGIN = 1.5f;			// Texels between a triangle and its cell's edges; twice that between the two halves
+		const int MIN_CELL = 6;					// Smallest cell, in texels, that still leaves each triangle some texels
+		const float COVERAGE_RADIUS = 0.75f;	// Texels this close to a triangle are baked too, so bilinear taps at its edges are valid
+		const float RAY_OFFSET = 1e-3f;			// Ray origins are pushed off the surface by this much
+		const float RAY_FAR = 100.f;
+		const float PI = 3.14159265f;
+
+		/**
+		 * A world-space triangle in the bake BVH.
+		 */
+		struct triangle {
+			glm::vec3 v0, edge1, edge2;
+			glm::vec3 n0, n1, n2;				// Vertex normals
+			glm::vec3 face_normal;
+			int mesh;
+		};
+
+		/**
+		 * The triangle whose surface a lightmap texel samples, and where on it.
+		 */
+		struct texel_ref {
+			int triangle = -1;					// -1 for texels no triangle covers
+			float b1 = 0.f, b2 = 0.f;			// Barycentrics of the second and third vertices
+			float distance = 1e30f;				// Texel centre's distance from the triangle, in texels
+		};
+
+		/**
+		 * Small, fast per-texel random numbers. Seeding from the texel instead of the
+		 * thread keeps the bake identical for any thread count.
+		 */
+		struct texel_random {
+			uint32_t state;
+
+			texel_random(uint32_t seed) : state(seed * 747796405u + 2891336453u) { if (state == 0) state = 1; }
+
+			float next() {
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				return (state >> 8) * (1.f / 16777216.f);
+			}
+		};
+
+		/**
+		 * Möller-Trumbore ray/triangle test. Returns the hit distance or a negative value.
+		 */
+		float intersect_triangle(const triangle& tri, glm::vec3 origin, glm::vec3 direction, float max_distance) {
+			glm::vec3 p = glm::cross(direction, tri.edge2);
+			float determinant = glm::dot(tri.edge1, p);
+			if (std::fabs(determinant) < 1e-12f)
+				return -1.f;
+
+			float inverse_determinant = 1.f / determinant;
+			glm::vec3 s = origin - tri.v0;
+			float u = glm::dot(s, p) * inverse_determinant;
+			if (u < 0.f || u > 1.f)
+				return -1.f;
+
+			glm::vec3 q = glm::cross(s, tri.edge1);
+			float v = glm::dot(direction, q) * inverse_determinant;
+			if (v < 0.f || u + v > 1.f)
+				return -1.f;
+
+			float t = glm::dot(tri.edge2, q) * inverse_determinant;
+			return t > 1e-4f && t < max_distance ? t : -1.f;
+		}
+
+		/**
+		 * Barycentrics of p in the 2D triangle a, b, c, clamped onto the triangle.
+		 * Returns p's distance from the triangle.
+		 */
+		float clamped_barycentrics(glm::vec2 p, glm::vec2 a, glm::vec2 b, glm::vec2 c, float& b1, float& b2) {
+			glm::vec2 v0 = b - a, v1 = c - a, v2 = p - a;
+			float d00 = glm::dot(v0, v0), d01 = glm::dot(v0, v1), d11 = glm::dot(v1, v1);
+			float d20 = glm::dot(v2, v0), d21 = glm::dot(v2, v1);
+			float denominator = d00 * d11 - d01 * d01;
+			if (denominator == 0.f) {
+				b1 = b2 = 0.f;
+				return glm::length(v2);
+			}
+
+			b1 = (d11 * d20 - d01 * d21) / denominator;
+			b2 = (d00 * d21 - d01 * d20) / denominator;
+			float b0 = 1.f - b1 - b2;
+
+			b0 = std::max(b0, 0.f);
+			b1 = std::max(b1, 0.f);
+			b2 = std::max(b2, 0.f);
+			float sum = b0 + b1 + b2;
+			b1 /= sum;
+			b2 /= sum;
+
+			glm::vec2 closest = a + v0 * b1 + v1 * b2;
+			return glm::length(p - closest);
+		}
+
+		/**
+		 * Cosine-weighted direction in the hemisphere around normal.
+		 */
+		glm::vec3 cosine_sample(glm::vec3 normal, float r1, float r2) {
+			glm::vec3 helper = std::fabs(normal.x) > 0.9f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f);
+			glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+			glm::vec3 bitangent = glm::cross(normal, tangent);
+
+			float phi = 2.f * PI * r1;
+			float radius = std::sqrt(r2);
+			return tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + normal * std::sqrt(std::max(0.f, 1.f - r2));
+		}
+
+		unsigned char to_byte(float value) {
+			return (unsigned char)(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+		}
+
+		/**
+		 * Fill texels no triangle covers with the average of their covered neighbours,
+		 * a ring at a time, so filtering at chart edges never reads black.
+		 */
+		void dilate(Lightmap& lightmap, std::vector<bool>& covered, int passes) {
+			for (int pass = 0; pass < passes; ++pass) {
+				std::vector<bool> next = covered;
+				for (int y = 0; y < lightmap.height; ++y) {
+					for (int x = 0; x < lightmap.width; ++x) {
+						if (covered[y * lightmap.width + x])
+							continue;
+
+						int sum[4] = { 0, 0, 0, 0 }, count = 0;
+						for (int dy = -1; dy <= 1; ++dy) {
+							for (int dx = -1; dx <= 1; ++dx) {
+								int nx = x + dx, ny = y + dy;
+								if (nx < 0 || ny < 0 || nx >= lightmap.width || ny >= lightmap.height || !covered[ny * lightmap.width + nx])
+									continue;
+								for (int c = 0; c < 4; ++c)
+									sum[c] += lightmap.texels[(ny * lightmap.width + nx) * 4 + c];
+								++count;
+							}
+						}
+
+						if (count > 0) {
+							for (int c = 0; c < 4; ++c)
+								lightmap.texels[(y * lightmap.width + x) * 4 + c] = (unsigned char)(sum[c] / count);
+							next[y * lightmap.width + x] = true;
+						}
+					}
+				}
+				covered.swap(next);
+			}
+		}
+	}
+
+	BakeMesh gather(const Model& model) {
+		BakeMesh mesh;
+		mesh.model = model.model;
+
+		read_back_vertices(model, mesh.positions, mesh.normals);
+
+		/**
+		 * The smallest mip level is the texture's average color.
+		 */
+		GLint width = 0, height = 0;
+		glBindTexture(GL_TEXTURE_2D, model.texture);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		if (width > 0 && height > 0) {
+			int level = (int)std::floor(std::log2((float)std::max(width, height)));
+			glGetTexImage(GL_TEXTURE_2D, level, GL_RGB, GL_FLOAT, &mesh.albedo[0]);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		return mesh;
+	}
+
+	int generate_uvs(size_t triangle_count, int resolution, std::vector<glm::vec2>& uvs) {
+		int cells = (int)((triangle_count + 1) / 2);
+		int grid = std::max(1, (int)std::ceil(std::sqrt((float)cells)));
+		int cell = std::max(resolution / grid, MIN_CELL);
+		int size = grid * cell;
+
+		const float m = UV_MARGIN, c = (float)cell;
+		const glm::vec2 halves[2][3] = {
+			{ glm::vec2(m, m), glm::vec2(c - 2.f * m, m), glm::vec2(m, c - 2.f * m) },						// Lower left
+			{ glm::vec2(c - m, c - m), glm::vec2(2.f * m, c - m), glm::vec2(c - m, 2.f * m) },				// Upper right
+		};
+
+		uvs.resize(triangle_count * 3);
+		for (size_t i = 0; i < triangle_count; ++i) {
+			int index = (int)(i / 2);
+			glm::vec2 origin = glm::vec2((float)(index % grid * cell), (float)(index / grid * cell));
+			for (int corner = 0; corner < 3; ++corner)
+				uvs[i * 3 + corner] = (origin + halves[i % 2][corner]) / (float)size;
+		}
+
+		return size;
+	}
+
+	std::vector<Lightmap> bake(const std::vector<BakeMesh>& meshes, const DirectionalLight& light, const BakeSettings& settings, BakeStats& stats) {
+		using clock = std::chrono::high_resolution_clock;
+		stats = BakeStats();
+		stats.threads = settings.thread_count != 0 ? settings.thread_count : std::max(1u, std::thread::hardware_concurrency());
+
+		/**
+		 * Every triangle of every mesh in world space, in one BVH.
+		 */
+		auto build_start = clock::now();
+		std::vector<triangle> triangles;
+		std::vector<bvh::AABB> boxes;
+		std::vector<size_t> first_triangle;
+		for (size_t m = 0; m < meshes.size(); ++m) {
+			const BakeMesh& mesh = meshes[m];
+			glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(mesh.model)));
+			first_triangle.push_back(triangles.size());
+
+			for (size_t v = 0; v + 2 < mesh.positions.size(); v += 3) {
+				glm::vec3 p[3], n[3];
+				for (int corner = 0; corner < 3; ++corner) {
+					p[corner] = glm::vec3(mesh.model * glm::vec4(mesh.positions[v + corner], 1.f));
+					n[corner] = glm::normalize(normal_matrix * mesh.normals[v + corner]);
+				}
+
+				triangle tri;
+				tri.v0 = p[0];
+				tri.edge1 = p[1] - p[0];
+				tri.edge2 = p[2] - p[0];
+				tri.n0 = n[0];
+				tri.n1 = n[1];
+				tri.n2 = n[2];
+				glm::vec3 cross = glm::cross(tri.edge1, tri.edge2);
+				float area = glm::length(cross);
+				tri.face_normal = area > 0.f ? cross / area : n[0];
+				tri.mesh = (int)m;
+				triangles.push_back(tri);
+
+				bvh::AABB box;
+				box.min = glm::min(p[0], glm::min(p[1], p[2])) - glm::vec3(1e-4f);		// Padded so flat triangles still have volume
+				box.max = glm::max(p[0], glm::max(p[1], p[2])) + glm::vec3(1e-4f);
+				boxes.push_back(box);
+			}
+		}
+		stats.triangles = (unsigned int)triangles.size();
+
+		bvh::Tree tree;
+		tree.build(boxes, stats.threads);
+		stats.build_ms = std::chrono::duration<double, std::milli>(clock::now() - build_start).count();
+
+		/**
+		 * Lay out each mesh's lightmap and find the triangle under every texel.
+		 */
+		auto trace_start = clock::now();
+		std::vector<Lightmap> lightmaps(meshes.size());
+		std::vector<std::vector<texel_ref>> coverage(meshes.size());
+		for (size_t m = 0; m < meshes.size(); ++m) {
+			Lightmap& lightmap = lightmaps[m];
+			size_t triangle_count = meshes[m].positions.size() / 3;
+			int size = generate_uvs(triangle_count, settings.resolution, lightmap.uvs);
+			lightmap.width = lightmap.height = size;
+			lightmap.texels.assign((size_t)size * size * 4, 0);
+			coverage[m].resize((size_t)size * size);
+
+			for (size_t t = 0; t < triangle_count; ++t) {
+				glm::vec2 a = lightmap.uvs[t * 3] * (float)size, b = lightmap.uvs[t * 3 + 1] * (float)size, c = lightmap.uvs[t * 3 + 2] * (float)size;
+				glm::vec2 low = glm::min(a, glm::min(b, c)) - glm::vec2(COVERAGE_RADIUS);
+				glm::vec2 high = glm::max(a, glm::max(b, c)) + glm::vec2(COVERAGE_RADIUS);
+
+				for (int y = std::max(0, (int)low.y); y <= std::min(size - 1, (int)high.y); ++y) {
+					for (int x = std::max(0, (int)low.x); x <= std::min(size - 1, (int)high.x); ++x) {
+						float b1, b2;
+						float distance = clamped_barycentrics(glm::vec2(x + 0.5f, y + 0.5f), a, b, c, b1, b2);
+						texel_ref& ref = coverage[m][(size_t)y * size + x];
+						if (distance <= COVERAGE_RADIUS && distance < ref.distance) {
+							ref.triangle = (int)(first_triangle[m] + t);
+							ref.b1 = b1;
+							ref.b2 = b2;
+							ref.distance = distance;
+						}
+					}
+				}
+			}
+		}
+
+		/**
+		 * Trace rows of texels on every thread. Each row is written by exactly one
+		 * thread, and every texel seeds its own random numbers, so the result does not
+		 * depend on the thread count.
+		 */
+		struct row {
+			int mesh, y;
+		};
+		std::vector<row> rows;
+		for (size_t m = 0; m < meshes.size(); ++m)
+			for (int y = 0; y < lightmaps[m].height; ++y)
+				rows.push_back({ (int)m, y });
+
+		const glm::vec3 to_light = glm::normalize(-light.direction);
+		std::atomic<size_t> next_row(0);
+		std::atomic<unsigned long long> total_rays(0);
+		std::atomic<unsigned int> total_texels(0);
+
+		auto raycast = [&](glm::vec3 origin, glm::vec3 direction, int& hit) {
+			return tree.raycast(origin, direction, RAY_FAR,
+				[&](int object, float max_distance) { return intersect_triangle(triangles[object], origin, direction, max_distance); }, hit);
+		};
+
+		auto direct_light = [&](glm::vec3 position, glm::vec3 normal, unsigned long long& rays) {
+			float n_dot_l = glm::dot(normal, to_light);
+			if (n_dot_l <= 0.f)
+				return 0.f;
+			int hit;
+			++rays;
+			return raycast(position + normal * RAY_OFFSET, to_light, hit) < 0.f ? n_dot_l : 0.f;
+		};
+
+		auto worker = [&]() {
+			unsigned long long rays = 0;
+			unsigned int texels = 0;
+
+			for (size_t r = next_row++; r < rows.size(); r = next_row++) {
+				Lightmap& lightmap = lightmaps[rows[r].mesh];
+				for (int x = 0; x < lightmap.width; ++x) {
+					size_t index = (size_t)rows[r].y * lightmap.width + x;
+					const texel_ref& ref = coverage[rows[r].mesh][index];
+					if (ref.triangle < 0)
+						continue;
+
+					const triangle& tri = triangles[ref.triangle];
+					float b0 = 1.f - ref.b1 - ref.b2;
+					glm::vec3 position = tri.v0 + tri.edge1 * ref.b1 + tri.edge2 * ref.b2;
+					glm::vec3 normal = glm::normalize(tri.n0 * b0 + tri.n1 * ref.b1 + tri.n2 * ref.b2);
+
+					float direct = direct_light(position, normal, rays);
+
+					/**
+					 * One set of cosine-weighted rays estimates both the bounce (each hit
+					 * surface's albedo times the direct light it receives) and ambient
+					 * occlusion (the share of hits closer than ao_distance).
+					 */
+					texel_random rng((uint32_t)(rows[r].mesh * 73856093u) ^ (uint32_t)(rows[r].y * 19349663u) ^ (uint32_t)(x * 83492791u));
+					glm::vec3 bounce = glm::vec3(0.f);
+					int occluded = 0;
+					glm::vec3 origin = position + normal * RAY_OFFSET;
+					for (int s = 0; s < settings.samples; ++s) {
+						float r1 = rng.next(), r2 = rng.next();
+						glm::vec3 direction = cosine_sample(normal, r1, r2);
+
+						int hit;
+						++rays;
+						float distance = raycast(origin, direction, hit);
+						if (distance < 0.f)
+							continue;
+
+						if (distance < settings.ao_distance)
+							++occluded;
+
+						const triangle& hit_tri = triangles[hit];
+						glm::vec3 hit_normal = glm::dot(hit_tri.face_normal, direction) > 0.f ? -hit_tri.face_normal : hit_tri.face_normal;
+						bounce += meshes[hit_tri.mesh].albedo * direct_light(origin + direction * distance, hit_normal, rays);
+					}
+
+					glm::vec3 diffuse = glm::vec3(direct) + bounce / (float)settings.samples;
+					float ambient_occlusion = 1.f - (float)occluded / (float)settings.samples;
+
+					lightmap.texels[index * 4 + 0] = to_byte(diffuse.r);
+					lightmap.texels[index * 4 + 1] = to_byte(diffuse.g);
+					lightmap.texels[index * 4 + 2] = to_byte(diffuse.b);
+					lightmap.texels[index * 4 + 3] = to_byte(ambient_occlusion);
+					++texels;
+				}
+			}
+
+			total_rays += rays;
+			total_texels += texels;
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned int t = 1; t < stats.threads; ++t)
+			threads.emplace_back(worker);
+		worker();												// This thread works too
+		for (std::thread& thread : threads)
+			thread.join();
+
+		for (size_t m = 0; m < meshes.size(); ++m) {
+			std::vector<bool> covered(coverage[m].size());
+			for (size_t i = 0; i < covered.size(); ++i)
+				covered[i] = coverage[m][i].triangle >= 0;
+			dilate(lightmaps[m], covered, 2);
+		}
+
+		stats.rays = total_rays;
+		stats.texels = total_texels;
+		stats.trace_ms = std::chrono::duration<double, std::milli>(clock::now() - trace_start).count();
+		return lightmaps;
+	}
+
+	/**
+	 * File layout: "LMAP", version, width, height and UV count as 32-bit integers, the
+	 * UVs as float pairs, then RGBA8 texels.
+	 */
+	bool save(const Lightmap& lightmap, const std::string& path) {
+		std::ofstream file(path, std::ios::binary);
+		if (!file) {
+			std::cerr << "ERROR::LIGHTMAP::FILE_NOT_WRITTEN " << path << std::endl;
+			return false;
+		}
+
+		const int32_t header[4] = { 1, lightmap.width, lightmap.height, (int32_t)lightmap.uvs.size() };
+		file.write("LMAP", 4);
+		file.write((const char*)header, sizeof(header));
+		file.write((const char*)lightmap.uvs.data(), lightmap.uvs.size() * sizeof(glm::vec2));
+		file.write((const char*)lightmap.texels.data(), lightmap.texels.size());
+		return (bool)file;
+	}
+
+	bool load(Lightmap& lightmap, const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		char magic[4];
+		int32_t header[4];
+		file.read(magic, 4);
+		file.read((char*)header, sizeof(header));
+		if (!file || std::string(magic, 4) != "LMAP" || header[0] != 1 || header[1] <= 0 || header[2] <= 0 || header[3] < 0) {
+			std::cerr << "ERROR::LIGHTMAP::BAD_FILE " << path << std::endl;
+			return false;
+		}
+
+		lightmap.width = header[1];
+		lightmap.height = header[2];
+		lightmap.uvs.resize(header[3]);
+		lightmap.texels.resize((size_t)lightmap.width * lightmap.height * 4);
+		file.read((char*)lightmap.uvs.data(), lightmap.uvs.size() * sizeof(glm::vec2));
+		file.read((char*)lightmap.texels.data(), lightmap.texels.size());
+		if (!file) {
+			std::cerr << "ERROR::LIGHTMAP::TRUNCATED " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	void apply(Model& model, const Lightmap& lightmap) {
+		if (lightmap.uvs.size() != model.number_of_vertices) {
+			std::cerr << "ERROR::LIGHTMAP::VERTEX_COUNT_MISMATCH" << std::endl;		// Baked for different geometry
+			return;
+		}
+
+		glGenTextures(1, &model.lightmap);
+		glBindTexture(GL_TEXTURE_2D, model.lightmap);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, lightmap.width, lightmap.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, lightmap.texels.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);			// No mipmaps: they would blend neighbouring triangles
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		unsigned int VBO;
+		glGenBuffers(1, &VBO);
+		glBindVertexArray(model.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, lightmap.uvs.size() * sizeof(glm::vec2), lightmap.uvs.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(UV_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+		glEnableVertexAttribArray(UV_ATTRIBUTE);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
@@ -0,0 +1,91 @@
+/**
+ * "lightmaps.h" - Offline lightmap baker for static Models. Every triangle of every
+ *		Model is put in one BVH (see bvh.h), each Model gets a generated second UV set
+ *		that gives every triangle its own texels, and the directional light's diffuse
+ *		light (direct, shadowed, plus one bounce off the scene's average albedos) and
+ *		ambient occlusion are ray traced into a per-Model lightmap on every core. At
+ *		runtime the BAKED_LIGHTING shader variant (see permutations.h) reads the
+ *		lightmap instead of evaluating the directional light's diffuse term, so only
+ *		its specular term and the point lights are still computed per fragment.
+ *		Function implementations defined in "lightmaps.cpp".
+ */
+#pragma once
+#ifndef __LIGHTMAPS_H__
+#define __LIGHTMAPS_H__
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "lights.h"
+#include "models.h"
+
+namespace lightmaps {
+	const int TEXTURE_UNIT = 3;
+	const int UV_ATTRIBUTE = 7;					// After the per-instance model matrix (locations 3-6)
+
+	struct BakeSettings {
+		int resolution = 256;					// Lightmap size per Model, in texels; raised if the triangles need more room
+		int samples = 64;						// Hemisphere rays per texel, shared by the bounce and ambient occlusion
+		float ao_distance = 0.25f;				// Hits further away than this do not occlude
+		unsigned int thread_count = 0;			// 0 for hardware concurrency
+	};
+
+	struct BakeStats {
+		unsigned int triangles = 0;
+		unsigned int texels = 0;				// Texels covered by a triangle and traced
+		unsigned long long rays = 0;
+		unsigned int threads = 0;
+		double build_ms = 0.0;					// Triangle BVH build
+		double trace_ms = 0.0;
+	};
+
+	/**
+	 * A Model's geometry and average albedo, read back from OpenGL once so the bake
+	 * itself needs no context.
+	 */
+	struct BakeMesh {
+		std::vector<glm::vec3> positions;		// Object space, three per triangle
+		std::vector<glm::vec3> normals;
+		glm::mat4 model = glm::mat4(1.f);
+		glm::vec3 albedo = glm::vec3(0.5f);
+	};
+
+	/**
+	 * A baked lightmap: one lightmap UV per Model vertex, and RGBA8 texels holding the
+	 * directional light's diffuse irradiance per unit light color in RGB and ambient
+	 * occlusion in A.
+	 */
+	struct Lightmap {
+		int width = 0;
+		int height = 0;
+		std::vector<glm::vec2> uvs;
+		std::vector<unsigned char> texels;
+	};
+
+	BakeMesh gather(const Model& model);		// Read a Model back from OpenGL; requires a GL context
+
+	/**
+	 * Lay out triangle_count triangles two to a square cell of a resolution x
+	 * resolution atlas, with gutters so bilinear filtering never mixes triangles. Writes
+	 * three UVs per triangle and returns the atlas size actually used.
+	 */
+	int generate_uvs(size_t triangle_count, int resolution, std::vector<glm::vec2>& uvs);
+
+	/**
+	 * Bake one lightmap per mesh. Every mesh occludes and bounces light onto every
+	 * other.
+	 */
+	std::vector<Lightmap> bake(const std::vector<BakeMesh>& meshes, const DirectionalLight& light, const BakeSettings& settings, BakeStats& stats);
+
+	bool save(const Lightmap& lightmap, const std::string& path);
+	bool load(Lightmap& lightmap, const std::string& path);
+
+	/**
+	 * Upload a lightmap and add its UVs to model's VAO as attribute UV_ATTRIBUTE. The
+	 * Model is drawn with BAKED_LIGHTING while models_set_baked_lighting(true).
+	 */
+	void apply(Model& model, const Lightmap& lightmap);
+}
+#endif//__LIGHTMAPS_H__
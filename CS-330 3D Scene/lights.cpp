@@ -1,79 +1,94 @@
 #include <glad/glad.h>
+#include <cmath>
+#include <cstddef>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "lights.h"
 
 namespace glob {
 	Shader* radiant_light_shader = nullptr;
+	unsigned int light_sprite_VAO = 0;
+	unsigned int light_sprite_instances = 0;			// Streamed light_sprite per light
+	size_t light_sprite_capacity = 0;					// Lights light_sprite_instances has room for
+	const float light_sprite_size = 0.03f;				// World-space radius of the dot at a light's position
 };
 
-struct vertex {
-	float x, y, z;
-	float r, g, b;
+struct light_sprite {
+	glm::vec3 position;
+	glm::vec3 color;
 };
 
 void lights_init()
 {
-	glob::radiant_light_shader = new Shader("shaders/radiant_light.vs.glsl", "shaders/radiant_light.fs.glsl");
+	using namespace glob;
+
+	radiant_light_shader = new Shader("shaders/radiant_light.vs.glsl", "shaders/radiant_light.fs.glsl");
+
+	/**
+	 * One quad for the dots, expanded around each light in view space; the per-light
+	 * data is instanced.
+	 */
+	std::vector<float> corners = { -1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f };
+	unsigned int corner_VBO;
+	glGenVertexArrays(1, &light_sprite_VAO);
+	glGenBuffers(1, &corner_VBO);
+	glGenBuffers(1, &light_sprite_instances);
+
+	glBindVertexArray(light_sprite_VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, corner_VBO);
+	glBufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(float), corners.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, light_sprite_instances);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(light_sprite), (void*)offsetof(light_sprite, position));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(light_sprite), (void*)offsetof(light_sprite, color));
+	for (int attribute = 1; attribute <= 2; ++attribute) {
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribDivisor(attribute, 1);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	radiant_light_shader->use();
+	radiant_light_shader->setFloat("spriteSize", light_sprite_size);
 }
 
 RadiantLight get_point_light() {
-	RadiantLight point_light;
-
-	vertex point[1] = {
-		0.f, 0.f, 0.f,
-		0.831f,  0.921f, 1.f
-	};
-	const int floats_per_vertex = 3;
-	const int floats_per_color = 3;
-	int stride = floats_per_vertex + floats_per_color;
+	return get_point_light(glm::vec3(-1.f, 0.5f, 1.f), glm::vec3(0.831f, 0.921f, 1.f), glm::vec3(1.f, 0.045f, 0.0075f));
+}
 
-	glm::vec3 position = glm::vec3(-1.f, 0.5f, 1.f);
-	glm::vec3 color = glm::vec3(point[0].r, point[0].g, point[0].b);
-	glm::vec3 attenuation = glm::vec3(1.f, 0.045f, 0.0075f);
+RadiantLight get_point_light(glm::vec3 position, glm::vec3 color, glm::vec3 attenuation) {
+	RadiantLight point_light;
 
 	point_light.position = position;
 	point_light.color = color;
-	point_light.number_of_vertices = 1;
 	point_light.attenuation_coefficients = attenuation;
-
-	unsigned VAO, VBO;
-
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-
-	glBindVertexArray(VAO);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER,
-		sizeof(point),
-		&point[0],
-		GL_STATIC_DRAW);
-
-	glVertexAttribPointer(0, floats_per_vertex,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floats_per_color,
-		GL_FLOAT, GL_FALSE,
-		stride * sizeof(float),
-		(void*)(sizeof(float) * floats_per_vertex));
-	glEnableVertexAttribArray(1);
-
-	glBindVertexArray(0);
-
-	point_light.VAO = VAO;
-
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::translate(model, position);
-	
-	point_light.model = model;
+	point_light.radius = light_radius(attenuation, color);
 
 	return point_light;
 };
 
+/**
+ * Distance at which a light's brightest channel, attenuated by
+ * 1 / (constant + linear * d + quadratic * d^2), falls to threshold. Solved with the
+ * quadratic formula; returns 0 for a light that never reaches threshold.
+ */
+float light_radius(glm::vec3 attenuation, glm::vec3 color, float threshold) {
+	float intensity = glm::max(color.r, glm::max(color.g, color.b));
+	float constant = attenuation.x - intensity / threshold;	// constant + linear * d + quadratic * d^2 = intensity / threshold
+	if (constant >= 0.f)
+		return 0.f;
+
+	if (attenuation.z > 0.f)
+		return (-attenuation.y + sqrtf(attenuation.y * attenuation.y - 4.f * attenuation.z * constant)) / (2.f * attenuation.z);
+	if (attenuation.y > 0.f)
+		return -constant / attenuation.y;
+
+	return INFINITY;										// Constant attenuation reaches everywhere
+}
+
 DirectionalLight get_directional_light() {
 	DirectionalLight dir_light;
 
@@ -85,14 +100,42 @@ DirectionalLight get_directional_light() {
 }
 
 void draw_radiant_light(RadiantLight light, glm::mat4 projection, glm::mat4 view) {
+	draw_radiant_lights(std::vector<RadiantLight>(1, light), projection, view);
+}
+
+void draw_radiant_lights(const std::vector<RadiantLight>& lights, glm::mat4 projection, glm::mat4 view) {
 	using namespace glob;
 
-	radiant_light_shader->use();
+	if (lights.empty())
+		return;
+
+	std::vector<light_sprite> sprites;
+	sprites.reserve(lights.size());
+	for (const RadiantLight& light : lights)
+		sprites.push_back({ light.position, light.color });
+
+	/**
+	 * Orphan the instance buffer rather than overwrite data a previous draw may still
+	 * be reading.
+	 */
+	glBindBuffer(GL_ARRAY_BUFFER, light_sprite_instances);
+	if (sprites.size() > light_sprite_capacity)
+		light_sprite_capacity = sprites.size() + sprites.size() / 2;
+	glBufferData(GL_ARRAY_BUFFER, light_sprite_capacity * sizeof(light_sprite), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sprites.size() * sizeof(light_sprite), sprites.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glBindVertexArray(light.VAO);
+	radiant_light_shader->use();
 	radiant_light_shader->setMat4("projection", projection);
 	radiant_light_shader->setMat4("view", view);
-	radiant_light_shader->setMat4("model", light.model);
 
-	glDrawArrays(GL_TRIANGLES, 0, light.number_of_vertices);
-}
\ No newline at end of file
+	GLint polygon_mode[2];
+	glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);		// Dots are shapes cut out of the quad, not its outline
+
+	glBindVertexArray(light_sprite_VAO);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)sprites.size());
+	glBindVertexArray(0);
+
+	glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+}
@@ -2,17 +2,17 @@
 #ifndef __LIGHTS_H__
 #define __LIGHTS_H__
 
+#include <vector>
+
 #include <glm/glm.hpp>
 #include "shader.h"
 
 struct radiant_light_mesh {
-	unsigned int VAO;
-	unsigned int number_of_vertices;
-	glm::mat4 model;
 	glm::vec3 position;
 	glm::vec3 color;
 
 	glm::vec3 attenuation_coefficients;
+	float radius = 0.f;								// Cutoff distance past which the light is ignored
 };
 typedef struct radiant_light_mesh RadiantLight;
 
@@ -26,7 +26,17 @@ void lights_init();
 
 RadiantLight get_point_light();
 
+RadiantLight get_point_light(glm::vec3 position, glm::vec3 color, glm::vec3 attenuation);
+
+float light_radius(glm::vec3 attenuation, glm::vec3 color, float threshold = 5.f / 256.f);
+
 DirectionalLight get_directional_light();
 
 void draw_radiant_light(RadiantLight light, glm::mat4 projection, glm::mat4 view);
+
+/**
+ * Draw every light as a camera-facing dot in the light's color, all in one instanced
+ * draw. Cutoff radii are debug lines (see debug_draw::LineBatch::light_radius()).
+ */
+void draw_radiant_lights(const std::vector<RadiantLight>& lights, glm::mat4 projection, glm::mat4 view);
 #endif//__LIGHTS_H__
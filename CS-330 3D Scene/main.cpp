@@ -12,7 +12,13 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
 
 /**
 * Forward declares all functions in "main.cpp" for unit testing
@@ -40,6 +46,101 @@
  */
 #include "models.h"
 
+/**
+ * Contains the frustum culling stage
+ */
+#include "culling.h"
+
+/**
+ * Contains the bounding volume hierarchy
+ */
+#include "bvh.h"
+
+/**
+ * Contains the occlusion query culler
+ */
+#include "occlusion.h"
+
+/**
+ * Contains the clustered forward lighting grid
+ */
+#include "clustered.h"
+
+/**
+ * Contains the GPU-culled instanced prop field
+ */
+#include "instancing.h"
+
+/**
+ * Contains the deferred shading path
+ */
+#include "deferred.h"
+
+/**
+ * Contains the visibility buffer shading path
+ */
+#include "visibility.h"
+
+/**
+ * Contains the streaming texture loader
+ */
+#include "textures.h"
+
+/**
+ * Contains the offline texture cooker
+ */
+#include "cooker.h"
+
+/**
+ * Contains the cached shadow maps
+ */
+#include "shadows.h"
+
+/**
+ * Contains the depth pre-pass
+ */
+#include "prepass.h"
+
+/**
+ * Contains the lightmap baker
+ */
+#include "lightmaps.h"
+
+/**
+ * Contains dynamic resolution scaling
+ */
+#include "resolution.h"
+
+/**
+ * Contains post-process anti-aliasing
+ */
+#include "antialiasing.h"
+
+/**
+ * Contains screen-space ambient occlusion
+ */
+#include "ssao.h"
+
+/**
+ * Contains the spherical harmonics ambient probe
+ */
+#include "environment.h"
+
+/**
+ * Contains the reflection probes
+ */
+#include "reflections.h"
+
+/**
+ * Contains the debug line batch
+ */
+#include "debug_draw.h"
+
+/**
+ * Contains the "--bench" command-line benchmarks
+ */
+#include "benchmarks.h"
+
 /**
  * All global variables (primarily for the camera)
  */
@@ -64,6 +165,25 @@ namespace glob {
 	bool wireframe = false;
 	bool zoom = false;
 	int pointLightColor = 0;
+	bool frustum_culling = true;
+	bool bvh_culling = false;
+	bool occlusion_culling = false;
+	bool prop_field = false;
+	bool clustered_lighting = false;
+	deferred::Path shading_path = deferred::Path::FORWARD;
+	bool fog = false;
+	bool blinn_phong = false;
+	bool shadows_enabled = false;
+	int pcf_radius = 1;
+	prepass::Mode prepass_mode = prepass::Mode::AUTO;
+	bool baked_lighting = false;
+	debug_draw::Level debug_level = debug_draw::Level::OFF;
+	bool dynamic_resolution = false;
+	resolution::Upscale upscale = resolution::Upscale::SHARPENED;
+	antialiasing::Mode aa_mode = antialiasing::Mode::OFF;
+	bool ambient_occlusion = false;
+	bool sh_ambient = false;
+	bool reflections = false;
 }
 
 /**
@@ -85,6 +205,41 @@ void processInput(GLFWwindow* window);
 int main(int argc, char* argv[]) {
 	GLFWwindow* window;	// Main render window
 
+	/**
+	 * Run the command-line benchmarks instead of the scene when asked to.
+	 */
+	if (argc > 1 && std::string(argv[1]) == "--bench")
+		return bench::run(argc, argv);
+
+	/**
+	 * Cook the scene's textures into block compressed files next to them and exit
+	 * when run with "--cook". Cook again after changing an image: the loader uses a
+	 * cooked file whenever there is one.
+	 */
+	if (argc > 1 && std::string(argv[1]) == "--cook") {
+		struct source {
+			const char* path;
+			textures::Usage usage;
+		};
+		const source sources[] = {
+			{ "data/wood.jpg", textures::Usage::ALBEDO },
+			{ "data/switch.jpg", textures::Usage::ALBEDO },
+			{ "data/orange.jpg", textures::Usage::ALBEDO },
+			{ "data/napkin.jpg", textures::Usage::ALBEDO },
+			{ "data/soda.jpg", textures::Usage::ALBEDO },
+			{ "data/switch_specular_map.jpg", textures::Usage::MASK },
+		};
+
+		cooker::CookSettings cook_settings;
+		cooker::CookStats cook_stats;
+		for (const source& s : sources)
+			cooker::cook(s.path, cooker::cooked_path(s.path), s.usage, cook_settings, cook_stats);
+
+		std::cout << "Cooked " << cook_stats.images << " textures on " << cook_stats.threads << " threads: " << cook_stats.source_bytes / (1024 * 1024) << " MB to "
+			<< cook_stats.cooked_bytes / (1024 * 1024) << " MB with mipmaps, decode " << (int)cook_stats.decode_ms << " ms, encode " << (int)cook_stats.encode_ms << " ms" << std::endl;
+		return cook_stats.images == sizeof(sources) / sizeof(sources[0]) ? 0 : -1;
+	}
+
 	/**
 	* Initialize GLFW and create the main render window. Safely end execution
 	* on failure.
@@ -142,8 +297,10 @@ int main(int argc, char* argv[]) {
 	models_init();
 
 	/**
-	 * Create models
+	 * Create models. Their textures are decoded on worker threads and show a grey
+	 * placeholder until they land, so the first frame does not wait on every JPEG.
 	 */
+	textures::loader().asynchronous = true;
 	RadiantLight light = get_point_light();
 	DirectionalLight light2 = get_directional_light();
 
@@ -154,9 +311,156 @@ int main(int argc, char* argv[]) {
 	Model soda = get_soda_model("data/soda.jpg");
 
 	Material console_mat;
-	console_mat.specular_map = load_wrap_texture("data/switch_specular_map.jpg");
+	console_mat.specular_map = load_wrap_texture("data/switch_specular_map.jpg", textures::Usage::MASK);
 	console_mat.shine = 1.0f;
-	
+	console.material = &console_mat;
+
+	/**
+	 * Gather Models into the scene and compute their world-space bounds. Every Model
+	 * is static, so the bounds only need computing once.
+	 */
+	std::vector<Model> scene = { desk, console, napkin, orange, soda };	// Draw order
+	const char* scene_names[] = { "desk", "console", "napkin", "orange", "soda" };
+
+	/**
+	 * Bake lightmaps for the scene and exit when run with "--bake"; otherwise load the
+	 * lightmaps baked before, if any.
+	 */
+	if (argc > 1 && std::string(argv[1]) == "--bake") {
+		textures::loader().finish();									// Albedos are read back from the textures
+		std::vector<lightmaps::BakeMesh> meshes;
+		for (const Model& model : scene)
+			meshes.push_back(lightmaps::gather(model));
+
+		lightmaps::BakeSettings bake_settings;
+		lightmaps::BakeStats bake_stats;
+		std::vector<lightmaps::Lightmap> baked = lightmaps::bake(meshes, light2, bake_settings, bake_stats);
+		for (size_t i = 0; i < baked.size(); ++i)
+			lightmaps::save(baked[i], std::string("data/") + scene_names[i] + ".lightmap");
+
+		std::cout << "Baked " << bake_stats.texels << " texels from " << bake_stats.triangles << " triangles on " << bake_stats.threads << " threads: "
+			<< bake_stats.rays << " rays in " << (int)bake_stats.trace_ms << " ms (BVH " << (int)bake_stats.build_ms << " ms)" << std::endl;
+		glfwTerminate();
+		return 0;
+	}
+
+	for (size_t i = 0; i < scene.size(); ++i) {
+		lightmaps::Lightmap lightmap;
+		if (lightmaps::load(lightmap, std::string("data/") + scene_names[i] + ".lightmap"))
+			lightmaps::apply(scene[i], lightmap);
+	}
+	culling::BoundsSoA scene_bounds;
+	culling::update_bounds(scene_bounds, scene);
+
+	std::vector<bvh::AABB> scene_boxes;
+	for (const Model& model : scene)
+		scene_boxes.push_back(bvh::model_bounds(model));
+	bvh::Tree scene_tree;
+	scene_tree.build(scene_boxes);										// Spatial index for culling and scene queries
+
+	occlusion::OcclusionCuller occlusion_culler;
+	occlusion_culler.init();
+	occlusion::OcclusionStats occlusion_stats;
+
+	/**
+	 * A field of oranges around the desk, culled and drawn entirely on the GPU.
+	 */
+	std::vector<glm::mat4> field_transforms;
+	for (int x = 0; x < 64; ++x) {
+		for (int z = 0; z < 64; ++z) {
+			glm::mat4 transform = glm::translate(glm::mat4(1.f), glm::vec3(-16.f + x * 0.5f, -0.5f, -16.f + z * 0.5f));
+			transform = glm::scale(transform, glm::vec3(0.06f));
+			transform = glm::rotate(transform, glm::radians((float)((x * 37 + z * 11) % 360)), glm::vec3(0.f, 1.f, 0.f));
+			field_transforms.push_back(transform);
+		}
+	}
+	instancing::InstanceField prop_field;
+	prop_field.init(orange, field_transforms);
+
+	/**
+	 * Hundreds of small colored point lights hovering over and around the desk, lit
+	 * through the cluster grid.
+	 */
+	std::vector<RadiantLight> point_lights;
+	std::vector<float> light_heights;
+	std::mt19937 light_rng(330);
+	std::uniform_real_distribution<float> light_spread(-4.f, 4.f);
+	std::uniform_real_distribution<float> light_height(0.f, 0.5f);
+	std::uniform_real_distribution<float> light_channel(0.f, 0.5f);
+	for (int i = 0; i < 256; ++i) {
+		glm::vec3 color = glm::vec3(light_channel(light_rng), light_channel(light_rng), 0.5f);
+		if (i % 3 != 2)
+			std::swap(color[i % 3], color[2]);							// Brightest channel varies between lights
+		light_heights.push_back(light_height(light_rng));
+		point_lights.push_back(get_point_light(glm::vec3(light_spread(light_rng), light_heights.back(), light_spread(light_rng)),
+			color, glm::vec3(1.f, 1.4f, 7.2f)));							// Cutoff radius of roughly 1.75
+	}
+
+	clustered::ClusterGrid light_grid;
+	light_grid.init();
+
+	std::vector<RadiantLight> light_gizmos;								// Light sources drawn this frame
+	light_gizmos.reserve(point_lights.size() + 1);
+
+	/**
+	 * Shadow maps for the point and directional lights. Every scene Model is a static
+	 * caster, so the maps are only redrawn when the camera leaves a cascade's cached
+	 * coverage.
+	 */
+	shadows::ShadowMaps shadow_maps;
+	shadow_maps.init();
+	const std::vector<Model> dynamic_casters;
+
+	prepass::DepthPrepass depth_prepass;
+	depth_prepass.init();
+
+	deferred::DeferredRenderer deferred_renderer;
+	deferred_renderer.init(GLFW_WINDOW_WIDTH, GLFW_WINDOW_HEIGHT);
+
+	visibility::VisibilityRenderer visibility_renderer;
+	visibility_renderer.init(GLFW_WINDOW_WIDTH, GLFW_WINDOW_HEIGHT);
+
+	ssao::AmbientOcclusion ambient_occlusion;
+	ambient_occlusion.init();
+
+	environment::AmbientProbe ambient_probe;
+	ambient_probe.init();
+	glm::vec3 probe_light_color = glm::vec3(-1.f);			// Point light color the probe was last projected for
+
+	/**
+	 * Reflection probes in front of and behind the console. Both project onto a room
+	 * whose floor is just under the desk and whose walls are far enough away that the
+	 * empty space around the desk reflects as empty; a floor exactly at the desk's
+	 * surface would let rounding put the desk outside it.
+	 */
+	reflections::ReflectionProbes reflection_probes;
+	reflection_probes.init();
+	bvh::AABB desk_room;
+	desk_room.min = glm::vec3(-5.f, -0.1f, -5.f);
+	desk_room.max = glm::vec3(5.f, 5.f, 5.f);
+	reflection_probes.add_probe(glm::vec3(0.f, 0.08f, 0.55f), desk_room);		// Between the can and the orange
+	reflection_probes.add_probe(glm::vec3(0.f, 0.15f, -0.85f), desk_room);
+	glm::vec4 probe_lighting = glm::vec4(-1.f);			// Lighting the probes were last captured with
+
+	debug_draw::LineBatch debug_lines;
+	debug_lines.init();
+
+	resolution::DynamicResolution dynamic_resolution;
+	dynamic_resolution.init();
+
+	antialiasing::Fxaa fxaa;
+	fxaa.init();
+
+	Fog fog;
+	fog.color = glm::vec3(0.5f, 0.5f, 0.55f);
+	fog.density = 0.15f;
+
+	std::vector<unsigned int> visible;									// Indices into scene that survived culling
+	visible.reserve(scene.size());
+	culling::CullStats cull_stats;
+
+	float last_title_update = 0.f;
+
 	/**
 	 * Main rendering loop
 	 */
@@ -171,9 +475,37 @@ int main(int argc, char* argv[]) {
 		processInput(window);
 
 		/**
-		 * Clear color and depth buffers before rendering.
+		 * Upload textures decoded since the last frame. The last frame's visible Models
+		 * mark their textures used, with their share of the screen as the priority of
+		 * any levels still streaming in, so the nearest and largest sharpen first.
+		 * Probes captured with coarser levels are captured again.
 		 */
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		for (unsigned int index : visible) {
+			glm::vec3 center(scene_bounds.center_x[index], scene_bounds.center_y[index], scene_bounds.center_z[index]);
+			float distance = std::max(glm::length(center - glob::cameraPos), 0.01f);
+			float coverage = scene_bounds.radius[index] * scene_bounds.radius[index] / (distance * distance);
+			textures::loader().prioritize(scene[index].texture, coverage);
+			if (scene[index].material != nullptr)
+				textures::loader().prioritize(scene[index].material->specular_map, coverage);
+		}
+		if (textures::loader().update() > 0)
+			reflection_probes.invalidate_all();
+
+		/**
+		 * Clear color and depth buffers before rendering. With fog on the background is
+		 * the fog color. With dynamic resolution or anti-aliasing the scene is drawn
+		 * offscreen and that target is cleared instead.
+		 */
+		bool offscreen = glob::dynamic_resolution || glob::aa_mode != antialiasing::Mode::OFF;
+		if (glob::fog)
+			glClearColor(fog.color.r, fog.color.g, fog.color.b, 1.0f);
+		else
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		if (!offscreen)
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		models_set_fog(glob::fog ? &fog : nullptr);
+		models_set_blinn_phong(glob::blinn_phong);
+		models_set_baked_lighting(glob::baked_lighting);
 
 		/**
 		 * Create projection, view and model matrices to pass to shader.
@@ -189,6 +521,18 @@ int main(int argc, char* argv[]) {
 
 		float aspect_ratio = (float)viewport.width / (float)viewport.height;																	// Calculate aspect ratio using viewport width and height
 
+		/**
+		 * Offscreen, the scene is drawn into a target that is scaled with dynamic
+		 * resolution and full size otherwise; everything below sees that target's size.
+		 */
+		if (offscreen) {
+			dynamic_resolution.adaptive = glob::dynamic_resolution;
+			dynamic_resolution.upscale = glob::upscale;
+			dynamic_resolution.begin_frame(viewport.width, viewport.height);
+			viewport.width = dynamic_resolution.width();
+			viewport.height = dynamic_resolution.height();
+		}
+
 		glm::mat4 projection;
 		if (glob::orthographic) {																												// Create projection matrix depending on value of glob::orthographic
 			float ratio_size_per_depth = atan(glm::radians(glob::fov) / 2.f) * 2.f;																	// Multiply this variable by distance Z from the camera to get aspect ratio of ortho projection
@@ -204,6 +548,61 @@ int main(int argc, char* argv[]) {
 
 		glm::mat4 view = glm::lookAt(glob::cameraPos, glob::cameraPos + glob::cameraFront, glob::cameraUp);										// Create view matrix									
 
+		/**
+		 * Cull Models outside of the view frustum. The resulting visible list is what
+		 * gets drawn below.
+		 */
+		culling::Frustum frustum = culling::extract_frustum(projection * view);
+
+		if (glob::frustum_culling && glob::bvh_culling) {
+			visible.clear();
+			scene_tree.query_frustum(frustum, visible);
+			std::sort(visible.begin(), visible.end());							// Keep the scene's draw order
+
+			cull_stats.visible = (unsigned int)visible.size();
+			cull_stats.culled = (unsigned int)(scene.size() - visible.size());
+		}
+		else if (glob::frustum_culling) {
+			culling::cull(frustum, scene_bounds, visible, cull_stats);
+		}
+		else {
+			visible.clear();
+			for (unsigned int i = 0; i < scene.size(); ++i)
+				visible.push_back(i);											// Everything is visible with culling off
+
+			cull_stats.visible = (unsigned int)scene.size();
+			cull_stats.culled = 0;
+		}
+
+		/**
+		 * Bob the clustered lights up and down, then rebuild the cluster light lists for
+		 * this frame's view.
+		 */
+		if (glob::clustered_lighting) {
+			for (size_t i = 0; i < point_lights.size(); ++i)
+				point_lights[i].position.y = light_heights[i] + 0.2f * sinf(curr_time + (float)i);
+
+			light_grid.assign(point_lights, view, projection);
+			light_grid.upload(point_lights);
+			models_bind_light_grid(&light_grid, viewport.width, viewport.height);
+		}
+		else {
+			models_bind_light_grid(nullptr, viewport.width, viewport.height);
+		}
+
+		/**
+		 * Bring the shadow maps up to date; this draws nothing when no light, static
+		 * Model or cascade moved.
+		 */
+		if (glob::shadows_enabled) {
+			shadow_maps.settings.pcf_radius = glob::pcf_radius;
+			shadow_maps.update(scene, dynamic_casters, light2, light, view, projection);
+			models_bind_shadows(&shadow_maps);
+		}
+		else {
+			models_bind_shadows(nullptr);
+		}
+
 		/**
 		 * Set polygon mode depending on value of wireframe
 		 */
@@ -231,16 +630,204 @@ int main(int argc, char* argv[]) {
 		}
 
 		/**
-		 * Draw models
+		 * Spherical harmonics ambient: a room lit from above by both lights, dimmer
+		 * around the sides and dimmer still below, where the light has bounced off the
+		 * wooden desk. It averages about the constant ambient term, and is only
+		 * projected again when the point light changes color.
+		 */
+		if (glob::sh_ambient && light.color != probe_light_color) {
+			glm::vec3 ambient = (light.color + light2.color) * glob::ambient_strength;
+			environment::Cubemap room = environment::procedural_environment(16, ambient * 1.6f, ambient, ambient * glm::vec3(0.6f, 0.4f, 0.25f));
+			ambient_probe.upload(environment::irradiance(environment::project(room)));
+			probe_light_color = light.color;
+		}
+		models_set_sh_ambient(glob::sh_ambient);
+
+		/**
+		 * Bring the reflection probes a step closer to up to date, refreshing them all
+		 * when the lighting they captured changed. The captures are lit like the scene
+		 * but neither reflect nor use the cluster grid, whose light lists are for the
+		 * camera's view.
 		 */
-		draw_radiant_light(light, projection, view);													// Draw light source
+		models_bind_reflections(nullptr);
+		if (glob::reflections) {
+			glm::vec4 lighting = glm::vec4(light.color,
+				(float)(glob::fog + 2 * glob::shadows_enabled + 4 * glob::baked_lighting + 8 * glob::sh_ambient + 16 * glob::blinn_phong));
+			if (lighting != probe_lighting) {
+				reflection_probes.invalidate_all();
+				probe_lighting = lighting;
+			}
+
+			models_bind_light_grid(nullptr, viewport.width, viewport.height);
+			reflection_probes.update([&](const glm::mat4& probe_projection, const glm::mat4& probe_view, glm::vec3 eye) {
+				for (const Model& model : scene)
+					draw_scene_model(model, probe_projection, probe_view, light, light2, eye);
+			});
+			if (glob::clustered_lighting)
+				models_bind_light_grid(&light_grid, viewport.width, viewport.height);
+			models_bind_reflections(&reflection_probes);
+		}
 
-		draw_model(desk, projection, view, light, light2, glob::cameraPos);								// Draw desk Model
-		draw_material_model(console, console_mat, projection, view, light, light2, glob::cameraPos);	// Draw console Model
-		draw_model(napkin, projection, view, light, light2, glob::cameraPos);							// Draw napkin Model
-		draw_model(orange, projection, view, light, light2, glob::cameraPos);							// Draw orange Model
-		draw_model(soda, projection, view, light, light2, glob::cameraPos);								// Draw soda can Model
+		/**
+		 * Draw models. With deferred shading the scene Models only fill the G-buffer, and
+		 * with the visibility buffer only write triangle IDs; either way they are lit
+		 * afterwards in full-screen passes, and the light source and prop field are still
+		 * drawn forward on top.
+		 */
+		bool deferred_shading = glob::shading_path == deferred::Path::DEFERRED;
+		bool visibility_shading = glob::shading_path == deferred::Path::VISIBILITY_BUFFER;
+		auto draw_scene_index = [&](unsigned int index) {
+			if (deferred_shading)
+				draw_model_gbuffer(scene[index], projection, view);
+			else if (visibility_shading)
+				visibility_renderer.draw(scene[index], projection, view);
+			else
+				draw_scene_model(scene[index], projection, view, light, light2, glob::cameraPos);
+		};
 
+		/**
+		 * Every light source is drawn as a sprite in one instanced draw; with debug lines
+		 * on the batch also outlines each light's cutoff radius.
+		 */
+		light_gizmos.clear();
+		light_gizmos.push_back(light);
+		if (glob::clustered_lighting)
+			light_gizmos.insert(light_gizmos.end(), point_lights.begin(), point_lights.end());
+
+		if (deferred_shading) {
+			if (deferred_renderer.width() != viewport.width || deferred_renderer.height() != viewport.height)
+				deferred_renderer.resize(viewport.width, viewport.height);						// Follow window resizes
+			deferred_renderer.begin_geometry();
+		}
+		else if (visibility_shading) {
+			if (visibility_renderer.width() != viewport.width || visibility_renderer.height() != viewport.height)
+				visibility_renderer.resize(viewport.width, viewport.height);
+			visibility_renderer.begin_geometry();
+		}
+		else {
+			draw_radiant_lights(light_gizmos, projection, view);									// Draw light sources
+		}
+
+		if (glob::occlusion_culling) {
+			occlusion_culler.render(scene_tree, frustum, projection * view, glob::cameraPos, draw_scene_index,
+				occlusion_stats);																	// Draw Models not known to be occluded, then queue occlusion queries
+		}
+		else if (deferred_shading || visibility_shading) {
+			for (unsigned int index : visible)
+				draw_scene_index(index);															// Draw each visible Model
+		}
+		else {
+			/**
+			 * Forward shading goes through the depth pre-pass, which also counts the
+			 * fragments lit. Its queries cannot overlap the occlusion culler's, and
+			 * deferred and visibility buffer lighting already light each pixel once.
+			 */
+			depth_prepass.mode = glob::prepass_mode;
+			if (depth_prepass.begin_frame(viewport.width, viewport.height)) {
+				depth_prepass.begin_depth();
+				for (unsigned int index : visible)
+					draw_model_depth(scene[index], projection, view);								// Lay down depth only
+			}
+			depth_prepass.begin_color();
+			for (unsigned int index : visible)
+				draw_scene_index(index);															// Light only the nearest fragments
+			depth_prepass.end_frame();
+		}
+
+		if (deferred_shading) {
+			deferred_renderer.ambient_occlusion = glob::ambient_occlusion ? &ambient_occlusion : nullptr;
+			deferred_renderer.shade(projection, view, light, light2, glob::cameraPos, glob::clustered_lighting ? &light_grid : nullptr, models_fog(),
+				offscreen ? dynamic_resolution.framebuffer() : 0);
+			draw_radiant_lights(light_gizmos, projection, view);									// Draw light sources, depth tested against the G-buffer
+		}
+		else if (visibility_shading) {
+			visibility_renderer.resolve(projection, view, light, light2, glob::cameraPos, glob::clustered_lighting ? &light_grid : nullptr, models_fog(),
+				offscreen ? dynamic_resolution.framebuffer() : 0);
+			draw_radiant_lights(light_gizmos, projection, view);									// Draw light sources, depth tested against the ID pass
+		}
+
+		if (glob::prop_field) {
+			prop_field.cull(frustum);																// Cull the field on the GPU
+			prop_field.draw(projection, view, light, light2, glob::cameraPos);						// Draw the instances that survived
+		}
+
+		/**
+		 * Debug lines for the visible Models, the lights and the shadow cascades, all
+		 * drawn in one call.
+		 */
+		if (glob::debug_level != debug_draw::Level::OFF) {
+			debug_lines.clear();
+			for (unsigned int index : visible)
+				debug_lines.box(bvh::model_bounds(scene[index]), glm::vec3(0.f, 1.f, 0.f));
+			for (const RadiantLight& gizmo : light_gizmos)
+				debug_lines.light_radius(gizmo);
+			if (glob::shadows_enabled) {
+				for (int cascade = 0; cascade < shadow_maps.settings.cascades; ++cascade)
+					debug_lines.frustum(shadow_maps.cascade_matrix(cascade), glm::vec3(1.f, 0.f, 1.f));
+			}
+			if (glob::debug_level == debug_draw::Level::NORMALS) {
+				for (unsigned int index : visible)
+					debug_lines.normals(scene[index], 0.05f, glm::vec3(1.f, 1.f, 0.f));
+			}
+			debug_lines.draw(projection, view);
+		}
+
+		if (offscreen)
+			dynamic_resolution.end_frame(glob::aa_mode == antialiasing::Mode::FXAA ? &fxaa : nullptr);	// Anti-alias and upscale into the window
+
+		/**
+		 * Report frame rate and culling counters in the window title once a second.
+		 */
+		if (curr_time - last_title_update >= 1.f) {
+			std::ostringstream title;
+			const char* paths[] = { "forward", "deferred", "visibility buffer" };
+			title << "3D Scene | " << (int)(1.f / glob::deltaTime) << " fps" << " | " << paths[(int)glob::shading_path]
+				<< (glob::blinn_phong ? " Blinn-Phong" : " Phong") << (glob::baked_lighting ? ", baked" : "")
+				<< " | " << (glob::bvh_culling ? "BVH" : "flat") << " visible: " << cull_stats.visible << " culled: " << cull_stats.culled;
+			if (glob::occlusion_culling)
+				title << " | occluded: " << (int)(occlusion_stats.skipped_fraction() * 100.f) << "%";
+			if (glob::clustered_lighting)
+				title << " | lights: " << light_grid.stats().lights << "/" << point_lights.size() << " (max " << light_grid.stats().max_per_cluster << " per cluster)";
+			if (visibility_shading) {
+				title << " | visibility: " << visibility_renderer.stats().draws << " draws, " << visibility_renderer.stats().triangles << " triangles, "
+					<< visibility_renderer.stats().materials << " materials";
+			}
+			if (glob::shading_path == deferred::Path::FORWARD && !glob::occlusion_culling) {
+				const char* modes[] = { "auto", "on", "off" };
+				title << " | pre-pass: " << modes[(int)glob::prepass_mode] << (depth_prepass.active() ? " (active)" : "")
+					<< ", overdraw " << std::round(depth_prepass.stats().overdraw * 10.f) / 10.f << "x";
+			}
+			if (glob::shadows_enabled)
+				title << " | shadows: PCF " << glob::pcf_radius << ", " << shadow_maps.stats().static_passes << " static " << shadow_maps.stats().dynamic_passes << " dynamic passes";
+			if (glob::dynamic_resolution) {
+				title << " | resolution: " << (int)std::round(dynamic_resolution.stats().scale * 100.f) << "% " << dynamic_resolution.width() << "x" << dynamic_resolution.height()
+					<< (glob::upscale == resolution::Upscale::SHARPENED ? " sharpened" : " bilinear") << ", GPU " << std::round(dynamic_resolution.stats().gpu_ms * 10.0) / 10.0 << " ms";
+			}
+			if (glob::aa_mode == antialiasing::Mode::FXAA)
+				title << " | FXAA";
+			if (glob::ambient_occlusion && deferred_shading) {
+				title << " | SSAO: " << ambient_occlusion.stats().width << "x" << ambient_occlusion.stats().height
+					<< ", GPU " << std::round(ambient_occlusion.stats().gpu_ms * 100.0) / 100.0 << " ms";
+			}
+			else if (glob::ambient_occlusion) {
+				title << " | SSAO: deferred only";
+			}
+			if (glob::sh_ambient)
+				title << " | SH ambient";
+			if (glob::reflections) {
+				title << " | probes: " << reflection_probes.size() << ", " << reflection_probes.stats().faces_rendered << " faces "
+					<< reflection_probes.stats().mips_filtered << " mips per frame, " << reflection_probes.stats().steps_pending << " steps pending";
+			}
+			if (glob::debug_level != debug_draw::Level::OFF)
+				title << " | debug: " << debug_lines.line_count() << " lines";
+			title << " | textures: " << textures::loader().loaded() << ", " << textures::loader().resident_bytes() / (1024 * 1024) << " MB";
+			if (textures::loader().pending() > 0)
+				title << ", " << textures::loader().pending() << " loading";
+			if (glob::prop_field)
+				title << " | field: " << prop_field.visible() << "/" << prop_field.size() << (prop_field.indirect() ? " (indirect)" : " (frame late)");
+			glfwSetWindowTitle(window, title.str().c_str());
+			last_title_update = curr_time;
+		}
 
 		glfwSwapBuffers(window);				// Swaps front and back framebuffers (output to screen)
 
@@ -368,6 +955,24 @@ void processInput(GLFWwindow* window)
 	static bool p_pressed = false;
 	static bool o_pressed = false;
 	static bool i_pressed = false;
+	static bool c_pressed = false;
+	static bool b_pressed = false;
+	static bool x_pressed = false;
+	static bool g_pressed = false;
+	static bool l_pressed = false;
+	static bool r_pressed = false;
+	static bool f_pressed = false;
+	static bool h_pressed = false;
+	static bool t_pressed = false;
+	static bool y_pressed = false;
+	static bool z_pressed = false;
+	static bool k_pressed = false;
+	static bool n_pressed = false;
+	static bool v_pressed = false;
+	static bool m_pressed = false;
+	static bool u_pressed = false;
+	static bool j_pressed = false;
+	static bool one_pressed = false;
 
 	using namespace glob;														// This method accesses and modifies global variables
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -402,6 +1007,141 @@ void processInput(GLFWwindow* window)
 		i_pressed = false;								// Set i_pressed to false
 
 
+	if (!c_pressed && glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) {
+		glob::frustum_culling ^= true;							// Toggle value of frustum_culling
+		c_pressed = true;										// Set c_pressed to true
+	}																			// When "C" is pressed toggle frustum culling On or Off
+	if (c_pressed && glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE)
+		c_pressed = false;										// Set c_pressed to false
+
+	if (!b_pressed && glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) {
+		glob::bvh_culling ^= true;								// Toggle value of bvh_culling
+		b_pressed = true;										// Set b_pressed to true
+	}																			// When "B" is pressed toggle between flat and BVH frustum culling
+	if (b_pressed && glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE)
+		b_pressed = false;										// Set b_pressed to false
+
+	if (!x_pressed && glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS) {
+		glob::occlusion_culling ^= true;						// Toggle value of occlusion_culling
+		x_pressed = true;										// Set x_pressed to true
+	}																			// When "X" is pressed toggle occlusion query culling On or Off
+	if (x_pressed && glfwGetKey(window, GLFW_KEY_X) == GLFW_RELEASE)
+		x_pressed = false;										// Set x_pressed to false
+
+	if (!g_pressed && glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
+		glob::prop_field ^= true;								// Toggle value of prop_field
+		g_pressed = true;										// Set g_pressed to true
+	}																			// When "G" is pressed toggle the GPU-culled prop field On or Off
+	if (g_pressed && glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE)
+		g_pressed = false;										// Set g_pressed to false
+
+	if (!l_pressed && glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
+		glob::clustered_lighting ^= true;						// Toggle value of clustered_lighting
+		l_pressed = true;										// Set l_pressed to true
+	}																			// When "L" is pressed toggle the clustered point lights On or Off
+	if (l_pressed && glfwGetKey(window, GLFW_KEY_L) == GLFW_RELEASE)
+		l_pressed = false;										// Set l_pressed to false
+
+	if (!r_pressed && glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
+		glob::shading_path = (deferred::Path)(((int)glob::shading_path + 1) % 3);	// Cycle through forward, deferred, visibility buffer
+		r_pressed = true;										// Set r_pressed to true
+	}																			// When "R" is pressed change shading path
+	if (r_pressed && glfwGetKey(window, GLFW_KEY_R) == GLFW_RELEASE)
+		r_pressed = false;										// Set r_pressed to false
+
+	if (!f_pressed && glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) {
+		glob::fog ^= true;										// Toggle value of fog
+		f_pressed = true;										// Set f_pressed to true
+	}																			// When "F" is pressed toggle distance fog On or Off
+	if (f_pressed && glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE)
+		f_pressed = false;										// Set f_pressed to false
+
+	if (!h_pressed && glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) {
+		glob::blinn_phong ^= true;								// Toggle value of blinn_phong
+		h_pressed = true;										// Set h_pressed to true
+	}																			// When "H" is pressed toggle between Phong and Blinn-Phong specular
+	if (h_pressed && glfwGetKey(window, GLFW_KEY_H) == GLFW_RELEASE)
+		h_pressed = false;										// Set h_pressed to false
+
+	if (!t_pressed && glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
+		glob::shadows_enabled ^= true;							// Toggle value of shadows
+		t_pressed = true;										// Set t_pressed to true
+	}																			// When "T" is pressed toggle shadows On or Off
+	if (t_pressed && glfwGetKey(window, GLFW_KEY_T) == GLFW_RELEASE)
+		t_pressed = false;										// Set t_pressed to false
+
+	if (!y_pressed && glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) {
+		glob::pcf_radius = (glob::pcf_radius + 1) % 3;			// Cycle through PCF radius 0, 1, 2
+		y_pressed = true;										// Set y_pressed to true
+	}																			// When "Y" is pressed change shadow filtering
+	if (y_pressed && glfwGetKey(window, GLFW_KEY_Y) == GLFW_RELEASE)
+		y_pressed = false;										// Set y_pressed to false
+
+	if (!z_pressed && glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) {
+		glob::prepass_mode = (prepass::Mode)(((int)glob::prepass_mode + 1) % 3);	// Cycle through auto, on, off
+		z_pressed = true;										// Set z_pressed to true
+	}																			// When "Z" is pressed change depth pre-pass mode
+	if (z_pressed && glfwGetKey(window, GLFW_KEY_Z) == GLFW_RELEASE)
+		z_pressed = false;										// Set z_pressed to false
+
+	if (!k_pressed && glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
+		glob::baked_lighting ^= true;							// Toggle value of baked_lighting
+		k_pressed = true;										// Set k_pressed to true
+	}																			// When "K" is pressed toggle baked lighting On or Off
+	if (k_pressed && glfwGetKey(window, GLFW_KEY_K) == GLFW_RELEASE)
+		k_pressed = false;										// Set k_pressed to false
+
+	if (!n_pressed && glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS) {
+		glob::debug_level = (debug_draw::Level)(((int)glob::debug_level + 1) % 3);	// Cycle through off, gizmos, gizmos and normals
+		n_pressed = true;										// Set n_pressed to true
+	}																			// When "N" is pressed change debug lines
+	if (n_pressed && glfwGetKey(window, GLFW_KEY_N) == GLFW_RELEASE)
+		n_pressed = false;										// Set n_pressed to false
+
+	if (!v_pressed && glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS) {
+		if (!glob::dynamic_resolution) {
+			glob::dynamic_resolution = true;
+			glob::upscale = resolution::Upscale::SHARPENED;
+		}
+		else if (glob::upscale == resolution::Upscale::SHARPENED) {
+			glob::upscale = resolution::Upscale::BILINEAR;
+		}
+		else {
+			glob::dynamic_resolution = false;
+		}														// Cycle through off, sharpened, bilinear
+		v_pressed = true;										// Set v_pressed to true
+	}																			// When "V" is pressed change dynamic resolution
+	if (v_pressed && glfwGetKey(window, GLFW_KEY_V) == GLFW_RELEASE)
+		v_pressed = false;										// Set v_pressed to false
+
+	if (!m_pressed && glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) {
+		glob::aa_mode = glob::aa_mode == antialiasing::Mode::OFF ? antialiasing::Mode::FXAA : antialiasing::Mode::OFF;	// Toggle FXAA
+		m_pressed = true;										// Set m_pressed to true
+	}																			// When "M" is pressed toggle anti-aliasing
+	if (m_pressed && glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE)
+		m_pressed = false;										// Set m_pressed to false
+
+	if (!u_pressed && glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) {
+		glob::ambient_occlusion ^= true;						// Toggle value of ambient_occlusion
+		u_pressed = true;										// Set u_pressed to true
+	}																			// When "U" is pressed toggle screen-space ambient occlusion
+	if (u_pressed && glfwGetKey(window, GLFW_KEY_U) == GLFW_RELEASE)
+		u_pressed = false;										// Set u_pressed to false
+
+	if (!j_pressed && glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
+		glob::sh_ambient ^= true;								// Toggle value of sh_ambient
+		j_pressed = true;										// Set j_pressed to true
+	}																			// When "J" is pressed toggle spherical harmonics ambient light
+	if (j_pressed && glfwGetKey(window, GLFW_KEY_J) == GLFW_RELEASE)
+		j_pressed = false;										// Set j_pressed to false
+
+	if (!one_pressed && glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
+		glob::reflections ^= true;								// Toggle value of reflections
+		one_pressed = true;										// Set one_pressed to true
+	}																			// When "1" is pressed toggle reflection probes
+	if (one_pressed && glfwGetKey(window, GLFW_KEY_1) == GLFW_RELEASE)
+		one_pressed = false;									// Set one_pressed to false
+
 	if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ||
 		glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS)
 		zoom = true;															// When "Shift" is held, scrolling behavior becomes zooming in and out
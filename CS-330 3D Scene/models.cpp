@@ -7,17 +7,36 @@
 #include "models.h"
 
 #include "shader.h"
+#include "permutations.h"
+#include "shadows.h"
+#include "lightmaps.h"
+#include "environment.h"
+#include "reflections.h"
 
 #include "utils.h"
 
 namespace glob {
-	Shader* universal_shader = nullptr;
-	Shader* material_shader = nullptr;
-	Shader* normals_shader = nullptr;
-	unsigned int number_of_textures = 0;
+	permutations::ShaderCache* model_shaders = nullptr;				// single_texture uber-shader variants
+	permutations::ShaderCache* gbuffer_shaders = nullptr;			// gbuffer variants
+	Shader* universal_shader = nullptr;								// Variant with no features
+	Shader* prepass_shader = nullptr;								// Depth only, position stream
 
-	const float ambient_strength = 0.2f;
-	const glm::vec3 ambient_color = glm::vec3(1.f, 1.f, 1.f);
+	const clustered::ClusterGrid* light_grid = nullptr;			// Set by models_bind_light_grid()
+	int light_grid_width = 0;
+	int light_grid_height = 0;
+
+	bool fog_enabled = false;										// Set by models_set_fog()
+	Fog fog_settings;
+
+	bool blinn_phong_enabled = false;									// Set by models_set_blinn_phong()
+
+	const shadows::ShadowMaps* shadow_maps = nullptr;				// Set by models_bind_shadows()
+
+	bool baked_lighting_enabled = false;							// Set by models_set_baked_lighting()
+
+	bool sh_ambient_enabled = false;								// Set by models_set_sh_ambient()
+
+	const reflections::ReflectionProbes* reflection_probes = nullptr;	// Set by models_bind_reflections()
 }
 
 struct vertex {
@@ -26,10 +45,230 @@ struct vertex {
 	float s, t;
 };
 
+/**
+ * Point a newly compiled Model shader variant's samplers at their texture units.
+ */
+static void setup_model_shader(Shader& shader, unsigned int features) {
+	shader.setInt("aTexture", 0);
+	if (features & permutations::SPECULAR_MAP)
+		shader.setInt("specularMap", 1);
+	if (features & permutations::CLUSTERED_LIGHTS)
+		clustered::set_texture_units(shader);
+	if (features & permutations::SHADOWS) {
+		shader.setInt("dirShadowMap", shadows::FIRST_TEXTURE_UNIT);
+		shader.setInt("pointShadowMap", shadows::FIRST_TEXTURE_UNIT + 1);
+	}
+	if (features & permutations::BAKED_LIGHTING)
+		shader.setInt("lightmap", lightmaps::TEXTURE_UNIT);
+	if (features & permutations::SH_AMBIENT)
+		environment::bind_uniform_block(shader);
+	if (features & permutations::REFLECTIONS)
+		reflections::set_texture_units(shader);
+}
+
 void models_init() {
-	glob::universal_shader = new Shader("shaders/single_texture.vs.glsl", "shaders/single_texture.fs.glsl");
-	glob::material_shader = new Shader("shaders/single_texture.vs.glsl", "shaders/material_single_texture.fs.glsl");
-	glob::normals_shader = new Shader("shaders/draw_normals.vs.glsl", "shaders/draw_normals.fs.glsl", "shaders/draw_normals.gs.glsl");
+	glob::model_shaders = new permutations::ShaderCache("shaders/single_texture.vs.glsl", "shaders/single_texture.fs.glsl", setup_model_shader, "shaders/lighting.glsl");
+	glob::gbuffer_shaders = new permutations::ShaderCache("shaders/single_texture.vs.glsl", "shaders/gbuffer.fs.glsl", setup_model_shader);
+	glob::universal_shader = &glob::model_shaders->get(0);
+	glob::prepass_shader = new Shader("shaders/depth_prepass.vs.glsl", "shaders/shadow_depth.fs.glsl");
+
+	glob::light_grid = nullptr;
+	glob::fog_enabled = false;
+	glob::blinn_phong_enabled = false;
+	glob::shadow_maps = nullptr;
+	glob::baked_lighting_enabled = false;
+	glob::sh_ambient_enabled = false;
+	glob::reflection_probes = nullptr;
+}
+
+/**
+ * Light Models drawn from now on with a cluster grid's point lights, or turn clustered
+ * lighting off when grid is null.
+ */
+void models_bind_light_grid(const clustered::ClusterGrid* grid, int viewport_width, int viewport_height) {
+	glob::light_grid = grid;
+	glob::light_grid_width = viewport_width;
+	glob::light_grid_height = viewport_height;
+}
+
+/**
+ * Fog Models drawn from now on, or turn fog off when fog is null.
+ */
+void models_set_fog(const Fog* fog) {
+	glob::fog_enabled = fog != nullptr;
+	if (fog != nullptr)
+		glob::fog_settings = *fog;
+}
+
+const Fog* models_fog() {
+	return glob::fog_enabled ? &glob::fog_settings : nullptr;
+}
+
+/**
+ * Light Models drawn from now on with Blinn-Phong rather than Phong specular.
+ */
+void models_set_blinn_phong(bool enabled) {
+	glob::blinn_phong_enabled = enabled;
+}
+
+bool models_blinn_phong() {
+	return glob::blinn_phong_enabled;
+}
+
+/**
+ * Shadow Models drawn from now on with a set of shadow maps, or turn shadows off when
+ * maps is null.
+ */
+void models_bind_shadows(const shadows::ShadowMaps* maps) {
+	glob::shadow_maps = maps;
+}
+
+const shadows::ShadowMaps* models_shadows() {
+	return glob::shadow_maps;
+}
+
+/**
+ * Light Models drawn from now on that have a lightmap from it (see lightmaps.h).
+ */
+void models_set_baked_lighting(bool enabled) {
+	glob::baked_lighting_enabled = enabled;
+}
+
+bool models_baked_lighting() {
+	return glob::baked_lighting_enabled;
+}
+
+/**
+ * Light Models drawn from now on with the spherical harmonics ambient light last
+ * uploaded by an environment::AmbientProbe instead of the constant ambient term.
+ */
+void models_set_sh_ambient(bool enabled) {
+	glob::sh_ambient_enabled = enabled;
+}
+
+bool models_sh_ambient() {
+	return glob::sh_ambient_enabled;
+}
+
+/**
+ * Reflect the nearest of a set of reflection probes in Models drawn from now on, or
+ * turn reflections off when probes is null.
+ */
+void models_bind_reflections(const reflections::ReflectionProbes* probes) {
+	glob::reflection_probes = probes;
+}
+
+const reflections::ReflectionProbes* models_reflections() {
+	return glob::reflection_probes;
+}
+
+/**
+ * Feature bit for a Model's own baked lighting, and its lightmap bound when it has one.
+ */
+static unsigned int bind_lightmap(const Model& model) {
+	if (!glob::baked_lighting_enabled || model.lightmap == 0)
+		return 0;
+
+	glActiveTexture(GL_TEXTURE0 + lightmaps::TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, model.lightmap);
+	glActiveTexture(GL_TEXTURE0);
+	return permutations::BAKED_LIGHTING;
+}
+
+/**
+ * Bind the Model shader variant for features plus the scene-wide features (clustered
+ * lights, fog) and set the uniforms every Model drawn with it shares.
+ */
+Shader& use_model_shader(unsigned int features, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos) {
+	using namespace glob;
+
+	if (light_grid != nullptr)
+		features |= permutations::CLUSTERED_LIGHTS;
+	if (fog_enabled)
+		features |= permutations::FOG;
+	if (blinn_phong_enabled)
+		features |= permutations::BLINN_PHONG;
+	if (shadow_maps != nullptr)
+		features |= permutations::SHADOWS;
+	if (sh_ambient_enabled)
+		features |= permutations::SH_AMBIENT;
+	if (reflection_probes != nullptr)
+		features |= permutations::REFLECTIONS;
+
+	Shader& shader = model_shaders->get(features);
+	shader.use();
+
+	shader.setFloat("ambientStrength", ambient_strength);
+	shader.setVec3("ambientColor", ambient_color);
+
+	shader.setVec3("pointLight.position", point_light.position);
+	shader.setVec3("pointLight.color", point_light.color);
+	shader.setVec3("dirLight.direction", dir_light.direction);
+	shader.setVec3("dirLight.color", dir_light.color);
+	shader.setVec3("attenCoeff", point_light.attenuation_coefficients);
+	shader.setVec3("viewPos", viewPos);
+
+	shader.setMat4("projection", projection);
+	shader.setMat4("view", view);
+
+	if (light_grid != nullptr)
+		light_grid->bind(shader, light_grid_width, light_grid_height);
+
+	if (shadow_maps != nullptr)
+		shadow_maps->bind(shader);
+
+	if (reflection_probes != nullptr)
+		reflection_probes->bind(shader);
+
+	if (fog_enabled) {
+		shader.setVec3("fogColor", fog_settings.color);
+		shader.setFloat("fogDensity", fog_settings.density);
+	}
+
+	return shader;
+}
+
+/**
+ * Compute a Model's object-space bounding box from interleaved vertex data whose
+ * first three floats are the vertex position.
+ */
+void compute_bounds(Model& model, const float* vertex_data, size_t number_of_vertices, int stride) {
+	if (number_of_vertices == 0)
+		return;
+
+	model.bounds_min = glm::vec3(vertex_data[0], vertex_data[1], vertex_data[2]);
+	model.bounds_max = model.bounds_min;
+
+	for (size_t i = 1; i < number_of_vertices; ++i) {
+		const float* position = vertex_data + i * stride;
+		model.bounds_min = glm::min(model.bounds_min, glm::vec3(position[0], position[1], position[2]));
+		model.bounds_max = glm::max(model.bounds_max, glm::vec3(position[0], position[1], position[2]));
+	}
+}
+
+/**
+ * Give a Model a second VAO that reads only vertex positions, copied tightly packed out
+ * of its interleaved vertex data, so depth-only passes fetch 12 bytes per vertex
+ * instead of 32.
+ */
+void create_position_stream(Model& model, const float* vertex_data, size_t number_of_vertices, int stride) {
+	std::vector<float> positions(number_of_vertices * 3);
+	for (size_t i = 0; i < number_of_vertices; ++i) {
+		positions[i * 3 + 0] = vertex_data[i * stride + 0];
+		positions[i * 3 + 1] = vertex_data[i * stride + 1];
+		positions[i * 3 + 2] = vertex_data[i * stride + 2];
+	}
+
+	unsigned int VBO;
+	glGenVertexArrays(1, &model.position_VAO);
+	glGenBuffers(1, &VBO);
+
+	glBindVertexArray(model.position_VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
 }
 
 void create_model(Model& model, std::vector<vertex> vertices, glm::mat4 model_matrix, const char* texture_path) {
@@ -79,6 +318,8 @@ void create_model(Model& model, std::vector<vertex> vertices, glm::mat4 model_ma
 	 * Set orange models number of vertices
 	 */
 	model.number_of_vertices = vertices.size();
+	compute_bounds(model, &vertices[0].x, vertices.size(), stride);
+	create_position_stream(model, &vertices[0].x, vertices.size(), stride);
 
 	/**
 	 * Assign model matrix
@@ -90,10 +331,6 @@ void create_model(Model& model, std::vector<vertex> vertices, glm::mat4 model_ma
 	 */
 	unsigned int console_texture = load_wrap_texture(texture_path);				// Generate texture with wrapping attributes (ideally it will be a web and should not repeat)
 
-	glob::universal_shader->use();												// Bind universal shader to context
-	glob::universal_shader->setInt("texture", glob::number_of_textures++);		// Tell shader where to find texture
-
-	model.texture_offset = glob::number_of_textures - 1;						// Assign offset from GL_TEXTURE0 texture unit
 	model.texture = console_texture;											// Assing handle to texture
 }
 
@@ -153,6 +390,8 @@ Model get_desk_model(const char* texture_path) {
 	plane.VAO = plane_VAO;								// Assign VAO handle to Model
 	plane.number_of_vertices = sizeof(plane_vertices)
 							/ (sizeof(float) * stride);	// Assign number_of_vertices to Model
+	compute_bounds(plane, plane_vertices, plane.number_of_vertices, stride);
+	create_position_stream(plane, plane_vertices, plane.number_of_vertices, stride);
 
 	/**
 	 * Define plane model matrix.
@@ -169,10 +408,6 @@ Model get_desk_model(const char* texture_path) {
 	 */
 	unsigned int plane_texture = load_wrap_texture(texture_path);									// Generate texture with wrapping attributes
 
-	glob::universal_shader->use();																	// Bind universal shader to context
-	glob::universal_shader->setInt("texture", glob::number_of_textures++);							// Tell shader where to find texture
-
-	plane.texture_offset = glob::number_of_textures - 1;											// Assign offset from GL_TEXTURE0 texture unit
 	plane.texture = plane_texture;																	// Assing handle to texture
 
 	plane.shine = 0.3f;
@@ -291,6 +526,8 @@ Model get_switch_model(const char* texture_path) {
 	console.VAO = switch_VAO;							// Assign VAO handle to model
 	console.number_of_vertices = sizeof(console_vertices)
 		/ (sizeof(float) * stride);						// Assign number_of_vertices to model
+	compute_bounds(console, console_vertices, console.number_of_vertices, stride);
+	create_position_stream(console, console_vertices, console.number_of_vertices, stride);
 
 	/**
 	 * Define switch model matrix.
@@ -307,10 +544,6 @@ Model get_switch_model(const char* texture_path) {
 	 */
 	unsigned int console_texture = load_wrap_texture(texture_path);				// Generate texture with wrapping attributes (ideally it will be a web and should not repeat)
 
-	glob::universal_shader->use();												// Bind universal shader to context
-	glob::universal_shader->setInt("texture", glob::number_of_textures++);		// Tell shader where to find texture
-
-	console.texture_offset = glob::number_of_textures - 1;						// Assign offset from GL_TEXTURE0 texture unit
 	console.texture = console_texture;											// Assing handle to texture
 
 	return console;
@@ -655,80 +888,121 @@ Model get_soda_model(const char* texture_path) {
 }
 
 void draw_model(Model model, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos) {
-	using namespace glob;
+	Shader& shader = use_model_shader(bind_lightmap(model), projection, view, point_light, dir_light, viewPos);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, model.texture);
 
-	universal_shader->use();
-	universal_shader->setInt("aTexture", 0);
-
-	universal_shader->setFloat("ambientStrength", ambient_strength);
-	universal_shader->setVec3("ambientColor", ambient_color);
-
-	universal_shader->setVec3("pointLight.position", point_light.position);
-	universal_shader->setVec3("pointLight.color", point_light.color);
-	universal_shader->setVec3("dirLight.direction", dir_light.direction);
-	universal_shader->setVec3("dirLight.color", dir_light.color);
-	universal_shader->setVec3("attenCoeff", point_light.attenuation_coefficients);
-	universal_shader->setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
-
-	universal_shader->setFloat("specularStrength", model.shine);
-	universal_shader->setVec3("viewPos", viewPos);
+	shader.setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
+	shader.setFloat("specularStrength", model.shine);
 
 	glBindVertexArray(model.VAO);
-	universal_shader->setMat4("projection", projection);
-	universal_shader->setMat4("view", view);
-	universal_shader->setMat4("model", model.model);
+	shader.setMat4("model", model.model);
 
 	glDrawArrays(GL_TRIANGLES, 0, model.number_of_vertices);
 }
 
 void draw_material_model(Model model, Material mat, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos) {
-	using namespace glob;
-
-	material_shader->use();
+	Shader& shader = use_model_shader(permutations::SPECULAR_MAP | bind_lightmap(model), projection, view, point_light, dir_light, viewPos);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, model.texture);
-	material_shader->setInt("aTexture", 0);
-
-	material_shader->setFloat("ambientStrength", ambient_strength);
-	material_shader->setVec3("ambientColor", ambient_color);
 
-	material_shader->setVec3("pointLight.position", point_light.position);
-	material_shader->setVec3("pointLight.color", point_light.color);
-	material_shader->setVec3("dirLight.direction", dir_light.direction);
-	material_shader->setVec3("dirLight.color", dir_light.color);
-	material_shader->setVec3("attenCoeff", point_light.attenuation_coefficients);
-	material_shader->setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
+	shader.setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, mat.specular_map);
-	material_shader->setInt("specularMap", 1);
-	material_shader->setFloat("specularStrength", mat.shine);
-	material_shader->setVec3("viewPos", viewPos);
+	glActiveTexture(GL_TEXTURE0);
+	shader.setFloat("specularStrength", mat.shine);
 
 	glBindVertexArray(model.VAO);
-	material_shader->setMat4("projection", projection);
-	material_shader->setMat4("view", view);
-	material_shader->setMat4("model", model.model);
+	shader.setMat4("model", model.model);
 
 	glDrawArrays(GL_TRIANGLES, 0, model.number_of_vertices);
 }
 
-void draw_normals(Model model, glm::mat4 projection, glm::mat4 view) {
-	using namespace glob;
+/**
+ * Draw a Model with the shader matching its material (if any).
+ */
+void draw_scene_model(const Model& model, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos) {
+	if (model.material != nullptr)
+		draw_material_model(model, *model.material, projection, view, point_light, dir_light, viewPos);
+	else
+		draw_model(model, projection, view, point_light, dir_light, viewPos);
+}
+
+/**
+ * Write a Model's albedo, specular strength and normal into the bound G-buffer (see
+ * deferred.h). Lighting happens later, in DeferredRenderer::shade().
+ */
+void draw_model_gbuffer(const Model& model, glm::mat4 projection, glm::mat4 view) {
+	Shader& shader = glob::gbuffer_shaders->get(model.material != nullptr ? (unsigned int)permutations::SPECULAR_MAP : 0u);
+	shader.use();
 
-	glActiveTexture(GL_TEXTURE0 + model.texture_offset);
+	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, model.texture);
 
-	normals_shader->use();
+	if (model.material != nullptr) {
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, model.material->specular_map);
+		glActiveTexture(GL_TEXTURE0);
+		shader.setFloat("specularStrength", model.material->shine);
+	}
+	else {
+		shader.setFloat("specularStrength", model.shine);
+	}
+
+	shader.setMat3("normalModel", glm::mat3(glm::transpose(glm::inverse(model.model))));
 
 	glBindVertexArray(model.VAO);
-	normals_shader->setMat4("projection", projection);
-	normals_shader->setMat4("view", view);
-	normals_shader->setMat4("model", model.model);
+	shader.setMat4("projection", projection);
+	shader.setMat4("view", view);
+	shader.setMat4("model", model.model);
 
 	glDrawArrays(GL_TRIANGLES, 0, model.number_of_vertices);
-}
\ No newline at end of file
+}
+
+/**
+ * Write only a Model's depth, from its position stream (see prepass.h). The vertex
+ * shader transforms positions exactly as the Model shaders do, so the colour pass
+ * can depth test against the result with GL_LEQUAL.
+ */
+void draw_model_depth(const Model& model, glm::mat4 projection, glm::mat4 view) {
+	glob::prepass_shader->use();
+	glob::prepass_shader->setMat4("projection", projection);
+	glob::prepass_shader->setMat4("view", view);
+	glob::prepass_shader->setMat4("model", model.model);
+
+	glBindVertexArray(model.position_VAO != 0 ? model.position_VAO : model.VAO);
+	glDrawArrays(GL_TRIANGLES, 0, model.number_of_vertices);
+}
+
+/**
+ * Read the interleaved vertex buffer back through the VAO's own attribute layout.
+ */
+void read_back_vertices(const Model& model, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals) {
+	GLint buffer = 0, stride = 0, buffer_size = 0;
+	void* normal_offset = nullptr;
+	glBindVertexArray(model.VAO);
+	glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+	glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+	glGetVertexAttribPointerv(1, GL_VERTEX_ATTRIB_ARRAY_POINTER, &normal_offset);
+	glBindVertexArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &buffer_size);
+	std::vector<unsigned char> data(buffer_size);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, buffer_size, data.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (stride == 0)
+		stride = 3 * sizeof(float);			// Tightly packed positions
+	positions.clear();
+	normals.clear();
+	for (unsigned int i = 0; i < model.number_of_vertices; ++i) {
+		const float* position = (const float*)(data.data() + i * stride);
+		const float* normal = (const float*)(data.data() + i * stride + (size_t)normal_offset);
+		positions.push_back(glm::vec3(position[0], position[1], position[2]));
+		normals.push_back(glm::vec3(normal[0], normal[1], normal[2]));
+	}
+}
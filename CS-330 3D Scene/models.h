@@ -2,29 +2,85 @@
 #ifndef __MODELS_H__
 #define __MODELS_H__
 
+#include <vector>
+
 #include <glm/glm.hpp>
 
 #include "lights.h"
+#include "clustered.h"
+#include "permutations.h"
+
+namespace shadows {
+	class ShadowMaps;
+}
+
+namespace reflections {
+	class ReflectionProbes;
+}
+
+namespace glob {
+	const float ambient_strength = 0.2f;
+	const glm::vec3 ambient_color = glm::vec3(1.f, 1.f, 1.f);
+}
+
+struct material {
+	unsigned int specular_map;
+	float shine = 0.f;
+};
+typedef struct material Material;
 
 struct tex_mesh {
 	unsigned int texture;
-	unsigned int texture_offset;
 	unsigned int VAO;
+	unsigned int position_VAO = 0;				// Tightly packed positions only, for depth-only passes
 	unsigned int number_of_vertices;
 	glm::mat4 model;
 
+	glm::vec3 bounds_min = glm::vec3(0.f);		// Object-space bounding box, minimum corner
+	glm::vec3 bounds_max = glm::vec3(0.f);		// Object-space bounding box, maximum corner
+
 	float shine = 0.f;
+	const Material* material = nullptr;			// Optional specular map; drawn with draw_material_model when set
+	unsigned int lightmap = 0;					// Baked lighting texture (see lightmaps.h), 0 when not baked
 };
 typedef struct tex_mesh Model;
 
-struct material {
-	unsigned int specular_map;
-	float shine = 0.f;
+struct fog {
+	glm::vec3 color = glm::vec3(0.f);
+	float density = 0.f;						// Exponential squared falloff per unit of view distance
 };
-typedef struct material Material;
+typedef struct fog Fog;
 
 void models_init();
 
+void models_bind_light_grid(const clustered::ClusterGrid* grid, int viewport_width, int viewport_height);
+
+void models_set_fog(const Fog* fog);
+
+const Fog* models_fog();
+
+void models_set_blinn_phong(bool enabled);
+
+void models_bind_shadows(const shadows::ShadowMaps* maps);
+
+const shadows::ShadowMaps* models_shadows();
+
+bool models_blinn_phong();
+
+void models_set_baked_lighting(bool enabled);
+
+bool models_baked_lighting();
+
+void models_set_sh_ambient(bool enabled);
+
+bool models_sh_ambient();
+
+void models_bind_reflections(const reflections::ReflectionProbes* probes);
+
+const reflections::ReflectionProbes* models_reflections();
+
+Shader& use_model_shader(unsigned int features, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos);
+
 Model get_desk_model(const char* texture_path);
 
 Model get_switch_model(const char* texture_path);
@@ -39,5 +95,15 @@ void draw_model(Model model, glm::mat4 projection, glm::mat4 view, RadiantLight
 
 void draw_material_model(Model model, Material mat, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos);
 
-void draw_normals(Model model, glm::mat4 projection, glm::mat4 view);
+void draw_scene_model(const Model& model, glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos);
+
+void draw_model_gbuffer(const Model& model, glm::mat4 projection, glm::mat4 view);
+
+void draw_model_depth(const Model& model, glm::mat4 projection, glm::mat4 view);
+
+/**
+ * Read a Model's object-space vertex positions and normals back from OpenGL, three per
+ * triangle.
+ */
+void read_back_vertices(const Model& model, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals);
 #endif//__MODELS_H__
\ No newline at end of file
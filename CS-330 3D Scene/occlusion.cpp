@@ -0,0 +1,263 @@
+/**
+ * "occlusion.cpp" - Implementations for occlusion query culling. Function prototypes
+ *		defined in "occlusion.h".
+ */
+#include <glad/glad.h>
+
+#include "occlusion.h"
+
+namespace occlusion {
+	void OcclusionCuller::init() {
+		proxy_shader = new Shader("shaders/bounding_box.vs.glsl", "shaders/bounding_box.fs.glsl");
+
+		/**
+		 * Unit cube in [0, 1], stretched over each box by the vertex shader.
+		 */
+		const float cube_vertices[] = {
+			0.f, 0.f, 0.f,	1.f, 0.f, 0.f,	1.f, 1.f, 0.f,	1.f, 1.f, 0.f,	0.f, 1.f, 0.f,	0.f, 0.f, 0.f,	// back
+			0.f, 0.f, 1.f,	1.f, 0.f, 1.f,	1.f, 1.f, 1.f,	1.f, 1.f, 1.f,	0.f, 1.f, 1.f,	0.f, 0.f, 1.f,	// front
+			0.f, 1.f, 1.f,	0.f, 1.f, 0.f,	0.f, 0.f, 0.f,	0.f, 0.f, 0.f,	0.f, 0.f, 1.f,	0.f, 1.f, 1.f,	// left
+			1.f, 1.f, 1.f,	1.f, 1.f, 0.f,	1.f, 0.f, 0.f,	1.f, 0.f, 0.f,	1.f, 0.f, 1.f,	1.f, 1.f, 1.f,	// right
+			0.f, 0.f, 0.f,	1.f, 0.f, 0.f,	1.f, 0.f, 1.f,	1.f, 0.f, 1.f,	0.f, 0.f, 1.f,	0.f, 0.f, 0.f,	// bottom
+			0.f, 1.f, 0.f,	1.f, 1.f, 0.f,	1.f, 1.f, 1.f,	1.f, 1.f, 1.f,	0.f, 1.f, 1.f,	0.f, 1.f, 0.f	// top
+		};
+
+		unsigned int VBO;
+		glGenVertexArrays(1, &cube_VAO);
+		glGenBuffers(1, &VBO);
+
+		glBindVertexArray(cube_VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+	}
+
+	void OcclusionCuller::reset() {
+		for (node_state& state : states)
+			if (state.query != 0)
+				glDeleteQueries(1, &state.query);
+
+		states.clear();
+		pending_nodes.clear();
+		proxy_nodes.clear();
+	}
+
+	/**
+	 * Read back every query whose result has arrived. Nothing here waits on the GPU:
+	 * queries that are not ready yet are simply checked again next frame.
+	 */
+	void OcclusionCuller::fetch_results(const bvh::Tree& tree) {
+		const std::vector<bvh::Node>& nodes = tree.nodes();
+
+		size_t still_pending = 0;
+		for (size_t i = 0; i < pending_nodes.size(); ++i) {
+			int index = pending_nodes[i];
+			node_state& state = states[index];
+
+			GLuint available = 0;
+			glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				pending_nodes[still_pending++] = index;
+				continue;
+			}
+
+			GLuint any_samples = 0;
+			glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &any_samples);
+			state.pending = false;
+
+			if (any_samples) {
+				/**
+				 * A hidden node became visible: assume its whole subtree is visible so it is
+				 * drawn (and its leaves re-tested) next frame, rather than descending one
+				 * level of queries per frame.
+				 */
+				if (!state.visible && !nodes[index].is_leaf())
+					set_subtree_visible(tree, index);
+
+				state.visible = true;
+				pull_up_visibility(tree, index);
+			}
+			else {
+				state.visible = false;
+				pull_up_invisibility(tree, nodes[index].parent);
+			}
+		}
+		pending_nodes.resize(still_pending);
+	}
+
+	void OcclusionCuller::set_subtree_visible(const bvh::Tree& tree, int node) {
+		const std::vector<bvh::Node>& nodes = tree.nodes();
+
+		std::vector<int> stack(1, node);
+		while (!stack.empty()) {
+			int index = stack.back();
+			stack.pop_back();
+
+			states[index].visible = true;
+			if (!nodes[index].is_leaf()) {
+				stack.push_back(nodes[index].left);
+				stack.push_back(nodes[index].right);
+			}
+		}
+	}
+
+	void OcclusionCuller::pull_up_visibility(const bvh::Tree& tree, int node) {
+		for (int index = tree.nodes()[node].parent; index != bvh::NULL_NODE; index = tree.nodes()[index].parent)
+			states[index].visible = true;
+	}
+
+	/**
+	 * Once both children of a node are hidden the node itself is hidden, so next frame
+	 * a single query on it replaces queries on its children.
+	 */
+	void OcclusionCuller::pull_up_invisibility(const bvh::Tree& tree, int node) {
+		const std::vector<bvh::Node>& nodes = tree.nodes();
+
+		for (int index = node; index != bvh::NULL_NODE; index = nodes[index].parent) {
+			if (states[nodes[index].left].visible || states[nodes[index].right].visible)
+				break;
+
+			states[index].visible = false;
+		}
+	}
+
+	unsigned int OcclusionCuller::count_leaves_in_frustum(const bvh::Tree& tree, int node, const culling::Frustum& frustum) {
+		const bvh::Node& n = tree.nodes()[node];
+		if (!culling::aabb_visible(frustum, n.bounds.min, n.bounds.max))
+			return 0;
+
+		return n.is_leaf() ? 1 : count_leaves_in_frustum(tree, n.left, frustum) + count_leaves_in_frustum(tree, n.right, frustum);
+	}
+
+	void OcclusionCuller::render(const bvh::Tree& tree, const culling::Frustum& frustum, glm::mat4 view_projection, glm::vec3 camera_position,
+		const std::function<void(unsigned int object)>& draw_object, OcclusionStats& stats) {
+		stats = OcclusionStats();
+		frame++;
+
+		if (tree.root() == bvh::NULL_NODE)
+			return;
+
+		const std::vector<bvh::Node>& nodes = tree.nodes();
+		if (states.size() != nodes.size()) {
+			reset();
+			states.resize(nodes.size());									// New nodes start out visible
+		}
+
+		fetch_results(tree);
+		proxy_nodes.clear();
+
+		/**
+		 * Front-to-back traversal, so nearby occluders are in the depth buffer before the
+		 * objects they hide are tested.
+		 */
+		std::vector<int> stack(1, tree.root());
+		while (!stack.empty()) {
+			int index = stack.back();
+			stack.pop_back();
+
+			const bvh::Node& node = nodes[index];
+			node_state& state = states[index];
+
+			if (!culling::aabb_visible(frustum, node.bounds.min, node.bounds.max))
+				continue;
+
+			/**
+			 * A box around the camera is clipped by the near plane and can't be tested
+			 * reliably, so it is always treated as visible.
+			 */
+			const glm::vec3 near_margin = glm::vec3(0.1f);
+			bool camera_inside = glm::all(glm::greaterThanEqual(camera_position, node.bounds.min - near_margin))
+				&& glm::all(glm::lessThanEqual(camera_position, node.bounds.max + near_margin));
+
+			if (!state.visible && !camera_inside) {
+				unsigned int hidden = count_leaves_in_frustum(tree, index, frustum);	// Only for the statistics
+				stats.in_frustum += hidden;
+				stats.skipped += hidden;
+
+				if (!state.pending)
+					proxy_nodes.push_back(index);								// Hidden: test the box, skip the subtree
+				continue;
+			}
+
+			if (node.is_leaf()) {
+				stats.in_frustum++;
+				stats.drawn++;
+
+				/**
+				 * Visible leaves are re-tested with their own draw, staggered so only a
+				 * fraction of them issue queries on any one frame.
+				 */
+				bool test = !state.pending && !camera_inside && (frame + index) % visible_test_interval == 0;
+				if (test) {
+					if (state.query == 0)
+						glGenQueries(1, &state.query);
+					glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+				}
+
+				draw_object((unsigned int)node.object);
+
+				if (test) {
+					glEndQuery(GL_ANY_SAMPLES_PASSED);
+					state.pending = true;
+					pending_nodes.push_back(index);
+					stats.queries_issued++;
+				}
+				continue;
+			}
+
+			/**
+			 * Push the farther child first so the nearer one is visited first.
+			 */
+			glm::vec3 left_center = (nodes[node.left].bounds.min + nodes[node.left].bounds.max) * 0.5f;
+			glm::vec3 right_center = (nodes[node.right].bounds.min + nodes[node.right].bounds.max) * 0.5f;
+			glm::vec3 to_left = left_center - camera_position;
+			glm::vec3 to_right = right_center - camera_position;
+			bool left_nearer = glm::dot(to_left, to_left) < glm::dot(to_right, to_right);
+
+			stack.push_back(left_nearer ? node.right : node.left);
+			stack.push_back(left_nearer ? node.left : node.right);
+		}
+
+		if (proxy_nodes.empty())
+			return;
+
+		/**
+		 * Query the hidden nodes' boxes against this frame's depth buffer without
+		 * touching color or depth.
+		 */
+		GLint polygon_mode[2];
+		glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+
+		proxy_shader->use();
+		proxy_shader->setMat4("viewProjection", view_projection);
+		glBindVertexArray(cube_VAO);
+
+		for (int index : proxy_nodes) {
+			node_state& state = states[index];
+			if (state.query == 0)
+				glGenQueries(1, &state.query);
+
+			const glm::vec3 epsilon = glm::vec3(1e-3f);					// Keep flat boxes (the desk) from z-fighting their own geometry
+			proxy_shader->setVec3("boxMin", nodes[index].bounds.min - epsilon);
+			proxy_shader->setVec3("boxMax", nodes[index].bounds.max + epsilon);
+
+			glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+			glDrawArrays(GL_TRIANGLES, 0, 36);
+			glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+			state.pending = true;
+			pending_nodes.push_back(index);
+			stats.queries_issued++;
+		}
+
+		glBindVertexArray(0);
+		glDepthMask(GL_TRUE);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+	}
+}
@@ -0,0 +1,73 @@
+/**
+ * "occlusion.h" - Hardware occlusion query culling over the scene BVH, in the spirit of
+ *		CHC++ (Mattausch et al. 2008). Nodes that were hidden are tested with
+ *		GL_ANY_SAMPLES_PASSED queries against their bounding boxes, hierarchy nodes
+ *		before leaves; visible leaves are re-tested with their own draw every few
+ *		frames. Results are only read once available, so the CPU never waits on the
+ *		GPU; a node's result is used from the frame it arrives in. Only OpenGL 3.3
+ *		core features are used, so it runs under Mesa llvmpipe. Function
+ *		implementations defined in "occlusion.cpp".
+ */
+#pragma once
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "culling.h"
+#include "shader.h"
+
+namespace occlusion {
+	/**
+	 * Counters for the most recent frame.
+	 */
+	struct OcclusionStats {
+		unsigned int in_frustum = 0;		// Objects that passed frustum culling
+		unsigned int drawn = 0;				// Objects actually drawn
+		unsigned int skipped = 0;			// Objects in the frustum skipped as occluded
+		unsigned int queries_issued = 0;	// Queries started this frame
+
+		float skipped_fraction() const { return in_frustum == 0 ? 0.f : (float)skipped / (float)in_frustum; }
+	};
+
+	class OcclusionCuller {
+	public:
+		unsigned int visible_test_interval = 4;		// Re-test visible leaves every this many frames
+
+		void init();								// Create the proxy shader and cube; requires a GL context
+		void reset();								// Forget all visibility (e.g. after the BVH was rebuilt)
+
+		/**
+		 * Traverse tree front to back from camera_position, calling draw_object for every
+		 * object that is in the frustum and not known to be occluded, then issue proxy
+		 * queries for hidden nodes against the depth buffer that was just rendered.
+		 */
+		void render(const bvh::Tree& tree, const culling::Frustum& frustum, glm::mat4 view_projection, glm::vec3 camera_position,
+			const std::function<void(unsigned int object)>& draw_object, OcclusionStats& stats);
+
+	private:
+		struct node_state {
+			unsigned int query = 0;					// GL query object, created on first use
+			bool pending = false;					// Query issued but result not read yet
+			bool visible = true;					// Last known visibility
+		};
+
+		Shader* proxy_shader = nullptr;
+		unsigned int cube_VAO = 0;
+		unsigned int frame = 0;
+		std::vector<node_state> states;			// Indexed like bvh::Tree::nodes()
+		std::vector<int> pending_nodes;
+		std::vector<int> proxy_nodes;			// Hidden nodes to query after drawing this frame
+
+		void fetch_results(const bvh::Tree& tree);
+		void set_subtree_visible(const bvh::Tree& tree, int node);
+		void pull_up_visibility(const bvh::Tree& tree, int node);
+		void pull_up_invisibility(const bvh::Tree& tree, int node);
+		unsigned int count_leaves_in_frustum(const bvh::Tree& tree, int node, const culling::Frustum& frustum);
+	};
+}
+#endif//__OCCLUSION_H__
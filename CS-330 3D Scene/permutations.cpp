@@ -0,0 +1,59 @@
+/**
+ * "permutations.cpp" - Implementations for shader permutations. Function prototypes
+ *		defined in "permutations.h".
+ */
+#include <glad/glad.h>
+
+#include "permutations.h"
+
+namespace permutations {
+	static const char* const feature_names[FEATURE_COUNT] = {
+		"SPECULAR_MAP",
+		"CLUSTERED_LIGHTS",
+		"FOG",
+		"INSTANCED",
+		"BLINN_PHONG",
+		"SHADOWS",
+		"BAKED_LIGHTING",
+		"AMBIENT_OCCLUSION",
+		"SH_AMBIENT",
+		"REFLECTIONS",
+		"VISIBILITY_BUFFER",
+	};
+
+	std::string defines(unsigned int features) {
+		std::string result;
+		for (int bit = 0; bit < FEATURE_COUNT; ++bit) {
+			if (features & (1u << bit))
+				result += std::string("#define ") + feature_names[bit] + "\n";
+		}
+		return result;
+	}
+
+	ShaderCache::ShaderCache(const char* vertex_path, const char* fragment_path, setup_function setup, const char* include_path)
+		: vertex_path(vertex_path), fragment_path(fragment_path), include_path(include_path != nullptr ? include_path : ""), setup(setup) {}
+
+	Shader& ShaderCache::get(unsigned int features) {
+		auto found = variants.find(features);
+		if (found != variants.end())
+			return *found->second;
+
+		Shader* shader = new Shader(vertex_path.c_str(), fragment_path.c_str(), nullptr, defines(features),
+			include_path.empty() ? nullptr : include_path.c_str());
+		if (setup != nullptr) {
+			shader->use();
+			setup(*shader, features);
+		}
+
+		variants[features] = shader;
+		return *shader;
+	}
+
+	void ShaderCache::clear() {
+		for (auto& variant : variants) {
+			glDeleteProgram(variant.second->ID);
+			delete variant.second;
+		}
+		variants.clear();
+	}
+}
@@ -0,0 +1,69 @@
+/**
+ * "permutations.h" - Shader permutations. An uber-shader source is written once with
+ *		"#ifdef" blocks for each optional feature, and every combination that is
+ *		actually drawn with is compiled on first use and cached under its feature
+ *		bitmask, so each variant contains only the work it needs. Function
+ *		implementations defined in "permutations.cpp".
+ */
+#pragma once
+#ifndef __PERMUTATIONS_H__
+#define __PERMUTATIONS_H__
+
+#include <string>
+#include <unordered_map>
+
+#include "shader.h"
+
+namespace permutations {
+	/**
+	 * Feature bits. Each bit turns on the "#define" of the same name in the uber-shader
+	 * sources.
+	 */
+	enum Feature : unsigned int {
+		SPECULAR_MAP = 1u << 0,					// Scale specular light by a specular map texture
+		CLUSTERED_LIGHTS = 1u << 1,				// Add the cluster grid's point lights (see clustered.h)
+		FOG = 1u << 2,							// Blend toward a fog color with view distance
+		INSTANCED = 1u << 3,					// Per-instance model matrix attribute instead of a uniform
+		BLINN_PHONG = 1u << 4,					// Blinn-Phong (halfway vector) specular instead of Phong
+		SHADOWS = 1u << 5,						// Shadow the point and directional lights (see shadows.h)
+		BAKED_LIGHTING = 1u << 6,				// Directional light diffuse and ambient occlusion from a lightmap (see lightmaps.h)
+		AMBIENT_OCCLUSION = 1u << 7,			// Darken ambient light with screen-space ambient occlusion (see ssao.h)
+		SH_AMBIENT = 1u << 8,					// Ambient light from spherical harmonics instead of a constant (see environment.h)
+		REFLECTIONS = 1u << 9,					// Reflect the nearest reflection probe (see reflections.h)
+		VISIBILITY_BUFFER = 1u << 10,			// Read surfaces from the visibility buffer instead of the G-buffer (see visibility.h)
+	};
+	const int FEATURE_COUNT = 11;
+
+	/**
+	 * The "#define" lines for a feature bitmask, in bit order.
+	 */
+	std::string defines(unsigned int features);
+
+	class ShaderCache {
+	public:
+		/**
+		 * setup is called once on each newly compiled variant, e.g. to point its
+		 * samplers at texture units.
+		 */
+		typedef void (*setup_function)(Shader& shader, unsigned int features);
+
+		/**
+		 * include_path, if given, names a source every variant's fragment stage starts
+		 * with after its "#define" lines, e.g. the lighting kernel shared by the forward
+		 * and deferred shaders.
+		 */
+		ShaderCache(const char* vertex_path, const char* fragment_path, setup_function setup = nullptr, const char* include_path = nullptr);
+
+		Shader& get(unsigned int features);		// Compile the variant on first use; requires a GL context
+		size_t size() const { return variants.size(); }
+		void clear();							// Delete every compiled variant
+
+	private:
+		std::string vertex_path;
+		std::string fragment_path;
+		std::string include_path;				// Empty for none
+		setup_function setup;
+		std::unordered_map<unsigned int, Shader*> variants;
+	};
+}
+#endif//__PERMUTATIONS_H__
@@ -0,0 +1,135 @@
+/**
+ * "prepass.cpp" - Implementations for the depth pre-pass. Function prototypes defined
+ *		in "prepass.h".
+ */
+#include <glad/glad.h>
+
+#include "prepass.h"
+
+namespace prepass {
+	/**
+	 * Every threshold has hysteresis so a scene hovering around one does not flip the
+	 * pre-pass on and off every probe.
+	 */
+	bool should_prepass(bool active, float overdraw, float hidden_fraction, float cost_ratio, const PrepassSettings& settings) {
+		if (active) {
+			if (cost_ratio > 0.f && cost_ratio >= settings.disable_cost_ratio)
+				return false;
+			return overdraw >= settings.disable_overdraw && hidden_fraction >= settings.min_hidden_fraction * 0.5f;
+		}
+
+		if (cost_ratio > 0.f && cost_ratio > settings.enable_cost_ratio)
+			return false;
+		return overdraw >= settings.enable_overdraw && hidden_fraction >= settings.min_hidden_fraction;
+	}
+
+	void DepthPrepass::init() {
+		for (frame_queries& frame : frames) {
+			glGenQueries(1, &frame.depth);
+			glGenQueries(1, &frame.color);
+			glGenQueries(1, &frame.time);
+		}
+		frames_since_probe = settings.probe_interval;	// Measure on the first frame
+	}
+
+	/**
+	 * Read back every frame whose queries have finished, oldest first. Nothing here
+	 * waits on the GPU.
+	 */
+	void DepthPrepass::fetch_results() {
+		for (int i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+			frame_queries& frame = frames[(current + i) % FRAMES_IN_FLIGHT];	// current is the oldest
+			if (!frame.pending)
+				continue;
+
+			GLuint available = 0;
+			glGetQueryObjectuiv(frame.time, GL_QUERY_RESULT_AVAILABLE, &available);	// Ended last
+			if (!available)
+				break;									// Later frames cannot have finished either
+
+			GLuint color_samples = 0, depth_samples = 0;
+			GLuint64 time_ns = 0;
+			glGetQueryObjectuiv(frame.color, GL_QUERY_RESULT, &color_samples);
+			glGetQueryObjectui64v(frame.time, GL_QUERY_RESULT, &time_ns);
+			frame.pending = false;
+
+			last_stats.active = frame.active;
+			last_stats.lit_samples = color_samples;
+			if (frame.active) {
+				glGetQueryObjectuiv(frame.depth, GL_QUERY_RESULT, &depth_samples);
+				last_stats.unculled_samples = depth_samples;	// The pre-pass sees the same fragments a plain colour pass would
+				last_stats.visible_samples = color_samples;
+				last_stats.prepass_ms = time_ns * 1e-6;
+			}
+			else {
+				last_stats.unculled_samples = color_samples;
+				last_stats.plain_ms = time_ns * 1e-6;
+			}
+
+			if (last_stats.visible_samples > 0)
+				last_stats.overdraw = (float)last_stats.unculled_samples / (float)last_stats.visible_samples;
+
+			float cost_ratio = 0.f;
+			if (last_stats.prepass_ms > 0.0 && last_stats.plain_ms > 0.0)
+				cost_ratio = (float)(last_stats.prepass_ms / last_stats.plain_ms);
+
+			if (viewport_pixels > 0) {
+				float hidden = (float)last_stats.unculled_samples - (float)last_stats.visible_samples;
+				auto_active = should_prepass(auto_active, last_stats.overdraw, hidden / (float)viewport_pixels, cost_ratio, settings);
+			}
+		}
+	}
+
+	bool DepthPrepass::begin_frame(int width, int height) {
+		fetch_results();
+		viewport_pixels = (unsigned int)(width * height);
+
+		switch (mode) {
+		case Mode::ON:
+			frame_active = true;
+			break;
+		case Mode::OFF:
+			frame_active = false;
+			break;
+		case Mode::AUTO:
+			frame_active = auto_active;
+			if (++frames_since_probe >= settings.probe_interval) {
+				frame_active = !auto_active;			// Probe: each kind of frame can only be measured by drawing one
+				frames_since_probe = 0;
+			}
+			break;
+		}
+
+		frames[current].active = frame_active;
+		frames[current].pending = false;				// Still unread after FRAMES_IN_FLIGHT frames: drop it rather than wait
+		glBeginQuery(GL_TIME_ELAPSED, frames[current].time);
+		return frame_active;
+	}
+
+	void DepthPrepass::begin_depth() {
+		glBeginQuery(GL_SAMPLES_PASSED, frames[current].depth);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	}
+
+	void DepthPrepass::begin_color() {
+		if (frame_active) {
+			glEndQuery(GL_SAMPLES_PASSED);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthMask(GL_FALSE);						// Depth is final; only the nearest fragment of each pixel passes
+			glDepthFunc(GL_LEQUAL);
+		}
+		glBeginQuery(GL_SAMPLES_PASSED, frames[current].color);
+	}
+
+	void DepthPrepass::end_frame() {
+		glEndQuery(GL_SAMPLES_PASSED);
+		glEndQuery(GL_TIME_ELAPSED);
+		if (frame_active) {
+			glDepthMask(GL_TRUE);
+			glDepthFunc(GL_LESS);
+		}
+
+		frames[current].pending = true;
+		current = (current + 1) % FRAMES_IN_FLIGHT;
+	}
+}
@@ -0,0 +1,101 @@
+/**
+ * "prepass.h" - Optional depth pre-pass for forward shading. Opaque Models are first
+ *		drawn depth-only from their position streams, then drawn again with full
+ *		lighting against that depth with GL_LEQUAL and depth writes off, so every
+ *		pixel is lit once no matter how much the Models overlap. GL_SAMPLES_PASSED
+ *		queries count the fragments each pass lets through and GL_TIME_ELAPSED queries
+ *		time both kinds of frame; the results are read back without waiting on the GPU
+ *		and drive an automatic mode that only pays for the extra geometry pass when
+ *		overdraw is high and the pre-pass actually makes frames faster, i.e. the scene
+ *		is fragment bound. Function implementations defined in "prepass.cpp".
+ */
+#pragma once
+#ifndef __PREPASS_H__
+#define __PREPASS_H__
+
+namespace prepass {
+	enum class Mode {
+		AUTO,									// Pre-pass while overdraw is high and it makes frames faster
+		ON,
+		OFF,
+	};
+
+	/**
+	 * Thresholds for Mode::AUTO. Overdraw is fragments lit without a pre-pass per
+	 * visible fragment; hidden fractions are hidden fragments per viewport pixel; cost
+	 * ratios are the GPU time of a pre-pass frame over that of a plain one.
+	 */
+	struct PrepassSettings {
+		float enable_overdraw = 1.3f;			// Turn on at or above this overdraw...
+		float disable_overdraw = 1.15f;			// ...and back off below this one
+		float min_hidden_fraction = 0.1f;		// Turn on only if at least this share of the screen is lit needlessly
+		float enable_cost_ratio = 0.95f;		// Turn on only if pre-pass frames are at least 5% faster...
+		float disable_cost_ratio = 1.05f;		// ...and back off once they are 5% slower
+		unsigned int probe_interval = 30;		// Run one frame the other way this often to keep both measurements fresh
+	};
+
+	/**
+	 * Counters from the most recent frame whose queries have been read back.
+	 */
+	struct PrepassStats {
+		bool active = false;					// The frame used the pre-pass
+		unsigned int lit_samples = 0;			// Fragments that ran the lighting shader
+		unsigned int unculled_samples = 0;		// Fragments that would have been lit without a pre-pass
+		unsigned int visible_samples = 0;		// Most recent measurement of fragments left after the pre-pass; 0 before any
+		float overdraw = 1.f;					// unculled_samples / visible_samples
+		double prepass_ms = 0.0;				// GPU time of the most recent frame with the pre-pass; 0 before any
+		double plain_ms = 0.0;					// GPU time of the most recent frame without it; 0 before any
+	};
+
+	/**
+	 * The Mode::AUTO decision: whether the pre-pass should be on next frame, given
+	 * whether it is on now, the measured overdraw, the hidden fragments per viewport
+	 * pixel and the cost ratio (0 while either kind of frame has not been timed yet).
+	 */
+	bool should_prepass(bool active, float overdraw, float hidden_fraction, float cost_ratio, const PrepassSettings& settings);
+
+	class DepthPrepass {
+	public:
+		Mode mode = Mode::AUTO;
+		PrepassSettings settings;
+
+		void init();							// Create the queries; requires a GL context
+
+		/**
+		 * Start a forward frame drawn into a width x height viewport. Returns whether the
+		 * frame uses the pre-pass; if so call begin_depth() and draw every opaque Model
+		 * with draw_model_depth() before begin_color(). The frame is timed from here to
+		 * end_frame().
+		 */
+		bool begin_frame(int width, int height);
+		void begin_depth();
+		void begin_color();						// Draw opaque Models with lighting after this...
+		void end_frame();						// ...then restore depth writes and GL_LESS
+
+		bool active() const { return frame_active; }
+		bool auto_on() const { return auto_active; }
+		const PrepassStats& stats() const { return last_stats; }
+
+	private:
+		static const int FRAMES_IN_FLIGHT = 3;
+
+		struct frame_queries {
+			unsigned int depth = 0;				// Samples passed by the pre-pass
+			unsigned int color = 0;				// Samples passed by the colour pass
+			unsigned int time = 0;				// Both passes, GPU time
+			bool active = false;
+			bool pending = false;
+		};
+
+		frame_queries frames[FRAMES_IN_FLIGHT];
+		int current = 0;
+		bool frame_active = false;
+		bool auto_active = false;
+		unsigned int frames_since_probe = 0;
+		unsigned int viewport_pixels = 0;
+		PrepassStats last_stats;
+
+		void fetch_results();
+	};
+}
+#endif//__PREPASS_H__
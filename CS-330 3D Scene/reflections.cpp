@@ -0,0 +1,250 @@
+/**
+ * "reflections.cpp" - Implementations for reflection probes. Function prototypes
+ *		defined in "reflections.h".
+ */
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "reflections.h"
+
+namespace reflections {
+	/**
+	 * Cube map face order matches GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, as in
+	 * shadows.cpp.
+	 */
+	static const glm::vec3 face_directions[6] = {
+		glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.f, 0.f),
+		glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, -1.f, 0.f),
+		glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f),
+	};
+	static const glm::vec3 face_ups[6] = {
+		glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f),
+		glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f),
+		glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f),
+	};
+
+	glm::mat4 face_view(int face, glm::vec3 eye) {
+		return glm::lookAt(eye, eye + face_directions[face], face_ups[face]);
+	}
+
+	static unsigned int create_cube(int size, int levels) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+		for (int level = 0; level < levels; ++level) {
+			int level_size = std::max(size >> level, 1);
+			for (int face = 0; face < 6; ++face)
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA16F, level_size, level_size, 0, GL_RGBA, GL_FLOAT, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		return texture;
+	}
+
+	void ReflectionProbes::init(const ReflectionSettings& reflection_settings) {
+		settings = reflection_settings;
+
+		filter_shader = new Shader("shaders/fullscreen.vs.glsl", "shaders/probe_filter.fs.glsl");
+		filter_shader->use();
+		filter_shader->setInt("environment", 0);
+
+		glGenRenderbuffers(1, &depth_renderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, settings.size, settings.size);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &capture_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, capture_framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+		glGenFramebuffers(1, &filter_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		glGenVertexArrays(1, &empty_VAO);
+		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);	// Filter across face edges, or every mip shows the cube's seams
+	}
+
+	int ReflectionProbes::add_probe(glm::vec3 position, const bvh::AABB& box) {
+		if ((int)probes.size() >= MAX_PROBES)
+			return -1;
+
+		probe added;
+		added.position = position;
+		added.box = box;
+		int capture_levels = 1;
+		while ((settings.size >> capture_levels) > 0)
+			++capture_levels;
+		added.capture = create_cube(settings.size, capture_levels);
+		added.filtered = create_cube(settings.size, MIP_COUNT);
+		added.filtering = create_cube(settings.size, MIP_COUNT);
+
+		/**
+		 * Until its first refresh is filtered the probe reflects black rather than
+		 * whatever the driver left in the texture.
+		 */
+		GLint framebuffer = 0;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+		GLfloat clear_color[4];
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+		glBindFramebuffer(GL_FRAMEBUFFER, filter_framebuffer);
+		glClearColor(0.f, 0.f, 0.f, 1.f);
+		for (int mip = 0; mip < MIP_COUNT; ++mip) {
+			for (int face = 0; face < 6; ++face) {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, added.filtered, mip);
+				glClear(GL_COLOR_BUFFER_BIT);
+			}
+		}
+		glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+		probes.push_back(added);
+		return (int)probes.size() - 1;
+	}
+
+	void ReflectionProbes::invalidate(const bvh::AABB& bounds) {
+		for (probe& p : probes) {
+			if (p.box.overlaps(bounds))
+				p.dirty = true;
+		}
+	}
+
+	void ReflectionProbes::invalidate_all() {
+		for (probe& p : probes)
+			p.dirty = true;
+	}
+
+	void ReflectionProbes::render_face(probe& target, int face, const draw_function& draw) {
+		glBindFramebuffer(GL_FRAMEBUFFER, capture_framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, target.capture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cerr << "ERROR::FRAMEBUFFER::PROBE::INCOMPLETE" << std::endl;
+
+		glViewport(0, 0, settings.size, settings.size);
+		glEnable(GL_DEPTH_TEST);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		glm::mat4 projection = glm::perspective(glm::radians(90.f), 1.f, 0.02f, 20.f);
+		draw(projection, face_view(face, target.position), target.position);
+		++last_stats.faces_rendered;
+	}
+
+	/**
+	 * Convolve the captured faces with the GGX lobe of mip's roughness into that mip of
+	 * the map being filtered. The capture's own mipmaps are rebuilt first, so wide lobes
+	 * can read a few coarse texels instead of many fine ones.
+	 */
+	void ReflectionProbes::filter_mip(probe& target, int mip) {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, target.capture);
+		if (mip == 0)
+			glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+		int mip_size = std::max(settings.size >> mip, 1);
+		glBindFramebuffer(GL_FRAMEBUFFER, filter_framebuffer);
+		glViewport(0, 0, mip_size, mip_size);
+		glDisable(GL_DEPTH_TEST);
+
+		filter_shader->use();
+		filter_shader->setFloat("roughness", (float)mip / (MIP_COUNT - 1));
+		filter_shader->setInt("sampleCount", std::max(settings.filter_samples, 1));
+		filter_shader->setFloat("sourceTexelSolidAngle", 4.f * 3.14159265f / (6.f * settings.size * settings.size));
+
+		glBindVertexArray(empty_VAO);
+		for (int face = 0; face < 6; ++face) {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, target.filtering, mip);
+			filter_shader->setInt("face", face);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+		glBindVertexArray(0);
+
+		glEnable(GL_DEPTH_TEST);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		++last_stats.mips_filtered;
+	}
+
+	void ReflectionProbes::update(const draw_function& draw) {
+		last_stats = ReflectionStats();
+
+		int budget = settings.steps_per_frame;
+		bool state_saved = false;
+		GLint viewport[4];
+		GLint framebuffer = 0;
+		GLint polygon_mode[2];
+
+		/**
+		 * Spend the budget on one probe at a time, starting with next_probe, so the
+		 * probe being refreshed finishes before the next one starts.
+		 */
+		for (size_t checked = 0; budget > 0 && checked < probes.size(); ) {
+			probe& target = probes[next_probe];
+			if (target.step == STEPS && target.dirty) {
+				target.step = 0;				// Changes after this point need another refresh
+				target.dirty = false;
+			}
+			if (target.step == STEPS) {
+				next_probe = (next_probe + 1) % (int)probes.size();
+				++checked;
+				continue;
+			}
+
+			if (!state_saved) {
+				glGetIntegerv(GL_VIEWPORT, viewport);
+				glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+				glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+				state_saved = true;
+			}
+
+			if (target.step < 6)
+				render_face(target, target.step, draw);
+			else
+				filter_mip(target, target.step - 6);
+			++target.step;
+			--budget;
+			checked = 0;
+			if (target.step == STEPS) {
+				std::swap(target.filtered, target.filtering);		// Shaders only ever see a map filtered from one capture
+				next_probe = (next_probe + 1) % (int)probes.size();	// Let the others go first, even if this one is dirty again
+			}
+		}
+
+		for (const probe& p : probes)
+			last_stats.steps_pending += (STEPS - p.step) + (p.dirty ? STEPS : 0);
+
+		if (state_saved) {
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+			glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+		}
+	}
+
+	void set_texture_units(Shader& shader) {
+		shader.use();
+		for (int i = 0; i < MAX_PROBES; ++i)
+			shader.setInt("reflectionProbes[" + std::to_string(i) + "]", FIRST_TEXTURE_UNIT + i);
+	}
+
+	void ReflectionProbes::bind(const Shader& shader) const {
+		for (size_t i = 0; i < probes.size(); ++i) {
+			glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + (int)i);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, probes[i].filtered);
+
+			std::string index = "[" + std::to_string(i) + "]";
+			shader.setVec3("probePositions" + index, probes[i].position);
+			shader.setVec3("probeBoxMin" + index, probes[i].box.min);
+			shader.setVec3("probeBoxMax" + index, probes[i].box.max);
+		}
+		glActiveTexture(GL_TEXTURE0);
+
+		shader.setInt("probeCount", (int)probes.size());
+		shader.setFloat("probeMaxLod", (float)(MIP_COUNT - 1));
+	}
+}
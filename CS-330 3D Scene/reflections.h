@@ -0,0 +1,125 @@
+/**
+ * "reflections.h" - Local reflection probes. Each probe renders the lit scene around a
+ *		point into a cube map and prefilters it with the GGX lobe into a mip chain, one
+ *		roughness per mip, so a surface's reflection is a single textureLod() at the
+ *		level its roughness picks. Shaders built with REFLECTIONS (see permutations.h)
+ *		sample the probe nearest each fragment, parallax-corrected against the probe's
+ *		box.
+ *
+ *		Refreshing a probe takes six face renders and MIP_COUNT filter passes. These are
+ *		spread over frames, at most steps_per_frame of them across all probes each
+ *		frame, so a refreshing probe costs about one sixth of a scene render per frame
+ *		and an up-to-date one costs nothing, instead of six scene renders per probe
+ *		every frame. A probe is refreshed when something inside its box moves or the
+ *		lighting changes; the refresh is filtered into a second map, and shaders keep
+ *		sampling the previous one until every mip of the new one is done. Function
+ *		implementations defined in "reflections.cpp".
+ */
+#pragma once
+#ifndef __REFLECTIONS_H__
+#define __REFLECTIONS_H__
+
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "shader.h"
+
+namespace reflections {
+	const int FIRST_TEXTURE_UNIT = 10;			// After SSAO (unit 9); one unit per probe
+	const int MAX_PROBES = 2;					// Size of the shaders' probe arrays
+	const int MIP_COUNT = 5;					// Roughness 0, 0.25, ..., 1, one per mip
+	const int STEPS = 6 + MIP_COUNT;			// Face renders, then filter passes, in one refresh
+
+	/**
+	 * Probe configuration. Everything but steps_per_frame is fixed at init().
+	 */
+	struct ReflectionSettings {
+		int size = 128;							// Captured face size, in texels
+		int steps_per_frame = 1;				// Face renders or filter passes per frame, over all probes; STEPS refreshes a probe every frame
+		int filter_samples = 32;				// GGX samples per texel when prefiltering
+	};
+
+	/**
+	 * Work done by the most recent update().
+	 */
+	struct ReflectionStats {
+		unsigned int faces_rendered = 0;
+		unsigned int mips_filtered = 0;
+		int steps_pending = 0;					// Steps left before every probe is up to date
+	};
+
+	/**
+	 * View matrix looking from eye through cube map face (GL_TEXTURE_CUBE_MAP_POSITIVE_X
+	 * + face). With a 90 degree square projection, rendering with it writes the face
+	 * as a cube map samples it.
+	 */
+	glm::mat4 face_view(int face, glm::vec3 eye);
+
+	class ReflectionProbes {
+	public:
+		ReflectionSettings settings;
+
+		void init(const ReflectionSettings& reflection_settings = ReflectionSettings());	// Create the shader and framebuffers; requires a GL context
+
+		/**
+		 * Add a probe at position that reflects surroundings lying on box. It starts out
+		 * black and dirty. At most MAX_PROBES; returns its index, or -1 when full.
+		 */
+		int add_probe(glm::vec3 position, const bvh::AABB& box);
+
+		void invalidate(const bvh::AABB& bounds);	// Something within bounds moved: refresh the probes whose box it overlaps
+		void invalidate_all();					// Call when the lighting changes
+
+		/**
+		 * Draws the lit scene with projection and view from eye into the bound,
+		 * cleared cube face.
+		 */
+		typedef std::function<void(const glm::mat4& projection, const glm::mat4& view, glm::vec3 eye)> draw_function;
+
+		/**
+		 * Do up to settings.steps_per_frame steps of the pending refreshes, calling draw
+		 * for every face rendered. draw must not sample the probes themselves. Restores
+		 * the bound framebuffer and viewport afterwards.
+		 */
+		void update(const draw_function& draw);
+
+		/**
+		 * Bind the prefiltered maps to texture units FIRST_TEXTURE_UNIT onwards and set
+		 * the probe uniforms of shader, a variant compiled with REFLECTIONS.
+		 */
+		void bind(const Shader& shader) const;
+
+		const ReflectionStats& stats() const { return last_stats; }
+		size_t size() const { return probes.size(); }
+
+	private:
+		struct probe {
+			glm::vec3 position = glm::vec3(0.f);
+			bvh::AABB box;
+			unsigned int capture = 0;			// RGBA16F cube map the faces are rendered into, with mipmaps for filtering
+			unsigned int filtered = 0;			// RGBA16F cube map the shaders sample, one roughness per mip
+			unsigned int filtering = 0;			// Same, filled by the refresh in progress and swapped with filtered when it completes
+			int step = STEPS;					// Next step of the refresh in progress; STEPS when none is
+			bool dirty = true;					// Needs a refresh after the one in progress
+		};
+
+		std::vector<probe> probes;
+		int next_probe = 0;						// Refreshed first when several are pending
+
+		unsigned int capture_framebuffer = 0;	// Colour face and depth
+		unsigned int filter_framebuffer = 0;	// Colour face only
+		unsigned int depth_renderbuffer = 0;
+		unsigned int empty_VAO = 0;
+		Shader* filter_shader = nullptr;
+		ReflectionStats last_stats;
+
+		void render_face(probe& target, int face, const draw_function& draw);
+		void filter_mip(probe& target, int mip);
+	};
+
+	void set_texture_units(Shader& shader);		// Point a REFLECTIONS variant's probe samplers at their units
+}
+#endif//__REFLECTIONS_H__
@@ -0,0 +1,215 @@
+/**
+ * "resolution.cpp" - Implementations for dynamic resolution scaling. Function
+ *		prototypes defined in "resolution.h".
+ */
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "resolution.h"
+
+namespace resolution {
+	/**
+	 * Aim for the middle of the band the scale holds still in, so one adjustment
+	 * usually lands inside it.
+	 */
+	float next_scale(float scale, float frame_ms, const ResolutionSettings& settings) {
+		if (frame_ms <= 0.f)
+			return scale;						// Nothing measured yet
+		if (frame_ms <= settings.target_ms && frame_ms >= settings.target_ms * settings.headroom)
+			return scale;
+
+		float aim_ms = settings.target_ms * (1.f + settings.headroom) * 0.5f;
+		float ideal = scale * std::sqrt(aim_ms / frame_ms);
+		ideal = std::min(std::max(ideal, scale - settings.max_step), scale + settings.max_step);
+		return std::min(std::max(ideal, settings.min_scale), settings.max_scale);
+	}
+
+	void DynamicResolution::init() {
+		upscale_shader = new Shader("shaders/fullscreen.vs.glsl", "shaders/upscale.fs.glsl");
+		upscale_shader->use();
+		upscale_shader->setInt("scene", 0);
+
+		for (frame_queries& frame : frames) {
+			glGenQueries(1, &frame.start);
+			glGenQueries(1, &frame.end);
+		}
+		glGenVertexArrays(1, &empty_VAO);
+	}
+
+	/**
+	 * The target is allocated at the window's size and rendered into from its
+	 * bottom-left corner, so scale changes never reallocate it.
+	 */
+	static unsigned int create_color_target(int width, int height) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);		// Bilinear upscale and FXAA taps
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+
+	void DynamicResolution::resize(int width, int height) {
+		if (target_framebuffer != 0) {
+			glDeleteFramebuffers(1, &target_framebuffer);
+			unsigned int textures[2] = { color, depth };
+			glDeleteTextures(2, textures);
+		}
+		if (aa_framebuffer != 0) {
+			glDeleteFramebuffers(1, &aa_framebuffer);
+			glDeleteTextures(1, &aa_color);
+			aa_framebuffer = 0;
+		}
+		target_width = width;
+		target_height = height;
+
+		color = create_color_target(width, height);
+
+		glGenTextures(1, &depth);
+		glBindTexture(GL_TEXTURE_2D, depth);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);	// Matches the G-buffer so deferred depth can be blitted
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &target_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, target_framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cerr << "ERROR::FRAMEBUFFER::RESOLUTION::INCOMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	/**
+	 * Read back every frame whose queries have finished, oldest first. Nothing here
+	 * waits on the GPU.
+	 */
+	void DynamicResolution::fetch_results() {
+		for (int i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+			frame_queries& frame = frames[(current + i) % FRAMES_IN_FLIGHT];	// current is the oldest
+			if (!frame.pending)
+				continue;
+
+			GLuint available = 0;
+			glGetQueryObjectuiv(frame.end, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;							// Later frames cannot have finished either
+
+			GLuint64 start_ns = 0, end_ns = 0;
+			glGetQueryObjectui64v(frame.start, GL_QUERY_RESULT, &start_ns);
+			glGetQueryObjectui64v(frame.end, GL_QUERY_RESULT, &end_ns);
+			frame.pending = false;
+
+			/**
+			 * Normalise to full resolution so frames measured before the last scale
+			 * change still count.
+			 */
+			last_stats.gpu_ms = (end_ns - start_ns) * 1e-6;
+			double full_ms = last_stats.gpu_ms / ((double)frame.scale * frame.scale);
+			if (last_stats.full_ms <= 0.0)
+				last_stats.full_ms = full_ms;
+			else
+				last_stats.full_ms += (full_ms - last_stats.full_ms) * settings.smoothing;
+
+			if (adaptive)
+				scale = next_scale(scale, (float)(last_stats.full_ms * scale * scale), settings);
+		}
+	}
+
+	void DynamicResolution::begin_frame(int width, int height) {
+		fetch_results();
+		if (!adaptive)
+			scale = settings.max_scale;
+
+		window_width = width;
+		window_height = height;
+		if (target_width != width || target_height != height)
+			resize(width, height);				// Follow window resizes
+
+		int alignment = std::max(settings.size_alignment, 1);
+		render_width = std::min(width, std::max(alignment, (int)std::lround(width * scale / alignment) * alignment));
+		render_height = std::min(height, std::max(alignment, (int)std::lround(height * scale / alignment) * alignment));
+		last_stats.scale = scale;
+
+		frames[current].scale = (float)render_width / (float)width;
+		frames[current].pending = false;		// Still unread after FRAMES_IN_FLIGHT frames: drop it rather than wait
+		glQueryCounter(frames[current].start, GL_TIMESTAMP);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, target_framebuffer);
+		glViewport(0, 0, render_width, render_height);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	void DynamicResolution::upscale_from(unsigned int texture) {
+		upscale_shader->use();
+		upscale_shader->setVec2("uvScale", glm::vec2((float)render_width / target_width, (float)render_height / target_height));
+		upscale_shader->setVec2("texelSize", glm::vec2(1.f / target_width, 1.f / target_height));
+		upscale_shader->setFloat("sharpness", upscale == Upscale::SHARPENED && render_width < window_width ? sharpness : 0.f);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture);
+
+		/**
+		 * The upscale replaces every pixel and must not be depth tested or clipped by
+		 * wireframe mode.
+		 */
+		GLint polygon_mode[2];
+		glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glDisable(GL_DEPTH_TEST);
+
+		glBindVertexArray(empty_VAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+
+		glEnable(GL_DEPTH_TEST);
+		glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+	}
+
+	void DynamicResolution::end_frame(const antialiasing::Fxaa* fxaa) {
+		glm::vec2 uv_scale = glm::vec2((float)render_width / target_width, (float)render_height / target_height);
+		glm::vec2 texel_size = glm::vec2(1.f / target_width, 1.f / target_height);
+		bool scaled = render_width != window_width || render_height != window_height;
+
+		if (fxaa != nullptr && !scaled) {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, window_width, window_height);
+			fxaa->apply(color, uv_scale, texel_size);
+		}
+		else if (fxaa != nullptr) {
+			/**
+			 * Anti-alias at the rendered size, where the edges are still a pixel wide,
+			 * then upscale the result.
+			 */
+			if (aa_framebuffer == 0) {
+				aa_color = create_color_target(target_width, target_height);
+				glGenFramebuffers(1, &aa_framebuffer);
+				glBindFramebuffer(GL_FRAMEBUFFER, aa_framebuffer);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, aa_color, 0);
+				if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+					std::cerr << "ERROR::FRAMEBUFFER::ANTIALIASING::INCOMPLETE" << std::endl;
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, aa_framebuffer);
+			fxaa->apply(color, uv_scale, texel_size);			// Viewport is still the rendered size
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, window_width, window_height);
+			upscale_from(aa_color);
+		}
+		else {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, window_width, window_height);
+			upscale_from(color);
+		}
+
+		glQueryCounter(frames[current].end, GL_TIMESTAMP);
+		frames[current].pending = true;
+		current = (current + 1) % FRAMES_IN_FLIGHT;
+	}
+}
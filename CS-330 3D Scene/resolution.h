@@ -0,0 +1,113 @@
+/**
+ * "resolution.h" - Dynamic resolution scaling. The scene is rendered into an offscreen
+ *		colour/depth target at a fraction of the window's size and upscaled to the
+ *		window with a bilinear or sharpened blit. The GPU time of every frame is
+ *		measured with a pair of GL_TIMESTAMP queries that are read back a few frames
+ *		later without waiting on the GPU, smoothed, and fed to a controller that picks
+ *		the render scale expected to keep frames within a time budget. The same path,
+ *		held at full resolution, serves post-process anti-aliasing (see
+ *		antialiasing.h), which runs on the rendered frame before it is upscaled.
+ *		Function implementations defined in "resolution.cpp".
+ */
+#pragma once
+#ifndef __RESOLUTION_H__
+#define __RESOLUTION_H__
+
+#include "antialiasing.h"
+#include "shader.h"
+
+namespace resolution {
+	enum class Upscale {
+		SHARPENED,								// Bilinear plus a contrast-limited unsharp mask
+		BILINEAR,
+	};
+
+	struct ResolutionSettings {
+		float target_ms = 16.7f;				// GPU frame time budget
+		float headroom = 0.8f;					// Scale up only while frames take less than this share of the budget
+		float min_scale = 0.5f;					// Of the window's width and height
+		float max_scale = 1.f;
+		float max_step = 0.1f;					// Largest scale change per measured frame
+		float smoothing = 0.25f;				// Weight of each new measurement in the running average
+		int size_alignment = 8;					// Render sizes are rounded to multiples of this many pixels
+	};
+
+	/**
+	 * Counters from the most recent frame whose timing has been read back.
+	 */
+	struct ResolutionStats {
+		float scale = 1.f;						// Render scale for the current frame
+		double gpu_ms = 0.0;					// Measured GPU time of the frame read back last
+		double full_ms = 0.0;					// Smoothed estimate of the GPU time at full resolution; 0 before any measurement
+	};
+
+	/**
+	 * The controller: the render scale for the next frame, given the current one and
+	 * the GPU time a frame is expected to take at it. Fragment cost is taken to grow
+	 * with the pixel count, i.e. the scale squared; the scale moves at most max_step
+	 * and holds still while frames fall between headroom * target_ms and target_ms.
+	 */
+	float next_scale(float scale, float frame_ms, const ResolutionSettings& settings);
+
+	class DynamicResolution {
+	public:
+		ResolutionSettings settings;
+		Upscale upscale = Upscale::SHARPENED;
+		float sharpness = 0.5f;					// Unsharp mask strength for Upscale::SHARPENED
+		bool adaptive = true;					// false to render at max_scale whatever the frame time
+
+		void init();							// Create the queries and upscale shader; requires a GL context
+
+		/**
+		 * Read back finished timings, pick this frame's scale, then bind and clear the
+		 * offscreen target with a viewport of width() x height(). The frame is timed
+		 * from here to end_frame().
+		 */
+		void begin_frame(int window_width, int window_height);
+
+		/**
+		 * Upscale the target into the default framebuffer's window_width x
+		 * window_height viewport and leave the default framebuffer bound. With fxaa the
+		 * frame is anti-aliased at its rendered size first; at full resolution that pass
+		 * replaces the upscale.
+		 */
+		void end_frame(const antialiasing::Fxaa* fxaa = nullptr);
+
+		int width() const { return render_width; }
+		int height() const { return render_height; }
+		unsigned int framebuffer() const { return target_framebuffer; }	// Has a D24S8 depth attachment
+		const ResolutionStats& stats() const { return last_stats; }
+
+	private:
+		static const int FRAMES_IN_FLIGHT = 4;
+
+		struct frame_queries {
+			unsigned int start = 0;				// GL_TIMESTAMP at begin_frame()
+			unsigned int end = 0;				// GL_TIMESTAMP after the upscale
+			float scale = 1.f;
+			bool pending = false;
+		};
+
+		frame_queries frames[FRAMES_IN_FLIGHT];
+		int current = 0;
+
+		unsigned int target_framebuffer = 0;
+		unsigned int color = 0;					// RGBA8, window sized
+		unsigned int depth = 0;					// DEPTH24_STENCIL8, window sized
+		unsigned int aa_framebuffer = 0;		// Anti-aliased frame before upscaling; created on first use
+		unsigned int aa_color = 0;				// RGBA8, window sized
+		unsigned int empty_VAO = 0;
+		int target_width = 0, target_height = 0;
+		int window_width = 0, window_height = 0;
+		int render_width = 0, render_height = 0;
+		float scale = 1.f;
+
+		Shader* upscale_shader = nullptr;
+		ResolutionStats last_stats;
+
+		void resize(int width, int height);
+		void upscale_from(unsigned int texture);
+		void fetch_results();
+	};
+}
+#endif//__RESOLUTION_H__
@@ -14,9 +14,11 @@ class Shader
 {
 public:
 	unsigned int ID;
-	// constructor generates the shader on the fly
+	// constructor generates the shader on the fly; defines (e.g. "#define FOG\n")
+	// are inserted after the #version line of every stage, and the source at
+	// fragmentIncludePath (e.g. the lighting kernel) after the fragment stage's defines
 	// ------------------------------------------------------------------------
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "", const char* fragmentIncludePath = nullptr)
 	{
 		// 1. retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
@@ -53,6 +55,21 @@ public:
 				gShaderFile.close();
 				geometryCode = gShaderStream.str();
 			}
+			// if a fragment include path is present, insert its source with the defines
+			std::string fragmentInclude;
+			if (fragmentIncludePath != nullptr)
+			{
+				std::ifstream iShaderFile;
+				iShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+				iShaderFile.open(fragmentIncludePath);
+				std::stringstream iShaderStream;
+				iShaderStream << iShaderFile.rdbuf();
+				iShaderFile.close();
+				fragmentInclude = iShaderStream.str();
+			}
+			vertexCode = insertDefines(vertexCode, defines);
+			fragmentCode = insertDefines(fragmentCode, defines + fragmentInclude);
+			geometryCode = insertDefines(geometryCode, defines);
 		}
 		catch (std::ifstream::failure& e)
 		{
@@ -163,6 +180,17 @@ public:
 	}
 
 private:
+	// utility function for inserting defines after the #version line, which must stay first.
+	// ------------------------------------------------------------------------
+	static std::string insertDefines(const std::string& code, const std::string& defines)
+	{
+		if (defines.empty())
+			return code;
+		size_t lineEnd = code.find('\n');
+		if (lineEnd == std::string::npos)
+			return code + "\n" + defines;
+		return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+	}
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(GLuint shader, std::string type)
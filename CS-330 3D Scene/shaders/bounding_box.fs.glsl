@@ -0,0 +1,7 @@
+#version 330 core
+out vec4 FragColor;
+
+void main()
+{
+	FragColor = vec4(1.0);	// Color writes are masked off for occlusion queries; only depth testing matters
+}
@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;													// Unit cube corner in [0, 1]
+
+uniform vec3 boxMin;																// World-space box minimum corner
+uniform vec3 boxMax;																// World-space box maximum corner
+uniform mat4 viewProjection;														// Projection * view matrix
+void main()
+{
+	gl_Position = viewProjection * vec4(mix(boxMin, boxMax, aPos), 1.0);				// Stretch the unit cube over the box
+}
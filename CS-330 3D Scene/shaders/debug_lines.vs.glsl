@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;													// World space
+layout (location = 1) in vec3 aColor;
+
+out vec3 LineColor;
+
+uniform mat4 viewProjection;														// Projection * view matrix
+void main()
+{
+	gl_Position = viewProjection * vec4(aPos, 1.0);
+	LineColor = aColor;
+}
@@ -0,0 +1,156 @@
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+
+#ifdef VISIBILITY_BUFFER
+uniform usampler2D visibilityBuffer;											// (draw << triangleBits) | triangle (see visibility.h)
+uniform int triangleBits;
+uniform samplerBuffer vertexData;												// 2 texels per vertex: position and normal x, normal yz and texture coordinates
+uniform samplerBuffer drawData;													// 6 texels per draw: model matrix rows, normal matrix columns
+uniform sampler2D aTexture;
+#ifdef SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
+uniform float specularStrength;
+#else
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+#endif
+uniform mat4 inverseViewProjection;												// reconstructs world position from depth
+// the lighting itself is the kernel in lighting.glsl, inserted ahead of this source
+
+#ifdef AMBIENT_OCCLUSION
+uniform sampler2D aoTexture;					// unoccluded fraction and linear view depth, at a fraction of the resolution
+uniform vec2 aoSize;							// its size in texels
+#endif
+
+#ifdef VISIBILITY_BUFFER
+// barycentric coordinates of the point where the camera ray through a window position
+// meets the plane of triangle p0 p1 p2 (Moller-Trumbore, without rejecting rays that
+// miss: a neighbouring pixel's ray may pass just outside the triangle)
+vec3 RayBarycentrics(vec2 windowPos, vec3 p0, vec3 p1, vec3 p2) {
+	vec2 ndc = windowPos / vec2(textureSize(visibilityBuffer, 0)) * 2.0 - 1.0;
+	vec4 nearPoint = inverseViewProjection * vec4(ndc, -1.0, 1.0);
+	vec4 farPoint = inverseViewProjection * vec4(ndc, 1.0, 1.0);
+	vec3 origin = nearPoint.xyz / nearPoint.w;
+	vec3 direction = farPoint.xyz / farPoint.w - origin;							// also right for orthographic projections
+
+	vec3 e1 = p1 - p0;
+	vec3 e2 = p2 - p0;
+	vec3 h = cross(direction, e2);
+	float f = 1.0 / dot(e1, h);
+	vec3 s = origin - p0;
+	float u = f * dot(s, h);
+	float v = f * dot(direction, cross(s, e1));
+	return vec3(1.0 - u - v, u, v);
+}
+
+// set worldPos and norm, and return the albedo and specular strength, of the triangle
+// the visibility buffer holds for this pixel, as the G-buffer pass would have written
+// them
+vec4 ResolveVisibility() {
+	uint id = texelFetch(visibilityBuffer, ivec2(gl_FragCoord.xy), 0).r;
+	int draw = int(id >> uint(triangleBits)) * 6;
+	int first = int(id & ((1u << uint(triangleBits)) - 1u)) * 6;				// 3 vertices of 2 texels each
+
+	vec4 modelRows[3] = vec4[](texelFetch(drawData, draw), texelFetch(drawData, draw + 1), texelFetch(drawData, draw + 2));
+	mat3 normalModel = mat3(texelFetch(drawData, draw + 3).xyz, texelFetch(drawData, draw + 4).xyz, texelFetch(drawData, draw + 5).xyz);
+
+	vec3 positions[3];
+	vec3 normals[3];
+	mat3x2 texCoords;
+	for (int i = 0; i < 3; ++i) {
+		vec4 a = texelFetch(vertexData, first + i * 2);
+		vec4 b = texelFetch(vertexData, first + i * 2 + 1);
+		vec4 position = vec4(a.xyz, 1.0);
+		positions[i] = vec3(dot(modelRows[0], position), dot(modelRows[1], position), dot(modelRows[2], position));
+		normals[i] = vec3(a.w, b.xy);
+		texCoords[i] = b.zw;
+	}
+
+	// the neighbouring pixels' coordinates give the texture gradients hardware
+	// derivatives would have
+	vec3 bary = RayBarycentrics(gl_FragCoord.xy, positions[0], positions[1], positions[2]);
+	vec3 baryX = RayBarycentrics(gl_FragCoord.xy + vec2(1.0, 0.0), positions[0], positions[1], positions[2]);
+	vec3 baryY = RayBarycentrics(gl_FragCoord.xy + vec2(0.0, 1.0), positions[0], positions[1], positions[2]);
+
+	worldPos = positions[0] * bary.x + positions[1] * bary.y + positions[2] * bary.z;
+	norm = normalize(normalModel * (normals[0] * bary.x + normals[1] * bary.y + normals[2] * bary.z));
+
+	vec2 texCoord = texCoords * bary;
+	vec2 dx = texCoords * baryX - texCoord;
+	vec2 dy = texCoords * baryY - texCoord;
+	float specular = specularStrength;
+#ifdef SPECULAR_MAP
+	specular *= textureGrad(specularMap, texCoord, dx, dy).r;
+#endif
+	return vec4(textureGrad(aTexture, texCoord, dx, dy).rgb, clamp(specular, 0.0, 1.0));
+}
+#endif
+
+vec3 DecodeNormal(vec2 encoded) {
+	encoded = encoded * 2.0 - 1.0;
+	vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-n.z, 0.0);												// unfold the lower hemisphere
+	n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+	return normalize(n);
+}
+
+#ifdef AMBIENT_OCCLUSION
+// bilinear upsample of the occlusion, with each of the 4 texels weighted down by how
+// far its depth is from this pixel's so occlusion never bleeds across silhouettes
+float AmbientOcclusion() {
+	float viewDepth = -(view * vec4(worldPos, 1.0)).z;
+	vec2 coord = TexCoord * aoSize - 0.5;
+	ivec2 base = ivec2(floor(coord));
+	vec2 f = fract(coord);
+
+	float total = 0.0;
+	float weights = 0.0;
+	for (int i = 0; i < 4; ++i) {
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		vec2 texel = texelFetch(aoTexture, clamp(base + offset, ivec2(0), ivec2(aoSize) - 1), 0).rg;
+		vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+		float weight = bilinear.x * bilinear.y / (1e-3 + abs(texel.g - viewDepth));
+		total += texel.r * weight;
+		weights += weight;
+	}
+	return total / weights;
+}
+#endif
+
+void main()
+{
+#ifdef VISIBILITY_BUFFER
+	vec4 albedoSpecular = ResolveVisibility();									// only this material's pixels pass the depth test
+#else
+	float depth = texture(gDepth, TexCoord).r;
+	if (depth == 1.0)
+		discard;																// nothing was drawn here
+
+	// reconstruct the world-space position from the depth buffer
+	vec4 clip = vec4(vec3(TexCoord, depth) * 2.0 - 1.0, 1.0);
+	vec4 world = inverseViewProjection * clip;
+	worldPos = world.xyz / world.w;
+
+	norm = DecodeNormal(texture(gNormal, TexCoord).rg);
+	vec4 albedoSpecular = texture(gAlbedoSpecular, TexCoord);
+#endif
+	viewDir = normalize(viewPos - worldPos);
+	specularScale = vec3(albedoSpecular.a);
+	hasSpecular = albedoSpecular.a > 0.0;
+
+	vec3 lighting = CalcAmbient();
+#ifdef AMBIENT_OCCLUSION
+	lighting *= AmbientOcclusion();
+#endif
+	lighting += CalcPointLight(pointLight) + CalcDirLight(dirLight);
+#ifdef CLUSTERED_LIGHTS
+	lighting += CalcClusteredLights();
+#endif
+#ifdef REFLECTIONS
+	lighting += CalcReflection();
+#endif
+	FragColor = vec4(ApplyFog(lighting * albedoSpecular.rgb), 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+invariant gl_Position;																// Must match single_texture.vs.glsl exactly for GL_LEQUAL to pass
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat4 model;
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos.x, aPos.y, aPos.z, 1.0);	// Same expression as single_texture.vs.glsl
+}
@@ -0,0 +1,17 @@
+#version 330 core
+out vec2 TexCoord;
+
+#ifdef VISIBILITY_BUFFER
+uniform float materialDepth;													// window depth of the material being resolved (see visibility.h)
+#endif
+
+void main()
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);					// (0,0), (2,0), (0,2): one triangle covering the screen
+	TexCoord = corner;
+#ifdef VISIBILITY_BUFFER
+	gl_Position = vec4(corner * 2.0 - 1.0, materialDepth * 2.0 - 1.0, 1.0);
+#else
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+#endif
+}
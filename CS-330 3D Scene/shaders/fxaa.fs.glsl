@@ -0,0 +1,159 @@
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+
+uniform sampler2D scene;
+uniform vec2 uvScale;																// Rendered size / target texture size
+uniform vec2 texelSize;																// 1 / target texture size
+
+const float EDGE_THRESHOLD_MIN = 0.0312;											// Skip darker local contrast than this...
+const float EDGE_THRESHOLD_MAX = 0.125;												// ...or than this share of the brightest neighbour
+const float SUBPIXEL_QUALITY = 0.75;
+const int SEARCH_STEPS = 12;
+const float SEARCH_STRIDE[SEARCH_STEPS] = float[](1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0);
+
+vec2 uvMin;
+vec2 uvMax;
+
+vec3 Fetch(vec2 uv)
+{
+	return textureLod(scene, clamp(uv, uvMin, uvMax), 0.0).rgb;						// Never filter outside the rendered area; no derivatives in the edge walk
+}
+
+float Luma(vec3 color)
+{
+	return sqrt(dot(color, vec3(0.299, 0.587, 0.114)));							// Perceptual, roughly gamma corrected
+}
+
+float LumaAt(vec2 uv, vec2 offset)
+{
+	return Luma(Fetch(uv + offset * texelSize));
+}
+
+void main()
+{
+	uvMin = 0.5 * texelSize;
+	uvMax = uvScale - 0.5 * texelSize;
+	vec2 uv = clamp(TexCoord * uvScale, uvMin, uvMax);
+	vec3 color = Fetch(uv);
+
+	/**
+	 * Local contrast from the four direct neighbours; low contrast is left alone.
+	 */
+	float lumaCenter = Luma(color);
+	float lumaDown = LumaAt(uv, vec2(0.0, -1.0));
+	float lumaUp = LumaAt(uv, vec2(0.0, 1.0));
+	float lumaLeft = LumaAt(uv, vec2(-1.0, 0.0));
+	float lumaRight = LumaAt(uv, vec2(1.0, 0.0));
+
+	float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+	float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+	float lumaRange = lumaMax - lumaMin;
+	if (lumaRange < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD_MAX)) {
+		FragColor = vec4(color, 1.0);
+		return;
+	}
+
+	float lumaDownLeft = LumaAt(uv, vec2(-1.0, -1.0));
+	float lumaUpRight = LumaAt(uv, vec2(1.0, 1.0));
+	float lumaUpLeft = LumaAt(uv, vec2(-1.0, 1.0));
+	float lumaDownRight = LumaAt(uv, vec2(1.0, -1.0));
+
+	/**
+	 * Edge orientation from the 3x3 neighbourhood's second derivatives.
+	 */
+	float lumaDownUp = lumaDown + lumaUp;
+	float lumaLeftRight = lumaLeft + lumaRight;
+	float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+	float lumaDownCorners = lumaDownLeft + lumaDownRight;
+	float lumaRightCorners = lumaDownRight + lumaUpRight;
+	float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+	float edgeHorizontal = abs(-2.0 * lumaLeft + lumaLeftCorners) + abs(-2.0 * lumaCenter + lumaDownUp) * 2.0 + abs(-2.0 * lumaRight + lumaRightCorners);
+	float edgeVertical = abs(-2.0 * lumaUp + lumaUpCorners) + abs(-2.0 * lumaCenter + lumaLeftRight) * 2.0 + abs(-2.0 * lumaDown + lumaDownCorners);
+	bool isHorizontal = edgeHorizontal >= edgeVertical;
+
+	/**
+	 * Which side of the pixel the edge lies on: the neighbour with the steeper
+	 * gradient.
+	 */
+	float luma1 = isHorizontal ? lumaDown : lumaLeft;
+	float luma2 = isHorizontal ? lumaUp : lumaRight;
+	float gradient1 = luma1 - lumaCenter;
+	float gradient2 = luma2 - lumaCenter;
+	bool is1Steepest = abs(gradient1) >= abs(gradient2);
+	float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+	float stepLength = isHorizontal ? texelSize.y : texelSize.x;
+	float lumaLocalAverage;
+	if (is1Steepest) {
+		stepLength = -stepLength;
+		lumaLocalAverage = 0.5 * (luma1 + lumaCenter);
+	}
+	else {
+		lumaLocalAverage = 0.5 * (luma2 + lumaCenter);
+	}
+
+	vec2 edgeUV = uv;
+	if (isHorizontal)
+		edgeUV.y += stepLength * 0.5;
+	else
+		edgeUV.x += stepLength * 0.5;
+
+	/**
+	 * Walk along the edge both ways until the luma leaves the edge's average.
+	 */
+	vec2 offset = isHorizontal ? vec2(texelSize.x, 0.0) : vec2(0.0, texelSize.y);
+	vec2 uv1 = edgeUV - offset;
+	vec2 uv2 = edgeUV + offset;
+	float lumaEnd1 = Luma(Fetch(uv1)) - lumaLocalAverage;
+	float lumaEnd2 = Luma(Fetch(uv2)) - lumaLocalAverage;
+	bool reached1 = abs(lumaEnd1) >= gradientScaled;
+	bool reached2 = abs(lumaEnd2) >= gradientScaled;
+
+	for (int i = 1; i < SEARCH_STEPS && !(reached1 && reached2); ++i) {
+		if (!reached1) {
+			uv1 -= offset * SEARCH_STRIDE[i];
+			lumaEnd1 = Luma(Fetch(uv1)) - lumaLocalAverage;
+			reached1 = abs(lumaEnd1) >= gradientScaled;
+		}
+		if (!reached2) {
+			uv2 += offset * SEARCH_STRIDE[i];
+			lumaEnd2 = Luma(Fetch(uv2)) - lumaLocalAverage;
+			reached2 = abs(lumaEnd2) >= gradientScaled;
+		}
+	}
+
+	/**
+	 * Blend across the edge by how far the pixel is from its nearer end, but only if
+	 * that end's luma variation matches the centre's side of the edge.
+	 */
+	float distance1 = isHorizontal ? uv.x - uv1.x : uv.y - uv1.y;
+	float distance2 = isHorizontal ? uv2.x - uv.x : uv2.y - uv.y;
+	bool isDirection1 = distance1 < distance2;
+	float distanceFinal = min(distance1, distance2);
+	float edgeLength = distance1 + distance2;
+	float pixelOffset = -distanceFinal / edgeLength + 0.5;
+
+	bool isLumaCenterSmaller = lumaCenter < lumaLocalAverage;
+	bool correctVariation = ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0) != isLumaCenterSmaller;
+	float finalOffset = correctVariation ? pixelOffset : 0.0;
+
+	/**
+	 * Sub-pixel aliasing: features thinner than a pixel blend towards the
+	 * neighbourhood average.
+	 */
+	float lumaAverage = (1.0 / 12.0) * (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+	float subPixelOffset1 = clamp(abs(lumaAverage - lumaCenter) / lumaRange, 0.0, 1.0);
+	float subPixelOffset2 = (-2.0 * subPixelOffset1 + 3.0) * subPixelOffset1 * subPixelOffset1;
+	float subPixelOffsetFinal = subPixelOffset2 * subPixelOffset2 * SUBPIXEL_QUALITY;
+	finalOffset = max(finalOffset, subPixelOffsetFinal);
+
+	vec2 finalUV = uv;
+	if (isHorizontal)
+		finalUV.y += finalOffset * stepLength;
+	else
+		finalUV.x += finalOffset * stepLength;
+
+	FragColor = vec4(Fetch(finalUV), 1.0);
+}
@@ -0,0 +1,35 @@
+#version 330 core
+in vec2 TexCoord;
+in vec3 FragPos;
+in vec3 Normal;
+
+layout (location = 0) out vec4 AlbedoSpecular;									// RGBA8: albedo, specular strength
+layout (location = 1) out vec2 OctahedralNormal;								// RG16: octahedral-encoded normal in [0, 1]
+
+uniform sampler2D aTexture;
+#ifdef SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
+uniform float specularStrength;
+
+// fold the lower hemisphere of the octahedron over the upper one
+vec2 OctWrap(vec2 v) {
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeNormal(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);										// project onto the octahedron
+	vec2 encoded = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+	return encoded * 0.5 + 0.5;
+}
+
+void main()
+{
+	float specular = specularStrength;
+#ifdef SPECULAR_MAP
+	specular *= texture(specularMap, TexCoord).r;
+#endif
+
+	AlbedoSpecular = vec4(texture(aTexture, TexCoord).rgb, clamp(specular, 0.0, 1.0));
+	OctahedralNormal = EncodeNormal(normalize(Normal));
+}
@@ -0,0 +1,7 @@
+#version 330 core
+out vec4 FragColor;
+
+void main()
+{
+	FragColor = vec4(1.0);	// Never runs: the culling pass is drawn with GL_RASTERIZER_DISCARD
+}
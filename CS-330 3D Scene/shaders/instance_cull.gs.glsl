@@ -0,0 +1,18 @@
+#version 330 core
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in mat4 vModel[];
+flat in int vVisible[];
+
+out mat4 instanceModel;																// Captured by transform feedback
+
+void main()
+{
+	if (vVisible[0] == 0)
+		return;																		// Culled instances emit nothing, so the output stays packed
+
+	instanceModel = vModel[0];
+	EmitVertex();
+	EndPrimitive();
+}
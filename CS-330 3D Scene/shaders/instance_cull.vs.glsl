@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in mat4 aModel;												// Instance model matrix (locations 0-3), one per point
+
+out mat4 vModel;
+flat out int vVisible;
+
+uniform vec4 frustumPlanes[6];														// Normalized planes: left, right, bottom, top, near, far
+uniform vec4 boundingSphere;														// Mesh bounding sphere: object-space center (xyz) and radius (w)
+void main()
+{
+	vec3 center = vec3(aModel * vec4(boundingSphere.xyz, 1.0));						// Sphere center in world space
+	float scale = max(length(aModel[0].xyz), max(length(aModel[1].xyz), length(aModel[2].xyz)));
+	float radius = boundingSphere.w * scale;										// Largest axis scale keeps the sphere conservative
+
+	vVisible = 1;
+	for (int i = 0; i < 6; ++i)
+		if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius)
+			vVisible = 0;															// Entirely behind one plane
+
+	vModel = aModel;
+}
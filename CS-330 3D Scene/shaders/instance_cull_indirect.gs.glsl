@@ -0,0 +1,22 @@
+#version 420 core
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in mat4 vModel[];
+flat in int vVisible[];
+
+out mat4 instanceModel;																// Captured by transform feedback
+
+layout (binding = 0, offset = 4) uniform atomic_uint instanceCount;					// instanceCount field of the indirect draw command
+
+void main()
+{
+	if (vVisible[0] == 0)
+		return;																		// Culled instances emit nothing, so the output stays packed
+
+	instanceModel = vModel[0];
+	EmitVertex();
+	EndPrimitive();
+
+	atomicCounterIncrement(instanceCount);
+}
@@ -0,0 +1,282 @@
+// lighting kernel shared by the forward uber-shader (single_texture.fs.glsl) and the
+// deferred and visibility buffer lighting pass (deferred_lighting.fs.glsl). It has no
+// #version line: Shader inserts it after the #version line and feature #defines of
+// their fragment stage (see shader.h), so both light a surface with the same code.
+//
+// The including shader sets the per-fragment terms below in main() before lighting.
+
+uniform float ambientStrength;
+
+struct PointLight {
+	vec3 position;
+	vec3 color;
+};
+uniform PointLight pointLight;
+
+struct DirectionalLight {
+	vec3 direction;
+	vec3 color;
+};
+uniform DirectionalLight dirLight;
+
+uniform vec3 attenCoeff = vec3(1.0, 0.0, 0.0);
+uniform vec3 viewPos;
+
+#if defined(CLUSTERED_LIGHTS) || defined(SHADOWS) || defined(AMBIENT_OCCLUSION)
+uniform mat4 view;
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+uniform samplerBuffer clusterLights;			// 3 texels per light: position and radius, color, attenuation coefficients
+uniform usamplerBuffer clusterGrid;				// first index and light count of each cluster
+uniform usamplerBuffer clusterLightIndices;		// light indices, grouped by cluster
+uniform ivec3 clusterDimensions;				// tiles in x, tiles in y, depth slices
+uniform vec2 clusterTileSize;					// tile size in pixels
+uniform vec2 clusterDepthScaleBias;				// slice = log(view depth) * scale - bias
+#endif
+
+#ifdef SHADOWS
+uniform sampler2DArrayShadow dirShadowMap;		// one layer per cascade
+uniform mat4 dirShadowMatrices[4];				// world to light clip space of each cascade
+uniform vec4 cascadeSplits;						// far view depth of each cascade
+uniform int cascadeCount;
+uniform samplerCubeShadow pointShadowMap;		// distance from the point light / pointShadowFar
+uniform float pointShadowFar;
+uniform int pcfRadius;							// 0 for a single tap
+#endif
+
+#ifdef SH_AMBIENT
+layout(std140) uniform AmbientSH {
+	vec4 shAmbient[9];							// rgb: irradiance / pi coefficients, pre-scaled by the basis constants
+};
+#endif
+
+#ifdef REFLECTIONS
+uniform samplerCube reflectionProbes[2];		// prefiltered radiance, roughness = mip / probeMaxLod (see reflections.h)
+uniform vec3 probePositions[2];
+uniform vec3 probeBoxMin[2];					// the surroundings each probe's reflections are projected onto
+uniform vec3 probeBoxMax[2];
+uniform int probeCount;
+uniform float probeMaxLod;
+#endif
+
+#ifdef FOG
+uniform vec3 fogColor;
+uniform float fogDensity;
+#endif
+
+// terms shared by every light, computed once per fragment in main()
+vec3 worldPos;
+vec3 norm;
+vec3 viewDir;
+vec3 specularScale;																// specular strength, scaled by the specular map if there is one
+bool hasSpecular;																// false skips every specular term
+#ifdef BAKED_LIGHTING
+vec4 baked;																		// lightmap texel (see single_texture.fs.glsl)
+#endif
+
+// x^32 by repeated squaring, cheaper than pow()'s exp2(log2(x) * 32)
+float Pow32(float x) {
+	x *= x; x *= x; x *= x; x *= x;
+	return x * x;
+}
+
+// specular light reflected toward the camera from a light of color arriving along
+// lightDir, before attenuation
+vec3 CalcSpecular(vec3 lightDir, vec3 color) {
+	if (!hasSpecular)
+		return vec3(0.0);
+
+#ifdef BLINN_PHONG
+	vec3 halfwayDir = normalize(lightDir + viewDir);				// halfway between light and view directions
+	float spec = Pow32(max(dot(norm, halfwayDir), 0.0));
+	spec *= spec;
+	spec *= spec;													// exponent 128: about the same highlight size as Phong's 32
+#else
+	vec3 reflectDir = reflect(-lightDir, norm);						// calculate direction of reflected light
+	float spec = Pow32(max(dot(viewDir, reflectDir), 0.0));			// calculate specular constant
+#endif
+	return specularScale * spec * color;
+}
+
+// diffuse and specular light reflected toward the camera from a light of color
+// arriving along lightDir, before attenuation
+vec3 CalcLight(vec3 lightDir, vec3 color) {
+	float diff = max(dot(norm, lightDir), 0.0);					// calculate how bright the fragment should be based
+																	// on the angle between the normal and ray of light
+	return diff * color + CalcSpecular(lightDir, color);
+}
+
+// ambient light reaching the surface, per unit albedo
+vec3 CalcAmbient() {
+#ifdef SH_AMBIENT
+	vec3 n = norm;
+	vec3 result = shAmbient[0].rgb
+		+ shAmbient[1].rgb * n.y + shAmbient[2].rgb * n.z + shAmbient[3].rgb * n.x
+		+ shAmbient[4].rgb * (n.x * n.y) + shAmbient[5].rgb * (n.y * n.z) + shAmbient[6].rgb * (3.0 * n.z * n.z - 1.0)
+		+ shAmbient[7].rgb * (n.x * n.z) + shAmbient[8].rgb * (n.x * n.x - n.y * n.y);
+	return max(result, vec3(0.0));												// ringing can dip below zero
+#else
+	return (pointLight.color + dirLight.color) * ambientStrength;				// ambient from both lights once
+#endif
+}
+
+#ifdef SHADOWS
+// fraction of the directional light reaching worldPos
+float DirShadow() {
+	float viewDepth = -(view * vec4(worldPos, 1.0)).z;
+	if (viewDepth > cascadeSplits[cascadeCount - 1])
+		return 1.0;																// past the shadow distance
+
+	int cascade = 0;
+	while (cascade < cascadeCount - 1 && viewDepth > cascadeSplits[cascade])
+		++cascade;
+
+	vec4 lightClip = dirShadowMatrices[cascade] * vec4(worldPos, 1.0);
+	vec3 coords = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+	vec2 texel = 1.0 / vec2(textureSize(dirShadowMap, 0).xy);
+
+	float lit = 0.0;
+	for (int x = -pcfRadius; x <= pcfRadius; ++x)
+		for (int y = -pcfRadius; y <= pcfRadius; ++y)
+			lit += texture(dirShadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+	return lit / float((2 * pcfRadius + 1) * (2 * pcfRadius + 1));
+}
+
+// fraction of the point light reaching worldPos
+float PointShadow(vec3 lightPosition) {
+	vec3 fromLight = worldPos - lightPosition;
+	float lightDistance = length(fromLight);
+	if (lightDistance >= pointShadowFar)
+		return 1.0;
+	float reference = (lightDistance - 0.02) / pointShadowFar;					// constant bias
+
+	if (pcfRadius == 0)
+		return texture(pointShadowMap, vec4(fromLight, reference));
+
+	// taps spread over the cube corners and edge midpoints, wider for larger radii
+	const vec3 offsets[20] = vec3[](
+		vec3(1, 1, 1), vec3(1, -1, 1), vec3(-1, -1, 1), vec3(-1, 1, 1),
+		vec3(1, 1, -1), vec3(1, -1, -1), vec3(-1, -1, -1), vec3(-1, 1, -1),
+		vec3(1, 1, 0), vec3(1, -1, 0), vec3(-1, -1, 0), vec3(-1, 1, 0),
+		vec3(1, 0, 1), vec3(-1, 0, 1), vec3(1, 0, -1), vec3(-1, 0, -1),
+		vec3(0, 1, 1), vec3(0, -1, 1), vec3(0, -1, -1), vec3(0, 1, -1));
+	float spread = lightDistance * 0.005 * float(pcfRadius);
+	float lit = 0.0;
+	for (int i = 0; i < 20; ++i)
+		lit += texture(pointShadowMap, vec4(fromLight + offsets[i] * spread, reference));
+	return lit / 20.0;
+}
+#endif
+
+vec3 CalcPointLight(PointLight light) {
+	// calculate attenuation coefficient based on distance from light
+	vec3 toLight = light.position - worldPos;
+	float lightDistance = length(toLight);
+	float attenuation = 1.0 / (attenCoeff.x + attenCoeff.y * lightDistance + attenCoeff.z * (lightDistance * lightDistance));
+
+	vec3 result = CalcLight(toLight / lightDistance, light.color) * attenuation;
+#ifdef SHADOWS
+	result *= PointShadow(light.position);
+#endif
+	return result;
+}
+
+vec3 CalcDirLight(DirectionalLight light) {
+#ifdef BAKED_LIGHTING
+	// diffuse comes shadowed and with a bounce from the lightmap; only specular is
+	// evaluated here
+	vec3 specular = CalcSpecular(normalize(-light.direction), light.color);
+#ifdef SHADOWS
+	specular *= DirShadow();
+#endif
+	return baked.rgb * light.color + specular;
+#else
+	vec3 result = CalcLight(normalize(-light.direction), light.color);
+#ifdef SHADOWS
+	result *= DirShadow();
+#endif
+	return result;
+#endif
+}
+
+#ifdef CLUSTERED_LIGHTS
+vec3 CalcClusteredLights() {
+	// find the cluster this fragment falls in
+	float viewDepth = -(view * vec4(worldPos, 1.0)).z;
+	int slice = int(log(viewDepth) * clusterDepthScaleBias.x - clusterDepthScaleBias.y);
+	ivec2 tile = ivec2(gl_FragCoord.xy / clusterTileSize);
+	ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), clusterDimensions - 1);
+	uvec2 lightRange = texelFetch(clusterGrid, cluster.x + clusterDimensions.x * (cluster.y + clusterDimensions.y * cluster.z)).xy;
+
+	vec3 result = vec3(0.0);
+
+	// only the lights that reach this cluster are visited
+	for (uint i = 0u; i < lightRange.y; ++i) {
+		int light = int(texelFetch(clusterLightIndices, int(lightRange.x + i)).x);
+		vec4 positionRadius = texelFetch(clusterLights, light * 3);
+
+		vec3 toLight = positionRadius.xyz - worldPos;
+		float distanceSquared = dot(toLight, toLight);
+		if (distanceSquared >= positionRadius.w * positionRadius.w)
+			continue;
+
+		vec3 color = texelFetch(clusterLights, light * 3 + 1).rgb;
+		vec3 coefficients = texelFetch(clusterLights, light * 3 + 2).xyz;
+
+		// attenuation, windowed so it reaches zero at the cutoff radius
+		float lightDistance = sqrt(distanceSquared);
+		float attenuation = 1.0 / (coefficients.x + coefficients.y * lightDistance + coefficients.z * distanceSquared);
+		float ratio = distanceSquared / (positionRadius.w * positionRadius.w);
+		float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+		attenuation *= window * window;
+
+		result += CalcLight(toLight / lightDistance, color) * attenuation;
+	}
+
+	return result;
+}
+#endif
+
+#ifdef REFLECTIONS
+// direction from probe i to where the ray from worldPos along r leaves the probe's
+// box, so nearby surroundings line up with what the probe saw; r itself from outside
+// the box
+vec3 BoxProject(vec3 r, int i) {
+	if (any(lessThan(worldPos, probeBoxMin[i])) || any(greaterThan(worldPos, probeBoxMax[i])))
+		return r;
+	vec3 exits = max((probeBoxMax[i] - worldPos) / r, (probeBoxMin[i] - worldPos) / r);
+	return worldPos + r * min(min(exits.x, exits.y), exits.z) - probePositions[i];
+}
+
+// surroundings reflected toward the camera, from the probe nearest worldPos, blurred
+// by roughness
+vec3 ProbeReflection(float roughness) {
+	vec3 r = reflect(-viewDir, norm);
+	float lod = roughness * probeMaxLod;
+	if (probeCount > 1 && distance(worldPos, probePositions[1]) < distance(worldPos, probePositions[0]))
+		return textureLod(reflectionProbes[1], BoxProject(r, 1), lod).rgb;
+	return textureLod(reflectionProbes[0], BoxProject(r, 0), lod).rgb;
+}
+
+// reflected surroundings per unit albedo: glossier surfaces reflect sharper and more,
+// and everything more at grazing angles
+vec3 CalcReflection() {
+	if (!hasSpecular)
+		return vec3(0.0);
+	float specular = clamp(dot(specularScale, vec3(1.0 / 3.0)), 0.0, 1.0);
+	float fresnel = pow(1.0 - max(dot(norm, viewDir), 0.0), 5.0);
+	return ProbeReflection(1.0 - specular) * specular * mix(0.25, 1.0, fresnel);
+}
+#endif
+
+// exponential squared fog over the distance from the camera
+vec3 ApplyFog(vec3 color) {
+#ifdef FOG
+	float fogDistance = length(viewPos - worldPos);
+	float fogFactor = exp(-(fogDensity * fogDistance) * (fogDensity * fogDistance));
+	return mix(fogColor, color, clamp(fogFactor, 0.0, 1.0));
+#else
+	return color;
+#endif
+}
@@ -0,0 +1,72 @@
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+
+uniform samplerCube environment;												// captured radiance, with mipmaps
+uniform int face;																// GL_TEXTURE_CUBE_MAP_POSITIVE_X + face is being written
+uniform float roughness;
+uniform int sampleCount;
+uniform float sourceTexelSolidAngle;											// of one texel of environment's top mip
+
+// direction through a point of the face, as environment::cubemap_direction()
+vec3 FaceDirection(vec2 uv) {
+	uv = uv * 2.0 - 1.0;
+	if (face == 0) return vec3(1.0, -uv.y, -uv.x);
+	if (face == 1) return vec3(-1.0, -uv.y, uv.x);
+	if (face == 2) return vec3(uv.x, 1.0, uv.y);
+	if (face == 3) return vec3(uv.x, -1.0, -uv.y);
+	if (face == 4) return vec3(uv.x, -uv.y, 1.0);
+	return vec3(-uv.x, -uv.y, -1.0);
+}
+
+// i-th of n points of the Hammersley set, evenly spread over the unit square
+vec2 Hammersley(uint i, uint n) {
+	uint bits = i;
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10);
+}
+
+void main()
+{
+	vec3 N = normalize(FaceDirection(TexCoord));
+	if (roughness == 0.0) {
+		FragColor = vec4(textureLod(environment, N, 0.0).rgb, 1.0);				// a mirror: copy the capture
+		return;
+	}
+
+	// GGX lobe around N, assuming the view direction is N as well (split-sum
+	// approximation, after Karis, "Real Shading in Unreal Engine 4", 2013)
+	vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+	vec3 T = normalize(cross(up, N));
+	vec3 B = cross(N, T);
+	float a2 = roughness * roughness * roughness * roughness;
+
+	vec3 sum = vec3(0.0);
+	float weight = 0.0;
+	for (int i = 0; i < sampleCount; ++i) {
+		vec2 xi = Hammersley(uint(i), uint(sampleCount));
+		float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a2 - 1.0) * xi.y));
+		float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+		float phi = 6.2831853 * xi.x;
+		vec3 H = T * (sinTheta * cos(phi)) + B * (sinTheta * sin(phi)) + N * cosTheta;
+		vec3 L = 2.0 * dot(N, H) * H - N;
+		float NdotL = dot(N, L);
+		if (NdotL <= 0.0)
+			continue;
+
+		// read the mip whose texels are about the solid angle this sample stands for,
+		// so a few samples do not alias (filtered importance sampling)
+		float d = cosTheta * cosTheta * (a2 - 1.0) + 1.0;
+		float pdf = a2 / (3.14159265 * d * d) / 4.0;							// D * NdotH / (4 VdotH), with N = V
+		float sampleSolidAngle = 1.0 / (float(sampleCount) * pdf);
+		float lod = max(0.5 * log2(sampleSolidAngle / sourceTexelSolidAngle) + 1.0, 0.0);
+
+		sum += textureLod(environment, L, lod).rgb * NdotL;
+		weight += NdotL;
+	}
+	FragColor = vec4(sum / max(weight, 1e-4), 1.0);
+}
@@ -1,9 +1,13 @@
 #version 330 core
 out vec4 FragColor;
 
-in vec4 VertexColor;
+in vec2 Corner;
+in vec3 LightColor;
 
 void main()
 {
-	FragColor = VertexColor;
-}
\ No newline at end of file
+	if (dot(Corner, Corner) > 1.0)
+		discard;																	// Round dot cut out of the quad
+
+	FragColor = vec4(LightColor, 1.0);
+}
@@ -1,14 +1,19 @@
 #version 330 core
-layout (location = 1) in vec3 aPos;
-layout (location = 2) in vec3 aVertexColor;
+layout (location = 0) in vec2 aCorner;												// Sprite quad corner in [-1, 1]
+layout (location = 1) in vec3 aLightPosition;										// Per light (instanced)
+layout (location = 2) in vec3 aLightColor;											// Per light (instanced)
 
-out vec4 VertexColor;
+out vec2 Corner;
+out vec3 LightColor;
 
-uniform mat4 model;																	// Model matrix (uniform input)
 uniform mat4 view;																	// View matrix (uniform input)
 uniform mat4 projection;															// Projection matrix (uniform input)
+uniform float spriteSize;															// World-space radius of the dot
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos.x, aPos.y, aPos.z, 1.0);	// Map the input vec3 to a vec4 and set it to gl_Position. 
-	VertexColor = vec4(aVertexColor, 1.0);
-}
\ No newline at end of file
+	vec4 center = view * vec4(aLightPosition, 1.0);
+	gl_Position = projection * (center + vec4(aCorner * spriteSize, 0.0, 0.0));	// Expand in view space so the sprite faces the camera
+
+	Corner = aCorner;
+	LightColor = aLightColor / max(max(aLightColor.r, aLightColor.g), max(aLightColor.b, 1e-4));	// Dim lights are drawn at full brightness
+}
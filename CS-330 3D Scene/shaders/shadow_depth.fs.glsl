@@ -0,0 +1,5 @@
+#version 330 core
+// depth only: the rasterizer writes the depth a directional shadow map or the depth pre-pass needs
+void main()
+{
+}
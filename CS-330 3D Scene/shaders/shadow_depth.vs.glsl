@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out vec3 FragPos;
+
+uniform mat4 lightSpace;															// light projection * light view
+uniform mat4 model;
+void main()
+{
+	vec4 world = model * vec4(aPos, 1.0);
+	FragPos = world.xyz;
+	gl_Position = lightSpace * world;
+}
@@ -0,0 +1,12 @@
+#version 330 core
+in vec3 FragPos;
+
+uniform vec3 lightPosition;
+uniform float farPlane;
+
+// point light shadows store distance from the light, which is the same on every
+// face of the cube map, rather than each face's projected depth
+void main()
+{
+	gl_FragDepth = length(FragPos - lightPosition) / farPlane;
+}
@@ -1,86 +1,57 @@
 #version 330 core
+// uber-shader: features are switched on by #defines inserted after the #version line
+// (see permutations.h)
+//	SPECULAR_MAP		scale specular light by specularMap
+//	CLUSTERED_LIGHTS	add the cluster grid's point lights
+//	FOG					blend toward fogColor with view distance
+//	BLINN_PHONG			halfway-vector specular instead of Phong's reflection vector
+//	SHADOWS				shadow the point and directional lights
+//	BAKED_LIGHTING		directional light diffuse and ambient occlusion from a lightmap
+//	SH_AMBIENT			ambient light from spherical harmonics instead of a constant
+//	REFLECTIONS			add the nearest reflection probe's surroundings
+// the lighting itself is the kernel in lighting.glsl, inserted ahead of this source
 in vec2 TexCoord;
 in vec3 FragPos;
 in vec3 Normal;
 out vec4 FragColor;
 
-uniform float ambientStrength;
-
-struct PointLight {
-	vec3 position;
-	vec3 color;
-};
-uniform PointLight pointLight;
-
-struct DirectionalLight {
-	vec3 direction;
-	vec3 color;
-};
-uniform DirectionalLight dirLight;
-
-uniform vec3 attenCoeff = vec3(1.0, 0.0, 0.0);
-
 uniform float specularStrength;
-uniform vec3 viewPos;
 uniform sampler2D aTexture;
+#ifdef SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
 
-vec3 CalcPointLight(PointLight light) {
-	// calculate attenuation coefficient based on distance from light
-	float lightDistance = length(light.position - FragPos);
-	float attenuation = 1.0 / (attenCoeff.x + attenCoeff.y * lightDistance + attenCoeff.z * (lightDistance * lightDistance));
-
-	// calculate ambient lighting
-	vec3 ambient = light.color * ambientStrength;
-
-	// calculate diffuse lighting
-	vec3 norm = normalize(Normal);								// normalize Normal vector incase does not already
-																	// have a magnitude of 1
-	vec3 lightDir = normalize(light.position - FragPos);		// calculate direction of ray hitting fragment and
-																	// normalize the result
-	float diff = max(dot(norm, lightDir), 0.0);					// calculate how bright the fragment should be based
-																	// on the angle between the normal and ray of light
-	vec3 diffuse = diff * light.color;
-
-	// calculate specular lighting
-	vec3 viewDir = normalize(viewPos - FragPos);				// calculate view direction and normalize
-	vec3 reflectDir = reflect(-lightDir, norm);					// calculate direction of reflected light
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);	// calculate specular constant
-
-	vec3 specular = specularStrength * spec * light.color;
-	
-	// adjust for attenuation
-	diffuse *= attenuation;
-	specular *= attenuation;
-
-	return (ambient + diffuse + specular);
-}
-
-vec3 CalcDirLight(DirectionalLight light) {
-	// calculate light direction
-	vec3 lightDir = normalize(-light.direction);
-
-	// calculate ambient lighting
-	vec3 ambient = light.color * ambientStrength;
-
-	// calculate diffuse lighting
-	vec3 norm = normalize(Normal);								// normalize Normal vector incase does not already
-																	// have a magnitude of 1
-	float diff = max(dot(norm, lightDir), 0.0);					// calculate how bright the fragment should be based
-																	// on the angle between the normal and ray of light
-	vec3 diffuse = diff * light.color;
-
-	// calculate specular lighting
-	vec3 viewDir = normalize(viewPos - FragPos);				// calculate view direction and normalize
-	vec3 reflectDir = reflect(-lightDir, norm);					// calculate direction of reflected light
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);	// calculate specular constant
-
-	vec3 specular = specularStrength * spec * light.color;
-
-	return (ambient + diffuse + specular);
-}
+#ifdef BAKED_LIGHTING
+in vec2 LightmapCoord;
+uniform sampler2D lightmap;						// rgb: directional light diffuse per unit light color, a: ambient occlusion
+#endif
 
 void main()
 {
-	// calculate fragment color
-	FragColor = vec4(CalcPointLight(pointLight) + CalcDirLight(dirLight), 1.0) * texture(aTexture, TexCoord);
-}
\ No newline at end of file
+	worldPos = FragPos;
+	norm = normalize(Normal);									// normalize Normal vector incase does not already
+																	// have a magnitude of 1
+	viewDir = normalize(viewPos - worldPos);
+	hasSpecular = specularStrength > 0.0;
+#ifdef SPECULAR_MAP
+	specularScale = vec3(specularStrength * texture(specularMap, TexCoord).r);	// One channel, as in gbuffer.fs.glsl
+#else
+	specularScale = vec3(specularStrength);
+#endif
+
+	// calculate fragment color: ambient once, then each light's diffuse and specular
+	vec3 lighting = CalcAmbient();
+#ifdef BAKED_LIGHTING
+	baked = texture(lightmap, LightmapCoord);
+	lighting *= baked.a;
+#endif
+	lighting += CalcPointLight(pointLight) + CalcDirLight(dirLight);
+#ifdef CLUSTERED_LIGHTS
+	lighting += CalcClusteredLights();
+#endif
+#ifdef REFLECTIONS
+	lighting += CalcReflection();
+#endif
+	FragColor = vec4(lighting, 1.0) * texture(aTexture, TexCoord);
+	FragColor.rgb = ApplyFog(FragColor.rgb);
+}
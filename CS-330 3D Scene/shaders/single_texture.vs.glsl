@@ -6,15 +6,29 @@ layout (location = 2) in vec2 aTexCoord;
 out vec2 TexCoord;																	// Define the output parameter (taken by the fragment shader to texture the fragment).
 out vec3 FragPos;
 out vec3 Normal;
+invariant gl_Position;																// Bit-identical to the depth pre-pass (depth_prepass.vs.glsl)
 
-uniform mat4 model;																	// Model matrix (uniform input)
 uniform mat4 view;																	// View matrix (uniform input)
 uniform mat4 projection;															// Projection matrix (uniform input)
+#ifdef INSTANCED
+layout (location = 3) in mat4 aModel;												// Per-instance model matrix (locations 3-6)
+#define model aModel
+#define normalModel mat3(aModel)													// Instances are uniformly scaled, so no inverse transpose is needed
+#else
+uniform mat4 model;																	// Model matrix (uniform input)
 uniform mat3 normalModel;															// Model matrix for normals
+#endif
+#ifdef BAKED_LIGHTING
+layout (location = 7) in vec2 aLightmapCoord;										// Second UV set, generated by the lightmap baker
+out vec2 LightmapCoord;
+#endif
 void main()
 {
 	gl_Position = projection * view * model * vec4(aPos.x, aPos.y, aPos.z, 1.0);	// Map the input vec3 to a vec4 and set it to gl_Position. 
 	TexCoord = aTexCoord;
 	FragPos = vec3(model * vec4(aPos, 1.0));
 	Normal = vec3(normalModel * vec3(aNorm));
+#ifdef BAKED_LIGHTING
+	LightmapCoord = aLightmapCoord;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#version 330 core
+in vec2 TexCoord;
+out vec2 Occlusion;																	// unoccluded fraction, linear view depth (0 where nothing was drawn)
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform sampler2D history;															// last frame's Occlusion
+uniform mat4 projection;
+uniform mat4 inverseProjection;
+uniform mat4 view;
+uniform mat4 previousProjection;
+uniform mat4 viewToPreviousView;
+
+uniform vec3 kernel[16];															// hemisphere around +Z, see ssao::kernel()
+uniform int sampleCount;
+uniform float radius;
+uniform float bias;
+uniform float intensity;
+uniform float historyWeight;														// 0 when there is no history
+uniform float frameAngle;
+
+// octahedral decoding, as in deferred_lighting.fs.glsl
+vec3 DecodeNormal(vec2 encoded) {
+	encoded = encoded * 2.0 - 1.0;
+	vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+	return normalize(n);
+}
+
+vec3 ViewPosition(vec2 uv, float depth) {
+	vec4 position = inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return position.xyz / position.w;
+}
+
+void main()
+{
+	float depth = textureLod(gDepth, TexCoord, 0.0).r;
+	if (depth == 1.0) {
+		Occlusion = vec2(1.0, 0.0);													// nothing was drawn here
+		return;
+	}
+
+	vec3 position = ViewPosition(TexCoord, depth);
+	vec3 normal = normalize(mat3(view) * DecodeNormal(textureLod(gNormal, TexCoord, 0.0).rg));
+
+	// rotate the kernel per pixel (interleaved gradient noise) and per frame
+	float noise = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+	float angle = 6.2831853 * noise + frameAngle;
+	vec3 random = vec3(cos(angle), sin(angle), 0.0);
+	vec3 tangent = random - normal * dot(random, normal);
+	if (dot(tangent, tangent) < 1e-4)
+		tangent = vec3(-random.y, random.x, 0.0);									// random happened to be along the normal
+	tangent = normalize(tangent);
+	mat3 tbn = mat3(tangent, cross(normal, tangent), normal);
+
+	float occlusion = 0.0;
+	for (int i = 0; i < sampleCount; ++i) {
+		vec3 samplePosition = position + tbn * kernel[i] * radius;
+		vec4 clip = projection * vec4(samplePosition, 1.0);
+		vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+		if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))
+			continue;																// off screen: unoccluded
+
+		float sceneDepth = ViewPosition(uv, textureLod(gDepth, uv, 0.0).r).z;
+		float range = smoothstep(0.0, 1.0, radius / abs(position.z - sceneDepth));	// ignore geometry far in front
+		occlusion += (sceneDepth >= samplePosition.z + bias ? 1.0 : 0.0) * range;
+	}
+	float ao = pow(1.0 - occlusion / float(sampleCount), intensity);
+
+	// blend with last frame's result where it saw the same surface
+	vec4 previousPosition = viewToPreviousView * vec4(position, 1.0);
+	vec4 previousClip = previousProjection * previousPosition;
+	vec2 previousUV = previousClip.xy / previousClip.w * 0.5 + 0.5;
+	if (historyWeight > 0.0 && all(greaterThanEqual(previousUV, vec2(0.0))) && all(lessThanEqual(previousUV, vec2(1.0)))) {
+		vec2 previous = textureLod(history, previousUV, 0.0).rg;
+		float previousDepth = -previousPosition.z;
+		if (abs(previous.g - previousDepth) < 0.05 * previousDepth)
+			ao = mix(ao, previous.r, historyWeight);
+	}
+
+	Occlusion = vec2(ao, -position.z);
+}
@@ -0,0 +1,33 @@
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+
+uniform sampler2D scene;
+uniform vec2 uvScale;																// Rendered size / target texture size
+uniform vec2 texelSize;																// 1 / target texture size
+uniform float sharpness;															// 0 for plain bilinear
+
+void main()
+{
+	vec2 uvMin = 0.5 * texelSize;
+	vec2 uvMax = uvScale - 0.5 * texelSize;											// Never filter in texels outside the rendered area
+	vec2 uv = clamp(TexCoord * uvScale, uvMin, uvMax);
+	vec3 color = texture(scene, uv).rgb;
+
+	if (sharpness > 0.0) {
+		/**
+		 * Unsharp mask against the four neighbours, clamped to their range so edges do
+		 * not ring.
+		 */
+		vec3 n = texture(scene, clamp(uv + vec2(0.0, texelSize.y), uvMin, uvMax)).rgb;
+		vec3 s = texture(scene, clamp(uv - vec2(0.0, texelSize.y), uvMin, uvMax)).rgb;
+		vec3 e = texture(scene, clamp(uv + vec2(texelSize.x, 0.0), uvMin, uvMax)).rgb;
+		vec3 w = texture(scene, clamp(uv - vec2(texelSize.x, 0.0), uvMin, uvMax)).rgb;
+		vec3 low = min(color, min(min(n, s), min(e, w)));
+		vec3 high = max(color, max(max(n, s), max(e, w)));
+		vec3 blur = (n + s + e + w) * 0.25;
+		color = clamp(color + (color - blur) * sharpness, low, high);
+	}
+
+	FragColor = vec4(color, 1.0);
+}
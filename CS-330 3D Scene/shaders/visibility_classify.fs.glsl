@@ -0,0 +1,19 @@
+#version 330 core
+uniform usampler2D visibilityBuffer;
+uniform samplerBuffer drawData;													// 6 texels per draw, material index in the w of the fourth
+uniform int triangleBits;
+
+// write each pixel's material as its depth, so each material's resolve pass can be
+// early depth tested down to its own pixels
+void main()
+{
+	uint id = texelFetch(visibilityBuffer, ivec2(gl_FragCoord.xy), 0).r;
+	if (id == 0xFFFFFFFFu) {
+		gl_FragDepth = 1.0;														// nothing was drawn here: no pass matches
+		return;
+	}
+
+	int draw = int(id >> uint(triangleBits));
+	float material = texelFetch(drawData, draw * 6 + 3).w;
+	gl_FragDepth = (material + 1.0) / 1024.0;
+}
@@ -0,0 +1,9 @@
+#version 330 core
+out uint Visibility;															// R32UI: draw and triangle (see visibility.h)
+
+uniform uint drawID;															// already shifted past the triangle bits
+
+void main()
+{
+	Visibility = drawID | uint(gl_PrimitiveID);									// triangles of a glDrawArrays() call count up from 0
+}
@@ -0,0 +1,324 @@
+/**
+ * "shadows.cpp" - Implementations for cached shadow mapping. Function prototypes
+ *		defined in "shadows.h".
+ */
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "shadows.h"
+
+namespace shadows {
+	/**
+	 * Cube map face order matches GL_TEXTURE_CUBE_MAP_POSITIVE_X + face.
+	 */
+	static const glm::vec3 face_directions[6] = {
+		glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.f, 0.f),
+		glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, -1.f, 0.f),
+		glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f),
+	};
+	static const glm::vec3 face_ups[6] = {
+		glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f),
+		glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f),
+		glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f),
+	};
+
+	static unsigned int create_cascade_array(int size, int layers) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);		// Linear filtering of a compared texture is a free 2x2 PCF
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		const float border[4] = { 1.f, 1.f, 1.f, 1.f };								// Outside the map is unshadowed
+		glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		return texture;
+	}
+
+	static unsigned int create_cube(int size) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+		for (int face = 0; face < 6; ++face)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		return texture;
+	}
+
+	/**
+	 * Attach one cascade layer or cube face of a depth texture to the bound framebuffer.
+	 */
+	static void attach_depth(GLenum target, unsigned int texture, int layer, bool cube) {
+		if (cube)
+			glFramebufferTexture2D(target, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + layer, texture, 0);
+		else
+			glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+	}
+
+	void ShadowMaps::init(const ShadowSettings& shadow_settings) {
+		settings = shadow_settings;
+		settings.cascades = std::max(1, std::min(settings.cascades, MAX_CASCADES));
+
+		dir_static = create_cascade_array(settings.map_size, settings.cascades);
+		dir_live = create_cascade_array(settings.map_size, settings.cascades);
+		point_static = create_cube(settings.cube_size);
+		point_live = create_cube(settings.cube_size);
+
+		glGenFramebuffers(1, &depth_framebuffer);
+		glGenFramebuffers(1, &copy_framebuffer);
+		for (unsigned int framebuffer : { depth_framebuffer, copy_framebuffer }) {
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			glDrawBuffer(GL_NONE);				// Depth only
+			glReadBuffer(GL_NONE);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		depth_shader = new Shader("shaders/shadow_depth.vs.glsl", "shaders/shadow_depth.fs.glsl");
+		distance_shader = new Shader("shaders/shadow_depth.vs.glsl", "shaders/shadow_distance.fs.glsl");
+
+		invalidate_static();
+	}
+
+	void ShadowMaps::invalidate_static() {
+		for (cascade_key& key : cascade_keys)
+			key.valid = false;
+		point_key_valid = false;
+	}
+
+	/**
+	 * Split the view distance into cascades and fit each to a sphere around its slice
+	 * of the view frustum. The sphere only depends on the projection, so turning the
+	 * camera leaves it unchanged, and its center is snapped to a grid of a quarter of
+	 * its radius in light space, so moving the camera only changes a cascade once it
+	 * crosses a grid line. keys_changed[i] is set for every cascade whose cached
+	 * static depth no longer matches.
+	 */
+	void ShadowMaps::fit_cascades(const DirectionalLight& dir_light, const glm::mat4& view, const glm::mat4& projection, bool keys_changed[]) {
+		bool orthographic = projection[3][3] == 1.f;
+		float near_plane, far_plane;
+		if (orthographic) {
+			near_plane = (projection[3][2] + 1.f) / projection[2][2];
+			far_plane = (projection[3][2] - 1.f) / projection[2][2];
+		}
+		else {
+			near_plane = projection[3][2] / (projection[2][2] - 1.f);
+			far_plane = projection[3][2] / (projection[2][2] + 1.f);
+		}
+		float distance = std::min(far_plane, settings.shadow_distance);
+
+		/**
+		 * Corners of the whole view frustum in world space; any depth slice is a linear
+		 * blend between the near and far corners.
+		 */
+		glm::mat4 inverse_view_projection = glm::inverse(projection * view);
+		glm::vec3 near_corners[4], far_corners[4];
+		for (int i = 0; i < 4; ++i) {
+			glm::vec2 ndc = glm::vec2((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f);
+			glm::vec4 near_corner = inverse_view_projection * glm::vec4(ndc, -1.f, 1.f);
+			glm::vec4 far_corner = inverse_view_projection * glm::vec4(ndc, 1.f, 1.f);
+			near_corners[i] = glm::vec3(near_corner) / near_corner.w;
+			far_corners[i] = glm::vec3(far_corner) / far_corner.w;
+		}
+
+		glm::vec3 direction = glm::normalize(dir_light.direction);
+		glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+		glm::mat4 light_view = glm::lookAt(glm::vec3(0.f), direction, up);
+
+		float slice_near = near_plane;
+		for (int cascade = 0; cascade < settings.cascades; ++cascade) {
+			float fraction = (float)(cascade + 1) / settings.cascades;
+			float logarithmic = near_plane * std::pow(distance / near_plane, fraction);
+			float uniform = near_plane + (distance - near_plane) * fraction;
+			float slice_far = settings.split_lambda * logarithmic + (1.f - settings.split_lambda) * uniform;
+			cascade_splits[cascade] = slice_far;
+
+			glm::vec3 corners[8];
+			glm::vec3 center = glm::vec3(0.f);
+			for (int i = 0; i < 4; ++i) {
+				corners[i] = glm::mix(near_corners[i], far_corners[i], (slice_near - near_plane) / (far_plane - near_plane));
+				corners[i + 4] = glm::mix(near_corners[i], far_corners[i], (slice_far - near_plane) / (far_plane - near_plane));
+			}
+			for (const glm::vec3& corner : corners)
+				center += corner * 0.125f;
+
+			float radius = 0.f;
+			for (const glm::vec3& corner : corners)
+				radius = std::max(radius, glm::length(corner - center));
+			radius = std::ceil(radius * 64.f) / 64.f;	// Ignore float noise between frames
+
+			/**
+			 * Snap the center in light space. The box grows by one grid step so the
+			 * sphere stays covered wherever its real center lies within the step.
+			 */
+			float step = radius * 0.25f;
+			glm::vec3 light_center = glm::vec3(light_view * glm::vec4(center, 1.f));
+			light_center = glm::floor(light_center / step) * step;
+			float half_size = radius + step;
+
+			cascade_key key;
+			key.direction = direction;
+			key.center = light_center;
+			key.half_size = half_size;
+			key.valid = true;
+
+			cascade_key& cached = cascade_keys[cascade];
+			keys_changed[cascade] = !cached.valid || cached.direction != key.direction || cached.center != key.center || cached.half_size != key.half_size;
+			cached = key;
+
+			/**
+			 * The light looks down -z; casters up to caster_margin in front of the
+			 * cascade still cast into it.
+			 */
+			const float caster_margin = 20.f;
+			glm::mat4 light_projection = glm::ortho(light_center.x - half_size, light_center.x + half_size,
+				light_center.y - half_size, light_center.y + half_size,
+				-light_center.z - half_size - caster_margin, -light_center.z + half_size);
+			cascade_matrices[cascade] = light_projection * light_view;
+
+			slice_near = slice_far;
+		}
+	}
+
+	void ShadowMaps::draw_casters(const std::vector<Model>& casters, Shader& shader) {
+		for (const Model& caster : casters) {
+			shader.setMat4("model", caster.model);
+			glBindVertexArray(caster.position_VAO != 0 ? caster.position_VAO : caster.VAO);
+			glDrawArrays(GL_TRIANGLES, 0, caster.number_of_vertices);
+		}
+		glBindVertexArray(0);
+	}
+
+	void ShadowMaps::copy_layer(unsigned int source, unsigned int destination, int layer, bool cube) {
+		int size = cube ? settings.cube_size : settings.map_size;
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_framebuffer);
+		attach_depth(GL_READ_FRAMEBUFFER, source, layer, cube);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depth_framebuffer);
+		attach_depth(GL_DRAW_FRAMEBUFFER, destination, layer, cube);
+		glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, depth_framebuffer);
+	}
+
+	void ShadowMaps::update(const std::vector<Model>& static_casters, const std::vector<Model>& dynamic_casters,
+		const DirectionalLight& dir_light, const RadiantLight& point_light, const glm::mat4& view, const glm::mat4& projection) {
+		last_stats = ShadowStats();
+
+		bool cascade_changed[MAX_CASCADES];
+		fit_cascades(dir_light, view, projection, cascade_changed);
+
+		float far_plane = settings.point_far;
+		bool point_changed = !point_key_valid || point_key != point_light.position;
+		point_key = point_light.position;
+		point_key_valid = true;
+
+		bool any_static = point_changed;
+		for (int cascade = 0; cascade < settings.cascades; ++cascade)
+			any_static = any_static || cascade_changed[cascade];
+		dir_has_dynamic = !dynamic_casters.empty();
+		point_has_dynamic = !dynamic_casters.empty();
+		if (!any_static && dynamic_casters.empty())
+			return;								// Nothing moved: every cached map is still valid
+
+		/**
+		 * Save the state the passes below change.
+		 */
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		GLint framebuffer = 0;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+		GLint polygon_mode[2];
+		glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.f, 4.f);				// Slope-scaled bias against shadow acne
+		glBindFramebuffer(GL_FRAMEBUFFER, depth_framebuffer);
+
+		/**
+		 * Directional cascades.
+		 */
+		glViewport(0, 0, settings.map_size, settings.map_size);
+		depth_shader->use();
+		for (int cascade = 0; cascade < settings.cascades; ++cascade) {
+			depth_shader->setMat4("lightSpace", cascade_matrices[cascade]);
+
+			if (cascade_changed[cascade]) {
+				attach_depth(GL_FRAMEBUFFER, dir_static, cascade, false);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				draw_casters(static_casters, *depth_shader);
+				++last_stats.static_passes;
+			}
+
+			if (!dynamic_casters.empty()) {
+				copy_layer(dir_static, dir_live, cascade, false);
+				depth_shader->use();
+				draw_casters(dynamic_casters, *depth_shader);
+				++last_stats.dynamic_passes;
+			}
+		}
+
+		/**
+		 * Point light cube faces, storing distance from the light.
+		 */
+		glViewport(0, 0, settings.cube_size, settings.cube_size);
+		glm::mat4 face_projection = glm::perspective(glm::radians(90.f), 1.f, 0.05f, far_plane);
+		distance_shader->use();
+		distance_shader->setVec3("lightPosition", point_light.position);
+		distance_shader->setFloat("farPlane", far_plane);
+		for (int face = 0; face < 6; ++face) {
+			glm::mat4 face_view = glm::lookAt(point_light.position, point_light.position + face_directions[face], face_ups[face]);
+			distance_shader->setMat4("lightSpace", face_projection * face_view);
+
+			if (point_changed) {
+				attach_depth(GL_FRAMEBUFFER, point_static, face, true);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				draw_casters(static_casters, *distance_shader);
+				++last_stats.static_passes;
+			}
+
+			if (!dynamic_casters.empty()) {
+				copy_layer(point_static, point_live, face, true);
+				distance_shader->use();
+				draw_casters(dynamic_casters, *distance_shader);
+				++last_stats.dynamic_passes;
+			}
+		}
+
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+	}
+
+	void ShadowMaps::bind(Shader& shader) const {
+		glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, dir_has_dynamic ? dir_live : dir_static);
+		glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + 1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, point_has_dynamic ? point_live : point_static);
+		glActiveTexture(GL_TEXTURE0);
+
+		shader.setInt("dirShadowMap", FIRST_TEXTURE_UNIT);
+		shader.setInt("pointShadowMap", FIRST_TEXTURE_UNIT + 1);
+		glUniformMatrix4fv(glGetUniformLocation(shader.ID, "dirShadowMatrices"), settings.cascades, GL_FALSE, &cascade_matrices[0][0][0]);
+		glUniform4fv(glGetUniformLocation(shader.ID, "cascadeSplits"), 1, cascade_splits);
+		shader.setInt("cascadeCount", settings.cascades);
+		shader.setFloat("pointShadowFar", settings.point_far);
+		shader.setInt("pcfRadius", settings.pcf_radius);
+	}
+}
@@ -0,0 +1,106 @@
+/**
+ * "shadows.h" - Cached shadow maps for the directional light (optionally split into
+ *		cascades over the view distance) and the point light (a distance cube map).
+ *		Static casters are rendered into their own maps, which are only redrawn when a
+ *		light, a cascade's coverage or the static casters change; cascades are fitted
+ *		to rotation-invariant spheres snapped to a coarse light-space grid so a still or
+ *		slowly moving camera keeps hitting the cache. Dynamic casters are drawn each
+ *		frame on top of a copy of the static depth, so a frame where nothing moved does
+ *		no shadow rendering at all. Function implementations defined in "shadows.cpp".
+ */
+#pragma once
+#ifndef __SHADOWS_H__
+#define __SHADOWS_H__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "lights.h"
+#include "models.h"
+#include "shader.h"
+
+namespace shadows {
+	const int FIRST_TEXTURE_UNIT = 7;			// Directional cascades on this unit, point light cube map on the next
+	const int MAX_CASCADES = 4;
+
+	/**
+	 * Shadow map configuration. Everything but pcf_radius is fixed at init().
+	 */
+	struct ShadowSettings {
+		int map_size = 2048;					// Directional map size per cascade, in texels
+		int cascades = 3;						// 1 for a single directional map
+		float shadow_distance = 20.f;			// View depth the cascades cover; farther fragments are unshadowed
+		float split_lambda = 0.75f;				// 0 for evenly spaced cascade splits, 1 for logarithmic
+		int cube_size = 512;					// Point light cube map face size, in texels
+		float point_far = 10.f;					// Point light shadow range
+		int pcf_radius = 1;						// Percentage-closer filter: (2r+1)^2 taps for cascades, 0 for one tap
+	};
+
+	/**
+	 * Shadow map passes done by the most recent update().
+	 */
+	struct ShadowStats {
+		unsigned int static_passes = 0;			// Cascades or cube faces whose static depth was redrawn
+		unsigned int dynamic_passes = 0;		// Cascades or cube faces dynamic casters were drawn into
+	};
+
+	class ShadowMaps {
+	public:
+		ShadowSettings settings;
+
+		void init(const ShadowSettings& shadow_settings = ShadowSettings());	// Create the maps and shaders; requires a GL context
+		void invalidate_static();				// Call when a static caster moves, appears or disappears
+
+		/**
+		 * Bring the maps up to date for this frame's lights and camera. Restores the
+		 * bound framebuffer and viewport afterwards.
+		 */
+		void update(const std::vector<Model>& static_casters, const std::vector<Model>& dynamic_casters,
+			const DirectionalLight& dir_light, const RadiantLight& point_light, const glm::mat4& view, const glm::mat4& projection);
+
+		/**
+		 * Bind the maps to texture units FIRST_TEXTURE_UNIT and FIRST_TEXTURE_UNIT + 1 and
+		 * set the shadow uniforms of shader, a variant compiled with SHADOWS (see
+		 * permutations.h).
+		 */
+		void bind(Shader& shader) const;
+
+		const ShadowStats& stats() const { return last_stats; }
+		const glm::mat4& cascade_matrix(int cascade) const { return cascade_matrices[cascade]; }	// Light projection * view of a cascade
+
+	private:
+		/**
+		 * What a cached static map was rendered for. The map is reused while this stays
+		 * the same.
+		 */
+		struct cascade_key {
+			glm::vec3 direction = glm::vec3(0.f);
+			glm::vec3 center = glm::vec3(0.f);	// Snapped, in light space
+			float half_size = 0.f;
+			bool valid = false;
+		};
+
+		unsigned int depth_framebuffer = 0;
+		unsigned int copy_framebuffer = 0;		// Read framebuffer for static to live copies
+		unsigned int dir_static = 0, dir_live = 0;			// Depth 2D arrays, one layer per cascade
+		unsigned int point_static = 0, point_live = 0;		// Depth cube maps
+		bool dir_has_dynamic = false;			// Sample the live maps instead of the static ones
+		bool point_has_dynamic = false;
+
+		Shader* depth_shader = nullptr;
+		Shader* distance_shader = nullptr;
+
+		cascade_key cascade_keys[MAX_CASCADES];
+		glm::mat4 cascade_matrices[MAX_CASCADES];
+		float cascade_splits[MAX_CASCADES] = { 0.f };
+		glm::vec3 point_key = glm::vec3(0.f);
+		bool point_key_valid = false;
+		ShadowStats last_stats;
+
+		void fit_cascades(const DirectionalLight& dir_light, const glm::mat4& view, const glm::mat4& projection, bool keys_changed[]);
+		void draw_casters(const std::vector<Model>& casters, Shader& shader);
+		void copy_layer(unsigned int source, unsigned int destination, int layer, bool cube);
+	};
+}
+#endif//__SHADOWS_H__
@@ -0,0 +1,172 @@
+/**
+ * "ssao.cpp" - Implementations for screen-space ambient occlusion. Function prototypes
+ *		defined in "ssao.h".
+ */
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "ssao.h"
+
+namespace ssao {
+	/**
+	 * A Fibonacci spiral over the hemisphere for even directions, with lengths growing
+	 * quadratically from 0.1 to 1.
+	 */
+	std::vector<glm::vec3> kernel(int samples) {
+		std::vector<glm::vec3> points;
+		const float golden_angle = 2.39996323f;
+		for (int i = 0; i < samples; ++i) {
+			float t = (i + 0.5f) / samples;
+			float z = 1.f - t * 0.9f;							// Never flat along the surface
+			float r = std::sqrt(1.f - z * z);
+			float phi = golden_angle * i;
+			float length = 0.1f + 0.9f * t * t;
+			points.push_back(glm::vec3(r * std::cos(phi), r * std::sin(phi), z) * length);
+		}
+		return points;
+	}
+
+	void AmbientOcclusion::init() {
+		shader = new Shader("shaders/fullscreen.vs.glsl", "shaders/ssao.fs.glsl");
+		shader->use();
+		shader->setInt("gDepth", 0);
+		shader->setInt("gNormal", 1);
+		shader->setInt("history", 2);
+
+		std::vector<glm::vec3> points = kernel(MAX_SAMPLES);
+		for (int i = 0; i < MAX_SAMPLES; ++i)
+			shader->setVec3("kernel[" + std::to_string(i) + "]", points[i]);
+
+		glGenVertexArrays(1, &empty_VAO);
+		glGenQueries(FRAMES_IN_FLIGHT, queries);
+	}
+
+	void AmbientOcclusion::resize(int width, int height) {
+		if (framebuffers[0] != 0) {
+			glDeleteFramebuffers(2, framebuffers);
+			glDeleteTextures(2, targets);
+		}
+		last_stats.width = width;
+		last_stats.height = height;
+		history_valid = false;
+
+		glGenTextures(2, targets);
+		glGenFramebuffers(2, framebuffers);
+		for (int i = 0; i < 2; ++i) {
+			glBindTexture(GL_TEXTURE_2D, targets[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);	// Depth must never be interpolated across edges
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets[i], 0);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				std::cerr << "ERROR::FRAMEBUFFER::SSAO::INCOMPLETE" << std::endl;
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	/**
+	 * Read back every pass whose query has finished, oldest first. Nothing here waits
+	 * on the GPU.
+	 */
+	void AmbientOcclusion::fetch_results() {
+		for (int i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+			int query = (current_query + i) % FRAMES_IN_FLIGHT;	// current_query is the oldest
+			if (!pending[query])
+				continue;
+
+			GLuint available = 0;
+			glGetQueryObjectuiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+
+			GLuint64 time_ns = 0;
+			glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &time_ns);
+			last_stats.gpu_ms = time_ns * 1e-6;
+			pending[query] = false;
+		}
+	}
+
+	void AmbientOcclusion::compute(unsigned int depth_texture, unsigned int normal_texture, int width, int height, const glm::mat4& projection, const glm::mat4& view) {
+		fetch_results();
+
+		int divisor = std::max(1, settings.resolution_divisor);
+		int ao_width = (width + divisor - 1) / divisor;
+		int ao_height = (height + divisor - 1) / divisor;
+		if (ao_width != last_stats.width || ao_height != last_stats.height)
+			resize(ao_width, ao_height);
+
+		GLint framebuffer, viewport[4];
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+		glGetIntegerv(GL_VIEWPORT, viewport);
+
+		current = 1 - current;
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[current]);
+		glViewport(0, 0, ao_width, ao_height);
+
+		/**
+		 * Rotate the kernel by the golden angle every frame so consecutive frames sample
+		 * different directions, and reproject from this view to the previous one.
+		 */
+		shader->use();
+		shader->setMat4("projection", projection);
+		shader->setMat4("inverseProjection", glm::inverse(projection));
+		shader->setMat4("view", view);
+		shader->setMat4("previousProjection", previous_projection);
+		shader->setMat4("viewToPreviousView", previous_view * glm::inverse(view));
+		shader->setInt("sampleCount", std::min(std::max(settings.samples, 1), MAX_SAMPLES));
+		shader->setFloat("radius", settings.radius);
+		shader->setFloat("bias", settings.bias);
+		shader->setFloat("intensity", settings.intensity);
+		shader->setFloat("historyWeight", history_valid ? settings.history_weight : 0.f);
+		shader->setFloat("frameAngle", std::fmod(frame_index++ * 2.39996323f, 6.28318531f));
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, depth_texture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, normal_texture);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, targets[1 - current]);
+		glActiveTexture(GL_TEXTURE0);
+
+		/**
+		 * The pass replaces every pixel and must not be depth tested or clipped by
+		 * wireframe mode.
+		 */
+		GLint polygon_mode[2];
+		glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glDisable(GL_DEPTH_TEST);
+
+		glBeginQuery(GL_TIME_ELAPSED, queries[current_query]);
+		glBindVertexArray(empty_VAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glEndQuery(GL_TIME_ELAPSED);
+		pending[current_query] = true;					// Still unread after FRAMES_IN_FLIGHT passes: overwritten rather than waited on
+		current_query = (current_query + 1) % FRAMES_IN_FLIGHT;
+
+		glEnable(GL_DEPTH_TEST);
+		glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+		previous_projection = projection;
+		previous_view = view;
+		history_valid = true;
+	}
+
+	void AmbientOcclusion::bind(const Shader& shader) const {
+		shader.setVec2("aoSize", glm::vec2((float)last_stats.width, (float)last_stats.height));
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, targets[current]);
+		glActiveTexture(GL_TEXTURE0);
+	}
+}
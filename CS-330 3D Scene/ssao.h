@@ -0,0 +1,94 @@
+/**
+ * "ssao.h" - Screen-space ambient occlusion for deferred shading. A pass at half (or
+ *		quarter) resolution reads the G-buffer's depth and normals (see deferred.h),
+ *		tests a small hemisphere of view-space samples around each pixel against the
+ *		depth buffer and blends the result with the previous frame's, reprojected, so
+ *		the kernel's per-frame rotation accumulates into many more samples than any
+ *		one frame pays for. The lighting pass upsamples it with depth-aware bilateral
+ *		weights and darkens only ambient light with it.
+ *
+ *		Budget at the defaults (half resolution, 8 samples): 11 texture fetches per
+ *		half-resolution pixel (depth, normal, 8 sample depths, history), i.e. under 3
+ *		per full-resolution pixel, plus 4 in the lighting pass's upsample. The pass is
+ *		timed with GL_TIME_ELAPSED queries read back without waiting on the GPU.
+ *		Function implementations defined in "ssao.cpp".
+ */
+#pragma once
+#ifndef __SSAO_H__
+#define __SSAO_H__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+namespace ssao {
+	const int TEXTURE_UNIT = 9;					// After the shadow maps (units 7-8)
+	const int MAX_SAMPLES = 16;					// Size of the shader's kernel array
+
+	struct SsaoSettings {
+		int resolution_divisor = 2;				// 2 for half, 4 for quarter resolution
+		int samples = 8;						// Hemisphere samples per pixel per frame, up to MAX_SAMPLES
+		float radius = 0.15f;					// View-space sample radius, in world units
+		float bias = 0.005f;					// Depth difference below which a sample does not occlude
+		float intensity = 1.5f;					// Exponent on the unoccluded fraction
+		float history_weight = 0.85f;			// Share of the reprojected previous result kept each frame
+	};
+
+	struct SsaoStats {
+		int width = 0;							// Size of the occlusion target
+		int height = 0;
+		double gpu_ms = 0.0;					// GPU time of the most recent pass read back; 0 before any
+	};
+
+	/**
+	 * samples points in the unit hemisphere around +Z, spread over it and packed
+	 * towards its centre so nearby geometry weighs more than distant geometry.
+	 */
+	std::vector<glm::vec3> kernel(int samples);
+
+	class AmbientOcclusion {
+	public:
+		SsaoSettings settings;
+
+		void init();							// Create the shader and queries; requires a GL context
+
+		/**
+		 * Compute this frame's occlusion from a width x height G-buffer's depth
+		 * (D24S8) and octahedral normal (RG16) textures. Restores the bound framebuffer
+		 * and viewport.
+		 */
+		void compute(unsigned int depth_texture, unsigned int normal_texture, int width, int height, const glm::mat4& projection, const glm::mat4& view);
+
+		/**
+		 * Bind the occlusion to TEXTURE_UNIT and set the upsampling uniforms of a
+		 * shader built with AMBIENT_OCCLUSION (see permutations.h).
+		 */
+		void bind(const Shader& shader) const;
+
+		const SsaoStats& stats() const { return last_stats; }
+
+	private:
+		static const int FRAMES_IN_FLIGHT = 3;
+
+		Shader* shader = nullptr;
+		unsigned int empty_VAO = 0;
+		unsigned int framebuffers[2] = { 0, 0 };
+		unsigned int targets[2] = { 0, 0 };		// RG16F: occlusion, linear view depth; ping-ponged with the history
+		int current = 0;						// Target written this frame
+		bool history_valid = false;
+		unsigned int frame_index = 0;
+		glm::mat4 previous_projection = glm::mat4(1.f);
+		glm::mat4 previous_view = glm::mat4(1.f);
+
+		unsigned int queries[FRAMES_IN_FLIGHT] = {};
+		bool pending[FRAMES_IN_FLIGHT] = {};
+		int current_query = 0;
+		SsaoStats last_stats;
+
+		void resize(int width, int height);
+		void fetch_results();
+	};
+}
+#endif//__SSAO_H__
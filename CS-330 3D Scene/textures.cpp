@@ -0,0 +1,1061 @@
+/**
+ * "textures.cpp" - Implementations for asynchronous texture loading. Function
+ *		prototypes defined in "textures.h".
+ */
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "stb_image.h"
+#include "cooker.h"
+#include "textures.h"
+
+/**
+ * EXT_texture_compression_s3tc is not in the core profile headers.
+ */
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace textures {
+	static double now_ms() {
+		using namespace std::chrono;
+		return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	void copy_flipped(const unsigned char* source, unsigned char* destination, int width, int height, int channels) {
+		size_t row_size = (size_t)width * channels;
+		for (int row = 0; row < height; ++row)
+			std::memcpy(destination + (size_t)(height - 1 - row) * row_size, source + (size_t)row * row_size, row_size);
+	}
+
+	Format choose_format(int channels, Usage usage, bool srgb) {
+		Format chosen;
+		if (usage == Usage::MASK || (channels == 1 && !srgb)) {
+			chosen.components = 1;
+			chosen.internal_format = GL_R8;
+			chosen.format = GL_RED;
+			chosen.grey = true;
+		}
+		else if (channels == 2 && !srgb) {
+			chosen.components = 2;
+			chosen.internal_format = GL_RG8;
+			chosen.format = GL_RG;
+			chosen.grey = true;
+		}
+		else {
+			chosen.components = 4;					// OpenGL 3.3 has no one- or two-channel sRGB format
+			chosen.internal_format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+			chosen.format = GL_RGBA;
+		}
+		return chosen;
+	}
+
+	static bool has_extension(const char* name) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; ++i) {
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (extension != nullptr && std::strcmp(extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	/**
+	 * A read-only mapping of a whole file, so cooked and cached levels are copied
+	 * out of the page cache without a read buffer, in whatever order they are needed.
+	 */
+	class mapped_file {
+	public:
+		explicit mapped_file(const std::string& path) {
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			LARGE_INTEGER file_size;
+			if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+				return;
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping == NULL)
+				return;
+			bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			length = bytes != nullptr ? (size_t)file_size.QuadPart : 0;
+#else
+			int descriptor = open(path.c_str(), O_RDONLY);
+			struct stat info;
+			if (descriptor < 0 || fstat(descriptor, &info) != 0 || info.st_size == 0) {
+				if (descriptor >= 0)
+					close(descriptor);
+				return;
+			}
+			void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			close(descriptor);								// The mapping keeps the file open
+			if (view == MAP_FAILED)
+				return;
+			madvise(view, (size_t)info.st_size, MADV_WILLNEED);	// Read ahead while the mip tail is copied
+			bytes = (const unsigned char*)view;
+			length = (size_t)info.st_size;
+#endif
+		}
+
+		~mapped_file() {
+#ifdef _WIN32
+			if (bytes != nullptr)
+				UnmapViewOfFile(bytes);
+			if (mapping != NULL)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+#else
+			if (bytes != nullptr)
+				munmap((void*)bytes, length);
+#endif
+		}
+
+		const unsigned char* data() const { return bytes; }
+		size_t size() const { return length; }
+
+	private:
+		const unsigned char* bytes = nullptr;
+		size_t length = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#endif
+	};
+
+	/**
+	 * Cache file layout: a 64-byte header with the key and format, a table of
+	 * levels, then each level's texels, bottom-up, 16-byte aligned.
+	 */
+	static const char cache_magic[8] = { 'T', 'E', 'X', 'C', 'A', 'C', 'H', 'E' };
+	static const uint32_t CACHE_VERSION = 1;			// Bump when the layout or mip filter changes
+	static const size_t cache_header_size = 64;
+	static const size_t cache_level_entry = 24;
+
+	struct cache_header {
+		char magic[8];
+		uint32_t version;
+		uint32_t internal_format;
+		uint32_t format;
+		uint32_t components;
+		uint64_t path_hash;
+		int64_t modified;
+		uint64_t size;
+		uint32_t usage;
+		uint32_t srgb;
+		uint32_t level_count;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(cache_header) == cache_header_size, "Cache header is not 64 bytes");
+
+	struct cache_level {
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset;
+		uint64_t size;
+	};
+	static_assert(sizeof(cache_level) == cache_level_entry, "Cache level entry is not 24 bytes");
+
+	static uint64_t hash_path(const std::string& path) {
+		uint64_t hash = 14695981039346656037ull;			// FNV-1a
+		for (char c : path) {
+			hash ^= (unsigned char)c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static std::string cache_file(const std::string& directory, const std::string& path) {
+		std::string cached = cooker::cooked_path(path);
+		cached = cached.substr(0, cached.size() - 5) + ".texcache";	// Swap ".ktx2"
+		if (directory.empty())
+			return cached;
+		size_t slash = cached.find_last_of("/\\");
+		return directory + (slash == std::string::npos ? cached : cached.substr(slash + 1));
+	}
+
+	std::vector<unsigned char> downsample(const std::vector<unsigned char>& image, int width, int height, int components) {
+		int half_width = std::max(width / 2, 1), half_height = std::max(height / 2, 1);
+		std::vector<unsigned char> half((size_t)half_width * half_height * components);
+		for (int y = 0; y < half_height; ++y) {
+			int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+			for (int x = 0; x < half_width; ++x) {
+				int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+				for (int c = 0; c < components; ++c) {
+					int sum = image[((size_t)y0 * width + x0) * components + c] + image[((size_t)y0 * width + x1) * components + c]
+						+ image[((size_t)y1 * width + x0) * components + c] + image[((size_t)y1 * width + x1) * components + c];
+					half[((size_t)y * half_width + x) * components + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		return half;
+	}
+
+	TextureLoader::TextureLoader(const LoaderSettings& loader_settings) : settings(loader_settings) {
+		unsigned int thread_count = settings.thread_count != 0 ? settings.thread_count : std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < thread_count; ++i)
+			workers.emplace_back(&TextureLoader::work, this);
+	}
+
+	TextureLoader::~TextureLoader() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		work_queued.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	unsigned int TextureLoader::load(const char* path, Usage usage) {
+		double start = now_ms();
+		++loader_stats.requested;
+
+		std::string key = normalize_path(path) + (usage == Usage::MASK ? "|mask" : "|albedo");
+		auto found = keys.find(key);
+		if (found != keys.end()) {
+			entry& loaded = registry[found->second];
+			++loaded.references;
+			loaded.last_used = frame;
+			++loader_stats.shared;
+			loader_stats.load_ms += now_ms() - start;
+			return found->second;
+		}
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);		// One level for now; uploads switch to trilinear (see min_filter())
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		const unsigned char placeholder[3] = { 128, 128, 128 };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		entry& loaded = registry[texture];
+		loaded.key = key;
+		loaded.references = 1;
+		loaded.last_used = frame;
+		keys[key] = texture;
+
+		/**
+		 * The header gives the size, so the pixel buffer can be mapped here and the
+		 * worker can decode into it without coming back to the GL thread.
+		 */
+		job added;
+		added.texture = texture;
+		bool srgb = usage == Usage::ALBEDO && settings.srgb_albedo;		// Cooked textures are linear
+		bool prepared = settings.use_cooked && !srgb && prepare_cooked(added, path);
+		if (!prepared && settings.use_cache)
+			prepared = prepare_cached(added, path, usage, srgb);
+		if (!prepared) {
+			int width, height, channels;
+			if (!stbi_info(path, &width, &height, &channels)) {
+				std::cerr << "ERROR::TEXTURE::DATA::LOADING_FAILED" << std::endl;
+				loader_stats.load_ms += now_ms() - start;
+				return texture;
+			}
+
+			added.path = path;
+			added.format = choose_format(channels, usage, srgb);
+			added.write_cache = settings.use_cache && !added.cache_path.empty();
+			for (int level_width = width, level_height = height; ; ) {
+				level l;
+				l.width = level_width;
+				l.height = level_height;
+				l.buffer_size = (size_t)level_width * level_height * added.format.components;
+				added.levels.push_back(l);
+				if (!added.write_cache || (level_width == 1 && level_height == 1))
+					break;										// Without the cache, glGenerateMipmap builds the chain
+				level_width = std::max(level_width / 2, 1);
+				level_height = std::max(level_height / 2, 1);
+			}
+		}
+
+		size_t level_count = added.levels.size();
+		added.tail = 0;
+		if (settings.progressive && level_count > 1)
+			added.tail = mip_tail(added.levels[0].width, added.levels[0].height, level_count, settings.tail_size);
+		added.resident = level_count;
+		added.unread = level_count;
+
+		loaded.floor = level_count > 1 ? mip_tail(added.levels[0].width, added.levels[0].height, level_count, settings.tail_size) : 0;
+
+		if (!map_buffers(added, level_count)) {
+			loader_stats.load_ms += now_ms() - start;
+			return texture;
+		}
+
+		jobs.push_back(added);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(&jobs.back());
+		}
+		work_queued.notify_one();
+		loader_stats.load_ms += now_ms() - start;
+
+		if (!asynchronous)
+			finish();
+		return texture;
+	}
+
+	/**
+	 * Map a pixel buffer for each of the first count levels, one buffer per level so
+	 * each can be unmapped and uploaded as soon as the worker has written it while it
+	 * still writes the larger ones. On failure every buffer is deleted again.
+	 */
+	bool TextureLoader::map_buffers(job& target, size_t count) {
+		bool mapped = true;
+		for (size_t i = 0; i < count && mapped; ++i) {
+			level& l = target.levels[i];
+			glGenBuffers(1, &l.pixel_buffer);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, l.pixel_buffer);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, l.buffer_size, NULL, GL_STREAM_DRAW);
+			l.pixels = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, l.buffer_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			mapped = l.pixels != nullptr;
+		}
+		if (!mapped) {
+			std::cerr << "ERROR::TEXTURE::PIXEL_BUFFER::MAPPING_FAILED" << std::endl;
+			for (level& l : target.levels) {
+				if (l.pixel_buffer == 0)
+					continue;
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, l.pixel_buffer);
+				if (l.pixels != nullptr)
+					glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				glDeleteBuffers(1, &l.pixel_buffer);
+				l.pixel_buffer = 0;
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return mapped;
+	}
+
+	/**
+	 * Set up a job for the cooked file of the image at path, if there is a readable
+	 * one cooked from the image as it is now; like a cache file, it is passed over
+	 * once the image's modification time or size changes. A cooked file loaded by its
+	 * own path has no image to compare. Without S3TC, BC1 and BC3 blocks are decoded
+	 * to RGBA8 by the worker; BC4 and BC5 are core as RGTC.
+	 */
+	bool TextureLoader::prepare_cooked(job& added, const char* path) {
+		std::string cooked_path = cooker::cooked_path(path);
+		cooker::CookedHeader header;
+		if (!cooker::read_header(cooked_path, header))
+			return false;
+		if (cooked_path != path) {
+			struct stat info;
+			if (stat(path, &info) != 0 || header.source_modified != (long long)info.st_mtime || header.source_size != (unsigned long long)info.st_size)
+				return false;
+		}
+
+		bool color = header.format == cooker::BlockFormat::BC1 || header.format == cooker::BlockFormat::BC3;
+		if (color && s3tc_supported < 0)
+			s3tc_supported = has_extension("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+
+		added.path = cooked_path;
+		added.cooked = true;
+		added.block_format = header.format;
+		added.expand = color && !(settings.s3tc && s3tc_supported == 1);
+		switch (header.format) {
+		case cooker::BlockFormat::BC1: added.format.internal_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+		case cooker::BlockFormat::BC3: added.format.internal_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+		case cooker::BlockFormat::BC4: added.format.internal_format = GL_COMPRESSED_RED_RGTC1; added.format.components = 1; added.format.grey = true; break;
+		case cooker::BlockFormat::BC5: added.format.internal_format = GL_COMPRESSED_RG_RGTC2; added.format.components = 2; added.format.grey = true; break;
+		}
+		if (added.expand) {
+			added.format.internal_format = GL_RGBA8;
+			added.format.format = GL_RGBA;
+		}
+
+		for (const cooker::CookedLevel& cooked : header.levels) {
+			level l;
+			l.width = cooked.width;
+			l.height = cooked.height;
+			l.file_offset = cooked.offset;
+			l.file_size = cooked.size;
+			l.buffer_size = added.expand ? (size_t)cooked.width * cooked.height * 4 : cooked.size;
+			added.levels.push_back(l);
+		}
+
+		++loader_stats.cooked;
+		if (added.expand)
+			++loader_stats.expanded;
+		return true;
+	}
+
+	/**
+	 * Look for a cache file written from this very image with the same usage. Sets
+	 * the job's cache path and key either way, so a miss can write one.
+	 */
+	bool TextureLoader::prepare_cached(job& added, const char* path, Usage usage, bool srgb) {
+		struct stat info;
+		if (stat(path, &info) != 0)
+			return false;
+		added.cache_path = cache_file(settings.cache_directory, path);
+		added.key.path_hash = hash_path(path);
+		added.key.modified = (long long)info.st_mtime;
+		added.key.size = (unsigned long long)info.st_size;
+		added.key.usage = (unsigned int)usage;
+		added.key.srgb = srgb ? 1 : 0;
+
+		std::ifstream file(added.cache_path, std::ios::binary);
+		cache_header header;
+		if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, cache_magic, 8) != 0 || header.version != CACHE_VERSION
+			|| header.path_hash != added.key.path_hash || header.modified != added.key.modified || header.size != added.key.size
+			|| header.usage != added.key.usage || header.srgb != added.key.srgb || header.level_count == 0 || header.level_count > 32)
+			return false;
+
+		std::vector<cache_level> table(header.level_count);
+		if (!file.read((char*)table.data(), table.size() * sizeof(cache_level)))
+			return false;
+
+		for (const cache_level& entry : table) {
+			if (entry.size != (uint64_t)entry.width * entry.height * header.components)
+				return false;
+		}
+
+		added.path = added.cache_path;
+		added.cached = true;
+		added.format.internal_format = header.internal_format;
+		added.format.format = header.format;
+		added.format.components = (int)header.components;
+		added.format.grey = header.components < 3;
+		for (const cache_level& entry : table) {
+			level l;
+			l.width = (int)entry.width;
+			l.height = (int)entry.height;
+			l.file_offset = (size_t)entry.offset;
+			l.file_size = (size_t)entry.size;
+			l.buffer_size = (size_t)entry.size;
+			added.levels.push_back(l);
+		}
+		++loader_stats.cache_hits;
+		return true;
+	}
+
+	bool TextureLoader::write_cache(job& target, const std::vector<std::vector<unsigned char>>& images) {
+		cache_header header = {};
+		std::memcpy(header.magic, cache_magic, 8);
+		header.version = CACHE_VERSION;
+		header.internal_format = target.format.internal_format;
+		header.format = target.format.format;
+		header.components = (uint32_t)target.format.components;
+		header.path_hash = target.key.path_hash;
+		header.modified = target.key.modified;
+		header.size = target.key.size;
+		header.usage = target.key.usage;
+		header.srgb = target.key.srgb;
+		header.level_count = (uint32_t)target.levels.size();
+
+		std::vector<cache_level> table(target.levels.size());
+		size_t offset = (cache_header_size + cache_level_entry * table.size() + 15) & ~(size_t)15;
+		for (size_t i = 0; i < table.size(); ++i) {
+			table[i].width = (uint32_t)target.levels[i].width;
+			table[i].height = (uint32_t)target.levels[i].height;
+			table[i].offset = offset;
+			table[i].size = images[i].size();
+			offset = (offset + images[i].size() + 15) & ~(size_t)15;
+		}
+
+		/**
+		 * Written under a name of its own and renamed, so a reader never sees half a
+		 * file, even if two jobs cache the same image at once.
+		 */
+		std::string temporary = target.cache_path + "." + std::to_string((uintptr_t)&target) + ".tmp";
+		{
+			std::ofstream file(temporary, std::ios::binary);
+			file.write((const char*)&header, sizeof(header));
+			file.write((const char*)table.data(), table.size() * sizeof(cache_level));
+			const char padding[16] = {};
+			size_t written = cache_header_size + cache_level_entry * table.size();
+			for (size_t i = 0; i < table.size(); ++i) {
+				file.write(padding, table[i].offset - written);
+				file.write((const char*)images[i].data(), images[i].size());
+				written = table[i].offset + images[i].size();
+			}
+			if (!file) {
+				file.close();
+				std::remove(temporary.c_str());
+				std::cerr << "ERROR::TEXTURE::CACHE::WRITING_FAILED" << std::endl;
+				return false;
+			}
+		}
+		std::remove(target.cache_path.c_str());			// rename() does not replace files on Windows
+		if (std::rename(temporary.c_str(), target.cache_path.c_str()) != 0)
+			return false;
+
+		for (size_t i = 0; i < table.size(); ++i) {
+			target.levels[i].file_offset = (size_t)table[i].offset;	// So dropped levels can be read back
+			target.levels[i].file_size = (size_t)table[i].size;
+		}
+		return true;
+	}
+
+	void TextureLoader::work() {
+		for (;;) {
+			job* next;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				work_queued.wait(lock, [this]() { return stopping || !queue.empty(); });
+				if (stopping)
+					return;
+				next = queue.front();
+				queue.pop_front();
+			}
+
+			/**
+			 * Read a file's mip tail and queue it again behind the other jobs, so every
+			 * texture's tail is read before any texture's larger levels.
+			 */
+			if (next->tail > 0 && next->unread == next->levels.size() && (next->cooked || next->cached)) {
+				double start = now_ms();
+				read_levels(*next, next->tail);
+				next->decode_ms += now_ms() - start;
+				if (!next->failed) {
+					std::lock_guard<std::mutex> lock(mutex);
+					queue.push_back(next);
+					continue;
+				}
+			}
+			else {
+				decode(*next);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				next->ready = next->levels.size();
+				next->done = true;								// The GL thread may delete it from here on
+			}
+			work_decoded.notify_all();
+		}
+	}
+
+	/**
+	 * Decode on a worker thread. stbi_set_flip_vertically_on_load() is global state
+	 * shared by every thread, so the rows are flipped (for OpenGL's bottom-up rows)
+	 * while they are copied into the pixel buffer instead.
+	 */
+	void TextureLoader::decode(job& target) {
+		double start = now_ms();
+		if (target.cooked || target.cached) {
+			read_levels(target, 0);
+			target.decode_ms += now_ms() - start;
+			return;
+		}
+
+		int width, height, channels;
+		int components = target.format.components;
+		unsigned char* img_data = stbi_load(target.path.c_str(), &width, &height, &channels, components);
+		if (img_data == nullptr || width != target.levels[0].width || height != target.levels[0].height) {
+			target.failed = true;
+		}
+		else if (!target.write_cache) {
+			copy_flipped(img_data, target.levels[0].pixels, width, height, components);
+		}
+		else {
+			/**
+			 * Build the mip chain here rather than with glGenerateMipmap, and keep it
+			 * for next time. The pixel buffer is write-only, so the chain is built in
+			 * memory and copied in.
+			 */
+			std::vector<std::vector<unsigned char>> images(1, std::vector<unsigned char>(target.levels[0].buffer_size));
+			copy_flipped(img_data, images[0].data(), width, height, components);
+			for (size_t i = 1; i < target.levels.size(); ++i)
+				images.push_back(downsample(images[i - 1], target.levels[i - 1].width, target.levels[i - 1].height, components));
+			for (size_t i = 0; i < target.levels.size(); ++i)
+				std::memcpy(target.levels[i].pixels, images[i].data(), images[i].size());
+			target.cache_written = write_cache(target, images);
+		}
+		stbi_image_free(img_data);
+		target.decode_ms = now_ms() - start;
+	}
+
+	/**
+	 * Cooked and cached levels are already bottom-up, so they are copied straight
+	 * from the mapped file into their pixel buffers, or decoded block by block into
+	 * them when cooked blocks are to be expanded. Reads the levels from first to
+	 * those already read, smallest first, and hands each to the GL thread as soon as
+	 * it is written.
+	 */
+	void TextureLoader::read_levels(job& target, size_t first) {
+		mapped_file file(target.path);
+		if (file.data() == nullptr) {
+			target.failed = true;
+			return;
+		}
+
+		for (size_t i = target.unread; i-- > first; ) {
+			const level& l = target.levels[i];
+			if (l.file_offset + l.file_size > file.size()) {
+				target.failed = true;
+				return;
+			}
+			const unsigned char* source = file.data() + l.file_offset;
+			if (!target.expand) {
+				std::memcpy(l.pixels, source, l.file_size);
+			}
+			else {
+				int blocks_wide = (l.width + 3) / 4, bytes = cooker::block_bytes(target.block_format);
+				unsigned char rgba[16 * 4];
+				for (int by = 0; by < (l.height + 3) / 4; ++by) {
+					for (int bx = 0; bx < blocks_wide; ++bx) {
+						cooker::decode_block(target.block_format, source + ((size_t)by * blocks_wide + bx) * bytes, rgba);
+						for (int y = by * 4; y < std::min(by * 4 + 4, l.height); ++y) {
+							int columns = std::min(4, l.width - bx * 4);
+							std::memcpy(l.pixels + ((size_t)y * l.width + bx * 4) * 4, rgba + (y - by * 4) * 16, columns * 4);
+						}
+					}
+				}
+			}
+			target.unread = i;
+			mark_ready(target, target.levels.size() - i);
+		}
+	}
+
+	void TextureLoader::mark_ready(job& target, size_t ready) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			target.ready = ready;
+		}
+		work_decoded.notify_all();
+	}
+
+	size_t TextureLoader::next_level(const job& target) const {
+		return target.resident == target.levels.size() ? target.tail : target.resident - 1;
+	}
+
+	static void unmap(unsigned int pixel_buffer) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	/**
+	 * Hand the next part of an image to the driver: its mip tail (or whole image) if
+	 * none of it is resident yet, else as many rows of the next larger level as the
+	 * budget allows. Copies out of a pixel buffer are queued like draws, so the GL
+	 * thread does not wait for them, and deleting a buffer straight after is safe:
+	 * the driver keeps it until the copy is done. Returns the bytes uploaded.
+	 */
+	size_t TextureLoader::upload_step(job& target, size_t budget) {
+		bool compressed = target.cooked && !target.expand;
+		size_t level_count = target.levels.size(), uploaded = 0;
+		GLint alignment;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);					// One- and two-channel rows are not padded to 4 bytes
+		glBindTexture(GL_TEXTURE_2D, target.texture);
+
+		if (target.resident == level_count) {
+			/**
+			 * Allocate the levels above the tail without data, replacing the placeholder,
+			 * so later steps only fill them in.
+			 */
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			for (size_t i = 0; i < target.tail; ++i) {
+				const level& l = target.levels[i];
+				if (compressed)
+					glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, target.format.internal_format, l.width, l.height, 0, (GLsizei)l.buffer_size, NULL);
+				else
+					glTexImage2D(GL_TEXTURE_2D, (GLint)i, target.format.internal_format, l.width, l.height, 0, target.format.format, GL_UNSIGNED_BYTE, NULL);
+			}
+			for (size_t i = target.tail; i < level_count; ++i) {
+				level& l = target.levels[i];
+				unmap(l.pixel_buffer);
+				if (compressed)
+					glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, target.format.internal_format, l.width, l.height, 0, (GLsizei)l.buffer_size, (void*)0);
+				else
+					glTexImage2D(GL_TEXTURE_2D, (GLint)i, target.format.internal_format, l.width, l.height, 0, target.format.format, GL_UNSIGNED_BYTE, (void*)0);
+				glDeleteBuffers(1, &l.pixel_buffer);
+				uploaded += l.buffer_size;
+			}
+			if (target.format.grey) {
+				GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, target.format.components == 2 ? GL_GREEN : GL_ONE };
+				glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+			}
+			entry& loaded = registry[target.texture];
+			if (target.cooked || target.cached || target.write_cache) {
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)target.tail);	// Sample only what is here
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)level_count - 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter(target.tail, level_count));
+				for (const level& l : target.levels)
+					loaded.level_bytes.push_back(l.buffer_size);
+			}
+			else {
+				glGenerateMipmap(GL_TEXTURE_2D);
+				for (int width = target.levels[0].width, height = target.levels[0].height; ; width = std::max(width / 2, 1), height = std::max(height / 2, 1)) {
+					loaded.level_bytes.push_back((size_t)width * height * target.format.components);
+					if (width == 1 && height == 1)
+						break;
+				}
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter(0, loaded.level_bytes.size()));
+			}
+			for (size_t bytes : loaded.level_bytes)
+				resident += bytes;
+			target.resident = target.tail;
+		}
+		else {
+			/**
+			 * A band of whole rows, or of whole block rows when compressed, which is all
+			 * glCompressedTexSubImage2D accepts.
+			 */
+			size_t index = target.resident - 1;
+			level& l = target.levels[index];
+			if (target.rows_uploaded == 0)
+				unmap(l.pixel_buffer);
+			else
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, l.pixel_buffer);
+
+			int unit_rows = compressed ? 4 : 1;
+			int units = (l.height + unit_rows - 1) / unit_rows;
+			size_t unit_bytes = l.buffer_size / units;
+			int first = target.rows_uploaded / unit_rows;
+			int count = budget == 0 ? units - first : std::min(units - first, (int)std::max<size_t>(1, budget / unit_bytes));
+			int y = first * unit_rows, height = std::min(count * unit_rows, l.height - y);
+			if (compressed)
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)index, 0, y, l.width, height, target.format.internal_format, (GLsizei)(count * unit_bytes), (void*)(first * unit_bytes));
+			else
+				glTexSubImage2D(GL_TEXTURE_2D, (GLint)index, 0, y, l.width, height, target.format.format, GL_UNSIGNED_BYTE, (void*)(first * unit_bytes));
+			uploaded = count * unit_bytes;
+
+			target.rows_uploaded = y + height;
+			if (target.rows_uploaded == l.height) {
+				glDeleteBuffers(1, &l.pixel_buffer);
+				target.resident = index;
+				target.rows_uploaded = 0;
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)index);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter(index, level_count));
+			}
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+		return uploaded;
+	}
+
+	/**
+	 * Retire a job the worker is done with, once it is resident or has failed. A
+	 * failed image keeps its placeholder, or whatever levels it had uploaded.
+	 */
+	void TextureLoader::complete(job& target) {
+		for (size_t i = 0; i < target.resident; ++i) {
+			bool started = i + 1 == target.resident && target.rows_uploaded > 0;
+			if (!started)
+				unmap(target.levels[i].pixel_buffer);			// Still mapped
+			glDeleteBuffers(1, &target.levels[i].pixel_buffer);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (!target.failed && target.restream) {
+			++loader_stats.restreamed;
+		}
+		else if (!target.failed) {
+			++loader_stats.uploaded;
+			if (target.cache_written)
+				++loader_stats.cache_writes;
+			loader_stats.texture_bytes += target.levels[0].buffer_size;
+
+			/**
+			 * Keep where the levels came from, to read them again after giving them up.
+			 */
+			entry& loaded = registry[target.texture];
+			loaded.reloadable = target.cooked || target.cached || target.cache_written;
+			loaded.source = target;
+			if (target.cache_written) {
+				loaded.source.path = target.cache_path;
+				loaded.source.cached = true;
+				loaded.source.write_cache = false;
+			}
+			for (level& l : loaded.source.levels) {
+				l.pixel_buffer = 0;
+				l.pixels = nullptr;
+			}
+		}
+		else {
+			std::cerr << "ERROR::TEXTURE::DATA::LOADING_FAILED" << std::endl;
+		}
+		loader_stats.decode_ms += target.decode_ms;
+		loader_stats.slowest_decode_ms = std::max(loader_stats.slowest_decode_ms, target.decode_ms);
+	}
+
+	int TextureLoader::upload_ready(size_t budget, bool& completed) {
+		struct progress {
+			job* target;
+			size_t ready;
+			bool done;
+		};
+		std::vector<progress> snapshot;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (job& j : jobs)
+				snapshot.push_back({ &j, j.ready, j.done });
+		}
+
+		double start = now_ms();
+		size_t spent = 0;
+		std::vector<job*> changed;
+		for (;;) {
+			/**
+			 * Mip tails and whole images go first, in the order they were loaded, then
+			 * the next level of the most important texture.
+			 */
+			job* best = nullptr;
+			for (const progress& p : snapshot) {
+				job& j = *p.target;
+				if (j.resident == 0 || (p.done && j.failed) || p.ready < j.levels.size() - next_level(j))
+					continue;
+				bool tail = j.resident == j.levels.size();
+				bool best_tail = best != nullptr && best->resident == best->levels.size();
+				if (best == nullptr || (tail && !best_tail) || (!tail && !best_tail && j.priority > best->priority))
+					best = &j;
+			}
+			if (best == nullptr || (budget > 0 && spent >= budget))
+				break;
+
+			size_t resident = best->resident;
+			spent += upload_step(*best, budget > 0 ? budget - spent : 0);
+			if (best->resident != resident && std::find(changed.begin(), changed.end(), best) == changed.end())
+				changed.push_back(best);
+		}
+
+		completed = false;
+		for (const progress& p : snapshot) {
+			if (finished(*p.target, p.done)) {
+				complete(*p.target);
+				jobs.remove_if([&p](const job& j) { return &j == p.target; });
+				completed = true;
+			}
+		}
+		if (spent > 0 || completed)
+			loader_stats.upload_ms += now_ms() - start;
+		return (int)changed.size();
+	}
+
+	void TextureLoader::prioritize(unsigned int texture, float priority) {
+		auto found = registry.find(texture);
+		if (found != registry.end()) {
+			entry& loaded = found->second;
+			loaded.last_used = frame;
+
+			size_t missing = 0;
+			for (size_t i = 0; i < loaded.dropped; ++i)
+				missing += loaded.level_bytes[i];
+			if (missing > 0 && (settings.memory_budget == 0 || resident + missing <= settings.memory_budget) && !loading(texture))
+				restream(texture, loaded);
+		}
+
+		for (job& j : jobs) {
+			if (j.texture == texture)
+				j.priority = std::max(j.priority, priority);
+		}
+	}
+
+	void TextureLoader::release(unsigned int texture) {
+		auto found = registry.find(texture);
+		if (found != registry.end() && found->second.references > 0)
+			--found->second.references;
+	}
+
+	bool TextureLoader::loading(unsigned int texture) const {
+		for (const job& j : jobs) {
+			if (j.texture == texture)
+				return true;
+		}
+		return false;
+	}
+
+	/**
+	 * The source is the job that completed the texture, so everything the worker and
+	 * uploads changed is reset, done above all: a job left done would be completed
+	 * and deleted while a worker still reads into it.
+	 */
+	TextureLoader::job TextureLoader::restream_job(const job& source, size_t dropped) {
+		job again = source;
+		again.restream = true;
+		again.failed = false;
+		again.decode_ms = 0.0;
+		again.tail = dropped;
+		again.unread = dropped;
+		again.ready = again.levels.size() - dropped;
+		again.done = false;
+		again.resident = dropped;
+		again.rows_uploaded = 0;
+		again.priority = 0.f;
+		return again;
+	}
+
+	/**
+	 * Allocate the levels an idle texture gave up again and queue them to be read
+	 * from its file, largest last, like the rest of a streamed chain.
+	 */
+	void TextureLoader::restream(unsigned int texture, entry& loaded) {
+		job again = restream_job(loaded.source, loaded.dropped);
+		again.texture = texture;
+		if (!map_buffers(again, loaded.dropped))
+			return;
+
+		bool compressed = again.cooked && !again.expand;
+		glBindTexture(GL_TEXTURE_2D, texture);
+		for (size_t i = 0; i < loaded.dropped; ++i) {
+			const level& l = again.levels[i];
+			if (compressed)
+				glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, again.format.internal_format, l.width, l.height, 0, (GLsizei)l.buffer_size, NULL);
+			else
+				glTexImage2D(GL_TEXTURE_2D, (GLint)i, again.format.internal_format, l.width, l.height, 0, again.format.format, GL_UNSIGNED_BYTE, NULL);
+			resident += loaded.level_bytes[i];
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		loaded.dropped = 0;
+
+		jobs.push_back(again);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(&jobs.back());
+		}
+		work_queued.notify_one();
+	}
+
+	/**
+	 * Delete textures nobody references, least recently used first, then have the
+	 * least recently used idle textures give up their largest level, until texture
+	 * memory is within the budget. Textures still loading are left alone.
+	 */
+	void TextureLoader::enforce_budget() {
+		size_t budget = settings.memory_budget;
+		for (;;) {
+			unsigned int unused = 0, idle = 0;
+			for (const auto& loaded : registry) {
+				const entry& e = loaded.second;
+				if (loading(loaded.first))
+					continue;
+				if (e.references == 0 && (unused == 0 || e.last_used < registry[unused].last_used))
+					unused = loaded.first;
+				else if (e.references > 0 && e.reloadable && e.dropped < e.floor && frame - e.last_used >= settings.idle_frames
+					&& (idle == 0 || e.last_used < registry[idle].last_used))
+					idle = loaded.first;
+			}
+
+			if (unused != 0 && (budget == 0 || resident > budget)) {
+				entry& e = registry[unused];
+				for (size_t i = e.dropped; i < e.level_bytes.size(); ++i)
+					resident -= e.level_bytes[i];
+				glDeleteTextures(1, &unused);
+				keys.erase(e.key);
+				registry.erase(unused);
+				++loader_stats.evicted;
+			}
+			else if (idle != 0 && budget > 0 && resident > budget) {
+				entry& e = registry[idle];
+				bool compressed = e.source.cooked && !e.source.expand;
+				glBindTexture(GL_TEXTURE_2D, idle);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)e.dropped + 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter(e.dropped + 1, e.level_bytes.size()));
+				if (compressed)
+					glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)e.dropped, e.source.format.internal_format, 0, 0, 0, 0, NULL);	// Frees the level
+				else
+					glTexImage2D(GL_TEXTURE_2D, (GLint)e.dropped, e.source.format.internal_format, 0, 0, 0, e.source.format.format, GL_UNSIGNED_BYTE, NULL);
+				glBindTexture(GL_TEXTURE_2D, 0);
+				resident -= e.level_bytes[e.dropped];
+				++e.dropped;
+				++loader_stats.dropped_levels;
+			}
+			else {
+				return;
+			}
+		}
+	}
+
+	int TextureLoader::update() {
+		++frame;
+		bool completed;
+		int changed = upload_ready(settings.upload_budget, completed);
+		for (job& j : jobs)
+			j.priority = 0.f;
+		enforce_budget();
+		return changed;
+	}
+
+	void TextureLoader::forget() {
+		registry.clear();
+		keys.clear();
+		resident = 0;
+	}
+
+	void TextureLoader::finish() {
+		while (!jobs.empty()) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				work_decoded.wait(lock, [this]() {
+					for (const job& j : jobs) {
+						if (j.done || (j.resident > 0 && j.ready >= j.levels.size() - next_level(j)))
+							return true;
+					}
+					return false;
+				});
+			}
+			bool completed;
+			upload_ready(0, completed);
+		}
+	}
+
+	unsigned int TextureLoader::placeholders() const {
+		unsigned int count = 0;
+		for (const job& j : jobs) {
+			if (j.resident == j.levels.size())
+				++count;
+		}
+		return count;
+	}
+
+	std::string normalize_path(const std::string& path) {
+		std::string normalized;
+		for (char c : path) {
+			if (c == '\\')
+				c = '/';
+			if (c == '/' && !normalized.empty() && normalized.back() == '/')
+				continue;
+			normalized += c;
+			if (c == '/' && (normalized == "./" || (normalized.size() >= 3 && normalized.compare(normalized.size() - 3, 3, "/./") == 0)))
+				normalized.erase(normalized.size() - 2);
+		}
+		return normalized;
+	}
+
+	size_t mip_tail(int width, int height, size_t level_count, int tail_size) {
+		size_t tail = 0;
+		while (tail + 1 < level_count && std::max(width, height) > tail_size) {
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+			++tail;
+		}
+		return tail;
+	}
+
+	unsigned int min_filter(size_t base_level, size_t level_count) {
+		return base_level + 1 < level_count ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+	}
+
+	TextureLoader& loader() {
+		static TextureLoader shared;
+		return shared;
+	}
+}
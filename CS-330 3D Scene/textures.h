@@ -0,0 +1,317 @@
+/**
+ * "textures.h" - Asynchronous texture loading. load() reads only the image's header,
+ *		creates the texture with a one-texel grey placeholder and returns it at once,
+ *		so Models can be drawn with it right away. A pool of worker threads decodes the
+ *		image straight into a mapped pixel buffer object, and update() on the GL thread
+ *		unmaps it and has the driver copy it into the texture, so the GL thread never
+ *		waits on a decode and cold start takes about as long as the slowest image
+ *		rather than all of them in turn. Images cooked with "--cook" (see cooker.h) are
+ *		read instead of decoded, block compressed and with their mip chains; other
+ *		images are decoded once, mipmapped on the worker and kept in a cache file, so
+ *		later launches only memory-map and copy. Textures with a mip chain are read
+ *		smallest level first and shown from their mip tail within a frame or two; the
+ *		larger levels then stream in a few megabytes a frame, textures covering the
+ *		most of the screen first. Loading a path again shares its texture, and within a
+ *		memory budget textures no longer referenced are deleted, least recently used
+ *		first, and idle ones give up their largest levels until they are used again.
+ *		Function implementations defined in "textures.cpp".
+ */
+#pragma once
+#ifndef __TEXTURES_H__
+#define __TEXTURES_H__
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace cooker {
+	enum class BlockFormat;						// See cooker.h
+}
+
+namespace textures {
+	/**
+	 * What a texture is sampled for, which with its channel count picks its format.
+	 */
+	enum class Usage {
+		ALBEDO,									// Color, with alpha only if the image has it
+		MASK,									// One scalar per texel, e.g. a specular map; read from .r (or any of .rgb)
+	};
+
+	/**
+	 * How an image is decoded and stored. Every format is uploaded in the layout stb
+	 * decodes to, so the driver copies it without converting. Three-channel images
+	 * are stored as RGBA8, since drivers pad RGB8 to four bytes anyway and their
+	 * RGB upload path converts every texel on the CPU. One- and two-channel formats
+	 * are swizzled so .rgb reads the grey value and .a the alpha.
+	 */
+	struct Format {
+		int components = 4;						// Forced on stb_image
+		unsigned int internal_format = 0;
+		unsigned int format = 0;				// Of the decoded data
+		bool grey = false;						// Swizzle R to RGB
+	};
+
+	Format choose_format(int channels, Usage usage, bool srgb);
+
+	struct LoaderSettings {
+		unsigned int thread_count = 0;			// 0 for hardware concurrency
+		/**
+		 * Bytes update() copies into textures per call; 0 for no limit. Levels larger
+		 * than this are uploaded a band of rows at a time, so no frame waits on a whole
+		 * level. Images without a mip chain are uploaded whole, one per update().
+		 */
+		size_t upload_budget = 4 * 1024 * 1024;
+
+		/**
+		 * Upload the levels of textures with a mip chain smallest first: the mip tail,
+		 * every level no larger than tail_size on either side, as soon as it is read,
+		 * then each larger level as it arrives, raising the texture's base level as
+		 * they land. Off, a texture's levels are uploaded together once all are read.
+		 */
+		bool progressive = true;
+		int tail_size = 128;
+
+		/**
+		 * Texture memory to stay within, in bytes; 0 for none. Over it, textures with
+		 * no references left are deleted, least recently used first, then textures not
+		 * used for idle_frames give up their largest level, one at a time, down to the
+		 * mip tail. Without a budget, textures are deleted once unreferenced.
+		 */
+		size_t memory_budget = 0;
+		unsigned int idle_frames = 300;
+
+		/**
+		 * Store color images as sRGB, so they are linearized when sampled. Off, as the
+		 * shaders light in gamma space and write to a linear framebuffer.
+		 */
+		bool srgb_albedo = false;
+
+		bool use_cooked = true;					// Read the ".ktx2" "--cook" left next to an image instead, when there is one
+		bool s3tc = true;						// Upload cooked BC1 and BC3 as they are when the driver supports S3TC, else as RGBA8
+
+		/**
+		 * Keep each decoded image and its mip chain in a ".texcache" file, so later
+		 * loads of the same, unchanged image read it instead of decoding it. The file
+		 * is rewritten whenever the image's path, size or modification time, or its
+		 * usage or sRGB setting, differ from those it was written for.
+		 */
+		bool use_cache = true;
+		std::string cache_directory;			// With a trailing slash; empty to keep each cache file next to its image
+	};
+
+	struct LoaderStats {
+		unsigned int requested = 0;
+		unsigned int uploaded = 0;
+		unsigned int cooked = 0;				// Read from cooked files
+		unsigned int expanded = 0;				// Of those, decoded to RGBA8 for want of S3TC
+		unsigned int cache_hits = 0;			// Read from cache files
+		unsigned int cache_writes = 0;
+		double decode_ms = 0.0;					// Summed over every worker, with cooked and cache files' reads and mip chains built
+		double slowest_decode_ms = 0.0;
+		double load_ms = 0.0;					// GL thread time in load(): header reads and buffer mapping
+		double upload_ms = 0.0;					// GL thread time in update(): copies into textures and mipmaps
+		size_t texture_bytes = 0;				// Level 0 of every uploaded texture
+		unsigned int shared = 0;				// Loads that returned an already loaded texture
+		unsigned int evicted = 0;				// Textures deleted
+		unsigned int dropped_levels = 0;		// Levels given up by idle textures
+		unsigned int restreamed = 0;			// Textures whose dropped levels were read again
+	};
+
+	class TextureLoader {
+	public:
+		TextureLoader(const LoaderSettings& loader_settings = LoaderSettings());	// Start the workers; no GL context needed
+		~TextureLoader();						// Stop the workers. Images not yet uploaded keep their placeholder
+
+		bool asynchronous = false;				// When false, load() waits for its image like stbi_load would
+
+		/**
+		 * Create a GL_REPEAT, linearly filtered texture for the image at path and queue
+		 * it for decoding. Requires a GL context. The texture holds a grey placeholder
+		 * until update() uploads the image, or for good if the image cannot be read.
+		 * Loading a path already loaded with the same usage returns the same texture
+		 * and adds a reference to it.
+		 */
+		unsigned int load(const char* path, Usage usage = Usage::ALBEDO);
+		void release(unsigned int texture);		// Drop a reference load() added; update() deletes the texture when it is due
+
+		/**
+		 * Mark a texture used this frame, and ask for its missing levels to be streamed
+		 * ahead of others, e.g. with its share of the screen; textures not prioritized
+		 * count as 0. A texture that gave up levels reads them again. Call on the GL
+		 * thread before update(), which forgets every priority.
+		 */
+		void prioritize(unsigned int texture, float priority);
+
+		/**
+		 * Upload what the workers have read or decoded, within settings.upload_budget:
+		 * mip tails first, then the textures prioritized highest. Call once a frame on
+		 * the GL thread. Returns how many textures changed how they sample.
+		 */
+		int update();
+		void finish();							// Wait for and upload every queued image
+		unsigned int pending() const { return (unsigned int)jobs.size(); }	// Textures not yet complete
+		unsigned int placeholders() const;		// Of those, textures still showing the grey placeholder
+		unsigned int loaded() const { return (unsigned int)registry.size(); }	// Textures not deleted
+		size_t resident_bytes() const { return resident; }	// Texture memory allocated for every level of every texture
+		const LoaderStats& stats() const { return loader_stats; }
+
+		/**
+		 * Forget every texture without deleting it, once the context that owned them is
+		 * gone, so load() creates them again in the next one. Requires no pending loads.
+		 */
+		void forget();
+
+		LoaderSettings settings;
+
+		/**
+		 * A texture's loading state, shared by the GL thread and a worker. Public only
+		 * so its transitions can be tested without a GL context.
+		 */
+		struct level {
+			int width = 0;
+			int height = 0;
+			size_t file_offset = 0;
+			size_t file_size = 0;
+			unsigned int pixel_buffer = 0;		// GL_PIXEL_UNPACK_BUFFER the worker writes the level into
+			unsigned char* pixels = nullptr;	// Its mapping, written only by the worker
+			size_t buffer_size = 0;
+		};
+
+		/**
+		 * What a cache file was written from; it is only read while all of it matches.
+		 */
+		struct cache_key {
+			unsigned long long path_hash = 0;
+			long long modified = 0;
+			unsigned long long size = 0;
+			unsigned int usage = 0;
+			unsigned int srgb = 0;
+		};
+
+		struct job {
+			std::string path;
+			unsigned int texture = 0;
+			Format format;
+			bool cooked = false;				// Levels read from a cooked file, rather than one level decoded and mipmapped
+			cooker::BlockFormat block_format{};
+			bool expand = false;				// Cooked blocks decoded to RGBA8 on the worker
+			bool cached = false;				// Levels read from a cache file
+			bool write_cache = false;			// Decoded image whose mip chain the worker builds and caches
+			std::string cache_path;
+			cache_key key;
+			bool cache_written = false;
+			std::vector<level> levels;			// Level 0 first; only level 0 when glGenerateMipmap builds the rest
+			size_t tail = 0;					// First level uploaded with the smallest, as one step
+			bool failed = false;
+			double decode_ms = 0.0;
+
+			size_t unread = 0;					// Levels below this the worker has yet to read; worker only
+			size_t ready = 0;					// Levels the worker has finished, counted from the smallest; under mutex
+			bool done = false;					// The worker is finished with the job; under mutex
+
+			size_t resident = 0;				// Lowest level uploaded, levels.size() for none; GL thread only
+			int rows_uploaded = 0;				// Of level resident - 1, while it is uploaded in bands
+			float priority = 0.f;
+			bool restream = false;				// Reading levels an idle texture gave up
+		};
+
+		/**
+		 * A job that reads levels [0, dropped) of a completed job's level table again,
+		 * with the rest counted as resident and ready. It is not done until a worker
+		 * has read those levels.
+		 */
+		static job restream_job(const job& source, size_t dropped);
+
+		/**
+		 * Whether the GL thread may complete and delete target: the worker is done with
+		 * it (done, as read under the mutex) and every level is uploaded or it failed.
+		 */
+		static bool finished(const job& target, bool done) { return done && (target.resident == 0 || target.failed); }
+
+	private:
+		/**
+		 * A loaded texture. Textures read from a cooked or cache file keep its level
+		 * table, so levels given up while idle can be read again.
+		 */
+		struct entry {
+			std::string key;
+			unsigned int references = 0;
+			unsigned long long last_used = 0;	// Frame
+			std::vector<size_t> level_bytes;	// Allocated per level, once the first upload has allocated them
+			size_t dropped = 0;					// Largest levels given up
+			size_t floor = 0;					// Levels that may be given up: those above the mip tail
+			bool reloadable = false;
+			job source;							// File, format and level table, without buffers
+		};
+
+		std::list<job> jobs;					// Queued, read or partly uploaded; owned by the GL thread
+		std::deque<job*> queue;					// Waiting for a worker
+		std::mutex mutex;
+		std::condition_variable work_queued;
+		std::condition_variable work_decoded;	// A job's ready or done changed
+		std::vector<std::thread> workers;
+		bool stopping = false;
+		int s3tc_supported = -1;				// Checked on the first cooked load
+		LoaderStats loader_stats;
+
+		std::unordered_map<unsigned int, entry> registry;	// By texture
+		std::unordered_map<std::string, unsigned int> keys;	// Normalized path and usage to texture
+		unsigned long long frame = 0;
+		size_t resident = 0;
+
+		void work();
+		bool map_buffers(job& target, size_t count);
+		bool prepare_cooked(job& added, const char* path);
+		bool prepare_cached(job& added, const char* path, Usage usage, bool srgb);
+		void decode(job& target);
+		void read_levels(job& target, size_t first);
+		bool write_cache(job& target, const std::vector<std::vector<unsigned char>>& images);
+		void mark_ready(job& target, size_t ready);
+		size_t next_level(const job& target) const;
+		size_t upload_step(job& target, size_t budget);
+		void complete(job& target);
+		int upload_ready(size_t budget, bool& completed);
+		bool loading(unsigned int texture) const;
+		void restream(unsigned int texture, entry& loaded);
+		void enforce_budget();
+	};
+
+	/**
+	 * Copy an image with its rows in reverse order, turning stb_image's top-down rows
+	 * into OpenGL's bottom-up ones.
+	 */
+	void copy_flipped(const unsigned char* source, unsigned char* destination, int width, int height, int channels);
+
+	/**
+	 * Halve an image with a box filter, like glGenerateMipmap, repeating the last row
+	 * or column of odd sizes.
+	 */
+	std::vector<unsigned char> downsample(const std::vector<unsigned char>& image, int width, int height, int components);
+
+	/**
+	 * The first level of a mip chain's tail: the levels from there down are no larger
+	 * than tail_size on either side, and there is always at least the last one.
+	 */
+	size_t mip_tail(int width, int height, size_t level_count, int tail_size);
+
+	/**
+	 * The minification filter for a texture sampled from base_level to the last of
+	 * level_count levels: trilinear when there is a smaller level to blend with,
+	 * else bilinear.
+	 */
+	unsigned int min_filter(size_t base_level, size_t level_count);
+
+	/**
+	 * The key a path is shared under: separators made forward slashes, "./" and
+	 * repeated slashes dropped, so different spellings of one file share a texture.
+	 */
+	std::string normalize_path(const std::string& path);
+
+	TextureLoader& loader();					// The loader load_wrap_texture() uses
+}
+#endif//__TEXTURES_H__
@@ -2,6 +2,14 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
-unsigned int load_wrap_texture(const char* texture_path);
+#include "textures.h"
+
+/**
+ * Load a GL_REPEAT texture through textures::loader() (see textures.h), in a format
+ * chosen for its usage and channel count. With the loader asynchronous the texture
+ * shows a placeholder until the loader's update() uploads it. Models loading the same
+ * image share one texture.
+ */
+unsigned int load_wrap_texture(const char* texture_path, textures::Usage usage = textures::Usage::ALBEDO);
 
 #endif//__UTILS_H__
\ No newline at end of file
@@ -0,0 +1,261 @@
+/**
+ * "visibility.cpp" - Implementations for the visibility buffer shading path. Function
+ *		prototypes defined in "visibility.h".
+ */
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "visibility.h"
+#include "deferred.h"
+
+namespace visibility {
+	static void setup_resolve_shader(Shader& shader, unsigned int features) {
+		deferred::setup_lighting_shader(shader, features);
+		shader.setInt("aTexture", 0);
+		shader.setInt("specularMap", 1);
+		shader.setInt("visibilityBuffer", 2);
+		shader.setInt("vertexData", FIRST_TEXTURE_UNIT);
+		shader.setInt("drawData", FIRST_TEXTURE_UNIT + 1);
+		shader.setInt("triangleBits", TRIANGLE_BITS);
+	}
+
+	void VisibilityRenderer::init(int width, int height) {
+		id_shader = new Shader("shaders/depth_prepass.vs.glsl", "shaders/visibility_id.fs.glsl");
+
+		classify_shader = new Shader("shaders/fullscreen.vs.glsl", "shaders/visibility_classify.fs.glsl");
+		classify_shader->use();
+		classify_shader->setInt("visibilityBuffer", 2);
+		classify_shader->setInt("drawData", FIRST_TEXTURE_UNIT + 1);
+		classify_shader->setInt("triangleBits", TRIANGLE_BITS);
+
+		resolve_shaders = new permutations::ShaderCache("shaders/fullscreen.vs.glsl", "shaders/deferred_lighting.fs.glsl", setup_resolve_shader, "shaders/lighting.glsl");
+
+		glGenBuffers(1, &draw_buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, draw_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);				// Resized every frame
+		glGenTextures(1, &draw_texture);
+		glBindTexture(GL_TEXTURE_BUFFER, draw_texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, draw_buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_buffer_texels);
+
+		glGenVertexArrays(1, &empty_VAO);
+		resize(width, height);
+	}
+
+	void VisibilityRenderer::release() {
+		if (framebuffer == 0)
+			return;
+
+		glDeleteFramebuffers(1, &framebuffer);
+		unsigned int textures[2] = { ids, depth };
+		glDeleteTextures(2, textures);
+		framebuffer = 0;
+	}
+
+	void VisibilityRenderer::resize(int width, int height) {
+		release();
+		buffer_width = width;
+		buffer_height = height;
+
+		glGenTextures(1, &ids);
+		glBindTexture(GL_TEXTURE_2D, ids);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);		// Integer textures cannot be filtered
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenTextures(1, &depth);
+		glBindTexture(GL_TEXTURE_2D, depth);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);	// Matches the default framebuffer so depth can be blitted
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ids, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cerr << "ERROR::FRAMEBUFFER::VISIBILITY::INCOMPLETE" << std::endl;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void VisibilityRenderer::begin_geometry() {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, buffer_width, buffer_height);
+		const GLuint empty[4] = { 0xFFFFFFFFu, 0, 0, 0 };
+		glClearBufferuiv(GL_COLOR, 0, empty);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		draw_data.clear();
+		materials.clear();
+		material_indices.clear();
+		last_stats = VisibilityStats();
+	}
+
+	/**
+	 * A texture buffer over the Model's own vertex buffer: with 8 floats per vertex,
+	 * each vertex is exactly two RGBA32F texels, so nothing is copied.
+	 */
+	unsigned int VisibilityRenderer::vertex_texture(const Model& model) {
+		auto found = vertex_textures.find(model.VAO);
+		if (found != vertex_textures.end())
+			return found->second;
+
+		GLint buffer = 0, stride = 0;
+		void* normal_offset = nullptr;
+		void* texcoord_offset = nullptr;
+		glBindVertexArray(model.VAO);
+		glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+		glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+		glGetVertexAttribPointerv(1, GL_VERTEX_ATTRIB_ARRAY_POINTER, &normal_offset);
+		glGetVertexAttribPointerv(2, GL_VERTEX_ATTRIB_ARRAY_POINTER, &texcoord_offset);
+		glBindVertexArray(0);
+
+		unsigned int texture = 0;
+		if (stride != 8 * sizeof(float) || (size_t)normal_offset != 3 * sizeof(float) || (size_t)texcoord_offset != 6 * sizeof(float))
+			std::cerr << "ERROR::VISIBILITY::UNSUPPORTED_VERTEX_LAYOUT" << std::endl;
+		else if ((long long)model.number_of_vertices * 2 > max_buffer_texels)
+			std::cerr << "ERROR::VISIBILITY::VERTEX_BUFFER_TOO_LARGE" << std::endl;
+		else {
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_BUFFER, texture);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+
+		vertex_textures[model.VAO] = texture;				// Also remembers failures, so each is reported once
+		return texture;
+	}
+
+	void VisibilityRenderer::draw(const Model& model, glm::mat4 projection, glm::mat4 view) {
+		unsigned int draw_index = (unsigned int)(draw_data.size() / 6);
+		if (draw_index >= MAX_DRAWS || model.number_of_vertices / 3 >= (1u << TRIANGLE_BITS) || vertex_texture(model) == 0)
+			return;
+
+		unsigned int specular_map = model.material != nullptr ? model.material->specular_map : 0;
+		float shine = model.material != nullptr ? model.material->shine : model.shine;
+		auto key = std::make_tuple(model.VAO, model.texture, specular_map, shine);
+		auto found = material_indices.find(key);
+		unsigned int material_index;
+		if (found != material_indices.end()) {
+			material_index = found->second;
+		}
+		else {
+			if (materials.size() >= MAX_MATERIALS)
+				return;
+			material_index = (unsigned int)materials.size();
+			materials.push_back({ model.VAO, model.texture, specular_map, shine });
+			material_indices[key] = material_index;
+		}
+
+		/**
+		 * Model matrix rows, so the resolve transforms a position with three dot
+		 * products, then the normal matrix's columns.
+		 */
+		glm::mat4 transposed = glm::transpose(model.model);
+		glm::mat3 normal_model = glm::mat3(glm::transpose(glm::inverse(model.model)));
+		draw_data.push_back(transposed[0]);
+		draw_data.push_back(transposed[1]);
+		draw_data.push_back(transposed[2]);
+		draw_data.push_back(glm::vec4(normal_model[0], (float)material_index));
+		draw_data.push_back(glm::vec4(normal_model[1], 0.f));
+		draw_data.push_back(glm::vec4(normal_model[2], 0.f));
+
+		id_shader->use();
+		id_shader->setMat4("projection", projection);
+		id_shader->setMat4("view", view);
+		id_shader->setMat4("model", model.model);
+		glUniform1ui(glGetUniformLocation(id_shader->ID, "drawID"), draw_index << TRIANGLE_BITS);
+
+		glBindVertexArray(model.position_VAO != 0 ? model.position_VAO : model.VAO);
+		glDrawArrays(GL_TRIANGLES, 0, model.number_of_vertices);
+		glBindVertexArray(0);
+
+		++last_stats.draws;
+		last_stats.triangles += model.number_of_vertices / 3;
+	}
+
+	void VisibilityRenderer::resolve(glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos,
+		const clustered::ClusterGrid* grid, const Fog* fog, unsigned int output_framebuffer) {
+		last_stats.materials = (unsigned int)materials.size();
+
+		glBindBuffer(GL_TEXTURE_BUFFER, draw_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, std::max(draw_data.size() * sizeof(glm::vec4), (size_t)16), NULL, GL_STREAM_DRAW);
+		if (!draw_data.empty())
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, draw_data.size() * sizeof(glm::vec4), draw_data.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, ids);
+		glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + 1);
+		glBindTexture(GL_TEXTURE_BUFFER, draw_texture);
+
+		/**
+		 * Like the deferred lighting pass, the resolve covers the whole screen and must
+		 * not be clipped by wireframe mode.
+		 */
+		GLint polygon_mode[2];
+		GLint depth_func = GL_LESS;
+		glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+		glGetIntegerv(GL_DEPTH_FUNC, &depth_func);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glEnable(GL_DEPTH_TEST);
+		glBindVertexArray(empty_VAO);
+
+		/**
+		 * Classify: every pixel's material index becomes its depth in the output.
+		 */
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthFunc(GL_ALWAYS);
+		classify_shader->use();
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		/**
+		 * One pass per material at exactly its depth: the depth test passes only on
+		 * its own pixels, and is decided before the shader runs.
+		 */
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+		unsigned int base_features = deferred::lighting_features(grid, fog) | permutations::VISIBILITY_BUFFER;
+		for (size_t i = 0; i < materials.size(); ++i) {
+			const material& m = materials[i];
+			Shader& shader = resolve_shaders->get(base_features | (m.specular_map != 0 ? (unsigned int)permutations::SPECULAR_MAP : 0u));
+			deferred::set_lighting_uniforms(shader, projection, view, point_light, dir_light, viewPos, grid, fog, buffer_width, buffer_height);
+			shader.setFloat("specularStrength", m.shine);
+			shader.setFloat("materialDepth", (float)(i + 1) / (MAX_MATERIALS + 1));
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, m.texture);
+			if (m.specular_map != 0) {
+				glActiveTexture(GL_TEXTURE1);
+				glBindTexture(GL_TEXTURE_2D, m.specular_map);
+			}
+			glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_BUFFER, vertex_textures[m.VAO]);
+
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+		glDepthMask(GL_TRUE);
+		glDepthFunc(depth_func);
+
+		glBindVertexArray(0);
+		glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+		glActiveTexture(GL_TEXTURE0);
+
+		/**
+		 * Replace the material depths with the ID pass's depth.
+		 */
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output_framebuffer);
+		glBlitFramebuffer(0, 0, buffer_width, buffer_height, 0, 0, buffer_width, buffer_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+	}
+}
@@ -0,0 +1,112 @@
+/**
+ * "visibility.h" - Visibility buffer shading path, selectable at runtime next to forward
+ *		and deferred shading. The geometry pass rasterizes only positions and writes one
+ *		32-bit ID per pixel, (draw << TRIANGLE_BITS) | triangle, so small and distant
+ *		triangles cost neither material shading of the 2x2 quads they only partly
+ *		cover nor G-buffer bandwidth. The resolve then finds each pixel's triangle,
+ *		fetches its three vertices from the Model's own vertex buffer through a texture
+ *		buffer, intersects the camera ray with it for perspective-correct attributes
+ *		and texture gradients, and runs the deferred lighting (see deferred.h) once per
+ *		pixel.
+ *
+ *		OpenGL 3.3 cannot pick a texture per pixel, so the resolve is one full-screen
+ *		pass per material (a Model's mesh, texture and specular). A classification pass
+ *		first writes each pixel's material index as depth, and each material's pass is
+ *		drawn at exactly that depth with GL_EQUAL, so early depth testing skips every
+ *		other pixel before it is shaded. Function implementations defined in
+ *		"visibility.cpp".
+ */
+#pragma once
+#ifndef __VISIBILITY_H__
+#define __VISIBILITY_H__
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "clustered.h"
+#include "lights.h"
+#include "models.h"
+#include "permutations.h"
+
+namespace visibility {
+	const int TRIANGLE_BITS = 18;				// Up to 262143 triangles per Model
+	const unsigned int MAX_DRAWS = (1u << (32 - TRIANGLE_BITS)) - 1;	// The all-ones ID marks pixels nothing was drawn on
+	const unsigned int MAX_MATERIALS = 1023;	// Material depths are (index + 1) / 1024
+	const int FIRST_TEXTURE_UNIT = 12;			// After the reflection probes: vertex data, then draw data
+
+	/**
+	 * Work done by the most recent frame.
+	 */
+	struct VisibilityStats {
+		unsigned int draws = 0;
+		unsigned int triangles = 0;
+		unsigned int materials = 0;				// Resolve passes
+	};
+
+	class VisibilityRenderer {
+	public:
+		void init(int width, int height);		// Create the ID buffer and shaders; requires a GL context
+		void resize(int width, int height);		// Recreate the ID and depth attachments at a new size
+
+		/**
+		 * Bind and clear the ID buffer and forget the last frame's draws. Draw Models
+		 * with draw() until resolve() is called.
+		 */
+		void begin_geometry();
+
+		/**
+		 * Write a Model's triangle IDs. Its vertex buffer must be the interleaved
+		 * position, normal, texture coordinate layout every Model in models.cpp uses.
+		 */
+		void draw(const Model& model, glm::mat4 projection, glm::mat4 view);
+
+		/**
+		 * Shade every pixel drawn since begin_geometry() into output_framebuffer (the
+		 * default framebuffer unless given), then copy the ID pass's depth there so
+		 * forward-rendered objects drawn afterwards are still depth tested. As with
+		 * DeferredRenderer::shade(), the output needs a D24S8 depth buffer at least as
+		 * large as the ID buffer, and grid and fog may be null.
+		 */
+		void resolve(glm::mat4 projection, glm::mat4 view, RadiantLight point_light, DirectionalLight dir_light, glm::vec3 viewPos,
+			const clustered::ClusterGrid* grid, const Fog* fog, unsigned int output_framebuffer = 0);
+
+		int width() const { return buffer_width; }
+		int height() const { return buffer_height; }
+		const VisibilityStats& stats() const { return last_stats; }
+
+	private:
+		struct material {
+			unsigned int VAO;
+			unsigned int texture;
+			unsigned int specular_map;			// 0 for none
+			float shine;
+		};
+
+		unsigned int framebuffer = 0;
+		unsigned int ids = 0;					// R32UI
+		unsigned int depth = 0;					// DEPTH24_STENCIL8
+		unsigned int empty_VAO = 0;
+		int buffer_width = 0;
+		int buffer_height = 0;
+
+		unsigned int draw_buffer = 0;			// 6 RGBA32F texels per draw: model matrix rows, normal matrix columns with the material index in the first w
+		unsigned int draw_texture = 0;
+		std::vector<glm::vec4> draw_data;
+		std::vector<material> materials;
+		std::map<std::tuple<unsigned int, unsigned int, unsigned int, float>, unsigned int> material_indices;
+		std::map<unsigned int, unsigned int> vertex_textures;	// VAO to a texture buffer over its vertex buffer, 2 RGBA32F texels per vertex
+		int max_buffer_texels = 0;
+
+		Shader* id_shader = nullptr;
+		Shader* classify_shader = nullptr;
+		permutations::ShaderCache* resolve_shaders = nullptr;	// deferred_lighting.fs.glsl with VISIBILITY_BUFFER
+		VisibilityStats last_stats;
+
+		unsigned int vertex_texture(const Model& model);	// 0 when the layout is not supported
+		void release();
+	};
+}
+#endif//__VISIBILITY_H__